@@ -0,0 +1,441 @@
+//aggregate.c: streaming statistics over bins of rows (every N rows, or runs of rows in the same interval of a coordinate)
+//Copyright 2012, Allen Jordan, allen.jordan@gmail.com
+
+//each window's rows are loaded as doubles a block at a time and split into runs of rows in the same bin, every column
+//of a run is summed up in one vectorized pass (SummarizeDoubleColumn), plus one more for its squared deviations when the
+//standard deviation is wanted, and the run's statistics are merged into the bin's (Chan et al.'s pairwise update), so
+//a bin can span any number of blocks and windows without keeping its rows
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+#include "aggregate.h"
+#include "colformat.h"
+#include "cftime.h"
+#include "unitconvert.h"
+
+//rows of every column loaded as doubles at a time, small enough to stay in cache while they're summed up
+#define AGGREGATE_BLOCK_ROWS	FORMAT_BLOCK_ROWS
+
+//significant digits the lower edges of coordinate bins are written with, so ex: 3*0.1 reads as 0.3
+#define BIN_EDGE_DIGITS	15
+
+//the statistics that are written for each column, in the order of their bits (the count is the bin's, not a column's)
+static const char *statisticNames[] = { "count", "mean", "min", "max", "stddev" };
+static const char *statisticLongNames[] = { "count", "mean", "minimum", "maximum", "standard deviation" };
+#define NUM_STATISTICS	5
+
+//a column's running statistics over a bin: the number of its values that aren't NaN, their mean, the sum of their
+//squared differences from it, and the smallest and largest of them
+typedef struct
+{
+	uint64_t count;
+	double mean;
+	double m2;
+	double min;
+	double max;
+} BinMoments;
+
+struct Aggregator
+{
+	AggregateOptions options;
+	VariableData * const *columns;
+	int numColumns;
+	//the columns summed up (all but the character ones), the key column's place among them, and a block of each
+	//loaded as doubles
+	int *summed;
+	int numSummed;
+	int keySummed;
+	double *block;
+	//the floats of a block of a mapped column, once their bytes are swapped
+	float *swapped;
+	//the bin being filled: whether there is one, its key (its interval, or its index for bins of rows), its number of
+	//rows, and the statistics of each summed column
+	int binOpen;
+	double binKey;
+	uint64_t binRowCount;
+	BinMoments *moments;
+	//rows added so far, and bins written
+	uint64_t numRows;
+	uint64_t numBins;
+	TimestampCache timestampCache;
+};
+
+int ParseAggregateStatistics(const char *list)
+{
+	int statistics = 0;
+	const char *name = list;
+	while (*name != '\0')
+	{
+		size_t length = strcspn(name, ",");
+		int i;
+		for (i = 0; i < NUM_STATISTICS; i++)
+		{
+			if (strlen(statisticNames[i]) == length && strncmp(name, statisticNames[i], length) == 0) break;
+		}
+		if (i == NUM_STATISTICS) return 0;
+		statistics |= 1 << i;
+		name += length;
+		if (*name == ',') name++;
+	}
+	return statistics;
+}
+
+//define a loader that turns count values of a column into doubles
+#define DEFINE_COLUMN_LOADER(name, valueType, load) \
+	static void name(const char *source, size_t stride, size_t count, double *values) \
+	{ \
+		size_t i; \
+		for (i = 0; i < count; i++) \
+		{ \
+			valueType value; \
+			load(valueType, source + i*stride, value); \
+			values[i] = value; \
+		} \
+	}
+
+//(bytes are unsigned, as they're written to CSV files)
+DEFINE_COLUMN_LOADER(LoadByteColumn, unsigned char, LOAD_NATIVE)
+DEFINE_COLUMN_LOADER(LoadShortColumn, short, LOAD_NATIVE)
+DEFINE_COLUMN_LOADER(LoadIntColumn, int, LOAD_NATIVE)
+DEFINE_COLUMN_LOADER(LoadFloatColumn, float, LOAD_NATIVE)
+DEFINE_COLUMN_LOADER(LoadDoubleColumn, double, LOAD_NATIVE)
+DEFINE_COLUMN_LOADER(LoadShortColumnBE, short, LOAD_BIG_ENDIAN)
+DEFINE_COLUMN_LOADER(LoadIntColumnBE, int, LOAD_BIG_ENDIAN)
+DEFINE_COLUMN_LOADER(LoadDoubleColumnBE, double, LOAD_BIG_ENDIAN)
+
+//check if a column's values can be summed up
+static int IsSummable(const VariableData *column)
+{
+	switch (column->type)
+	{
+		case NC_BYTE: case NC_SHORT: case NC_INT: case NC_FLOAT: case NC_DOUBLE: return 1;
+		default: return 0;
+	}
+}
+
+//load rows [start, start+count) of every summed column into the block as doubles
+static void LoadBlock(Aggregator *aggregator, const void * const *columnData, const size_t *strides, size_t start, size_t count)
+{
+	int s;
+	size_t i;
+	for (s = 0; s < aggregator->numSummed; s++)
+	{
+		int c = aggregator->summed[s];
+		const VariableData *column = aggregator->columns[c];
+		double *values = aggregator->block + s*AGGREGATE_BLOCK_ROWS;
+		if (columnData[c] == NULL)
+		{
+			for (i = 0; i < count; i++) values[i] = NAN;
+			continue;
+		}
+		const char *source = (const char *)columnData[c] + start*strides[c];
+		switch (column->type)
+		{
+			case NC_BYTE: LoadByteColumn(source, strides[c], count, values); break;
+			case NC_SHORT:
+				if (column->mapped) LoadShortColumnBE(source, strides[c], count, values);
+				else LoadShortColumn(source, strides[c], count, values);
+				break;
+			case NC_INT:
+				if (column->mapped) LoadIntColumnBE(source, strides[c], count, values);
+				else LoadIntColumn(source, strides[c], count, values);
+				break;
+			case NC_FLOAT:
+				if (column->mapped)
+				{
+					SwapFloatColumn(source, strides[c], count, aggregator->swapped);
+					LoadFloatColumn((const char *)aggregator->swapped, sizeof(float), count, values);
+				}
+				else LoadFloatColumn(source, strides[c], count, values);
+				break;
+			default:
+				if (column->mapped) LoadDoubleColumnBE(source, strides[c], count, values);
+				else LoadDoubleColumn(source, strides[c], count, values);
+				break;
+		}
+	}
+}
+
+Aggregator *CreateAggregator(const AggregateOptions *options, VariableData * const *columns, int numColumns)
+{
+	int c;
+	if (options->keyColumn >= 0 && !IsSummable(columns[options->keyColumn]))
+	{
+		printf("error: can't bin by %s, it isn't numeric\n", columns[options->keyColumn]->name);
+		return NULL;
+	}
+
+	Aggregator *aggregator = (Aggregator *)calloc(1, sizeof(Aggregator));
+	aggregator->options = *options;
+	aggregator->columns = columns;
+	aggregator->numColumns = numColumns;
+	aggregator->summed = (int *)malloc((numColumns + 1) * sizeof(int));
+	aggregator->keySummed = -1;
+	for (c = 0; c < numColumns; c++)
+	{
+		if (!IsSummable(columns[c])) continue;
+		if (c == options->keyColumn) aggregator->keySummed = aggregator->numSummed;
+		aggregator->summed[aggregator->numSummed++] = c;
+	}
+	aggregator->block = (double *)malloc(((size_t)aggregator->numSummed + 1) * AGGREGATE_BLOCK_ROWS * sizeof(double));
+	aggregator->swapped = (float *)malloc(AGGREGATE_BLOCK_ROWS * sizeof(float));
+	aggregator->moments = (BinMoments *)calloc(aggregator->numSummed + 1, sizeof(BinMoments));
+	InitTimestampCache(&aggregator->timestampCache);
+	return aggregator;
+}
+
+void FreeAggregator(Aggregator *aggregator)
+{
+	if (aggregator == NULL) return;
+	free(aggregator->summed);
+	free(aggregator->block);
+	free(aggregator->swapped);
+	free(aggregator->moments);
+	free(aggregator);
+}
+
+//write units in square brackets, unless they already have them
+static void PutUnits(CsvWriter *writer, const char *units)
+{
+	if (units[0] != '[') CsvWriterPutChar(writer, '[');
+	CsvWriterPutString(writer, units);
+	if (units[0] == '\0' || units[strlen(units)-1] != ']') CsvWriterPutChar(writer, ']');
+}
+
+//write one header line (0 for names, 1 for standard names, 2 for long names and 3 for units)
+static void WriteHeaderLine(const Aggregator *aggregator, CsvWriter *writer, int line)
+{
+	const AggregateOptions *options = &aggregator->options;
+	int s, statistic;
+
+	//the bin's first row, or the lower edge of its interval of the key column
+	const VariableData *key = (options->keyColumn >= 0) ? aggregator->columns[options->keyColumn] : NULL;
+	const char *keyLongName = (key == NULL) ? NULL : (key->longName[0] != '\0') ? key->longName : key->name;
+	switch (line)
+	{
+		case 0:
+			if (key == NULL) CsvWriterPutString(writer, "row");
+			else CsvWriterPrintf(writer, "%s_bin", key->name);
+			break;
+		case 1:
+			if (key != NULL) CsvWriterPutString(writer, key->standardName);
+			break;
+		case 2:
+			if (key == NULL) CsvWriterPutString(writer, "first row of the bin");
+			else CsvWriterPrintf(writer, "%s bin lower edge", keyLongName);
+			break;
+		default:
+			PutUnits(writer, (key == NULL) ? "" : key->timestamp ? "UTC" : key->units);
+			break;
+	}
+	if (options->statistics & AGGREGATE_COUNT)
+	{
+		CsvWriterPutBytes(writer, ", ", 2);
+		if (line == 0) CsvWriterPutString(writer, "count");
+		else if (line == 2) CsvWriterPutString(writer, "rows in the bin");
+		else if (line == 3) PutUnits(writer, "");
+	}
+
+	for (s = 0; s < aggregator->numSummed; s++)
+	{
+		const VariableData *column = aggregator->columns[aggregator->summed[s]];
+		const char *longName = (column->longName[0] != '\0') ? column->longName : column->name;
+		for (statistic = 1; statistic < NUM_STATISTICS; statistic++)
+		{
+			if (!(options->statistics & (1 << statistic))) continue;
+			int spread = ((1 << statistic) == AGGREGATE_STDDEV);
+			CsvWriterPutBytes(writer, ", ", 2);
+			switch (line)
+			{
+				//(a spread isn't the same quantity as the values, so it doesn't get their standard name)
+				case 0: CsvWriterPrintf(writer, "%s_%s", column->name, statisticNames[statistic]); break;
+				case 1: if (!spread) CsvWriterPutString(writer, column->standardName); break;
+				case 2: CsvWriterPrintf(writer, "%s of %s", statisticLongNames[statistic], longName); break;
+				default: PutUnits(writer, !column->timestamp ? column->units : spread ? "s" : "UTC"); break;
+			}
+		}
+	}
+	CsvWriterPutBytes(writer, "\r\n", 2);
+}
+
+void WriteAggregateHeader(const Aggregator *aggregator, CsvWriter *writer)
+{
+	int line;
+	for (line = 0; line < 4; line++) WriteHeaderLine(aggregator, writer, line);
+}
+
+//write a statistic of a column in the column's own form: a timestamp for a time coordinate, and the shortest text of a
+//float for a float column (its mean and spread are rounded to floats, no more precise than its values)
+//NaN (a bin without any of the column's values) is an empty cell
+static void PutStatistic(Aggregator *aggregator, CsvWriter *writer, double value, const VariableData *column, int timestamp)
+{
+	int decimals = aggregator->options.decimals;
+	if (value != value) return;
+	if (timestamp)
+	{
+		CsvWriterReserve(writer, CSV_MAX_NUMBER_LENGTH);
+		writer->length += FormatTimestamp(writer->buffer + writer->length, value, &aggregator->timestampCache);
+	}
+	else if (column->type == NC_FLOAT && decimals == CSV_SHORTEST) CsvWriterPutFloat(writer, (float)value, decimals);
+	else CsvWriterPutDouble(writer, value, decimals);
+}
+
+//write out the bin being filled, and start over
+static void WriteBin(Aggregator *aggregator, CsvWriter *writer)
+{
+	const AggregateOptions *options = &aggregator->options;
+	int s, statistic;
+
+	if (options->keyColumn < 0) CsvWriterPutUInt(writer, (uint64_t)aggregator->binKey * options->binRows);
+	else
+	{
+		const VariableData *key = aggregator->columns[options->keyColumn];
+		double edge = aggregator->binKey * options->binWidth;
+		if (!key->timestamp)
+		{
+			char text[32];
+			snprintf(text, sizeof(text), "%.*g", BIN_EDGE_DIGITS, edge);
+			edge = strtod(text, NULL);
+		}
+		PutStatistic(aggregator, writer, edge, key, key->timestamp);
+	}
+	if (options->statistics & AGGREGATE_COUNT)
+	{
+		CsvWriterPutBytes(writer, ", ", 2);
+		CsvWriterPutUInt(writer, aggregator->binRowCount);
+	}
+
+	for (s = 0; s < aggregator->numSummed; s++)
+	{
+		const VariableData *column = aggregator->columns[aggregator->summed[s]];
+		BinMoments *moments = &aggregator->moments[s];
+		for (statistic = 1; statistic < NUM_STATISTICS; statistic++)
+		{
+			if (!(options->statistics & (1 << statistic))) continue;
+			CsvWriterPutBytes(writer, ", ", 2);
+			if (moments->count == 0) continue;
+			switch (1 << statistic)
+			{
+				case AGGREGATE_MEAN: PutStatistic(aggregator, writer, moments->mean, column, column->timestamp); break;
+				case AGGREGATE_MIN: PutStatistic(aggregator, writer, moments->min, column, column->timestamp); break;
+				case AGGREGATE_MAX: PutStatistic(aggregator, writer, moments->max, column, column->timestamp); break;
+				//(the sample standard deviation, which takes at least 2 values, in seconds for a time coordinate)
+				default:
+					if (moments->count > 1) PutStatistic(aggregator, writer, sqrt(moments->m2 / (moments->count - 1)), column, 0);
+					break;
+			}
+		}
+		memset(moments, 0, sizeof(BinMoments));
+	}
+	CsvWriterPutBytes(writer, "\r\n", 2);
+
+	aggregator->binOpen = 0;
+	aggregator->binRowCount = 0;
+	aggregator->numBins++;
+}
+
+//add rows [start, start+count) of the block to the bin being filled
+static void AddRun(Aggregator *aggregator, size_t start, size_t count)
+{
+	int s;
+	for (s = 0; s < aggregator->numSummed; s++)
+	{
+		const double *values = aggregator->block + s*AGGREGATE_BLOCK_ROWS + start;
+		ColumnSummary summary;
+		SummarizeDoubleColumn(values, count, &summary);
+		if (summary.count == 0) continue;
+		double mean = summary.sum / summary.count;
+		double m2 = (aggregator->options.statistics & AGGREGATE_STDDEV) ? SumSquaredDeviations(values, count, mean) : 0.0;
+
+		BinMoments *moments = &aggregator->moments[s];
+		if (moments->count == 0)
+		{
+			moments->count = summary.count;
+			moments->mean = mean;
+			moments->m2 = m2;
+			moments->min = summary.min;
+			moments->max = summary.max;
+			continue;
+		}
+		//merge the run's statistics into the bin's
+		uint64_t total = moments->count + summary.count;
+		double delta = mean - moments->mean;
+		moments->mean += delta * ((double)summary.count / total);
+		moments->m2 += m2 + delta * delta * ((double)moments->count * summary.count / total);
+		if (summary.min < moments->min) moments->min = summary.min;
+		if (summary.max > moments->max) moments->max = summary.max;
+		moments->count = total;
+	}
+	aggregator->binRowCount += count;
+}
+
+void AggregateRows(Aggregator *aggregator, const void * const *columnData, const size_t *strides, size_t count,
+	CsvWriter *writer)
+{
+	const AggregateOptions *options = &aggregator->options;
+	size_t blockStart;
+	for (blockStart = 0; blockStart < count; blockStart += AGGREGATE_BLOCK_ROWS)
+	{
+		size_t blockRows = count - blockStart;
+		if (blockRows > AGGREGATE_BLOCK_ROWS) blockRows = AGGREGATE_BLOCK_ROWS;
+		LoadBlock(aggregator, columnData, strides, blockStart, blockRows);
+		const double *keys = (aggregator->keySummed >= 0) ? aggregator->block + aggregator->keySummed*AGGREGATE_BLOCK_ROWS : NULL;
+
+		//split the block into runs of rows in the same bin
+		size_t runStart = 0;
+		while (runStart < blockRows)
+		{
+			size_t runEnd;
+			double key;
+			if (keys == NULL)
+			{
+				key = (double)(aggregator->numRows / options->binRows);
+				runEnd = runStart + (options->binRows - aggregator->numRows % options->binRows);
+				if (runEnd > blockRows) runEnd = blockRows;
+			}
+			else
+			{
+				key = floor(keys[runStart] / options->binWidth);
+				//(rows without a key value aren't in any bin)
+				if (key != key)
+				{
+					runStart++;
+					aggregator->numRows++;
+					continue;
+				}
+				runEnd = runStart + 1;
+				while (runEnd < blockRows && floor(keys[runEnd] / options->binWidth) == key) runEnd++;
+			}
+
+			if (aggregator->binOpen && key != aggregator->binKey) WriteBin(aggregator, writer);
+			aggregator->binOpen = 1;
+			aggregator->binKey = key;
+			AddRun(aggregator, runStart, runEnd - runStart);
+			aggregator->numRows += runEnd - runStart;
+			runStart = runEnd;
+		}
+	}
+}
+
+void FinishAggregation(Aggregator *aggregator, CsvWriter *writer)
+{
+	if (aggregator->binOpen) WriteBin(aggregator, writer);
+}
+
+uint64_t GetAggregateBinCount(const Aggregator *aggregator)
+{
+	return aggregator->numBins;
+}
+
+int GetAggregateColumnCount(const Aggregator *aggregator)
+{
+	int numColumns = 1 + ((aggregator->options.statistics & AGGREGATE_COUNT) ? 1 : 0);
+	int statistic;
+	for (statistic = 1; statistic < NUM_STATISTICS; statistic++)
+	{
+		if (aggregator->options.statistics & (1 << statistic)) numColumns += aggregator->numSummed;
+	}
+	return numColumns;
+}
@@ -0,0 +1,55 @@
+//aggregate.h: streaming statistics over bins of rows (every N rows, or runs of rows in the same interval of a coordinate)
+//Copyright 2012, Allen Jordan, allen.jordan@gmail.com
+
+#ifndef AGGREGATE_H
+#define AGGREGATE_H
+
+#include <stdint.h>
+#include "ncdataset.h"
+#include "csvwriter.h"
+
+//the statistics written for each bin, --aggregate picks them
+#define AGGREGATE_COUNT		0x01
+#define AGGREGATE_MEAN		0x02
+#define AGGREGATE_MIN		0x04
+#define AGGREGATE_MAX		0x08
+#define AGGREGATE_STDDEV	0x10
+#define AGGREGATE_ALL		0x1F
+
+//parse a comma separated list of statistics (count, mean, min, max and stddev), returns their bits or 0 if it's invalid
+int ParseAggregateStatistics(const char *list);
+
+//how rows are binned
+typedef struct
+{
+	//every binRows rows are a bin, unless keyColumn is set (>= 0)
+	size_t binRows;
+	//otherwise a bin is a run of consecutive rows whose keyColumn values fall in the same binWidth wide interval
+	//[k*binWidth, (k+1)*binWidth), a bin is finished when the interval changes (so sorted keys give one bin per interval)
+	int keyColumn;
+	double binWidth;
+	//AGGREGATE_* bits
+	int statistics;
+	//CSV_SHORTEST or a fixed number of decimal places
+	int decimals;
+} AggregateOptions;
+
+//the running statistics of the bin being filled, carried from one window to the next
+typedef struct Aggregator Aggregator;
+
+//set up the statistics of a plan's columns (character columns are left out)
+Aggregator *CreateAggregator(const AggregateOptions *options, VariableData * const *columns, int numColumns);
+void FreeAggregator(Aggregator *aggregator);
+//write the header lines for the bins' columns: names, standard names, long names and units
+void WriteAggregateHeader(const Aggregator *aggregator, CsvWriter *writer);
+//add count rows of a window to the bins, writing out each bin that's finished
+//columnData[c] points at row 0 of column c's window, with strides[c] bytes from row to row (as for FormatRowRange)
+void AggregateRows(Aggregator *aggregator, const void * const *columnData, const size_t *strides, size_t count,
+	CsvWriter *writer);
+//write out the last bin, once every window has been added
+void FinishAggregation(Aggregator *aggregator, CsvWriter *writer);
+//the number of bins written, and the number of columns each one has
+uint64_t GetAggregateBinCount(const Aggregator *aggregator);
+int GetAggregateColumnCount(const Aggregator *aggregator);
+
+#endif
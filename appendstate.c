@@ -0,0 +1,166 @@
+//appendstate.c: the state file kept next to an output that's appended to as its NetCDF file grows along its record dimension
+//Copyright 2012, Allen Jordan, allen.jordan@gmail.com
+
+//a state file is a few lines of text, ex:
+//	records 3600
+//	output_bytes 412345
+//	input 2049 1837465
+//	record_hash 9c2e1f0a4b7d3e65
+//	signature csv decimals=-1 vars=time,press
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <netcdf.h>
+#include "appendstate.h"
+#include "ncdataset.h"
+
+char *GetAppendStateFilename(const char *outputFilename)
+{
+	size_t length = strlen(outputFilename) + 7;
+	char *stateFilename = (char *)malloc(length);
+	snprintf(stateFilename, length, "%s.state", outputFilename);
+	return stateFilename;
+}
+
+int LoadAppendState(const char *stateFilename, AppendState *state)
+{
+	state->numRecords = 0;
+	state->outputBytes = 0;
+	state->inputDevice = 0;
+	state->inputInode = 0;
+	state->recordHash = 0;
+	state->signature = NULL;
+	FILE *file = fopen(stateFilename, "r");
+	if (file == NULL) return -1;
+
+	int haveRecords = 0, haveBytes = 0, haveInput = 0, haveHash = 0;
+	char *line = NULL;
+	size_t lineCapacity = 0;
+	ssize_t lineLength;
+	while ((lineLength = getline(&line, &lineCapacity, file)) >= 0)
+	{
+		while (lineLength > 0 && (line[lineLength-1] == '\n' || line[lineLength-1] == '\r')) line[--lineLength] = '\0';
+		unsigned long long value, secondValue;
+		if (sscanf(line, "records %llu", &value) == 1)
+		{
+			state->numRecords = value;
+			haveRecords = 1;
+		}
+		else if (sscanf(line, "output_bytes %llu", &value) == 1)
+		{
+			state->outputBytes = value;
+			haveBytes = 1;
+		}
+		else if (sscanf(line, "input %llu %llu", &value, &secondValue) == 2)
+		{
+			state->inputDevice = value;
+			state->inputInode = secondValue;
+			haveInput = 1;
+		}
+		else if (sscanf(line, "record_hash %llx", &value) == 1)
+		{
+			state->recordHash = value;
+			haveHash = 1;
+		}
+		else if (strncmp(line, "signature ", 10) == 0)
+		{
+			free(state->signature);
+			state->signature = strdup(line + 10);
+		}
+	}
+	free(line);
+	fclose(file);
+
+	//(state files from before the input was recorded count as incomplete, so their outputs are converted whole once)
+	if (!haveRecords || !haveBytes || !haveInput || !haveHash || state->signature == NULL)
+	{
+		FreeAppendState(state);
+		return -1;
+	}
+	return 0;
+}
+
+int SaveAppendState(const char *stateFilename, const AppendState *state)
+{
+	size_t length = strlen(stateFilename) + 5;
+	char *tempFilename = (char *)malloc(length);
+	snprintf(tempFilename, length, "%s.tmp", stateFilename);
+
+	int status = -1;
+	FILE *file = fopen(tempFilename, "w");
+	if (file != NULL)
+	{
+		fprintf(file, "records %llu\noutput_bytes %llu\ninput %llu %llu\nrecord_hash %016llx\nsignature %s\n",
+			(unsigned long long)state->numRecords, (unsigned long long)state->outputBytes,
+			(unsigned long long)state->inputDevice, (unsigned long long)state->inputInode,
+			(unsigned long long)state->recordHash, state->signature);
+		if (fclose(file) == 0 && rename(tempFilename, stateFilename) == 0) status = 0;
+		else remove(tempFilename);
+	}
+	free(tempFilename);
+	return status;
+}
+
+void FreeAppendState(AppendState *state)
+{
+	free(state->signature);
+	state->signature = NULL;
+}
+
+//FNV-1a, continuing from hash
+static uint64_t HashBytes(uint64_t hash, const unsigned char *bytes, size_t count)
+{
+	size_t i;
+	for (i = 0; i < count; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+int HashRecords(int datasetID, int recordDimID, size_t firstRecord, size_t lastRecord, uint64_t *hash)
+{
+	*hash = 0xcbf29ce484222325ULL;
+	int numVars;
+	int ncResult = nc_inq(datasetID, NULL, &numVars, NULL, NULL);
+	if (ncResult != NC_NOERR) return ncResult;
+
+	int varID, i, r;
+	for (varID = 0; varID < numVars; varID++)
+	{
+		int numDims, dimIDs[NC_MAX_VAR_DIMS];
+		nc_type type;
+		ncResult = nc_inq_var(datasetID, varID, NULL, &type, &numDims, dimIDs, NULL);
+		if (ncResult != NC_NOERR) return ncResult;
+		//(only the types that are converted, others can't be compared byte for byte)
+		size_t typeSize = GetTypeSize(type);
+		if (numDims == 0 || dimIDs[0] != recordDimID || typeSize == 0) continue;
+
+		//one record is every value at a record dimension index
+		size_t start[NC_MAX_VAR_DIMS], count[NC_MAX_VAR_DIMS];
+		size_t recordBytes = typeSize;
+		start[0] = 0;
+		count[0] = 1;
+		for (i = 1; i < numDims; i++)
+		{
+			start[i] = 0;
+			ncResult = nc_inq_dimlen(datasetID, dimIDs[i], &count[i]);
+			if (ncResult != NC_NOERR) return ncResult;
+			recordBytes *= count[i];
+		}
+		if (recordBytes == 0) continue;
+
+		unsigned char *values = (unsigned char *)malloc(recordBytes);
+		for (r = 0; r < 2 && ncResult == NC_NOERR; r++)
+		{
+			start[0] = (r == 0) ? firstRecord : lastRecord;
+			ncResult = nc_get_vara(datasetID, varID, start, count, values);
+			if (ncResult == NC_NOERR) *hash = HashBytes(*hash, values, recordBytes);
+		}
+		free(values);
+		if (ncResult != NC_NOERR) return ncResult;
+	}
+	return NC_NOERR;
+}
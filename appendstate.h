@@ -0,0 +1,37 @@
+//appendstate.h: the state file kept next to an output that's appended to as its NetCDF file grows along its record dimension
+//Copyright 2012, Allen Jordan, allen.jordan@gmail.com
+
+#ifndef APPENDSTATE_H
+#define APPENDSTATE_H
+
+#include <stdint.h>
+
+//how far an output has got, read back from its state file
+typedef struct
+{
+	//records of the unlimited dimension converted so far, and the size of the output once they were written
+	uint64_t numRecords;
+	uint64_t outputBytes;
+	//the input file it was converted from (its device and inode), and a hash of the first and last records converted,
+	//so a file that was replaced, or rewritten in place with other values, is converted whole instead of appended to
+	uint64_t inputDevice;
+	uint64_t inputInode;
+	uint64_t recordHash;
+	//the options the output was written with, it's only appended to with the same ones
+	char *signature;
+} AppendState;
+
+//get the name of an output file's state file (<output>.state), in a new string
+char *GetAppendStateFilename(const char *outputFilename);
+//read a state file, returns 0 on success or -1 if there isn't a complete one
+int LoadAppendState(const char *stateFilename, AppendState *state);
+//write a state file, replacing the old one in a single rename so an interrupted write leaves the old one
+//returns 0 on success or -1 if it couldn't be written
+int SaveAppendState(const char *stateFilename, const AppendState *state);
+void FreeAppendState(AppendState *state);
+
+//hash the values of the first and last records (along the record dimension) of every variable that runs along it
+//returns a NetCDF status
+int HashRecords(int datasetID, int recordDimID, size_t firstRecord, size_t lastRecord, uint64_t *hash);
+
+#endif
@@ -0,0 +1,506 @@
+//arrowwriter.c: writing columns of typed values as an Arrow IPC file (the Feather V2 format), without any text conversion
+//Copyright 2012, Allen Jordan, allen.jordan@gmail.com
+
+//the file is the "ARROW1" signature, a stream of encapsulated messages (the schema, then a record batch per call),
+//and a footer indexing the record batches. each message is a continuation marker, the length of its flatbuffer
+//metadata, the metadata, and then the message body: the column buffers, each padded out to 8 bytes
+//the flatbuffers are built by hand here following Arrow's Schema.fbs, Message.fbs and File.fbs
+
+#include <stdlib.h>
+#include <string.h>
+#include "arrowwriter.h"
+
+//format version 5 metadata
+#define ARROW_METADATA_V5	4
+//MessageHeader union types
+#define ARROW_HEADER_SCHEMA	1
+#define ARROW_HEADER_RECORD_BATCH	3
+//Type union types
+#define ARROW_TYPE_INT	2
+#define ARROW_TYPE_FLOATING_POINT	3
+#define ARROW_TYPE_UTF8	5
+//FloatingPoint precisions
+#define ARROW_PRECISION_SINGLE	1
+#define ARROW_PRECISION_DOUBLE	2
+
+static const char arrowSignature[8] = { 'A', 'R', 'R', 'O', 'W', '1', 0, 0 };
+
+static size_t GetArrowTypeSize(ArrowColumnType type)
+{
+	switch (type)
+	{
+		case ARROW_INT8: return 1;
+		case ARROW_INT16: return 2;
+		case ARROW_INT32: return 4;
+		case ARROW_FLOAT32: return 4;
+		case ARROW_FLOAT64: return 8;
+		case ARROW_CHAR: return 1;
+		default: return 0;
+	}
+}
+
+static size_t PadTo8(size_t length)
+{
+	return (length + 7) & ~(size_t)7;
+}
+
+//---- flatbuffer building ----
+
+static void FbReset(FlatBuilder *b)
+{
+	b->length = 0;
+}
+
+//append bytes (zeros if value is NULL), returns where they went
+static size_t FbAppend(FlatBuilder *b, const void *value, size_t size)
+{
+	if (b->length + size > b->capacity)
+	{
+		while (b->length + size > b->capacity) b->capacity = (b->capacity == 0) ? 1024 : b->capacity * 2;
+		b->data = (uint8_t *)realloc(b->data, b->capacity);
+	}
+	size_t position = b->length;
+	if (value != NULL) memcpy(b->data + position, value, size);
+	else memset(b->data + position, 0, size);
+	b->length += size;
+	return position;
+}
+
+//pad with zeros until (length + extra) is a multiple of alignment
+static void FbPad(FlatBuilder *b, size_t alignment, size_t extra)
+{
+	size_t misalignment = (b->length + extra) % alignment;
+	if (misalignment != 0) FbAppend(b, NULL, alignment - misalignment);
+}
+
+static void FbPut(FlatBuilder *b, size_t position, const void *value, size_t size)
+{
+	memcpy(b->data + position, value, size);
+}
+
+//point the offset field at position to target, which has to come after it
+static void FbSetOffset(FlatBuilder *b, size_t position, size_t target)
+{
+	uint32_t offset = (uint32_t)(target - position);
+	FbPut(b, position, &offset, sizeof(offset));
+}
+
+#define FB_MAX_FIELDS	8
+
+//a table's fields: the vtable slot and byte size of each, and where each ended up once the table is written
+typedef struct
+{
+	int numSlots;
+	int numFields;
+	int slots[FB_MAX_FIELDS];
+	int sizes[FB_MAX_FIELDS];
+	size_t positions[FB_MAX_FIELDS];
+} FlatTable;
+
+static void FbAddField(FlatTable *table, int slot, int size)
+{
+	table->slots[table->numFields] = slot;
+	table->sizes[table->numFields] = size;
+	table->numFields++;
+}
+
+//write a table (zeroed) right after its vtable, returns the table's position
+//the fields are laid out largest first after the vtable offset, so every one of them is aligned
+static size_t FbWriteTable(FlatBuilder *b, FlatTable *table)
+{
+	int i, size;
+	uint16_t fieldOffsets[FB_MAX_FIELDS] = { 0 };
+	size_t offsets[FB_MAX_FIELDS];
+	size_t tableSize = 4;
+	for (size = 8; size >= 1; size /= 2)
+	{
+		for (i = 0; i < table->numFields; i++)
+		{
+			if (table->sizes[i] != size) continue;
+			tableSize = (tableSize + size - 1) / size * size;
+			offsets[i] = tableSize;
+			fieldOffsets[table->slots[i]] = (uint16_t)tableSize;
+			tableSize += size;
+		}
+	}
+
+	uint16_t vtableHeader[2];
+	vtableHeader[0] = (uint16_t)(4 + 2*table->numSlots);
+	vtableHeader[1] = (uint16_t)tableSize;
+	FbPad(b, 8, vtableHeader[0]);
+	size_t vtablePosition = FbAppend(b, vtableHeader, sizeof(vtableHeader));
+	FbAppend(b, fieldOffsets, 2*table->numSlots);
+
+	size_t tablePosition = b->length;
+	int32_t vtableOffset = (int32_t)(tablePosition - vtablePosition);
+	FbAppend(b, &vtableOffset, sizeof(vtableOffset));
+	FbAppend(b, NULL, tableSize - 4);
+	for (i = 0; i < table->numFields; i++) table->positions[i] = tablePosition + offsets[i];
+	return tablePosition;
+}
+
+static size_t FbWriteString(FlatBuilder *b, const char *str)
+{
+	uint32_t length = (uint32_t)strlen(str);
+	FbPad(b, 4, 0);
+	size_t position = FbAppend(b, &length, sizeof(length));
+	FbAppend(b, str, length + 1);
+	return position;
+}
+
+//write a (zeroed) vector, returns its position, the elements start 4 bytes after it
+static size_t FbWriteVector(FlatBuilder *b, uint32_t count, size_t elementSize, size_t alignment)
+{
+	FbPad(b, alignment, 4);
+	size_t position = FbAppend(b, &count, sizeof(count));
+	FbAppend(b, NULL, count * elementSize);
+	return position;
+}
+
+//a [KeyValue] vector
+static size_t FbWriteMetadata(FlatBuilder *b, const ArrowMetadata *metadata)
+{
+	int i;
+	size_t vector = FbWriteVector(b, (uint32_t)metadata->count, 4, 4);
+	for (i = 0; i < metadata->count; i++)
+	{
+		FlatTable keyValue = { 2, 0 };
+		FbAddField(&keyValue, 0, 4);
+		FbAddField(&keyValue, 1, 4);
+		size_t table = FbWriteTable(b, &keyValue);
+		FbSetOffset(b, vector + 4 + 4*i, table);
+		FbSetOffset(b, keyValue.positions[0], FbWriteString(b, metadata->keys[i]));
+		FbSetOffset(b, keyValue.positions[1], FbWriteString(b, metadata->values[i]));
+	}
+	return vector;
+}
+
+//a Type union member table for a column type, returns its position and sets its union type
+static size_t FbWriteType(FlatBuilder *b, ArrowColumnType columnType, uint8_t *unionType)
+{
+	FlatTable type = { 0, 0 };
+	size_t table;
+	if (columnType == ARROW_FLOAT32 || columnType == ARROW_FLOAT64)
+	{
+		int16_t precision = (columnType == ARROW_FLOAT32) ? ARROW_PRECISION_SINGLE : ARROW_PRECISION_DOUBLE;
+		type.numSlots = 1;
+		FbAddField(&type, 0, 2);
+		table = FbWriteTable(b, &type);
+		FbPut(b, type.positions[0], &precision, sizeof(precision));
+		*unionType = ARROW_TYPE_FLOATING_POINT;
+	}
+	else if (columnType == ARROW_CHAR)
+	{
+		table = FbWriteTable(b, &type);
+		*unionType = ARROW_TYPE_UTF8;
+	}
+	else
+	{
+		int32_t bitWidth = (int32_t)GetArrowTypeSize(columnType) * 8;
+		uint8_t isSigned = 1;
+		type.numSlots = 2;
+		FbAddField(&type, 0, 4);
+		FbAddField(&type, 1, 1);
+		table = FbWriteTable(b, &type);
+		FbPut(b, type.positions[0], &bitWidth, sizeof(bitWidth));
+		FbPut(b, type.positions[1], &isSigned, sizeof(isSigned));
+		*unionType = ARROW_TYPE_INT;
+	}
+	return table;
+}
+
+//a Schema table
+static size_t FbWriteSchema(FlatBuilder *b, const ArrowFileWriter *writer)
+{
+	int i;
+	FlatTable schema = { 4, 0 };
+	FbAddField(&schema, 1, 4);
+	if (writer->metadata.count > 0) FbAddField(&schema, 2, 4);
+	size_t schemaTable = FbWriteTable(b, &schema);
+
+	size_t fieldVector = FbWriteVector(b, (uint32_t)writer->numFields, 4, 4);
+	FbSetOffset(b, schema.positions[0], fieldVector);
+	for (i = 0; i < writer->numFields; i++)
+	{
+		const ArrowField *field = &writer->fields[i];
+		//name, type, children and custom_metadata (nullable is left false, there are never any nulls)
+		FlatTable fieldTable = { 7, 0 };
+		FbAddField(&fieldTable, 0, 4);
+		FbAddField(&fieldTable, 2, 1);
+		FbAddField(&fieldTable, 3, 4);
+		FbAddField(&fieldTable, 5, 4);
+		if (field->metadata.count > 0) FbAddField(&fieldTable, 6, 4);
+		size_t table = FbWriteTable(b, &fieldTable);
+		FbSetOffset(b, fieldVector + 4 + 4*i, table);
+
+		FbSetOffset(b, fieldTable.positions[0], FbWriteString(b, field->name));
+		uint8_t unionType;
+		size_t typeTable = FbWriteType(b, field->type, &unionType);
+		FbPut(b, fieldTable.positions[1], &unionType, sizeof(unionType));
+		FbSetOffset(b, fieldTable.positions[2], typeTable);
+		FbSetOffset(b, fieldTable.positions[3], FbWriteVector(b, 0, 4, 4));
+		if (field->metadata.count > 0) FbSetOffset(b, fieldTable.positions[4], FbWriteMetadata(b, &field->metadata));
+	}
+
+	if (writer->metadata.count > 0) FbSetOffset(b, schema.positions[1], FbWriteMetadata(b, &writer->metadata));
+	return schemaTable;
+}
+
+//start a flatbuffer with a Message table as its root, returns the position of the header offset to fill in
+static size_t FbStartMessage(FlatBuilder *b, uint8_t headerType, int64_t bodyLength)
+{
+	int16_t version = ARROW_METADATA_V5;
+	FbReset(b);
+	size_t root = FbAppend(b, NULL, 4);
+	FlatTable message = { 4, 0 };
+	FbAddField(&message, 0, 2);
+	FbAddField(&message, 1, 1);
+	FbAddField(&message, 2, 4);
+	FbAddField(&message, 3, 8);
+	FbSetOffset(b, root, FbWriteTable(b, &message));
+	FbPut(b, message.positions[0], &version, sizeof(version));
+	FbPut(b, message.positions[1], &headerType, sizeof(headerType));
+	FbPut(b, message.positions[3], &bodyLength, sizeof(bodyLength));
+	return message.positions[2];
+}
+
+//write the continuation marker, metadata length and a message's flatbuffer (padded so the body starts 8-byte aligned)
+//returns the total length written
+static uint32_t WriteMessageMetadata(FlatBuilder *b, CsvWriter *output)
+{
+	FbPad(b, 8, 0);
+	uint32_t prefix[2];
+	prefix[0] = 0xFFFFFFFF;
+	prefix[1] = (uint32_t)b->length;
+	CsvWriterPutBytes(output, (const char *)prefix, sizeof(prefix));
+	CsvWriterPutBytes(output, (const char *)b->data, b->length);
+	return (uint32_t)(sizeof(prefix) + b->length);
+}
+
+//---- the file ----
+
+static void InitArrowMetadata(ArrowMetadata *metadata)
+{
+	metadata->count = 0;
+	metadata->capacity = 0;
+	metadata->keys = NULL;
+	metadata->values = NULL;
+}
+
+static void FreeArrowMetadata(ArrowMetadata *metadata)
+{
+	int i;
+	for (i = 0; i < metadata->count; i++)
+	{
+		free(metadata->keys[i]);
+		free(metadata->values[i]);
+	}
+	free(metadata->keys);
+	free(metadata->values);
+	InitArrowMetadata(metadata);
+}
+
+ArrowFileWriter *CreateArrowFileWriter(void)
+{
+	ArrowFileWriter *writer = (ArrowFileWriter *)calloc(1, sizeof(ArrowFileWriter));
+	InitArrowMetadata(&writer->metadata);
+	return writer;
+}
+
+void FreeArrowFileWriter(ArrowFileWriter *writer)
+{
+	int i;
+	for (i = 0; i < writer->numFields; i++)
+	{
+		free(writer->fields[i].name);
+		FreeArrowMetadata(&writer->fields[i].metadata);
+	}
+	free(writer->fields);
+	FreeArrowMetadata(&writer->metadata);
+	free(writer->blocks);
+	free(writer->builder.data);
+	free(writer);
+}
+
+int AddArrowField(ArrowFileWriter *writer, const char *name, ArrowColumnType type)
+{
+	writer->fields = (ArrowField *)realloc(writer->fields, (writer->numFields + 1) * sizeof(ArrowField));
+	ArrowField *field = &writer->fields[writer->numFields];
+	field->name = strdup(name);
+	field->type = type;
+	InitArrowMetadata(&field->metadata);
+	return writer->numFields++;
+}
+
+void AddArrowMetadata(ArrowFileWriter *writer, int field, const char *key, const char *value)
+{
+	ArrowMetadata *metadata = (field >= 0) ? &writer->fields[field].metadata : &writer->metadata;
+	if (metadata->count == metadata->capacity)
+	{
+		metadata->capacity = (metadata->capacity == 0) ? 4 : metadata->capacity * 2;
+		metadata->keys = (char **)realloc(metadata->keys, metadata->capacity * sizeof(char*));
+		metadata->values = (char **)realloc(metadata->values, metadata->capacity * sizeof(char*));
+	}
+	metadata->keys[metadata->count] = strdup(key);
+	metadata->values[metadata->count] = strdup(value);
+	metadata->count++;
+}
+
+void WriteArrowHeader(ArrowFileWriter *writer, CsvWriter *output)
+{
+	FlatBuilder *b = &writer->builder;
+	CsvWriterPutBytes(output, arrowSignature, sizeof(arrowSignature));
+	size_t header = FbStartMessage(b, ARROW_HEADER_SCHEMA, 0);
+	FbSetOffset(b, header, FbWriteSchema(b, writer));
+	writer->fileOffset = sizeof(arrowSignature) + WriteMessageMetadata(b, output);
+}
+
+//count the characters of a character column that aren't NUL, each one becomes a 1 character string
+static size_t CountCharacters(const char *data, size_t count)
+{
+	size_t i, numCharacters = 0;
+	for (i = 0; i < count; i++) numCharacters += (data[i] != '\0');
+	return numCharacters;
+}
+
+void WriteArrowRecordBatch(ArrowFileWriter *writer, void * const *columnData, size_t count, CsvWriter *output)
+{
+	int i;
+	size_t j;
+	FlatBuilder *b = &writer->builder;
+	static const char padding[8] = { 0 };
+
+	//work out the body layout, every buffer starts 8-byte aligned: an empty validity buffer (no nulls) and the
+	//values for each column, plus the string offsets before the values for character columns
+	int numBuffers = 0;
+	for (i = 0; i < writer->numFields; i++) numBuffers += (writer->fields[i].type == ARROW_CHAR) ? 3 : 2;
+	int64_t *bufferOffsets = (int64_t *)malloc(numBuffers * sizeof(int64_t));
+	int64_t *bufferLengths = (int64_t *)malloc(numBuffers * sizeof(int64_t));
+	int64_t bodyLength = 0;
+	int buffer = 0;
+	for (i = 0; i < writer->numFields; i++)
+	{
+		bufferOffsets[buffer] = bodyLength;
+		bufferLengths[buffer++] = 0;
+		if (writer->fields[i].type == ARROW_CHAR)
+		{
+			bufferOffsets[buffer] = bodyLength;
+			bufferLengths[buffer++] = (int64_t)((count + 1) * sizeof(int32_t));
+			bodyLength += PadTo8((count + 1) * sizeof(int32_t));
+			bufferOffsets[buffer] = bodyLength;
+			bufferLengths[buffer] = (int64_t)CountCharacters((const char *)columnData[i], count);
+			bodyLength += PadTo8(bufferLengths[buffer++]);
+		}
+		else
+		{
+			bufferOffsets[buffer] = bodyLength;
+			bufferLengths[buffer++] = (int64_t)(count * GetArrowTypeSize(writer->fields[i].type));
+			bodyLength += PadTo8(count * GetArrowTypeSize(writer->fields[i].type));
+		}
+	}
+
+	//the RecordBatch message: the row count, a FieldNode (length, null count) per column and a Buffer (offset, length)
+	//per buffer
+	size_t header = FbStartMessage(b, ARROW_HEADER_RECORD_BATCH, bodyLength);
+	FlatTable recordBatch = { 5, 0 };
+	FbAddField(&recordBatch, 0, 8);
+	FbAddField(&recordBatch, 1, 4);
+	FbAddField(&recordBatch, 2, 4);
+	FbSetOffset(b, header, FbWriteTable(b, &recordBatch));
+	int64_t length = (int64_t)count;
+	FbPut(b, recordBatch.positions[0], &length, sizeof(length));
+	size_t nodes = FbWriteVector(b, (uint32_t)writer->numFields, 16, 8);
+	FbSetOffset(b, recordBatch.positions[1], nodes);
+	for (i = 0; i < writer->numFields; i++) FbPut(b, nodes + 4 + 16*i, &length, sizeof(length));
+	size_t buffers = FbWriteVector(b, (uint32_t)numBuffers, 16, 8);
+	FbSetOffset(b, recordBatch.positions[2], buffers);
+	for (i = 0; i < numBuffers; i++)
+	{
+		FbPut(b, buffers + 4 + 16*i, &bufferOffsets[i], sizeof(int64_t));
+		FbPut(b, buffers + 4 + 16*i + 8, &bufferLengths[i], sizeof(int64_t));
+	}
+
+	ArrowBlock block;
+	block.offset = writer->fileOffset;
+	block.metadataLength = WriteMessageMetadata(b, output);
+	block.bodyLength = (uint64_t)bodyLength;
+
+	//the body, straight from the column buffers
+	for (i = 0; i < writer->numFields; i++)
+	{
+		if (writer->fields[i].type == ARROW_CHAR)
+		{
+			//each non-NUL character is its own 1 character string, NULs are empty ones
+			const char *data = (const char *)columnData[i];
+			size_t offsetsLength = PadTo8((count + 1) * sizeof(int32_t));
+			int32_t *stringOffsets = (int32_t *)calloc(offsetsLength + PadTo8(count), 1);
+			char *characters = (char *)stringOffsets + offsetsLength;
+			int32_t numCharacters = 0;
+			for (j = 0; j < count; j++)
+			{
+				stringOffsets[j] = numCharacters;
+				characters[numCharacters] = data[j];
+				numCharacters += (data[j] != '\0');
+			}
+			stringOffsets[count] = numCharacters;
+			CsvWriterPutBytes(output, (const char *)stringOffsets, offsetsLength);
+			CsvWriterPutBytes(output, characters, PadTo8((size_t)numCharacters));
+			free(stringOffsets);
+		}
+		else
+		{
+			size_t dataLength = count * GetArrowTypeSize(writer->fields[i].type);
+			CsvWriterPutBytes(output, (const char *)columnData[i], dataLength);
+			CsvWriterPutBytes(output, (const char *)padding, PadTo8(dataLength) - dataLength);
+		}
+	}
+
+	if (writer->numBlocks == writer->blockCapacity)
+	{
+		writer->blockCapacity = (writer->blockCapacity == 0) ? 64 : writer->blockCapacity * 2;
+		writer->blocks = (ArrowBlock *)realloc(writer->blocks, writer->blockCapacity * sizeof(ArrowBlock));
+	}
+	writer->blocks[writer->numBlocks++] = block;
+	writer->fileOffset += block.metadataLength + block.bodyLength;
+
+	free(bufferOffsets);
+	free(bufferLengths);
+}
+
+void WriteArrowFooter(ArrowFileWriter *writer, CsvWriter *output)
+{
+	int i;
+	FlatBuilder *b = &writer->builder;
+
+	//end of the message stream
+	uint32_t endOfStream[2] = { 0xFFFFFFFF, 0 };
+	CsvWriterPutBytes(output, (const char *)endOfStream, sizeof(endOfStream));
+
+	//the Footer: the schema again, and a Block (offset, metadata length, body length) per record batch
+	int16_t version = ARROW_METADATA_V5;
+	FbReset(b);
+	size_t root = FbAppend(b, NULL, 4);
+	FlatTable footer = { 4, 0 };
+	FbAddField(&footer, 0, 2);
+	FbAddField(&footer, 1, 4);
+	FbAddField(&footer, 3, 4);
+	FbSetOffset(b, root, FbWriteTable(b, &footer));
+	FbPut(b, footer.positions[0], &version, sizeof(version));
+	FbSetOffset(b, footer.positions[1], FbWriteSchema(b, writer));
+	size_t blocks = FbWriteVector(b, (uint32_t)writer->numBlocks, 24, 8);
+	FbSetOffset(b, footer.positions[2], blocks);
+	for (i = 0; i < writer->numBlocks; i++)
+	{
+		int64_t offset = (int64_t)writer->blocks[i].offset;
+		int32_t metadataLength = (int32_t)writer->blocks[i].metadataLength;
+		int64_t bodyLength = (int64_t)writer->blocks[i].bodyLength;
+		FbPut(b, blocks + 4 + 24*i, &offset, sizeof(offset));
+		FbPut(b, blocks + 4 + 24*i + 8, &metadataLength, sizeof(metadataLength));
+		FbPut(b, blocks + 4 + 24*i + 16, &bodyLength, sizeof(bodyLength));
+	}
+
+	CsvWriterPutBytes(output, (const char *)b->data, b->length);
+	int32_t footerLength = (int32_t)b->length;
+	CsvWriterPutBytes(output, (const char *)&footerLength, sizeof(footerLength));
+	CsvWriterPutBytes(output, arrowSignature, 6);
+}
@@ -0,0 +1,86 @@
+//arrowwriter.h: writing columns of typed values as an Arrow IPC file (the Feather V2 format), without any text conversion
+//Copyright 2012, Allen Jordan, allen.jordan@gmail.com
+
+#ifndef ARROWWRITER_H
+#define ARROWWRITER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "csvwriter.h"
+
+//the column types that can be written, each value stored as is in native (little-endian) byte order
+typedef enum
+{
+	ARROW_INT8,
+	ARROW_INT16,
+	ARROW_INT32,
+	ARROW_FLOAT32,
+	ARROW_FLOAT64,
+	//single characters, written as 1 character UTF-8 strings (or empty ones for NUL characters)
+	ARROW_CHAR
+} ArrowColumnType;
+
+//key/value text pairs attached to the schema or a field (ex: units)
+typedef struct
+{
+	int count;
+	int capacity;
+	char **keys;
+	char **values;
+} ArrowMetadata;
+
+typedef struct
+{
+	char *name;
+	ArrowColumnType type;
+	ArrowMetadata metadata;
+} ArrowField;
+
+//a flatbuffer being built front to back (every offset to a child table, string or vector points forwards)
+typedef struct
+{
+	uint8_t *data;
+	size_t length;
+	size_t capacity;
+} FlatBuilder;
+
+//where a record batch message sits in the file, for the footer
+typedef struct
+{
+	uint64_t offset;
+	uint32_t metadataLength;
+	uint64_t bodyLength;
+} ArrowBlock;
+
+typedef struct
+{
+	int numFields;
+	ArrowField *fields;
+	ArrowMetadata metadata;
+
+	//bytes written to the file so far, and every record batch written, for the footer at the end
+	uint64_t fileOffset;
+	ArrowBlock *blocks;
+	int numBlocks;
+	int blockCapacity;
+
+	//reused for building each message's flatbuffer
+	FlatBuilder builder;
+} ArrowFileWriter;
+
+ArrowFileWriter *CreateArrowFileWriter(void);
+void FreeArrowFileWriter(ArrowFileWriter *writer);
+//add a column to the schema, returns its index
+int AddArrowField(ArrowFileWriter *writer, const char *name, ArrowColumnType type);
+//attach a key/value pair to a column (field >= 0) or to the whole file (field -1)
+void AddArrowMetadata(ArrowFileWriter *writer, int field, const char *key, const char *value);
+
+//write the file signature and the schema, once every field has been added
+void WriteArrowHeader(ArrowFileWriter *writer, CsvWriter *output);
+//write count rows of every column (columnData[i] points at count values of field i) as a record batch
+//batches have to be written out to the file in the order they're made
+void WriteArrowRecordBatch(ArrowFileWriter *writer, void * const *columnData, size_t count, CsvWriter *output);
+//write the end of stream marker and the footer indexing every record batch, finishing the file
+void WriteArrowFooter(ArrowFileWriter *writer, CsvWriter *output);
+
+#endif
@@ -0,0 +1,384 @@
+//batch.c: converting many input files, optionally in parallel on a pool of worker processes
+//Copyright 2012, Allen Jordan, allen.jordan@gmail.com
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "batch.h"
+
+void InitFileList(FileList *list)
+{
+	list->filenames = NULL;
+	list->count = 0;
+	list->capacity = 0;
+}
+
+void FreeFileList(FileList *list)
+{
+	int i;
+	for (i = 0; i < list->count; i++) free(list->filenames[i]);
+	free(list->filenames);
+	InitFileList(list);
+}
+
+void AddFileToList(FileList *list, const char *filename)
+{
+	if (list->count == list->capacity)
+	{
+		list->capacity = (list->capacity == 0) ? 64 : list->capacity * 2;
+		list->filenames = (char **)realloc(list->filenames, list->capacity * sizeof(char*));
+	}
+	list->filenames[list->count++] = strdup(filename);
+}
+
+int ReadFileManifest(FileList *list, const char *manifestFilename)
+{
+	FILE *manifest = (strcmp(manifestFilename, "-") == 0) ? stdin : fopen(manifestFilename, "r");
+	if (manifest == NULL)
+	{
+		printf("error: could not open file list: %s\n", manifestFilename);
+		return -1;
+	}
+
+	char *line = NULL;
+	size_t lineCapacity = 0;
+	ssize_t lineLength;
+	while ((lineLength = getline(&line, &lineCapacity, manifest)) >= 0)
+	{
+		//strip the line ending and any trailing whitespace
+		while (lineLength > 0 && (line[lineLength-1] == '\n' || line[lineLength-1] == '\r' || line[lineLength-1] == ' ' || line[lineLength-1] == '\t'))
+			line[--lineLength] = '\0';
+		if (lineLength == 0 || line[0] == '#') continue;
+		AddFileToList(list, line);
+	}
+	free(line);
+
+	if (manifest != stdin) fclose(manifest);
+	return 0;
+}
+
+//an input file and how its conversion went
+typedef struct
+{
+	int index;
+	off_t size;
+	int status;
+	int signal;
+} BatchFile;
+
+//sort largest first, so the long conversions start early and don't end up running alone at the end
+static int CompareFileSizeDescending(const void *a, const void *b)
+{
+	const BatchFile *fileA = (const BatchFile *)a;
+	const BatchFile *fileB = (const BatchFile *)b;
+	if (fileA->size != fileB->size) return (fileA->size > fileB->size) ? -1 : 1;
+	return fileA->index - fileB->index;
+}
+
+//read or write exactly length bytes, returns 0 on success or -1 on EOF/error
+static int ReadFully(int fd, void *buffer, size_t length)
+{
+	char *bytes = (char *)buffer;
+	while (length > 0)
+	{
+		ssize_t result = read(fd, bytes, length);
+		if (result < 0 && errno == EINTR) continue;
+		if (result <= 0) return -1;
+		bytes += result;
+		length -= (size_t)result;
+	}
+	return 0;
+}
+
+static int WriteFully(int fd, const void *buffer, size_t length)
+{
+	const char *bytes = (const char *)buffer;
+	while (length > 0)
+	{
+		ssize_t result = write(fd, bytes, length);
+		if (result < 0 && errno == EINTR) continue;
+		if (result <= 0) return -1;
+		bytes += result;
+		length -= (size_t)result;
+	}
+	return 0;
+}
+
+//main loop of a worker process: convert files until the command pipe is closed
+//each command is a filename, sent as its length and then its characters
+static void RunWorker(int commandFd, int resultFd, ConvertFileFunction convert, void *context, const BatchRecord *record)
+{
+	char *filename = NULL;
+	int32_t filenameCapacity = 0;
+	int32_t filenameLength;
+	while (ReadFully(commandFd, &filenameLength, sizeof(filenameLength)) == 0)
+	{
+		if (filenameLength < 0) break;
+		if (filenameLength >= filenameCapacity)
+		{
+			filenameCapacity = filenameLength + 1;
+			filename = (char *)realloc(filename, filenameCapacity);
+		}
+		if (ReadFully(commandFd, filename, filenameLength) != 0) break;
+		filename[filenameLength] = '\0';
+		
+		int32_t status = convert(filename, context);
+		fflush(stdout);
+		if (WriteFully(resultFd, &status, sizeof(status)) != 0) break;
+		//the file's record follows its status
+		if (record != NULL && WriteFully(resultFd, record->data, record->size) != 0) break;
+	}
+	free(filename);
+}
+
+static int StartWorker(WorkerPool *pool, int workerIndex)
+{
+	int commandPipe[2], resultPipe[2];
+	if (pipe(commandPipe) != 0) return -1;
+	if (pipe(resultPipe) != 0)
+	{
+		close(commandPipe[0]);
+		close(commandPipe[1]);
+		return -1;
+	}
+
+	//flush first so buffered console output isn't duplicated in the child
+	fflush(stdout);
+	pid_t pid = fork();
+	if (pid < 0)
+	{
+		close(commandPipe[0]);
+		close(commandPipe[1]);
+		close(resultPipe[0]);
+		close(resultPipe[1]);
+		return -1;
+	}
+
+	if (pid == 0)
+	{
+		//close the parent's ends of every other worker's pipes, so they see EOF when the parent closes them
+		int i;
+		for (i = 0; i < pool->numWorkers; i++)
+		{
+			if (i == workerIndex || pool->workers[i].pid <= 0) continue;
+			close(pool->workers[i].commandFd);
+			close(pool->workers[i].resultFd);
+		}
+		close(commandPipe[1]);
+		close(resultPipe[0]);
+		RunWorker(commandPipe[0], resultPipe[1], pool->convert, pool->context, pool->record);
+		fflush(stdout);
+		_exit(0);
+	}
+
+	close(commandPipe[0]);
+	close(resultPipe[1]);
+	Worker *worker = &pool->workers[workerIndex];
+	worker->pid = pid;
+	worker->commandFd = commandPipe[1];
+	worker->resultFd = resultPipe[0];
+	worker->busyFile = -1;
+	return 0;
+}
+
+static void StopWorker(Worker *worker, int *signalOut)
+{
+	int waitStatus = 0;
+	close(worker->commandFd);
+	close(worker->resultFd);
+	waitpid(worker->pid, &waitStatus, 0);
+	if (signalOut != NULL) *signalOut = WIFSIGNALED(waitStatus) ? WTERMSIG(waitStatus) : 0;
+	worker->pid = 0;
+	worker->busyFile = -1;
+}
+
+void InitWorkerPool(WorkerPool *pool, int numWorkers, ConvertFileFunction convert, void *context, const BatchRecord *record)
+{
+	pool->numWorkers = numWorkers;
+	pool->workers = (Worker *)calloc(numWorkers, sizeof(Worker));
+	pool->convert = convert;
+	pool->context = context;
+	pool->record = record;
+	pool->recordData = (record != NULL) ? malloc(record->size) : NULL;
+	//a worker that died has its pipes closed, writing to them must fail rather than kill the whole batch
+	pool->previousPipeHandler = signal(SIGPIPE, SIG_IGN);
+}
+
+int SubmitPoolFile(WorkerPool *pool, const char *filename, int tag)
+{
+	int i;
+	int32_t filenameLength = (int32_t)strlen(filename);
+	for (i = 0; i < pool->numWorkers; i++)
+	{
+		Worker *worker = &pool->workers[i];
+		if (worker->pid <= 0 && StartWorker(pool, i) != 0)
+		{
+			perror("error: could not start a worker process");
+			continue;
+		}
+		if (worker->busyFile >= 0) continue;
+		if (WriteFully(worker->commandFd, &filenameLength, sizeof(filenameLength)) != 0 ||
+			WriteFully(worker->commandFd, filename, filenameLength) != 0)
+		{
+			StopWorker(worker, NULL);
+			continue;
+		}
+		worker->busyFile = tag;
+		return i;
+	}
+	return -1;
+}
+
+int GetPoolPollList(const WorkerPool *pool, struct pollfd *pollList, int *pollWorkers)
+{
+	int i;
+	int numPolled = 0;
+	for (i = 0; i < pool->numWorkers; i++)
+	{
+		if (pool->workers[i].pid <= 0 || pool->workers[i].busyFile < 0) continue;
+		pollList[numPolled].fd = pool->workers[i].resultFd;
+		pollList[numPolled].events = POLLIN;
+		pollList[numPolled].revents = 0;
+		pollWorkers[numPolled++] = i;
+	}
+	return numPolled;
+}
+
+void ReadPoolResult(WorkerPool *pool, int workerIndex, int *tag, int *status, int *deathSignal)
+{
+	Worker *worker = &pool->workers[workerIndex];
+	const BatchRecord *record = pool->record;
+	*tag = worker->busyFile;
+	*deathSignal = 0;
+	int32_t result;
+	if (ReadFully(worker->resultFd, &result, sizeof(result)) == 0 &&
+		(record == NULL || ReadFully(worker->resultFd, pool->recordData, record->size) == 0))
+	{
+		*status = result;
+		worker->busyFile = -1;
+		if (record != NULL) record->collect(pool->recordData, record->collectContext);
+	}
+	else
+	{
+		//the worker died part way through this file, only this file fails and the worker is restarted for the next one
+		*status = BATCH_WORKER_DIED;
+		StopWorker(worker, deathSignal);
+	}
+}
+
+void StopWorkerPool(WorkerPool *pool)
+{
+	int i;
+	for (i = 0; i < pool->numWorkers; i++)
+	{
+		if (pool->workers[i].pid > 0) StopWorker(&pool->workers[i], NULL);
+	}
+	signal(SIGPIPE, pool->previousPipeHandler);
+	free(pool->recordData);
+	free(pool->workers);
+	pool->workers = NULL;
+	pool->numWorkers = 0;
+}
+
+static void RunFilesInParallel(const FileList *list, BatchFile *queue, int numJobs, ConvertFileFunction convert, void *context,
+	const BatchRecord *record)
+{
+	int i;
+	WorkerPool pool;
+	InitWorkerPool(&pool, numJobs, convert, context, record);
+	struct pollfd *pollList = (struct pollfd *)malloc(numJobs * sizeof(struct pollfd));
+	int *pollWorkers = (int *)malloc(numJobs * sizeof(int));
+
+	int nextFile = 0, numFinished = 0;
+	while (numFinished < list->count)
+	{
+		//hand the next largest files out to idle workers, starting (or restarting) workers as needed
+		while (nextFile < list->count && SubmitPoolFile(&pool, list->filenames[queue[nextFile].index], nextFile) >= 0)
+			nextFile++;
+
+		//wait for any busy worker to finish its file
+		int numPolled = GetPoolPollList(&pool, pollList, pollWorkers);
+		if (numPolled == 0)
+		{
+			//no worker could be started at all, so fail whatever is left
+			puts("error: no worker processes available");
+			for (; nextFile < list->count; nextFile++, numFinished++) queue[nextFile].status = -1;
+			break;
+		}
+		if (poll(pollList, numPolled, -1) < 0)
+		{
+			if (errno == EINTR) continue;
+			perror("poll");
+			break;
+		}
+
+		for (i = 0; i < numPolled; i++)
+		{
+			if (pollList[i].revents == 0) continue;
+			int fileIndex, status, deathSignal;
+			ReadPoolResult(&pool, pollWorkers[i], &fileIndex, &status, &deathSignal);
+			queue[fileIndex].status = status;
+			queue[fileIndex].signal = deathSignal;
+			numFinished++;
+		}
+	}
+
+	StopWorkerPool(&pool);
+	free(pollWorkers);
+	free(pollList);
+}
+
+int RunBatch(const FileList *list, int numJobs, ConvertFileFunction convert, void *context, const BatchRecord *record,
+	int *statuses)
+{
+	int i;
+	BatchFile *queue = (BatchFile *)malloc(list->count * sizeof(BatchFile));
+	for (i = 0; i < list->count; i++)
+	{
+		struct stat fileInfo;
+		queue[i].index = i;
+		queue[i].size = (stat(list->filenames[i], &fileInfo) == 0) ? fileInfo.st_size : 0;
+		queue[i].status = 0;
+		queue[i].signal = 0;
+	}
+
+	if (numJobs > list->count) numJobs = list->count;
+	if (numJobs <= 1)
+	{
+		//convert in this process, in the order given
+		for (i = 0; i < list->count; i++)
+		{
+			queue[i].status = convert(list->filenames[i], context);
+			if (record != NULL) record->collect(record->data, record->collectContext);
+		}
+	}
+	else
+	{
+		qsort(queue, list->count, sizeof(BatchFile), CompareFileSizeDescending);
+		RunFilesInParallel(list, queue, numJobs, convert, context, record);
+	}
+
+	//report every file that failed
+	int numFailed = 0;
+	for (i = 0; i < list->count; i++)
+	{
+		if (statuses != NULL) statuses[queue[i].index] = queue[i].status;
+		if (queue[i].status == 0) continue;
+		numFailed++;
+		const char *filename = list->filenames[queue[i].index];
+		if (queue[i].status == BATCH_WORKER_DIED) printf("failed: %s (worker died, signal %d)\n", filename, queue[i].signal);
+		else printf("failed: %s (status %d)\n", filename, queue[i].status);
+	}
+	if (list->count > 1) printf("converted %d of %d files, %d failed\n", list->count - numFailed, list->count, numFailed);
+
+	free(queue);
+	return numFailed;
+}
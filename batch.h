@@ -0,0 +1,88 @@
+//batch.h: converting many input files, optionally in parallel on a pool of worker processes
+//Copyright 2012, Allen Jordan, allen.jordan@gmail.com
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <poll.h>
+#include <sys/types.h>
+
+//converts a single file, returning 0 on success or a nonzero error status (ex: a NetCDF error code)
+typedef int (*ConvertFileFunction)(const char *filename, void *context);
+
+//a fixed-size record the convert function fills in for each file besides its status (ex: timings)
+//worker processes send it back along with the status, so the parent sees every file's record either way
+typedef struct
+{
+	//where the convert function leaves it
+	void *data;
+	size_t size;
+	//called in the parent after each file with its record (not for a file whose worker died part way through it)
+	void (*collect)(const void *data, void *collectContext);
+	void *collectContext;
+} BatchRecord;
+
+//status recorded for a file whose worker process died (crashed) while converting it
+#define BATCH_WORKER_DIED	-10000
+
+//a growing list of input filenames
+typedef struct
+{
+	char **filenames;
+	int count;
+	int capacity;
+} FileList;
+
+void InitFileList(FileList *list);
+void FreeFileList(FileList *list);
+void AddFileToList(FileList *list, const char *filename);
+//add every filename listed in a manifest file (one per line, blank lines and # comments skipped)
+//a manifest name of "-" reads the list from stdin, returns 0 on success or -1 if the manifest couldn't be read
+int ReadFileManifest(FileList *list, const char *manifestFilename);
+
+//a forked worker process, fed filenames over its command pipe and answering with statuses on its result pipe
+typedef struct
+{
+	pid_t pid;
+	int commandFd;
+	int resultFd;
+	//tag of the file being converted (ex: its position in the queue), or -1 if idle
+	int busyFile;
+} Worker;
+
+//a pool of worker processes that stay up from one file to the next, each converting a file at a time
+//(libnetcdf isn't thread-safe, and a crash while converting one file only takes down its own worker)
+typedef struct
+{
+	int numWorkers;
+	Worker *workers;
+	ConvertFileFunction convert;
+	void *context;
+	const BatchRecord *record;
+	//where a worker's record is read into before it's collected
+	void *recordData;
+	//put back once the pool is stopped
+	void (*previousPipeHandler)(int);
+} WorkerPool;
+
+//set up a pool of numWorkers workers, which are started as the first files are handed to them
+void InitWorkerPool(WorkerPool *pool, int numWorkers, ConvertFileFunction convert, void *context, const BatchRecord *record);
+//hand a file to an idle worker, starting (or restarting) workers as needed, tag (>= 0) identifies the file once it's done
+//returns the index of the worker converting it, or -1 if every worker is busy or none could be started
+int SubmitPoolFile(WorkerPool *pool, const char *filename, int tag);
+//fill in a poll entry for the result pipe of each busy worker, and the index of the worker it belongs to
+//returns the number of entries filled in (one per busy worker)
+int GetPoolPollList(const WorkerPool *pool, struct pollfd *pollList, int *pollWorkers);
+//read the result of a worker whose result pipe polled ready, collecting its record, and set the tag and status of its file
+//a worker that died part way through gives BATCH_WORKER_DIED, with the signal that killed it in deathSignal (0 otherwise)
+void ReadPoolResult(WorkerPool *pool, int workerIndex, int *tag, int *status, int *deathSignal);
+//stop every worker, waiting for any busy one to finish its file (its result is dropped)
+void StopWorkerPool(WorkerPool *pool);
+
+//convert every file in the list and print a summary of any failures, returns the number of files that failed
+//with numJobs > 1 the files are handed out largest first to a pool of numJobs worker processes
+//record is NULL if the conversions don't fill one in, statuses (if not NULL) gets each file's status in list order
+int RunBatch(const FileList *list, int numJobs, ConvertFileFunction convert, void *context, const BatchRecord *record,
+	int *statuses);
+
+#endif
@@ -0,0 +1,443 @@
+//benchconvert.c: benchmarks nc2csv and rs92nc2fltdat on synthetic NetCDF files, one JSON line per run
+//Copyright 2012, Allen Jordan, allen.jordan@gmail.com
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include "synthetic.h"
+
+#define MAX_MODES		16
+#define MAX_MODE_ARGS	32
+
+//the runs made over each file: converter options, and which converter they're for
+typedef struct
+{
+	const char *args;
+	int rs92;
+	//only for classic and 64-bit offset files (ex: --no-mmap does nothing for NetCDF-4)
+	int classicOnly;
+} BenchMode;
+
+static const BenchMode defaultModes[] =
+{
+	{ "", 0, 0 },
+	{ "--pipeline", 0, 0 },
+	{ "--no-mmap", 0, 1 },
+	{ "--format arrow", 0, 0 },
+	{ "--gzip", 0, 0 },
+	{ "", 1, 0 },
+	{ "--no-mmap", 1, 1 },
+	{ "--gzip", 1, 0 }
+};
+#define NUM_DEFAULT_MODES	((int)(sizeof(defaultModes)/sizeof(BenchMode)))
+
+//what one run measured, per-phase times are negative when the converter didn't report them
+typedef struct
+{
+	int status;
+	double wall, user, system;
+	long peakRSSKB;
+	long long outputBytes;
+	double readSeconds, formatSeconds, writeSeconds;
+} BenchResult;
+
+static double GetSeconds(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static long long GetFileSize(const char *filename)
+{
+	struct stat info;
+	if (stat(filename, &info) != 0) return -1;
+	return (long long)info.st_size;
+}
+
+//the files a converter can write for an input, next to it
+static const char *outputSuffixes[] = { ".csv", ".csv.gz", ".arrow", "flt.dat", "flt.dat.gz" };
+#define NUM_OUTPUT_SUFFIXES	((int)(sizeof(outputSuffixes)/sizeof(char*)))
+
+static void GetOutputName(const char *inputFilename, int suffix, char *name, size_t nameSize)
+{
+	//drop the .nc extension like the converters do
+	size_t baseLength = strlen(inputFilename);
+	if (baseLength > 3 && strcmp(inputFilename + baseLength - 3, ".nc") == 0) baseLength -= 3;
+	snprintf(name, nameSize, "%.*s%s", (int)baseLength, inputFilename, outputSuffixes[suffix]);
+}
+
+static void RemoveOutputs(const char *inputFilename)
+{
+	int s;
+	for (s = 0; s < NUM_OUTPUT_SUFFIXES; s++)
+	{
+		char name[4096];
+		GetOutputName(inputFilename, s, name, sizeof(name));
+		unlink(name);
+	}
+}
+
+//get the number a JSON object's key holds, leaving seconds alone if it doesn't have one
+static void GetJSONSeconds(const char *object, const char *key, double *seconds)
+{
+	char quotedKey[64];
+	snprintf(quotedKey, sizeof(quotedKey), "\"%s\":", key);
+	const char *value = strstr(object, quotedKey);
+	if (value == NULL) return;
+	value += strlen(quotedKey);
+	char *end;
+	double parsed = strtod(value, &end);
+	if (end != value) *seconds = parsed;
+}
+
+//pick the per-phase times out of the file stats line a converter writes with --stats (in its log, with its console output)
+static void ParsePhaseTimes(const char *logFilename, BenchResult *result)
+{
+	FILE *log = fopen(logFilename, "r");
+	if (log == NULL) return;
+	char *line = NULL;
+	size_t lineCapacity = 0;
+	while (getline(&line, &lineCapacity, log) >= 0)
+	{
+		//(the console output around it isn't line buffered, so the stats can start part way through a line)
+		const char *stats = strstr(line, "{\"file\":");
+		if (stats == NULL) continue;
+		const char *phases = strstr(stats, "\"phases\":{");
+		if (phases == NULL) continue;
+		GetJSONSeconds(phases, "read_s", &result->readSeconds);
+		GetJSONSeconds(phases, "format_s", &result->formatSeconds);
+		GetJSONSeconds(phases, "write_s", &result->writeSeconds);
+	}
+	free(line);
+	fclose(log);
+}
+
+//run a converter over one file, with its console output going to logFilename
+static void RunConverter(const char *converter, const char *modeArgs, const char *inputFilename, const char *logFilename,
+	BenchResult *result)
+{
+	memset(result, 0, sizeof(BenchResult));
+	result->readSeconds = result->formatSeconds = result->writeSeconds = -1;
+	result->outputBytes = -1;
+	RemoveOutputs(inputFilename);
+
+	//split the mode into arguments on spaces, after --stats for the phase times
+	char argsCopy[1024];
+	snprintf(argsCopy, sizeof(argsCopy), "%s", modeArgs);
+	char *argv[MAX_MODE_ARGS + 4];
+	int argc = 0;
+	argv[argc++] = (char *)converter;
+	argv[argc++] = "--stats";
+	char *token = strtok(argsCopy, " ");
+	while (token != NULL && argc < MAX_MODE_ARGS + 1)
+	{
+		argv[argc++] = token;
+		token = strtok(NULL, " ");
+	}
+	argv[argc++] = (char *)inputFilename;
+	argv[argc] = NULL;
+
+	double startTime = GetSeconds();
+	pid_t pid = fork();
+	if (pid == 0)
+	{
+		int logFD = open(logFilename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (logFD >= 0)
+		{
+			dup2(logFD, STDOUT_FILENO);
+			dup2(logFD, STDERR_FILENO);
+			close(logFD);
+		}
+		execv(converter, argv);
+		_exit(127);
+	}
+	if (pid < 0)
+	{
+		result->status = -1;
+		return;
+	}
+	int waitStatus;
+	struct rusage usage;
+	if (wait4(pid, &waitStatus, 0, &usage) < 0)
+	{
+		result->status = -1;
+		return;
+	}
+	result->wall = GetSeconds() - startTime;
+	result->status = WIFEXITED(waitStatus) ? WEXITSTATUS(waitStatus) : -1;
+	result->user = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6;
+	result->system = usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+	result->peakRSSKB = usage.ru_maxrss;
+
+	int s;
+	for (s = 0; s < NUM_OUTPUT_SUFFIXES && result->outputBytes < 0; s++)
+	{
+		char name[4096];
+		GetOutputName(inputFilename, s, name, sizeof(name));
+		result->outputBytes = GetFileSize(name);
+	}
+	ParsePhaseTimes(logFilename, result);
+	RemoveOutputs(inputFilename);
+}
+
+static void PrintSeconds(const char *key, double seconds)
+{
+	if (seconds < 0) printf(",\"%s\":null", key);
+	else printf(",\"%s\":%.4f", key, seconds);
+}
+
+//write a run as one JSON object on its own line
+static void PrintResult(const char *converter, const char *caseName, const SyntheticSpec *spec, const char *modeArgs,
+	long long inputBytes, const BenchResult *result)
+{
+	const char *formatName = (spec->format == NC_FORMAT_NETCDF4) ? "netcdf4" : (spec->format == NC_FORMAT_64BIT) ? "64bit" : "classic";
+	printf("{\"converter\":\"%s\",\"case\":\"%s\",\"format\":\"%s\",\"deflate\":%d,\"record\":%d,\"rows\":%zu,\"vars\":%d",
+		converter, caseName, formatName, spec->deflateLevel, spec->record, spec->numRows, spec->numVars);
+	//(mode arguments are plain options, with no quotes or backslashes to escape)
+	printf(",\"args\":\"%s\",\"status\":%d,\"input_bytes\":%lld,\"output_bytes\":%lld", modeArgs, result->status,
+		inputBytes, result->outputBytes);
+	PrintSeconds("wall_s", result->wall);
+	PrintSeconds("user_s", result->user);
+	PrintSeconds("sys_s", result->system);
+	double wall = (result->wall > 0) ? result->wall : 1e-9;
+	printf(",\"rows_per_s\":%.0f,\"mb_out_per_s\":%.2f,\"peak_rss_kb\":%ld", spec->numRows / wall,
+		(result->outputBytes > 0) ? result->outputBytes / 1e6 / wall : 0.0, result->peakRSSKB);
+	PrintSeconds("read_s", result->readSeconds);
+	PrintSeconds("format_s", result->formatSeconds);
+	PrintSeconds("write_s", result->writeSeconds);
+	printf("}\n");
+	fflush(stdout);
+}
+
+void PrintUsage()
+{
+	puts("usage: benchconvert [options]");
+	puts("runs nc2csv and rs92nc2fltdat over synthetic NetCDF files, printing one JSON line per run to stdout");
+	puts("with none of the file shape options, a built-in suite of files is run");
+	puts("  --rows N            rows per file (default 1000000, also applies to the built-in suite)");
+	puts("  --vars N            number of generic variables (default 8)");
+	puts("  --type TYPE         byte, short, int, float, double or mixed (default float)");
+	puts("  --format FORMAT     classic, 64bit or netcdf4 (default classic)");
+	puts("  --deflate N         zlib level for NetCDF-4 variables (default 0, none)");
+	puts("  --record            make the dimension unlimited, so the variables are record variables");
+	puts("  --rs92              add the RS-92 variables, so rs92nc2fltdat can convert the file too");
+	puts("  --mode ARGS         run nc2csv with these options (repeatable, replaces the default modes)");
+	puts("  --repeat N          run each conversion N times and report the fastest (default 3)");
+	puts("  --bin-dir DIR       where the converters are (default .)");
+	puts("  --data-dir DIR      where the synthetic files are kept between runs (default benchdata)");
+	puts("  --regenerate        write the synthetic files again even if they already exist");
+	puts("  --generate FILE     just write a synthetic file with the shape options, and exit");
+}
+
+static int ParseType(const char *name, nc_type *type)
+{
+	if (strcmp(name, "byte") == 0) *type = NC_BYTE;
+	else if (strcmp(name, "short") == 0) *type = NC_SHORT;
+	else if (strcmp(name, "int") == 0) *type = NC_INT;
+	else if (strcmp(name, "float") == 0) *type = NC_FLOAT;
+	else if (strcmp(name, "double") == 0) *type = NC_DOUBLE;
+	else if (strcmp(name, "mixed") == 0) *type = NC_NAT;
+	else return -1;
+	return 0;
+}
+
+static int ParseFormat(const char *name, int *format)
+{
+	if (strcmp(name, "classic") == 0) *format = NC_FORMAT_CLASSIC;
+	else if (strcmp(name, "64bit") == 0) *format = NC_FORMAT_64BIT;
+	else if (strcmp(name, "netcdf4") == 0 || strcmp(name, "nc4") == 0) *format = NC_FORMAT_NETCDF4;
+	else return -1;
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	SyntheticSpec custom;
+	InitSyntheticSpec(&custom);
+	int customShape = 0;
+	BenchMode modes[MAX_MODES];
+	int numModes = 0;
+	int repeat = 3;
+	const char *binDir = ".";
+	const char *dataDir = "benchdata";
+	const char *generateFilename = NULL;
+	int regenerate = 0;
+
+	int argIndex;
+	for (argIndex = 1; argIndex < argc; argIndex++)
+	{
+		char *arg = argv[argIndex];
+		int hasValue = (argIndex+1 < argc);
+		if (strcmp(arg, "--rows") == 0 && hasValue) custom.numRows = strtoull(argv[++argIndex], NULL, 10);
+		else if (strcmp(arg, "--vars") == 0 && hasValue)
+		{
+			custom.numVars = atoi(argv[++argIndex]);
+			customShape = 1;
+		}
+		else if (strcmp(arg, "--type") == 0 && hasValue)
+		{
+			if (ParseType(argv[++argIndex], &custom.type) != 0)
+			{
+				printf("error: unknown --type: %s\n", argv[argIndex]);
+				return -1;
+			}
+			customShape = 1;
+		}
+		else if (strcmp(arg, "--format") == 0 && hasValue)
+		{
+			if (ParseFormat(argv[++argIndex], &custom.format) != 0)
+			{
+				printf("error: unknown --format: %s\n", argv[argIndex]);
+				return -1;
+			}
+			customShape = 1;
+		}
+		else if (strcmp(arg, "--deflate") == 0 && hasValue)
+		{
+			custom.deflateLevel = atoi(argv[++argIndex]);
+			customShape = 1;
+		}
+		else if (strcmp(arg, "--record") == 0) custom.record = customShape = 1;
+		else if (strcmp(arg, "--rs92") == 0) custom.rs92 = customShape = 1;
+		else if (strcmp(arg, "--mode") == 0 && hasValue)
+		{
+			if (numModes == MAX_MODES)
+			{
+				printf("error: at most %d --mode options\n", MAX_MODES);
+				return -1;
+			}
+			modes[numModes].args = argv[++argIndex];
+			modes[numModes].rs92 = 0;
+			modes[numModes].classicOnly = 0;
+			numModes++;
+		}
+		else if (strcmp(arg, "--repeat") == 0 && hasValue) repeat = atoi(argv[++argIndex]);
+		else if (strcmp(arg, "--bin-dir") == 0 && hasValue) binDir = argv[++argIndex];
+		else if (strcmp(arg, "--data-dir") == 0 && hasValue) dataDir = argv[++argIndex];
+		else if (strcmp(arg, "--regenerate") == 0) regenerate = 1;
+		else if (strcmp(arg, "--generate") == 0 && hasValue) generateFilename = argv[++argIndex];
+		else if (strcmp(arg, "--help") == 0 || strcmp(arg, "-h") == 0)
+		{
+			PrintUsage();
+			return 0;
+		}
+		else
+		{
+			printf("error: unknown option: %s\n", arg);
+			PrintUsage();
+			return -1;
+		}
+	}
+	if (repeat < 1 || custom.numVars < 0 || custom.deflateLevel < 0 || custom.deflateLevel > 9)
+	{
+		puts("error: invalid --repeat, --vars or --deflate");
+		return -1;
+	}
+
+	if (generateFilename != NULL)
+	{
+		int status = GenerateSyntheticFile(&custom, generateFilename);
+		if (status != NC_NOERR) printf("error: could not write %s (%s)\n", generateFilename, nc_strerror(status));
+		return status;
+	}
+
+	//the built-in suite: each format and variable layout, plain and compressed NetCDF-4, and RS-92 soundings
+	SyntheticSpec cases[8];
+	int numCases = 0;
+	if (customShape) cases[numCases++] = custom;
+	else
+	{
+		int c;
+		for (c = 0; c < 6; c++)
+		{
+			InitSyntheticSpec(&cases[c]);
+			cases[c].numRows = custom.numRows;
+		}
+		cases[1].format = NC_FORMAT_64BIT;
+		cases[1].type = NC_NAT;
+		cases[1].record = 1;
+		cases[2].format = NC_FORMAT_NETCDF4;
+		cases[3].format = NC_FORMAT_NETCDF4;
+		cases[3].type = NC_NAT;
+		cases[3].deflateLevel = 1;
+		cases[4].rs92 = 1;
+		cases[4].numVars = 0;
+		cases[5].rs92 = 1;
+		cases[5].numVars = 0;
+		cases[5].format = NC_FORMAT_NETCDF4;
+		cases[5].deflateLevel = 1;
+		numCases = 6;
+	}
+	if (numModes == 0)
+	{
+		memcpy(modes, defaultModes, sizeof(defaultModes));
+		numModes = NUM_DEFAULT_MODES;
+	}
+
+	mkdir(dataDir, 0755);
+	char nc2csvPath[4096], rs92Path[4096];
+	snprintf(nc2csvPath, sizeof(nc2csvPath), "%s/nc2csv", binDir);
+	snprintf(rs92Path, sizeof(rs92Path), "%s/rs92nc2fltdat", binDir);
+
+	int numFailed = 0;
+	int c, m, r;
+	for (c = 0; c < numCases; c++)
+	{
+		const SyntheticSpec *spec = &cases[c];
+		char caseName[256], inputFilename[4096], logFilename[4096];
+		GetSyntheticName(spec, caseName, sizeof(caseName));
+		snprintf(inputFilename, sizeof(inputFilename), "%s/%s.nc", dataDir, caseName);
+		snprintf(logFilename, sizeof(logFilename), "%s/%s.log", dataDir, caseName);
+
+		if (regenerate || GetFileSize(inputFilename) < 0)
+		{
+			fprintf(stderr, "generating %s\n", inputFilename);
+			int status = GenerateSyntheticFile(spec, inputFilename);
+			if (status != NC_NOERR)
+			{
+				fprintf(stderr, "error: could not write %s (%s)\n", inputFilename, nc_strerror(status));
+				unlink(inputFilename);
+				numFailed++;
+				continue;
+			}
+		}
+		long long inputBytes = GetFileSize(inputFilename);
+		int caseFailed = 0;
+
+		for (m = 0; m < numModes; m++)
+		{
+			const BenchMode *mode = &modes[m];
+			if (mode->rs92 && !spec->rs92) continue;
+			if (mode->classicOnly && spec->format == NC_FORMAT_NETCDF4) continue;
+			const char *converter = mode->rs92 ? rs92Path : nc2csvPath;
+			fprintf(stderr, "running %s %s on %s\n", converter, mode->args, caseName);
+
+			//report the fastest of the repeats (the input is in the page cache after the first)
+			BenchResult best, result;
+			memset(&best, 0, sizeof(best));
+			for (r = 0; r < repeat; r++)
+			{
+				RunConverter(converter, mode->args, inputFilename, logFilename, &result);
+				if (r == 0 || result.status != 0 || (best.status == 0 && result.wall < best.wall)) best = result;
+				if (result.status != 0) break;
+			}
+			if (best.status != 0)
+			{
+				fprintf(stderr, "error: conversion failed with status %d, see %s\n", best.status, logFilename);
+				caseFailed = 1;
+				numFailed++;
+			}
+			PrintResult(mode->rs92 ? "rs92nc2fltdat" : "nc2csv", caseName, spec, mode->args, inputBytes, &best);
+		}
+		//(the log of a failed conversion is kept)
+		if (!caseFailed) unlink(logFilename);
+	}
+	return (numFailed == 0) ? 0 : 1;
+}
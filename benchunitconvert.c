@@ -0,0 +1,187 @@
+//benchunitconvert.c: times the scalar and vector unit conversion, masking and summing kernels against each other and checks
+//they agree
+//Copyright 2012, Allen Jordan, allen.jordan@gmail.com
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include <math.h>
+#include "unitconvert.h"
+
+//values per column, and passes over them per timing
+#define BENCH_VALUES		(4*1024*1024)
+#define BENCH_PASSES		8
+//bytes between values of the strided swap, as for a record variable in a file with 6 float record variables
+#define BENCH_RECORD_SIZE	24
+
+static double GetSeconds(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+//big-endian floats like the ones in an RS-92 sounding, stride bytes apart
+static void FillBigEndian(unsigned char *bytes, size_t stride, size_t count)
+{
+	size_t i;
+	for (i = 0; i < count; i++)
+	{
+		float value = (float)(200.0 + (rand() % 1000000) / 7.0);
+		uint32_t word;
+		memcpy(&word, &value, sizeof(word));
+		word = __builtin_bswap32(word);
+		memcpy(bytes + i*stride, &word, sizeof(word));
+	}
+}
+
+//the conversions rs92nc2fltdat makes
+static const UnitConversion benchConversions[] =
+{
+	{ 1, 60, 0, 0 },
+	{ 1, 1000, 0, 1 },
+	{ 100, 1, 0, 1 },
+	{ 1, 1, -273.15, 0 }
+};
+static const char *benchConversionNames[] = { "/60.0", "/1000f", "*100f", "-273.15" };
+#define NUM_BENCH_CONVERSIONS	((int)(sizeof(benchConversions)/sizeof(UnitConversion)))
+
+//CF decoding of the same values, masking a valid range and a fill value that's there, then unpacking the floats
+static const ValueMask benchMask = { 300.0, 100000.0, 1000.0, NAN };
+#define BENCH_SCALE		0.01f
+#define BENCH_OFFSET	-40.0f
+
+//mask and unpack count floats the way --cf-decode does, starting from a copy of values
+static void DecodeFloats(const float *values, size_t count, float *decoded)
+{
+	memcpy(decoded, values, count * sizeof(float));
+	MaskFloatColumn(decoded, count, &benchMask);
+	ScaleFloatColumn(decoded, count, BENCH_SCALE, BENCH_OFFSET);
+}
+
+//sum up the masked doubles the way --bin-rows and --bin do, the count leaves a tail after the last full set of lanes
+#define BENCH_SUMMED	(BENCH_VALUES - 3)
+static void SummarizeDoubles(const double *values, ColumnSummary *summary, double *squaredDeviations)
+{
+	SummarizeDoubleColumn(values, BENCH_SUMMED, summary);
+	*squaredDeviations = SumSquaredDeviations(values, BENCH_SUMMED, summary->sum / summary->count);
+}
+
+int main(void)
+{
+	int status = 0;
+	int path, i, pass;
+
+	unsigned char *contiguous = (unsigned char *)malloc(BENCH_VALUES * sizeof(float));
+	unsigned char *strided = (unsigned char *)malloc((size_t)BENCH_VALUES * BENCH_RECORD_SIZE);
+	float *values = (float *)malloc(BENCH_VALUES * sizeof(float));
+	float *scalarValues = (float *)malloc(BENCH_VALUES * sizeof(float));
+	float *scalarStridedValues = (float *)malloc(BENCH_VALUES * sizeof(float));
+	double *converted = (double *)malloc(BENCH_VALUES * sizeof(double));
+	double *scalarConverted = (double *)malloc(BENCH_VALUES * NUM_BENCH_CONVERSIONS * sizeof(double));
+	float *scalarDecoded = (float *)malloc(BENCH_VALUES * sizeof(float));
+	double *scalarMasked = (double *)malloc(BENCH_VALUES * sizeof(double));
+	if (contiguous == NULL || strided == NULL || values == NULL || scalarValues == NULL || scalarStridedValues == NULL ||
+		converted == NULL || scalarConverted == NULL || scalarDecoded == NULL || scalarMasked == NULL)
+	{
+		puts("error: out of memory");
+		status = -1;
+		goto cleanup;
+	}
+
+	srand(1);
+	FillBigEndian(contiguous, sizeof(float), BENCH_VALUES);
+	FillBigEndian(strided, BENCH_RECORD_SIZE, BENCH_VALUES);
+
+	printf("%d values, %d passes, times in ns per value\n", BENCH_VALUES, BENCH_PASSES);
+	printf("%-8s %10s %10s", "path", "swap", "swap rec");
+	for (i = 0; i < NUM_BENCH_CONVERSIONS; i++) printf(" %10s", benchConversionNames[i]);
+	printf(" %10s %10s %10s\n", "cf float", "mask dbl", "summary");
+
+	//the results of the scalar path, the others are checked against them bit for bit
+	SetConvertPath(CONVERT_SCALAR);
+	SwapFloatColumn(contiguous, sizeof(float), BENCH_VALUES, scalarValues);
+	SwapFloatColumn(strided, BENCH_RECORD_SIZE, BENCH_VALUES, scalarStridedValues);
+	for (i = 0; i < NUM_BENCH_CONVERSIONS; i++)
+		ConvertFloatColumn(scalarValues, BENCH_VALUES, &benchConversions[i], scalarConverted + (size_t)i*BENCH_VALUES);
+	DecodeFloats(scalarValues, BENCH_VALUES, scalarDecoded);
+	memcpy(scalarMasked, scalarConverted, BENCH_VALUES * sizeof(double));
+	MaskDoubleColumn(scalarMasked, BENCH_VALUES, &benchMask);
+	ColumnSummary scalarSummary, summary;
+	double scalarDeviations, deviations;
+	SummarizeDoubles(scalarMasked, &scalarSummary, &scalarDeviations);
+
+	for (path = CONVERT_SCALAR; path < NUM_CONVERT_PATHS; path++)
+	{
+		if (SetConvertPath((ConvertPath)path) != 0)
+		{
+			printf("%-8s (not supported by this CPU)\n", GetConvertPathName((ConvertPath)path));
+			continue;
+		}
+		printf("%-8s", GetConvertPathName((ConvertPath)path));
+		int mismatch = 0;
+
+		//byte swapping contiguous values (a fixed size variable) and strided ones (a record variable)
+		double startTime = GetSeconds();
+		for (pass = 0; pass < BENCH_PASSES; pass++) SwapFloatColumn(contiguous, sizeof(float), BENCH_VALUES, values);
+		printf(" %10.3f", (GetSeconds() - startTime) * 1e9 / ((double)BENCH_VALUES * BENCH_PASSES));
+		if (memcmp(scalarValues, values, BENCH_VALUES * sizeof(float)) != 0) mismatch = 1;
+
+		startTime = GetSeconds();
+		for (pass = 0; pass < BENCH_PASSES; pass++) SwapFloatColumn(strided, BENCH_RECORD_SIZE, BENCH_VALUES, values);
+		printf(" %10.3f", (GetSeconds() - startTime) * 1e9 / ((double)BENCH_VALUES * BENCH_PASSES));
+		if (memcmp(scalarStridedValues, values, BENCH_VALUES * sizeof(float)) != 0) mismatch = 1;
+
+		//the unit conversions, on the contiguous values
+		for (i = 0; i < NUM_BENCH_CONVERSIONS; i++)
+		{
+			startTime = GetSeconds();
+			for (pass = 0; pass < BENCH_PASSES; pass++) ConvertFloatColumn(scalarValues, BENCH_VALUES, &benchConversions[i], converted);
+			printf(" %10.3f", (GetSeconds() - startTime) * 1e9 / ((double)BENCH_VALUES * BENCH_PASSES));
+			if (memcmp(scalarConverted + (size_t)i*BENCH_VALUES, converted, BENCH_VALUES * sizeof(double)) != 0) mismatch = 1;
+		}
+		
+		//CF decoding (the copy into the column is part of the timing)
+		startTime = GetSeconds();
+		for (pass = 0; pass < BENCH_PASSES; pass++) DecodeFloats(scalarValues, BENCH_VALUES, values);
+		printf(" %10.3f", (GetSeconds() - startTime) * 1e9 / ((double)BENCH_VALUES * BENCH_PASSES));
+		if (memcmp(scalarDecoded, values, BENCH_VALUES * sizeof(float)) != 0) mismatch = 1;
+		
+		startTime = GetSeconds();
+		for (pass = 0; pass < BENCH_PASSES; pass++)
+		{
+			memcpy(converted, scalarConverted, BENCH_VALUES * sizeof(double));
+			MaskDoubleColumn(converted, BENCH_VALUES, &benchMask);
+		}
+		printf(" %10.3f", (GetSeconds() - startTime) * 1e9 / ((double)BENCH_VALUES * BENCH_PASSES));
+		if (memcmp(scalarMasked, converted, BENCH_VALUES * sizeof(double)) != 0) mismatch = 1;
+
+		//the count, sum, min, max and squared deviations of the masked doubles (skipping their NaNs)
+		startTime = GetSeconds();
+		for (pass = 0; pass < BENCH_PASSES; pass++) SummarizeDoubles(scalarMasked, &summary, &deviations);
+		printf(" %10.3f", (GetSeconds() - startTime) * 1e9 / ((double)BENCH_SUMMED * BENCH_PASSES));
+		if (memcmp(&scalarSummary, &summary, sizeof(ColumnSummary)) != 0 || memcmp(&scalarDeviations, &deviations, sizeof(double)) != 0)
+			mismatch = 1;
+
+		if (mismatch)
+		{
+			printf("  MISMATCH with scalar");
+			status = 1;
+		}
+		printf("\n");
+	}
+
+cleanup:
+	free(contiguous);
+	free(strided);
+	free(values);
+	free(scalarValues);
+	free(scalarStridedValues);
+	free(converted);
+	free(scalarConverted);
+	free(scalarDecoded);
+	free(scalarMasked);
+	return status;
+}
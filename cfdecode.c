@@ -0,0 +1,129 @@
+//cfdecode.c: CF conventions decoding of packed and masked variables (scale_factor, add_offset, _FillValue,
+//missing_value and valid_range/valid_min/valid_max)
+//Copyright 2012, Allen Jordan, allen.jordan@gmail.com
+
+//values are masked against the attributes first, while they're still the stored values, then unpacked:
+//	decoded = stored * scale_factor + add_offset
+//one vectorized pass each over a window of a column (see unitconvert.c)
+
+#include <stdlib.h>
+#include <math.h>
+#include "cfdecode.h"
+
+//read up to maxValues of a numeric attribute as doubles, setting the number read (0 if there's no such attribute, or
+//it's text) and its type, returns the NetCDF status of reading one that exists
+static int GetNumericAttribute(int datasetID, int varID, const char *attName, double *values, size_t maxValues,
+	size_t *numValues, nc_type *attType)
+{
+	size_t length;
+	*numValues = 0;
+	int ncResult = nc_inq_att(datasetID, varID, attName, attType, &length);
+	if (ncResult == NC_ENOTATT) return NC_NOERR;
+	if (ncResult != NC_NOERR) return ncResult;
+	if (*attType == NC_CHAR || length == 0) return NC_NOERR;
+	
+	double *allValues = (double *)malloc(length * sizeof(double));
+	ncResult = nc_get_att_double(datasetID, varID, attName, allValues);
+	if (ncResult == NC_NOERR)
+	{
+		for (*numValues = 0; *numValues < length && *numValues < maxValues; (*numValues)++) values[*numValues] = allValues[*numValues];
+	}
+	free(allValues);
+	return ncResult;
+}
+
+int GetCfDecoding(int datasetID, int varID, nc_type storedType, CfDecoding *decoding)
+{
+	decoding->active = 0;
+	decoding->packed = 0;
+	decoding->scaleFactor = 1.0;
+	decoding->addOffset = 0.0;
+	decoding->masked = 0;
+	decoding->mask.validMin = -INFINITY;
+	decoding->mask.validMax = INFINITY;
+	decoding->mask.fillValue = NAN;
+	decoding->mask.missingValue = NAN;
+	decoding->decodedType = storedType;
+	if (storedType == NC_CHAR) return NC_NOERR;
+	
+	double values[2];
+	size_t numValues;
+	nc_type attType;
+	int floatPacking = 1;
+	int ncResult = GetNumericAttribute(datasetID, varID, "scale_factor", values, 1, &numValues, &attType);
+	if (ncResult == NC_NOERR && numValues > 0)
+	{
+		decoding->packed = 1;
+		decoding->scaleFactor = values[0];
+		if (attType != NC_FLOAT) floatPacking = 0;
+	}
+	if (ncResult == NC_NOERR) ncResult = GetNumericAttribute(datasetID, varID, "add_offset", values, 1, &numValues, &attType);
+	if (ncResult == NC_NOERR && numValues > 0)
+	{
+		decoding->packed = 1;
+		decoding->addOffset = values[0];
+		if (attType != NC_FLOAT) floatPacking = 0;
+	}
+	
+	if (ncResult == NC_NOERR) ncResult = GetNumericAttribute(datasetID, varID, "_FillValue", values, 1, &numValues, &attType);
+	if (ncResult == NC_NOERR && numValues > 0)
+	{
+		decoding->masked = 1;
+		decoding->mask.fillValue = values[0];
+	}
+	//(only the first of several missing values is used)
+	if (ncResult == NC_NOERR) ncResult = GetNumericAttribute(datasetID, varID, "missing_value", values, 1, &numValues, &attType);
+	if (ncResult == NC_NOERR && numValues > 0)
+	{
+		decoding->masked = 1;
+		decoding->mask.missingValue = values[0];
+	}
+	//valid_range takes the place of valid_min and valid_max
+	if (ncResult == NC_NOERR) ncResult = GetNumericAttribute(datasetID, varID, "valid_range", values, 2, &numValues, &attType);
+	if (ncResult == NC_NOERR && numValues == 2)
+	{
+		decoding->masked = 1;
+		decoding->mask.validMin = values[0];
+		decoding->mask.validMax = values[1];
+	}
+	else
+	{
+		if (ncResult == NC_NOERR) ncResult = GetNumericAttribute(datasetID, varID, "valid_min", values, 1, &numValues, &attType);
+		if (ncResult == NC_NOERR && numValues > 0)
+		{
+			decoding->masked = 1;
+			decoding->mask.validMin = values[0];
+		}
+		if (ncResult == NC_NOERR) ncResult = GetNumericAttribute(datasetID, varID, "valid_max", values, 1, &numValues, &attType);
+		if (ncResult == NC_NOERR && numValues > 0)
+		{
+			decoding->masked = 1;
+			decoding->mask.validMax = values[0];
+		}
+	}
+	if (ncResult != NC_NOERR) return ncResult;
+	
+	decoding->active = decoding->packed || decoding->masked;
+	//(values that don't fit in a float's significand are unpacked as doubles whatever the attributes are)
+	if (decoding->packed) decoding->decodedType = (floatPacking && (storedType == NC_BYTE || storedType == NC_SHORT || storedType == NC_FLOAT)) ? NC_FLOAT : NC_DOUBLE;
+	else if (storedType != NC_FLOAT) decoding->decodedType = NC_DOUBLE;
+	return NC_NOERR;
+}
+
+void DecodeCfColumn(void *values, nc_type type, size_t count, const CfDecoding *decoding)
+{
+	if (type == NC_FLOAT)
+	{
+		if (decoding->masked) MaskFloatColumn((float *)values, count, &decoding->mask);
+		if (decoding->packed) ScaleFloatColumn((float *)values, count, decoding->scaleFactor, decoding->addOffset);
+	}
+	else
+	{
+		if (decoding->masked) MaskDoubleColumn((double *)values, count, &decoding->mask);
+		if (decoding->packed)
+		{
+			UnitConversion conversion = { decoding->scaleFactor, 1.0, decoding->addOffset, 0 };
+			ConvertDoubleColumn((const double *)values, count, &conversion, (double *)values);
+		}
+	}
+}
@@ -0,0 +1,34 @@
+//cfdecode.h: CF conventions decoding of packed and masked variables (scale_factor, add_offset, _FillValue,
+//missing_value and valid_range/valid_min/valid_max)
+//Copyright 2012, Allen Jordan, allen.jordan@gmail.com
+
+#ifndef CFDECODE_H
+#define CFDECODE_H
+
+#include <stddef.h>
+#include <netcdf.h>
+#include "unitconvert.h"
+
+//how a variable's stored values are decoded, from its attributes
+typedef struct
+{
+	//set when the variable has any of the attributes, otherwise its values are left as they are
+	int active;
+	//set when it has a scale_factor or add_offset, which default to 1 and 0
+	int packed;
+	double scaleFactor;
+	double addOffset;
+	//set when it has a fill value, missing value or valid range, the mask is tested against the stored values
+	int masked;
+	ValueMask mask;
+	//the type the values are decoded to: floats for a float variable that's only masked, or a byte, short or float
+	//variable packed with float attributes, doubles otherwise (so masked values can be NaN)
+	nc_type decodedType;
+} CfDecoding;
+
+//read the attributes of a variable stored as storedType, returns the NetCDF status of reading the ones it has
+int GetCfDecoding(int datasetID, int varID, nc_type storedType, CfDecoding *decoding);
+//decode count values in place, read from the variable as type (NC_FLOAT or NC_DOUBLE), masked values become NaN
+void DecodeCfColumn(void *values, nc_type type, size_t count, const CfDecoding *decoding);
+
+#endif
@@ -0,0 +1,265 @@
+//cftime.c: CF time coordinates ("seconds since 2012-06-14 18:05:32"), dates of the Gregorian calendar, and ISO 8601
+//timestamps formatted from a cache of the current day and second
+//Copyright 2012, Allen Jordan, allen.jordan@gmail.com
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <math.h>
+#include "cftime.h"
+#include "csvwriter.h"
+#include "unitconvert.h"
+
+#define SECONDS_PER_DAY		86400
+//the milliseconds since 1970 of 0000-01-01 and 10000-01-01, the timestamps that have 4 digit years
+#define TIMESTAMP_MIN_MS	(-62167219200000.0)
+#define TIMESTAMP_MAX_MS	(253402300800000.0)
+
+//division rounding down, for times before 1970
+static int64_t FloorDivide(int64_t value, int64_t divisor)
+{
+	int64_t quotient = value / divisor;
+	if (value % divisor != 0 && value < 0) quotient--;
+	return quotient;
+}
+
+//(Howard Hinnant's days_from_civil and civil_from_days, counting in 400 year eras that start on March 1st so the leap
+//day comes last)
+int64_t DaysFromCivil(int year, int month, int day)
+{
+	int64_t y = (int64_t)year - (month <= 2);
+	int64_t era = FloorDivide(y, 400);
+	int64_t yearOfEra = y - era*400;
+	int64_t dayOfYear = (153*(month + (month > 2 ? -3 : 9)) + 2)/5 + day - 1;
+	int64_t dayOfEra = yearOfEra*365 + yearOfEra/4 - yearOfEra/100 + dayOfYear;
+	return era*146097 + dayOfEra - 719468;
+}
+
+void CivilFromDays(int64_t days, int *year, int *month, int *day)
+{
+	days += 719468;
+	int64_t era = FloorDivide(days, 146097);
+	int64_t dayOfEra = days - era*146097;
+	int64_t yearOfEra = (dayOfEra - dayOfEra/1460 + dayOfEra/36524 - dayOfEra/146096) / 365;
+	int64_t dayOfYear = dayOfEra - (365*yearOfEra + yearOfEra/4 - yearOfEra/100);
+	int64_t monthIndex = (5*dayOfYear + 2)/153;
+	*day = (int)(dayOfYear - (153*monthIndex + 2)/5 + 1);
+	*month = (int)(monthIndex < 10 ? monthIndex + 3 : monthIndex - 9);
+	*year = (int)(yearOfEra + era*400 + (*month <= 2));
+}
+
+//read a run of digits as a number, returns 0 on success or -1 if there aren't any
+static int ParseDigits(const char **text, int *value)
+{
+	const char *start = *text;
+	*value = 0;
+	while (isdigit((unsigned char)**text) && *text - start < 9) *value = *value*10 + (*(*text)++ - '0');
+	return (*text > start) ? 0 : -1;
+}
+
+int ParseDateTime(const char *text, DateTime *dateTime)
+{
+	const char *next = text;
+	int sign = 1;
+	memset(dateTime, 0, sizeof(DateTime));
+	while (isspace((unsigned char)*next)) next++;
+	if (*next == '-')
+	{
+		sign = -1;
+		next++;
+	}
+	if (ParseDigits(&next, &dateTime->year) != 0 || *next++ != '-') return -1;
+	dateTime->year *= sign;
+	if (ParseDigits(&next, &dateTime->month) != 0 || *next++ != '-') return -1;
+	if (ParseDigits(&next, &dateTime->day) != 0) return -1;
+	if (dateTime->month < 1 || dateTime->month > 12 || dateTime->day < 1 || dateTime->day > 31) return -1;
+	
+	//the time of day, after a T or spaces
+	const char *timeStart = next;
+	if (*timeStart == 'T') timeStart++;
+	else while (*timeStart == ' ') timeStart++;
+	if (isdigit((unsigned char)*timeStart))
+	{
+		next = timeStart;
+		if (ParseDigits(&next, &dateTime->hour) != 0 || *next++ != ':') return -1;
+		if (ParseDigits(&next, &dateTime->minute) != 0) return -1;
+		if (*next == ':')
+		{
+			char *end;
+			next++;
+			if (!isdigit((unsigned char)*next)) return -1;
+			dateTime->second = strtod(next, &end);
+			next = end;
+		}
+		if (dateTime->hour > 24 || dateTime->minute > 59 || dateTime->second >= 61.0) return -1;
+	}
+	
+	//then Z, UTC or an offset from UTC (+hh, +hh:mm or +hhmm)
+	int offsetMinutes = 0;
+	while (*next == ' ') next++;
+	if (*next == 'Z') next++;
+	else if (strncasecmp(next, "UTC", 3) == 0) next += 3;
+	else if (*next == '+' || *next == '-')
+	{
+		int offsetSign = (*next++ == '-') ? -1 : 1;
+		const char *digitsStart = next;
+		int hours, minutes = 0;
+		if (ParseDigits(&next, &hours) != 0) return -1;
+		if (next - digitsStart == 4)
+		{
+			minutes = hours % 100;
+			hours /= 100;
+		}
+		else if (*next == ':')
+		{
+			next++;
+			if (ParseDigits(&next, &minutes) != 0) return -1;
+		}
+		offsetMinutes = offsetSign * (hours*60 + minutes);
+	}
+	while (isspace((unsigned char)*next)) next++;
+	if (*next != '\0') return -1;
+	
+	if (offsetMinutes != 0)
+	{
+		//move the time to UTC, which can change the date
+		double seconds = GetEpochSeconds(dateTime) - offsetMinutes*60.0;
+		double wholeSeconds = floor(seconds);
+		int64_t days = FloorDivide((int64_t)wholeSeconds, SECONDS_PER_DAY);
+		int secondOfDay = (int)((int64_t)wholeSeconds - days*SECONDS_PER_DAY);
+		CivilFromDays(days, &dateTime->year, &dateTime->month, &dateTime->day);
+		dateTime->hour = secondOfDay / 3600;
+		dateTime->minute = secondOfDay / 60 % 60;
+		dateTime->second = secondOfDay % 60 + (seconds - wholeSeconds);
+	}
+	return 0;
+}
+
+double GetEpochSeconds(const DateTime *dateTime)
+{
+	double days = (double)DaysFromCivil(dateTime->year, dateTime->month, dateTime->day);
+	return days*SECONDS_PER_DAY + dateTime->hour*3600.0 + dateTime->minute*60.0 + dateTime->second;
+}
+
+//the time units of CF (and udunits) coordinates, and their lengths in seconds
+static const struct
+{
+	const char *name;
+	double seconds;
+} timeUnitNames[] =
+{
+	{ "microseconds", 1e-6 }, { "microsecond", 1e-6 }, { "us", 1e-6 },
+	{ "milliseconds", 1e-3 }, { "millisecond", 1e-3 }, { "msecs", 1e-3 }, { "msec", 1e-3 }, { "ms", 1e-3 },
+	{ "seconds", 1 }, { "second", 1 }, { "secs", 1 }, { "sec", 1 }, { "s", 1 },
+	{ "minutes", 60 }, { "minute", 60 }, { "mins", 60 }, { "min", 60 },
+	{ "hours", 3600 }, { "hour", 3600 }, { "hrs", 3600 }, { "hr", 3600 }, { "h", 3600 },
+	{ "days", SECONDS_PER_DAY }, { "day", SECONDS_PER_DAY }, { "d", SECONDS_PER_DAY }
+};
+
+int ParseTimeUnits(const char *units, const char *defaultEpoch, TimeUnits *timeUnits)
+{
+	const char *next = units;
+	while (isspace((unsigned char)*next)) next++;
+	const char *unitStart = next;
+	while (isalpha((unsigned char)*next)) next++;
+	size_t unitLength = next - unitStart;
+	
+	size_t i;
+	timeUnits->unitSeconds = 0;
+	for (i = 0; i < sizeof(timeUnitNames)/sizeof(timeUnitNames[0]); i++)
+	{
+		if (strlen(timeUnitNames[i].name) == unitLength && strncasecmp(unitStart, timeUnitNames[i].name, unitLength) == 0)
+		{
+			timeUnits->unitSeconds = timeUnitNames[i].seconds;
+			break;
+		}
+	}
+	if (timeUnits->unitSeconds == 0) return -1;
+	
+	while (isspace((unsigned char)*next)) next++;
+	DateTime epoch;
+	if (*next == '\0' && defaultEpoch != NULL)
+	{
+		if (ParseDateTime(defaultEpoch, &epoch) != 0) return -1;
+	}
+	else if (strncasecmp(next, "since", 5) != 0 || !isspace((unsigned char)next[5]) || ParseDateTime(next + 5, &epoch) != 0) return -1;
+	timeUnits->epochSeconds = GetEpochSeconds(&epoch);
+	return 0;
+}
+
+int IsGregorianCalendar(const char *calendar)
+{
+	return calendar[0] == '\0' || strcasecmp(calendar, "standard") == 0 || strcasecmp(calendar, "gregorian") == 0
+		|| strcasecmp(calendar, "proleptic_gregorian") == 0;
+}
+
+void ConvertTimesToEpoch(double *values, size_t count, const TimeUnits *timeUnits)
+{
+	UnitConversion conversion = { timeUnits->unitSeconds, 1.0, timeUnits->epochSeconds, 0 };
+	ConvertDoubleColumn(values, count, &conversion, values);
+}
+
+void InitTimestampCache(TimestampCache *cache)
+{
+	cache->day = INT64_MIN;
+	cache->second = INT64_MIN;
+	memset(cache->text, 0, sizeof(cache->text));
+}
+
+//write a number of digits, zero padded
+static void WriteDigits(char *out, int value, int numDigits)
+{
+	int i;
+	for (i = numDigits-1; i >= 0; i--)
+	{
+		out[i] = '0' + value % 10;
+		value /= 10;
+	}
+}
+
+int FormatTimestamp(char *out, double seconds, TimestampCache *cache)
+{
+	if (isnan(seconds)) return 0;
+	//rounded to the millisecond first, so a time that rounds up to the next second gets that second's text
+	double milliseconds = floor(seconds*1000.0 + 0.5);
+	if (!(milliseconds >= TIMESTAMP_MIN_MS && milliseconds < TIMESTAMP_MAX_MS)) return FormatDoubleShortest(out, seconds);
+	int64_t wholeMilliseconds = (int64_t)milliseconds;
+	int64_t second = FloorDivide(wholeMilliseconds, 1000);
+	int millisecond = (int)(wholeMilliseconds - second*1000);
+	
+	if (second != cache->second)
+	{
+		int64_t day = FloorDivide(second, SECONDS_PER_DAY);
+		if (day != cache->day)
+		{
+			int year, month, dayOfMonth;
+			CivilFromDays(day, &year, &month, &dayOfMonth);
+			WriteDigits(cache->text, year, 4);
+			cache->text[4] = '-';
+			WriteDigits(cache->text + 5, month, 2);
+			cache->text[7] = '-';
+			WriteDigits(cache->text + 8, dayOfMonth, 2);
+			cache->text[10] = 'T';
+			cache->day = day;
+		}
+		int secondOfDay = (int)(second - day*SECONDS_PER_DAY);
+		WriteDigits(cache->text + 11, secondOfDay / 3600, 2);
+		cache->text[13] = ':';
+		WriteDigits(cache->text + 14, secondOfDay / 60 % 60, 2);
+		cache->text[16] = ':';
+		WriteDigits(cache->text + 17, secondOfDay % 60, 2);
+		cache->second = second;
+	}
+	
+	memcpy(out, cache->text, 19);
+	int length = 19;
+	if (millisecond != 0)
+	{
+		out[length++] = '.';
+		WriteDigits(out + length, millisecond, 3);
+		length += 3;
+	}
+	out[length++] = 'Z';
+	return length;
+}
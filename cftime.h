@@ -0,0 +1,65 @@
+//cftime.h: CF time coordinates ("seconds since 2012-06-14 18:05:32"), dates of the Gregorian calendar, and ISO 8601
+//timestamps formatted from a cache of the current day and second
+//Copyright 2012, Allen Jordan, allen.jordan@gmail.com
+
+#ifndef CFTIME_H
+#define CFTIME_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+//longest timestamp FormatTimestamp writes, ex: 2012-06-14T18:05:32.250Z
+#define TIMESTAMP_MAX_LENGTH	24
+
+//a date and time of day, UTC
+typedef struct
+{
+	int year, month, day;
+	int hour, minute;
+	double second;
+} DateTime;
+
+//days from 1970-01-01 to a date of the (proleptic) Gregorian calendar, and back
+int64_t DaysFromCivil(int year, int month, int day);
+void CivilFromDays(int64_t days, int *year, int *month, int *day);
+
+//parse a date and time like 2012-06-14T18:05:32.000Z or 1970-1-1 0:0:0 -6:00 (the time and UTC offset are optional),
+//converting it to UTC, returns 0 on success or -1 if the text isn't one
+int ParseDateTime(const char *text, DateTime *dateTime);
+//seconds from 1970-01-01 00:00:00 UTC to a date and time
+double GetEpochSeconds(const DateTime *dateTime);
+
+//what the values of a CF time coordinate count: units of unitSeconds since epochSeconds (seconds since 1970)
+typedef struct
+{
+	double unitSeconds;
+	double epochSeconds;
+} TimeUnits;
+
+//parse a time coordinate's units attribute, ex: "seconds since 2012-06-14 18:05:32" (milliseconds, seconds,
+//minutes, hours and days, but not months or years, which aren't fixed lengths of time)
+//units that are just a time unit (ex: "s") count from defaultEpoch instead, if it isn't NULL
+//returns 0 on success or -1 if the units aren't a time since a date
+int ParseTimeUnits(const char *units, const char *defaultEpoch, TimeUnits *timeUnits);
+//check if a calendar attribute names the Gregorian calendar the times are decoded in (an empty one does)
+int IsGregorianCalendar(const char *calendar);
+//turn count values of a time coordinate into seconds since 1970, in place
+void ConvertTimesToEpoch(double *values, size_t count, const TimeUnits *timeUnits);
+
+//the text of the last timestamp formatted, so the calendar is only worked out again when the day changes, and the time
+//of day when the second changes
+typedef struct
+{
+	int64_t day;
+	int64_t second;
+	//YYYY-MM-DDThh:mm:ss
+	char text[20];
+} TimestampCache;
+
+void InitTimestampCache(TimestampCache *cache);
+//write seconds since 1970 as an ISO 8601 UTC timestamp, with milliseconds when it has any (2012-06-14T18:05:32Z,
+//2012-06-14T18:05:32.250Z), into out (which must have room for CSV_MAX_NUMBER_LENGTH bytes)
+//NaN writes nothing, and times outside the years 0 to 9999 are written as plain numbers, returns the length written
+int FormatTimestamp(char *out, double seconds, TimestampCache *cache);
+
+#endif
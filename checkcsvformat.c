@@ -0,0 +1,292 @@
+//checkcsvformat.c: checks the hand-written number formatters against the C library, the shortest ones have to read back
+//as the same value through strtod/strtof, and the fixed one has to write exactly what printf's "%.*f" does
+//Copyright 2012, Allen Jordan, allen.jordan@gmail.com
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <math.h>
+#include <float.h>
+#include "csvwriter.h"
+
+//random values checked by each formatter
+#define CHECK_RANDOM_VALUES	100000
+//mismatches printed before the rest are just counted
+#define MAX_PRINTED			10
+
+//a fixed sequence of pseudo-random numbers (xorshift64*), so every run checks the same values
+static uint64_t randomState = UINT64_C(0x9E3779B97F4A7C15);
+static uint64_t NextRandom(void)
+{
+	randomState ^= randomState >> 12;
+	randomState ^= randomState << 25;
+	randomState ^= randomState >> 27;
+	return randomState * UINT64_C(0x2545F4914F6CDD1D);
+}
+
+//the counts for one formatter
+typedef struct
+{
+	const char *name;
+	uint64_t checked;
+	uint64_t failed;
+} CheckCounts;
+
+static void ReportFailure(CheckCounts *counts, const char *valueText, const char *expected, const char *actual)
+{
+	if (counts->failed++ < MAX_PRINTED) printf("%s: %s wrote \"%s\", expected %s\n", counts->name, valueText, actual, expected);
+}
+
+//count the digits of a number's text from the first nonzero one (up to any exponent)
+static int CountSignificantDigits(const char *text)
+{
+	int digits = 0, leading = 1;
+	for (; *text != '\0' && *text != 'e'; text++)
+	{
+		if (*text < '0' || *text > '9') continue;
+		if (*text == '0' && leading) continue;
+		leading = 0;
+		digits++;
+	}
+	return digits;
+}
+
+//count the zeros at the end of an integer's text (like 1000), which aren't significant either
+static int CountTrailingZeros(const char *text)
+{
+	const char *end = strchr(text, 'e');
+	if (end == NULL) end = text + strlen(text);
+	if (memchr(text, '.', end - text) != NULL) return 0;
+	int zeros = 0;
+	while (end > text && end[-1] == '0')
+	{
+		end--;
+		zeros++;
+	}
+	return zeros;
+}
+
+//check whether any text with one significant digit fewer than the formatter wrote reads back as the same value
+//(any text with more digits reads back too once one does, so that's enough to show it wrote the shortest)
+//the candidates are printf's correctly rounded digits and the ones a unit either side of them, since next to a power
+//of two the rounding interval is lopsided and the nearest digits can miss it when a neighbour doesn't
+static int HasShorterText(double value, int digits, int isFloat)
+{
+	char text[40];
+	int precision = digits - 1, i;
+	if (precision < 1) return 0;
+	value = fabs(value);
+	snprintf(text, sizeof(text), "%.*e", precision - 1, value);
+
+	//the digits as an integer m, so the value is m * 10^exponent
+	uint64_t m = 0, power = 1;
+	for (i = 0; text[i] != 'e'; i++) if (text[i] != '.') m = m * 10 + (uint64_t)(text[i] - '0');
+	int exponent = atoi(strchr(text, 'e') + 1) - (precision - 1);
+	for (i = 1; i < precision; i++) power *= 10;
+
+	//(below 10^(precision-1), the neighbour has its digits a place further down)
+	uint64_t candidates[4] = { m, m + 1, m - 1, power * 10 - 1 };
+	int exponents[4] = { exponent, exponent, exponent, exponent - 1 };
+	for (i = 0; i < 4; i++)
+	{
+		if (i == 3 && m != power) break;
+		snprintf(text, sizeof(text), "%llue%d", (unsigned long long)candidates[i], exponents[i]);
+		if (isFloat ? strtof(text, NULL) == (float)value : strtod(text, NULL) == value) return 1;
+	}
+	return 0;
+}
+
+static void CheckDoubleShortest(CheckCounts *counts, double value)
+{
+	char out[CSV_MAX_NUMBER_LENGTH + 1], valueText[40];
+	int length = FormatDoubleShortest(out, value);
+	out[length] = '\0';
+	snprintf(valueText, sizeof(valueText), "%.17g", value);
+	counts->checked++;
+
+	double readBack = strtod(out, NULL);
+	if (isnan(value) ? !isnan(readBack) : memcmp(&readBack, &value, sizeof(double)) != 0)
+	{
+		ReportFailure(counts, valueText, "text that reads back as the same value", out);
+		return;
+	}
+	if (!isfinite(value) || value == 0.0) return;
+
+	int digits = CountSignificantDigits(out) - CountTrailingZeros(out);
+	if (digits > 17) ReportFailure(counts, valueText, "at most 17 significant digits", out);
+	else if (HasShorterText(value, digits, 0)) ReportFailure(counts, valueText, "the shortest text that reads back", out);
+}
+
+static void CheckFloatShortest(CheckCounts *counts, float value)
+{
+	char out[CSV_MAX_NUMBER_LENGTH + 1], valueText[40];
+	int length = FormatFloatShortest(out, value);
+	out[length] = '\0';
+	snprintf(valueText, sizeof(valueText), "%.9g", value);
+	counts->checked++;
+
+	float readBack = strtof(out, NULL);
+	if (isnan(value) ? !isnan(readBack) : memcmp(&readBack, &value, sizeof(float)) != 0)
+	{
+		ReportFailure(counts, valueText, "text that reads back as the same value", out);
+		return;
+	}
+	if (!isfinite(value) || value == 0.0f) return;
+
+	int digits = CountSignificantDigits(out) - CountTrailingZeros(out);
+	if (digits > 9) ReportFailure(counts, valueText, "at most 9 significant digits", out);
+	else if (HasShorterText(value, digits, 1)) ReportFailure(counts, valueText, "the shortest text that reads back", out);
+}
+
+static void CheckDoubleFixed(CheckCounts *counts, double value, int decimals)
+{
+	char out[CSV_MAX_NUMBER_LENGTH + 1], expected[CSV_MAX_NUMBER_LENGTH + 3], valueText[64];
+	int length = FormatDoubleFixed(out, value, decimals);
+	out[length] = '\0';
+	snprintf(expected, sizeof(expected), "\"%.*f\"", decimals, value);
+	counts->checked++;
+	if (strlen(expected) != (size_t)length + 2 || memcmp(expected + 1, out, length) != 0)
+	{
+		snprintf(valueText, sizeof(valueText), "%.17g with %d decimals", value, decimals);
+		ReportFailure(counts, valueText, expected, out);
+	}
+}
+
+//a double with random bits (NaNs and infinities included)
+static double RandomBitsDouble(void)
+{
+	uint64_t bits = NextRandom();
+	double value;
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+static float RandomBitsFloat(void)
+{
+	uint32_t bits = (uint32_t)(NextRandom() >> 32);
+	float value;
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+//a value like the ones in a data file: a few significant digits, at a magnitude from 1e-12 to 1e12
+static double RandomDataValue(void)
+{
+	double digits = (double)(NextRandom() % 10000000);
+	int exponent = (int)(NextRandom() % 25) - 18;
+	double value = digits * pow(10.0, exponent);
+	return (NextRandom() & 1) ? -value : value;
+}
+
+//a value that's exactly halfway between two numbers with some number of decimals (ex: 0.125 with 2 decimals)
+static double RandomTieValue(int *decimals)
+{
+	int bits = 1 + (int)(NextRandom() % 20);
+	double value = (double)((NextRandom() % 1000000) * 2 + 1) / (double)(UINT64_C(1) << bits);
+	*decimals = bits - 1;
+	if (*decimals > CSV_MAX_DECIMALS) *decimals = CSV_MAX_DECIMALS;
+	return (NextRandom() & 1) ? -value : value;
+}
+
+//values at the edges of the formats: zeros, subnormals, the extremes, powers of 2 and 10, and well known hard cases
+static const double edgeDoubles[] =
+{
+	0.0, -0.0, 1.0, -1.0, 0.1, 0.2, 0.3, 1.0/3.0, 2.0/3.0, 0.5, 0.25, 0.125, 0.05, 0.005, 1.005, 2.675, 1.15, 1.25, 1.35,
+	2.5, 3.5, 0.045, 1e21, 1e22, 1e23, 9.999999999999999e22, 1e-7, 1e-6, 123456789012345678.0, 9007199254740991.0,
+	9007199254740992.0, 9007199254740993.0, 4503599627370495.5, 4503599627370496.5, 5e-324, 1e-323, 2.2250738585072009e-308,
+	2.2250738585072014e-308, 2.2250738585072011e-308, 1.7976931348623157e308, 4.9406564584124654e-324, 1e308, 1e-308,
+	5e-309, 1.2345678901234567e-300, 2.98023223876953125e-8, 5.764607523034235e17, 9.5e-5, 0.000001, 0.0000001,
+	1e15, 1e16, 1e17, 123.456, 253.45999145507812, 1.7976931348623157e308 / 3, 1e-300, 1e300
+};
+#define NUM_EDGE_DOUBLES	((int)(sizeof(edgeDoubles)/sizeof(double)))
+
+static const float edgeFloats[] =
+{
+	0.0f, -0.0f, 1.0f, -1.0f, 0.1f, 0.2f, 0.3f, 1.0f/3.0f, 253.46f, 1e-45f, 1.4e-45f, 1.17549435e-38f, 1.17549421e-38f,
+	3.40282347e38f, 16777215.0f, 16777216.0f, 16777217.0f, 8388607.5f, 1e10f, 1e-10f, 7.038531e-26f, 9.999999e-5f, 1e21f,
+	1e22f, 1e23f, 2.5f, 0.125f
+};
+#define NUM_EDGE_FLOATS	((int)(sizeof(edgeFloats)/sizeof(float)))
+
+int main(void)
+{
+	CheckCounts doubleShortest = { "FormatDoubleShortest", 0, 0 };
+	CheckCounts floatShortest = { "FormatFloatShortest", 0, 0 };
+	CheckCounts doubleFixed = { "FormatDoubleFixed", 0, 0 };
+	int i, e, decimals;
+
+	//the edge values (and their neighbours) with every number of decimals, plus the special values
+	for (i = 0; i < NUM_EDGE_DOUBLES; i++)
+	{
+		double neighbours[3] = { edgeDoubles[i], nextafter(edgeDoubles[i], -INFINITY), nextafter(edgeDoubles[i], INFINITY) };
+		int n;
+		for (n = 0; n < 3; n++)
+		{
+			CheckDoubleShortest(&doubleShortest, neighbours[n]);
+			CheckDoubleShortest(&doubleShortest, -neighbours[n]);
+			for (decimals = 0; decimals <= CSV_MAX_DECIMALS; decimals++)
+			{
+				CheckDoubleFixed(&doubleFixed, neighbours[n], decimals);
+				CheckDoubleFixed(&doubleFixed, -neighbours[n], decimals);
+			}
+		}
+	}
+	for (i = 0; i < NUM_EDGE_FLOATS; i++)
+	{
+		CheckFloatShortest(&floatShortest, edgeFloats[i]);
+		CheckFloatShortest(&floatShortest, -edgeFloats[i]);
+		CheckFloatShortest(&floatShortest, nextafterf(edgeFloats[i], -INFINITY));
+		CheckFloatShortest(&floatShortest, nextafterf(edgeFloats[i], INFINITY));
+	}
+	double specialValues[3] = { NAN, INFINITY, -INFINITY };
+	for (i = 0; i < 3; i++)
+	{
+		CheckDoubleShortest(&doubleShortest, specialValues[i]);
+		CheckFloatShortest(&floatShortest, (float)specialValues[i]);
+		for (decimals = 0; decimals <= CSV_MAX_DECIMALS; decimals++) CheckDoubleFixed(&doubleFixed, specialValues[i], decimals);
+	}
+
+	//every power of 2 and of 10 a double (or float) can hold
+	for (e = -1074; e <= 1023; e++) CheckDoubleShortest(&doubleShortest, ldexp(1.0, e));
+	for (e = -149; e <= 127; e++) CheckFloatShortest(&floatShortest, ldexpf(1.0f, e));
+	char powerText[16];
+	for (e = -323; e <= 308; e++)
+	{
+		snprintf(powerText, sizeof(powerText), "1e%d", e);
+		double power = strtod(powerText, NULL);
+		CheckDoubleShortest(&doubleShortest, power);
+		CheckDoubleFixed(&doubleFixed, power, abs(e) % (CSV_MAX_DECIMALS + 1));
+	}
+	for (e = -45; e <= 38; e++)
+	{
+		snprintf(powerText, sizeof(powerText), "1e%d", e);
+		CheckFloatShortest(&floatShortest, strtof(powerText, NULL));
+	}
+
+	//random bit patterns (every exponent, subnormals included), values like measurements, and exact ties
+	for (i = 0; i < CHECK_RANDOM_VALUES; i++)
+	{
+		CheckDoubleShortest(&doubleShortest, RandomBitsDouble());
+		CheckFloatShortest(&floatShortest, RandomBitsFloat());
+		double value = RandomDataValue();
+		CheckDoubleShortest(&doubleShortest, value);
+		CheckFloatShortest(&floatShortest, (float)value);
+		CheckDoubleFixed(&doubleFixed, value, (int)(NextRandom() % (CSV_MAX_DECIMALS + 1)));
+		CheckDoubleFixed(&doubleFixed, (float)value, 6);
+		value = RandomTieValue(&decimals);
+		CheckDoubleFixed(&doubleFixed, value, decimals);
+		//(and random bits with few decimals, most of them too big for the fast path or tiny)
+		CheckDoubleFixed(&doubleFixed, RandomBitsDouble(), (int)(NextRandom() % 4));
+	}
+
+	CheckCounts *all[3] = { &doubleShortest, &floatShortest, &doubleFixed };
+	int status = 0;
+	for (i = 0; i < 3; i++)
+	{
+		printf("%-22s %10llu values checked, %llu wrong\n", all[i]->name, (unsigned long long)all[i]->checked,
+			(unsigned long long)all[i]->failed);
+		if (all[i]->failed > 0) status = 1;
+	}
+	return status;
+}
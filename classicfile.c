@@ -0,0 +1,352 @@
+//classicfile.c: reading classic (CDF-1) and 64-bit offset (CDF-2) NetCDF files straight out of a memory map
+//Copyright 2012, Allen Jordan, allen.jordan@gmail.com
+
+//the header layout follows the NetCDF classic format specification: the magic number, the record count, then the
+//dimension, global attribute and variable lists, all big-endian and padded out to 4 bytes
+//fixed size variables are stored whole one after another, record variables are interleaved one record at a time
+
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "classicfile.h"
+
+//list tags
+#define CLASSIC_TAG_DIMENSION	0x0A
+#define CLASSIC_TAG_VARIABLE	0x0B
+#define CLASSIC_TAG_ATTRIBUTE	0x0C
+//number of records in a file still being written as a stream
+#define CLASSIC_STREAMING	0xFFFFFFFF
+
+//a bounds-checked walk through the header, failed is set (and stays set) if anything runs off the end of the file
+typedef struct
+{
+	const unsigned char *data;
+	size_t length;
+	size_t position;
+	int failed;
+} HeaderReader;
+
+static uint32_t ReadHeaderUInt32(HeaderReader *reader)
+{
+	if (reader->failed || reader->length - reader->position < 4)
+	{
+		reader->failed = 1;
+		return 0;
+	}
+	const unsigned char *bytes = reader->data + reader->position;
+	reader->position += 4;
+	return ((uint32_t)bytes[0] << 24) | ((uint32_t)bytes[1] << 16) | ((uint32_t)bytes[2] << 8) | (uint32_t)bytes[3];
+}
+
+static uint64_t ReadHeaderUInt64(HeaderReader *reader)
+{
+	uint64_t high = ReadHeaderUInt32(reader);
+	return (high << 32) | ReadHeaderUInt32(reader);
+}
+
+//skip length bytes plus the padding after them
+static void SkipHeaderBytes(HeaderReader *reader, uint64_t length)
+{
+	length = (length + 3) & ~(uint64_t)3;
+	if (reader->failed || reader->length - reader->position < length) reader->failed = 1;
+	else reader->position += (size_t)length;
+}
+
+static size_t GetClassicTypeSize(uint32_t type)
+{
+	switch (type)
+	{
+		case NC_BYTE: return 1;
+		case NC_CHAR: return 1;
+		case NC_SHORT: return 2;
+		case NC_INT: return 4;
+		case NC_FLOAT: return 4;
+		case NC_DOUBLE: return 8;
+		default: return 0;
+	}
+}
+
+//read a list's tag and element count, returns the count (0 for an absent list)
+static uint32_t ReadListStart(HeaderReader *reader, uint32_t tag)
+{
+	uint32_t listTag = ReadHeaderUInt32(reader);
+	uint32_t count = ReadHeaderUInt32(reader);
+	if (listTag != tag && !(listTag == 0 && count == 0)) reader->failed = 1;
+	return reader->failed ? 0 : count;
+}
+
+static void SkipAttributeList(HeaderReader *reader)
+{
+	uint32_t i, numAtts = ReadListStart(reader, CLASSIC_TAG_ATTRIBUTE);
+	for (i = 0; i < numAtts && !reader->failed; i++)
+	{
+		SkipHeaderBytes(reader, ReadHeaderUInt32(reader));
+		size_t typeSize = GetClassicTypeSize(ReadHeaderUInt32(reader));
+		if (typeSize == 0) reader->failed = 1;
+		SkipHeaderBytes(reader, (uint64_t)ReadHeaderUInt32(reader) * typeSize);
+	}
+}
+
+void CloseClassicFile(ClassicFile *file)
+{
+	int i;
+	if (file == NULL) return;
+	for (i = 0; i < file->numVars; i++)
+	{
+		free(file->vars[i].dimLengths);
+		free(file->vars[i].dimSteps);
+	}
+	free(file->vars);
+	if (file->map != NULL) munmap((void *)file->map, file->mapLength);
+	if (file->fd >= 0) close(file->fd);
+	free(file);
+}
+
+ClassicFile *OpenClassicFile(const char *filename)
+{
+	uint32_t i;
+	int j;
+	ClassicFile *file = (ClassicFile *)calloc(1, sizeof(ClassicFile));
+	size_t *dimLengths = NULL;
+	file->fd = open(filename, O_RDONLY);
+	struct stat fileInfo;
+	if (file->fd < 0 || fstat(file->fd, &fileInfo) != 0 || fileInfo.st_size < 32) goto failed;
+	file->mapLength = (size_t)fileInfo.st_size;
+	void *map = mmap(NULL, file->mapLength, PROT_READ, MAP_SHARED, file->fd, 0);
+	if (map == MAP_FAILED) goto failed;
+	file->map = (const unsigned char *)map;
+	//the rows are mostly read front to back
+	madvise(map, file->mapLength, MADV_SEQUENTIAL);
+
+	if (memcmp(file->map, "CDF", 3) != 0 || (file->map[3] != 1 && file->map[3] != 2)) goto failed;
+	file->version = file->map[3];
+	HeaderReader reader = { file->map, file->mapLength, 4, 0 };
+	uint32_t numRecords = ReadHeaderUInt32(&reader);
+	if (numRecords == CLASSIC_STREAMING) goto failed;
+	file->numRecords = numRecords;
+
+	//dimensions, the record dimension has length 0 in the header
+	uint32_t numDims = ReadListStart(&reader, CLASSIC_TAG_DIMENSION);
+	if (reader.failed || numDims > reader.length / 8) goto failed;
+	dimLengths = (size_t *)malloc((numDims > 0 ? numDims : 1) * sizeof(size_t));
+	uint32_t recordDimID = numDims;
+	for (i = 0; i < numDims && !reader.failed; i++)
+	{
+		SkipHeaderBytes(&reader, ReadHeaderUInt32(&reader));
+		dimLengths[i] = ReadHeaderUInt32(&reader);
+		if (dimLengths[i] == 0 && recordDimID == numDims)
+		{
+			recordDimID = i;
+			dimLengths[i] = file->numRecords;
+		}
+	}
+
+	SkipAttributeList(&reader);
+
+	//variables
+	uint32_t numVars = ReadListStart(&reader, CLASSIC_TAG_VARIABLE);
+	if (reader.failed || numVars > reader.length / 8) goto failed;
+	file->vars = (ClassicVariable *)calloc(numVars > 0 ? numVars : 1, sizeof(ClassicVariable));
+	int numRecordVars = 0;
+	uint64_t recordSize = 0, lastRecordVarSize = 0;
+	for (i = 0; i < numVars && !reader.failed; i++)
+	{
+		ClassicVariable *var = &file->vars[i];
+		file->numVars++;
+		SkipHeaderBytes(&reader, ReadHeaderUInt32(&reader));
+		uint32_t varNumDims = ReadHeaderUInt32(&reader);
+		if (reader.failed || varNumDims > (reader.length - reader.position) / 4) goto failed;
+		var->numDims = (int)varNumDims;
+		var->dimLengths = (size_t *)malloc((varNumDims > 0 ? varNumDims : 1) * sizeof(size_t));
+		var->dimSteps = (size_t *)malloc((varNumDims > 0 ? varNumDims : 1) * sizeof(size_t));
+		for (j = 0; j < var->numDims; j++)
+		{
+			uint32_t dimID = ReadHeaderUInt32(&reader);
+			if (dimID >= numDims || (dimID == recordDimID && j > 0)) goto failed;
+			var->dimLengths[j] = dimLengths[dimID];
+			if (dimID == recordDimID) var->isRecord = 1;
+		}
+		SkipAttributeList(&reader);
+		var->type = (nc_type)ReadHeaderUInt32(&reader);
+		var->elementSize = GetClassicTypeSize((uint32_t)var->type);
+		if (var->elementSize == 0) goto failed;
+		ReadHeaderUInt32(&reader);
+		var->begin = (file->version == 1) ? ReadHeaderUInt32(&reader) : ReadHeaderUInt64(&reader);
+
+		//steps within one record (or the whole variable), the record dimension's step is the record size
+		uint64_t step = var->elementSize;
+		for (j = var->numDims-1; j >= var->isRecord; j--)
+		{
+			var->dimSteps[j] = (size_t)step;
+			step *= var->dimLengths[j];
+		}
+		if (var->isRecord)
+		{
+			numRecordVars++;
+			lastRecordVarSize = step;
+			recordSize += (step + 3) & ~(uint64_t)3;
+		}
+		else if (step > 0 && (var->begin > file->mapLength || step > file->mapLength - var->begin)) goto failed;
+	}
+	if (reader.failed) goto failed;
+	//a lone record variable isn't padded between records
+	if (numRecordVars == 1) recordSize = lastRecordVarSize;
+	file->recordSize = recordSize;
+
+	for (i = 0; i < numVars; i++)
+	{
+		ClassicVariable *var = &file->vars[i];
+		if (!var->isRecord) continue;
+		var->dimSteps[0] = (size_t)recordSize;
+		if (file->numRecords == 0) continue;
+		uint64_t recordVarSize = var->elementSize;
+		for (j = 1; j < var->numDims; j++) recordVarSize *= var->dimLengths[j];
+		uint64_t end = var->begin + (file->numRecords - 1) * recordSize + recordVarSize;
+		if (end < var->begin || end > file->mapLength) goto failed;
+	}
+
+	free(dimLengths);
+	return file;
+
+failed:
+	free(dimLengths);
+	CloseClassicFile(file);
+	return NULL;
+}
+
+int GetClassicView(const ClassicFile *file, int varID, const size_t *start, const size_t *count, const ptrdiff_t *stride,
+	const void **data, size_t *valueStride)
+{
+	const ClassicVariable *var = &file->vars[varID];
+	int i;
+	uint64_t offset = var->begin;
+	for (i = 0; i < var->numDims; i++) offset += start[i] * var->dimSteps[i];
+
+	//from the fastest dimension out, each dimension that covers more than one index has to step over exactly the
+	//values of the ones inside it
+	size_t step = 0, run = 1;
+	for (i = var->numDims-1; i >= 0; i--)
+	{
+		if (count[i] <= 1) continue;
+		size_t dimStep = (size_t)stride[i] * var->dimSteps[i];
+		if (step == 0) step = dimStep;
+		else if (dimStep != step * run) return 0;
+		run *= count[i];
+	}
+
+	*data = file->map + offset;
+	*valueStride = (step == 0) ? var->elementSize : step;
+	return 1;
+}
+
+//copy count values spaced sourceStep bytes apart next to each other
+#define COPY_VALUES(type) \
+	for (i = 0; i < count; i++) memcpy((type *)destination + i, source + i*sourceStep, sizeof(type))
+
+static void CopyValues(const unsigned char *source, size_t sourceStep, size_t count, size_t elementSize, unsigned char *destination)
+{
+	size_t i;
+	if (sourceStep == elementSize)
+	{
+		memcpy(destination, source, count * elementSize);
+		return;
+	}
+	switch (elementSize)
+	{
+		case 1: COPY_VALUES(uint8_t); break;
+		case 2: COPY_VALUES(uint16_t); break;
+		case 4: COPY_VALUES(uint32_t); break;
+		case 8: COPY_VALUES(uint64_t); break;
+		default: break;
+	}
+}
+
+void CopyClassicSlab(const ClassicFile *file, int varID, const size_t *start, const size_t *count, const ptrdiff_t *stride,
+	void *buffer)
+{
+	const ClassicVariable *var = &file->vars[varID];
+	unsigned char *destination = (unsigned char *)buffer;
+	int numDims = var->numDims;
+	if (numDims == 0)
+	{
+		memcpy(destination, file->map + var->begin, var->elementSize);
+		return;
+	}
+
+	int d;
+	size_t steps[NC_MAX_VAR_DIMS], index[NC_MAX_VAR_DIMS];
+	uint64_t offset = var->begin;
+	for (d = 0; d < numDims; d++)
+	{
+		if (count[d] == 0) return;
+		offset += start[d] * var->dimSteps[d];
+		steps[d] = (size_t)stride[d] * var->dimSteps[d];
+		index[d] = 0;
+	}
+
+	//walk the hyperslab like an odometer, copying a run of the fastest dimension at a time
+	size_t innerCount = count[numDims-1];
+	for (;;)
+	{
+		CopyValues(file->map + offset, steps[numDims-1], innerCount, var->elementSize, destination);
+		destination += innerCount * var->elementSize;
+		for (d = numDims-2; d >= 0; d--)
+		{
+			offset += steps[d];
+			if (++index[d] < count[d]) break;
+			offset -= steps[d] * count[d];
+			index[d] = 0;
+		}
+		if (d < 0) break;
+	}
+}
+
+void PrefetchClassicView(const ClassicFile *file, const void *data, size_t count, size_t valueStride, size_t elementSize)
+{
+	if (count == 0) return;
+	size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+	size_t first = (size_t)((const unsigned char *)data - file->map);
+	size_t last = first + (count - 1) * valueStride + elementSize;
+	first -= first % pageSize;
+	madvise((void *)(file->map + first), last - first, MADV_WILLNEED);
+}
+
+void GetClassicSlabRange(const ClassicFile *file, int varID, const size_t *start, const size_t *count, const ptrdiff_t *stride,
+	uint64_t *first, uint64_t *last)
+{
+	const ClassicVariable *var = &file->vars[varID];
+	int d;
+	uint64_t offset = var->begin, extent = var->elementSize;
+	for (d = 0; d < var->numDims; d++)
+	{
+		if (count[d] == 0)
+		{
+			*first = *last = var->begin;
+			return;
+		}
+		offset += start[d] * var->dimSteps[d];
+		extent += (count[d] - 1) * (size_t)stride[d] * var->dimSteps[d];
+	}
+	*first = offset;
+	*last = offset + extent;
+}
+
+void ReleaseClassicRange(const ClassicFile *file, uint64_t first, uint64_t last)
+{
+	if (last > file->mapLength) last = file->mapLength;
+	if (first >= last) return;
+	//(the pages at either end may hold values of the next window too, they're just read back in if they do)
+	size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+	first -= first % pageSize;
+	madvise((void *)(file->map + first), (size_t)(last - first), MADV_DONTNEED);
+}
+
+int CheckClassicFileSize(const ClassicFile *file)
+{
+	struct stat fileInfo;
+	if (fstat(file->fd, &fileInfo) != 0 || (uint64_t)fileInfo.st_size < file->mapLength) return -1;
+	return 0;
+}
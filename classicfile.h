@@ -0,0 +1,65 @@
+//classicfile.h: reading classic (CDF-1) and 64-bit offset (CDF-2) NetCDF files straight out of a memory map
+//Copyright 2012, Allen Jordan, allen.jordan@gmail.com
+
+#ifndef CLASSICFILE_H
+#define CLASSICFILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <netcdf.h>
+
+//a variable's layout in the file, values are stored big-endian
+typedef struct
+{
+	nc_type type;
+	size_t elementSize;
+	int numDims;
+	size_t *dimLengths;
+	//bytes between consecutive indices along each dimension (the record size along the record dimension)
+	size_t *dimSteps;
+	int isRecord;
+	//file offset of the first value
+	uint64_t begin;
+} ClassicVariable;
+
+typedef struct
+{
+	int fd;
+	const unsigned char *map;
+	size_t mapLength;
+	//1 for CDF-1, 2 for CDF-2
+	int version;
+	size_t numRecords;
+	//bytes from one record to the next, covering one record of every record variable
+	uint64_t recordSize;
+	//variables in NetCDF variable ID order
+	int numVars;
+	ClassicVariable *vars;
+} ClassicFile;
+
+//map a classic or 64-bit offset file and parse its header
+//returns NULL if the file isn't one (ex: NetCDF-4, CDF-5 or a file still being streamed) or if its header doesn't check out
+ClassicFile *OpenClassicFile(const char *filename);
+void CloseClassicFile(ClassicFile *file);
+
+//get a hyperslab (start/count/stride in the variable's dimension order) as a view into the mapped file, when its values
+//in row-major order are evenly spaced: sets data to the first value and valueStride to the bytes between values
+//returns 1 if the hyperslab is such a view, 0 if it isn't (it then has to be copied with CopyClassicSlab)
+int GetClassicView(const ClassicFile *file, int varID, const size_t *start, const size_t *count, const ptrdiff_t *stride,
+	const void **data, size_t *valueStride);
+//copy a hyperslab out of the mapped file into buffer in row-major order, leaving the values big-endian
+void CopyClassicSlab(const ClassicFile *file, int varID, const size_t *start, const size_t *count, const ptrdiff_t *stride,
+	void *buffer);
+//ask for the pages of a view to be read in ahead of being used
+void PrefetchClassicView(const ClassicFile *file, const void *data, size_t count, size_t valueStride, size_t elementSize);
+//get the range of file offsets [first, last) a hyperslab's values lie in (first == last for an empty one)
+void GetClassicSlabRange(const ClassicFile *file, int varID, const size_t *start, const size_t *count, const ptrdiff_t *stride,
+	uint64_t *first, uint64_t *last);
+//drop the pages of a range of file offsets from this process once their values have been used, so the mapped file
+//doesn't pile up in the resident set (they're read back in from the page cache if they're used again)
+void ReleaseClassicRange(const ClassicFile *file, uint64_t first, uint64_t last);
+//check the file is still as long as it was when it was mapped, touching a page past the end of a truncated file would
+//raise SIGBUS, returns 0 if it is or -1 if it's been cut short
+int CheckClassicFileSize(const ClassicFile *file);
+
+#endif
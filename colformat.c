@@ -0,0 +1,176 @@
+//colformat.c: per-column, type-specialized CSV formatting kernels
+//Copyright 2012, Allen Jordan, allen.jordan@gmail.com
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "colformat.h"
+#include "cftime.h"
+
+//starting text capacity of a block, enough for typical numbers without ever growing
+#define INITIAL_CELL_CAPACITY	24
+
+//make room for at least one more number of any size after the first length bytes of text
+static void GrowColumnText(ColumnText *out, size_t length)
+{
+	while (out->capacity - length < CSV_MAX_NUMBER_LENGTH) out->capacity *= 2;
+	out->text = (char *)realloc(out->text, out->capacity);
+}
+
+//define a kernel that formats every value of a block with one formatting expression
+//the loop has no type dispatch, only a (nearly never taken) check that the text block has room
+#define DEFINE_COLUMN_KERNEL(name, valueType, load, formatExpression) \
+	static void name(const void *data, size_t stride, size_t count, int decimals, ColumnText *out) \
+	{ \
+		const char *source = (const char *)data; \
+		size_t length = 0; \
+		size_t i; \
+		(void)decimals; \
+		for (i = 0; i < count; i++) \
+		{ \
+			if (out->capacity - length < CSV_MAX_NUMBER_LENGTH) GrowColumnText(out, length); \
+			char *cell = out->text + length; \
+			valueType value; \
+			load(valueType, source + i*stride, value); \
+			length += formatExpression; \
+			out->cellEnds[i] = (uint32_t)length; \
+		} \
+	}
+
+DEFINE_COLUMN_KERNEL(FormatByteColumn, unsigned char, LOAD_NATIVE, FormatUInt64(cell, value))
+DEFINE_COLUMN_KERNEL(FormatCharColumn, char, LOAD_NATIVE, (*cell = value, 1))
+DEFINE_COLUMN_KERNEL(FormatShortColumn, short, LOAD_NATIVE, FormatInt64(cell, value))
+DEFINE_COLUMN_KERNEL(FormatIntColumn, int, LOAD_NATIVE, FormatInt64(cell, value))
+DEFINE_COLUMN_KERNEL(FormatFloatColumnShortest, float, LOAD_NATIVE, FormatFloatShortest(cell, value))
+DEFINE_COLUMN_KERNEL(FormatFloatColumnFixed, float, LOAD_NATIVE, FormatDoubleFixed(cell, value, decimals))
+DEFINE_COLUMN_KERNEL(FormatDoubleColumnShortest, double, LOAD_NATIVE, FormatDoubleShortest(cell, value))
+DEFINE_COLUMN_KERNEL(FormatDoubleColumnFixed, double, LOAD_NATIVE, FormatDoubleFixed(cell, value, decimals))
+
+//the same for big-endian values (bytes and characters don't need their own)
+DEFINE_COLUMN_KERNEL(FormatShortColumnBE, short, LOAD_BIG_ENDIAN, FormatInt64(cell, value))
+DEFINE_COLUMN_KERNEL(FormatIntColumnBE, int, LOAD_BIG_ENDIAN, FormatInt64(cell, value))
+DEFINE_COLUMN_KERNEL(FormatFloatColumnShortestBE, float, LOAD_BIG_ENDIAN, FormatFloatShortest(cell, value))
+DEFINE_COLUMN_KERNEL(FormatFloatColumnFixedBE, float, LOAD_BIG_ENDIAN, FormatDoubleFixed(cell, value, decimals))
+DEFINE_COLUMN_KERNEL(FormatDoubleColumnShortestBE, double, LOAD_BIG_ENDIAN, FormatDoubleShortest(cell, value))
+DEFINE_COLUMN_KERNEL(FormatDoubleColumnFixedBE, double, LOAD_BIG_ENDIAN, FormatDoubleFixed(cell, value, decimals))
+
+//the same again for decoded values, leaving the cells of masked (NaN) ones empty
+DEFINE_COLUMN_KERNEL(FormatMaskedFloatColumnShortest, float, LOAD_NATIVE, isnan(value) ? 0 : FormatFloatShortest(cell, value))
+DEFINE_COLUMN_KERNEL(FormatMaskedFloatColumnFixed, float, LOAD_NATIVE, isnan(value) ? 0 : FormatDoubleFixed(cell, value, decimals))
+DEFINE_COLUMN_KERNEL(FormatMaskedDoubleColumnShortest, double, LOAD_NATIVE, isnan(value) ? 0 : FormatDoubleShortest(cell, value))
+DEFINE_COLUMN_KERNEL(FormatMaskedDoubleColumnFixed, double, LOAD_NATIVE, isnan(value) ? 0 : FormatDoubleFixed(cell, value, decimals))
+
+//timestamps, through a cache of the current day and second kept by each formatting thread (a block holds a single
+//column, so the cache only goes back and forth between columns once a block)
+static __thread TimestampCache timestampCache = { INT64_MIN, INT64_MIN, "" };
+DEFINE_COLUMN_KERNEL(FormatTimestampColumn, double, LOAD_NATIVE, FormatTimestamp(cell, value, &timestampCache))
+
+//placeholder for skipped variables, every cell is empty
+static void FormatEmptyColumn(const void *data, size_t stride, size_t count, int decimals, ColumnText *out)
+{
+	(void)data;
+	(void)stride;
+	(void)decimals;
+	memset(out->cellEnds, 0, count * sizeof(uint32_t));
+}
+
+ColumnFormatKernel SelectColumnKernel(nc_type type, int bigEndian, int decimals)
+{
+	switch (type)
+	{
+		case NC_BYTE: return FormatByteColumn;
+		case NC_CHAR: return FormatCharColumn;
+		case NC_SHORT: return bigEndian ? FormatShortColumnBE : FormatShortColumn;
+		case NC_INT: return bigEndian ? FormatIntColumnBE : FormatIntColumn;
+		case NC_FLOAT:
+			if (bigEndian) return (decimals < 0) ? FormatFloatColumnShortestBE : FormatFloatColumnFixedBE;
+			return (decimals < 0) ? FormatFloatColumnShortest : FormatFloatColumnFixed;
+		case NC_DOUBLE:
+			if (bigEndian) return (decimals < 0) ? FormatDoubleColumnShortestBE : FormatDoubleColumnFixedBE;
+			return (decimals < 0) ? FormatDoubleColumnShortest : FormatDoubleColumnFixed;
+		default: return FormatEmptyColumn;
+	}
+}
+
+ColumnFormatKernel SelectMaskedColumnKernel(nc_type type, int decimals)
+{
+	switch (type)
+	{
+		case NC_FLOAT: return (decimals < 0) ? FormatMaskedFloatColumnShortest : FormatMaskedFloatColumnFixed;
+		case NC_DOUBLE: return (decimals < 0) ? FormatMaskedDoubleColumnShortest : FormatMaskedDoubleColumnFixed;
+		default: return SelectColumnKernel(type, 0, decimals);
+	}
+}
+
+ColumnFormatKernel GetTimestampColumnKernel(void)
+{
+	return FormatTimestampColumn;
+}
+
+void InitColumnFormatter(ColumnFormatter *formatter, ColumnFormatKernel kernel, int decimals)
+{
+	formatter->kernel = kernel;
+	formatter->decimals = decimals;
+	formatter->text.capacity = FORMAT_BLOCK_ROWS * INITIAL_CELL_CAPACITY + CSV_MAX_NUMBER_LENGTH;
+	formatter->text.text = (char *)malloc(formatter->text.capacity);
+	formatter->text.cellEnds = (uint32_t *)malloc(FORMAT_BLOCK_ROWS * sizeof(uint32_t));
+}
+
+void FreeColumnFormatter(ColumnFormatter *formatter)
+{
+	free(formatter->text.text);
+	free(formatter->text.cellEnds);
+	formatter->text.text = NULL;
+	formatter->text.cellEnds = NULL;
+}
+
+void WriteRowBlock(CsvWriter *writer, ColumnFormatter *columns, int numColumns, size_t count)
+{
+	size_t row;
+	int column;
+	for (row = 0; row < count; row++)
+	{
+		for (column = 0; column < numColumns; column++)
+		{
+			const ColumnText *text = &columns[column].text;
+			uint32_t start = (row == 0) ? 0 : text->cellEnds[row-1];
+			size_t length = text->cellEnds[row] - start;
+			
+			//room for the cell plus the ", " or "\r\n" after it
+			CsvWriterReserve(writer, length + 2);
+			char *out = writer->buffer + writer->length;
+			memcpy(out, text->text + start, length);
+			if (column != (numColumns-1))
+			{
+				out[length] = ',';
+				out[length+1] = ' ';
+			}
+			else
+			{
+				out[length] = '\r';
+				out[length+1] = '\n';
+			}
+			writer->length += length + 2;
+		}
+	}
+}
+
+void FormatRowRange(ColumnFormatter *columns, int numColumns, const void * const *columnData, const size_t *strides,
+	size_t start, size_t count, CsvWriter *writer)
+{
+	size_t blockStart;
+	int column;
+	for (blockStart = start; blockStart < start + count; blockStart += FORMAT_BLOCK_ROWS)
+	{
+		size_t blockCount = start + count - blockStart;
+		if (blockCount > FORMAT_BLOCK_ROWS) blockCount = FORMAT_BLOCK_ROWS;
+		
+		for (column = 0; column < numColumns; column++)
+		{
+			const void *blockData = NULL;
+			if (columnData[column] != NULL) blockData = (const char *)columnData[column] + blockStart*strides[column];
+			FormatColumnBlock(&columns[column], blockData, strides[column], blockCount);
+		}
+		WriteRowBlock(writer, columns, numColumns, blockCount);
+	}
+}
@@ -0,0 +1,82 @@
+//colformat.h: per-column, type-specialized CSV formatting kernels
+//Copyright 2012, Allen Jordan, allen.jordan@gmail.com
+
+#ifndef COLFORMAT_H
+#define COLFORMAT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <netcdf.h>
+#include "csvwriter.h"
+
+//number of rows formatted per kernel call, small enough that a block of every column stays in cache
+#define FORMAT_BLOCK_ROWS	1024
+
+//load a value from anywhere in memory (a mapped file's values are only 4-byte aligned)
+#define LOAD_NATIVE(valueType, source, value) memcpy(&value, source, sizeof(valueType))
+
+//load a big-endian value, swapping its bytes on the way into the register (classic NetCDF files are big-endian)
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define LOAD_BIG_ENDIAN(valueType, source, value) LOAD_NATIVE(valueType, source, value)
+#else
+#define LOAD_BIG_ENDIAN(valueType, source, value) \
+	do \
+	{ \
+		union { valueType typed; uint16_t u16; uint32_t u32; uint64_t u64; } swap; \
+		memcpy(&swap, source, sizeof(valueType)); \
+		if (sizeof(valueType) == 2) swap.u16 = __builtin_bswap16(swap.u16); \
+		else if (sizeof(valueType) == 4) swap.u32 = __builtin_bswap32(swap.u32); \
+		else if (sizeof(valueType) == 8) swap.u64 = __builtin_bswap64(swap.u64); \
+		value = swap.typed; \
+	} while (0)
+#endif
+
+//text for one block of cells of a single column, cell i is text[cellEnds[i-1], cellEnds[i])
+typedef struct
+{
+	char *text;
+	size_t capacity;
+	uint32_t *cellEnds;
+} ColumnText;
+
+//formats count values of the kernel's type from data into out, value i is stride bytes after value i-1
+typedef void (*ColumnFormatKernel)(const void *data, size_t stride, size_t count, int decimals, ColumnText *out);
+
+//a column's kernel, chosen once per variable, plus its reusable text block
+typedef struct
+{
+	ColumnFormatKernel kernel;
+	int decimals;
+	ColumnText text;
+} ColumnFormatter;
+
+//pick the kernel for a NetCDF type, decimals is CSV_SHORTEST or a fixed number of decimal places
+//bigEndian picks kernels that swap the bytes of each value as it's loaded (for values straight out of a classic file)
+//unsupported types get a kernel that writes empty cells
+ColumnFormatKernel SelectColumnKernel(nc_type type, int bigEndian, int decimals);
+//the same for the float and double columns of CF decoded variables, which are written as empty cells where they're NaN
+//(their masked values), any other type gets its usual kernel
+ColumnFormatKernel SelectMaskedColumnKernel(nc_type type, int decimals);
+//the kernel for doubles holding seconds since 1970, written as ISO 8601 timestamps (see FormatTimestamp)
+ColumnFormatKernel GetTimestampColumnKernel(void);
+
+void InitColumnFormatter(ColumnFormatter *formatter, ColumnFormatKernel kernel, int decimals);
+void FreeColumnFormatter(ColumnFormatter *formatter);
+
+//format one block of rows [0, count) of a column, data points to the first value of the block
+static inline void FormatColumnBlock(ColumnFormatter *formatter, const void *data, size_t stride, size_t count)
+{
+	formatter->kernel(data, stride, count, formatter->decimals, &formatter->text);
+}
+
+//write rows [0, count) of the already formatted columns to the CSV file, with ", " between cells
+void WriteRowBlock(CsvWriter *writer, ColumnFormatter *columns, int numColumns, size_t count);
+
+//format rows [start, start+count) of a window of column data and write them out, a block of rows at a time
+//columnData[c] points at row 0 of column c's window (NULL for empty columns), with strides[c] bytes from row to row
+//(the value size for a buffer of values, or more for a view of a variable interleaved with others in a file)
+void FormatRowRange(ColumnFormatter *columns, int numColumns, const void * const *columnData, const size_t *strides,
+	size_t start, size_t count, CsvWriter *writer);
+
+#endif
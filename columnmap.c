@@ -0,0 +1,310 @@
+//columnmap.c: the table mapping NetCDF variables onto fixed-width flt.dat columns
+//Copyright 2012, Allen Jordan, allen.jordan@gmail.com
+
+#include <stdlib.h>
+#include <string.h>
+#include "columnmap.h"
+#include "csvwriter.h"
+#include "convertstats.h"
+
+//fields per column line
+#define NUM_COLUMN_FIELDS	6
+//rows are written out in blocks of about this many bytes
+#define ROW_BLOCK_SIZE	(256*1024)
+
+//the built-in mapping, in the same format as a --columns file
+static const char *DEFAULT_COLUMN_MAP =
+	"#flt.dat columns, one per line in output order:\n"
+	"#  label, units, source, conversion, width, decimals\n"
+	"#the source is a variable name, or =N for a column that is N on every row\n"
+	"#the conversion is any of *N, /N and +N (or -N), in that order, done in double precision\n"
+	"#an f after the numbers of *N and /N scales in single precision instead, like a C float expression (x/1000)\n"
+	"instrument = Vaisala RS92\n"
+	"Time, min, time, /60, 10, 5\n"
+	"Press, hpa, press, , 10, 2\n"
+	"Alt, km, geopot, /1000f, 10, 4\n"
+	"Temp, deg C, temp, -273.15, 10, 2\n"
+	"RH, %, rh, *100f, 10, 2\n"
+	"TFp V, deg C, FP, -273.15, 10, 2\n"
+	"GPS lat, deg, lat, , 10, 5\n"
+	"GPS lon, deg, lon, , 10, 5\n"
+	"GPS alt, km, alt, /1000f, 10, 4\n"
+	"Wind, m/s, wspeed, , 10, 2\n"
+	"Wind Dir, deg, wdir, , 10, 2\n"
+	"Fl, , =1, , 10, 0\n";
+
+//trim the whitespace off both ends of a string in place
+static char *TrimField(char *text)
+{
+	while (*text == ' ' || *text == '\t') text++;
+	size_t length = strlen(text);
+	while (length > 0 && (text[length-1] == ' ' || text[length-1] == '\t' || text[length-1] == '\r' || text[length-1] == '\n'))
+		text[--length] = '\0';
+	return text;
+}
+
+static char *CopyString(const char *text)
+{
+	char *copy = (char *)malloc(strlen(text) + 1);
+	strcpy(copy, text);
+	return copy;
+}
+
+//parse a conversion like "/1000f" or "*1.8+32", returns 0 on success or -1 if it isn't one
+static int ParseConversion(const char *text, UnitConversion *conversion)
+{
+	conversion->multiplier = 1;
+	conversion->divisor = 1;
+	conversion->offset = 0;
+	conversion->singlePrecision = 0;
+	//the steps have to be written in the order they're applied: multiply, divide, add
+	int lastStep = -1;
+	int numScales = 0, numSinglePrecision = 0;
+	const char *position = text;
+	while (*position != '\0')
+	{
+		char op = *position++;
+		int step = (op == '*') ? 0 : (op == '/') ? 1 : (op == '+' || op == '-') ? 2 : -1;
+		if (step <= lastStep) return -1;
+		lastStep = step;
+
+		char *end;
+		double value = strtod(position, &end);
+		if (end == position) return -1;
+		position = end;
+		if (step < 2)
+		{
+			numScales++;
+			if (*position == 'f')
+			{
+				numSinglePrecision++;
+				position++;
+			}
+		}
+
+		if (step == 0) conversion->multiplier = value;
+		else if (step == 1)
+		{
+			if (value == 0) return -1;
+			conversion->divisor = value;
+		}
+		else conversion->offset = (op == '-') ? -value : value;
+	}
+	//the scaling is either all single precision or all double
+	if (numSinglePrecision != 0 && numSinglePrecision != numScales) return -1;
+	conversion->singlePrecision = (numSinglePrecision != 0);
+	return 0;
+}
+
+//parse one column line, returns 0 on success or -1 if it's malformed
+static int ParseColumnLine(char *line, ColumnMapping *column)
+{
+	char *fields[NUM_COLUMN_FIELDS];
+	int numFields = 0;
+	char *position = line;
+	while (numFields < NUM_COLUMN_FIELDS)
+	{
+		char *comma = strchr(position, ',');
+		fields[numFields++] = position;
+		if (comma == NULL) break;
+		*comma = '\0';
+		position = comma + 1;
+	}
+	if (numFields != NUM_COLUMN_FIELDS || strchr(fields[NUM_COLUMN_FIELDS-1], ',') != NULL) return -1;
+	int i;
+	for (i = 0; i < NUM_COLUMN_FIELDS; i++) fields[i] = TrimField(fields[i]);
+
+	const char *source = fields[2];
+	char *end;
+	if (fields[0][0] == '\0' || source[0] == '\0') return -1;
+	if (source[0] == '=')
+	{
+		column->constant = strtod(source + 1, &end);
+		if (end == source + 1 || *end != '\0') return -1;
+	}
+	if (ParseConversion(fields[3], &column->conversion) != 0) return -1;
+	long width = strtol(fields[4], &end, 10);
+	if (end == fields[4] || *end != '\0' || width < 1 || width > 100) return -1;
+	long decimals = strtol(fields[5], &end, 10);
+	if (end == fields[5] || *end != '\0' || decimals < 0 || decimals > CSV_MAX_DECIMALS) return -1;
+
+	column->label = CopyString(fields[0]);
+	column->units = CopyString(fields[1]);
+	column->variable = (source[0] == '=') ? NULL : CopyString(source);
+	column->width = (int)width;
+	column->decimals = (int)decimals;
+	return 0;
+}
+
+//parse a whole mapping, sourceName names it in error messages
+static ColumnMap *ParseColumnMap(const char *text, const char *sourceName)
+{
+	ColumnMap *map = (ColumnMap *)calloc(1, sizeof(ColumnMap));
+	int capacity = 0;
+	int lineNumber = 0;
+	const char *lineStart = text;
+	while (*lineStart != '\0')
+	{
+		size_t lineLength = strcspn(lineStart, "\n");
+		char *line = (char *)malloc(lineLength + 1);
+		memcpy(line, lineStart, lineLength);
+		line[lineLength] = '\0';
+		lineStart += lineLength;
+		if (*lineStart == '\n') lineStart++;
+		lineNumber++;
+
+		char *content = TrimField(line);
+		int valid = 1;
+		if (content[0] == '\0' || content[0] == '#') ;
+		else if (strncmp(content, "instrument", 10) == 0 && TrimField(content + 10)[0] == '=')
+		{
+			free(map->instrument);
+			map->instrument = CopyString(TrimField(TrimField(content + 10) + 1));
+		}
+		else
+		{
+			if (map->numColumns == capacity)
+			{
+				capacity = (capacity == 0) ? 16 : capacity*2;
+				map->columns = (ColumnMapping *)realloc(map->columns, capacity * sizeof(ColumnMapping));
+			}
+			memset(&map->columns[map->numColumns], 0, sizeof(ColumnMapping));
+			if (ParseColumnLine(content, &map->columns[map->numColumns]) == 0) map->numColumns++;
+			else valid = 0;
+		}
+		free(line);
+
+		if (!valid)
+		{
+			printf("error: %s line %d isn't a valid column (label, units, source, conversion, width, decimals)\n",
+				sourceName, lineNumber);
+			FreeColumnMap(map);
+			return NULL;
+		}
+	}
+
+	if (map->numColumns == 0)
+	{
+		printf("error: %s doesn't map any columns\n", sourceName);
+		FreeColumnMap(map);
+		return NULL;
+	}
+	if (map->instrument == NULL) map->instrument = CopyString("unknown");
+	return map;
+}
+
+ColumnMap *CreateDefaultColumnMap(void)
+{
+	return ParseColumnMap(DEFAULT_COLUMN_MAP, "the built-in column map");
+}
+
+ColumnMap *LoadColumnMap(const char *filename)
+{
+	FILE *file = fopen(filename, "r");
+	if (file == NULL)
+	{
+		printf("error: could not open column map: %s\n", filename);
+		return NULL;
+	}
+	char *text = NULL;
+	size_t length = 0, capacity = 0;
+	size_t bytesRead;
+	do
+	{
+		if (length + 4096 + 1 > capacity)
+		{
+			capacity = length + 4096 + 1 + capacity;
+			text = (char *)realloc(text, capacity);
+		}
+		bytesRead = fread(text + length, 1, capacity - length - 1, file);
+		length += bytesRead;
+	} while (bytesRead > 0);
+	text[length] = '\0';
+	fclose(file);
+
+	ColumnMap *map = ParseColumnMap(text, filename);
+	free(text);
+	return map;
+}
+
+void FreeColumnMap(ColumnMap *map)
+{
+	int i;
+	if (map == NULL) return;
+	for (i = 0; i < map->numColumns; i++)
+	{
+		free(map->columns[i].label);
+		free(map->columns[i].units);
+		free(map->columns[i].variable);
+	}
+	free(map->columns);
+	free(map->instrument);
+	free(map);
+}
+
+void WriteColumnHeaders(FILE *file, const ColumnMap *map)
+{
+	int c;
+	for (c = 0; c < map->numColumns; c++)
+		fprintf(file, "%*s%s", map->columns[c].width, map->columns[c].label, (c < map->numColumns-1) ? "," : "\r\n");
+	for (c = 0; c < map->numColumns; c++)
+	{
+		const ColumnMapping *column = &map->columns[c];
+		//the brackets are padded along with the units, so they sit right against them
+		int padding = column->width - (int)strlen(column->units) - 2;
+		fprintf(file, "%*s[%s]%s", (padding > 0) ? padding : 0, "", column->units, (c < map->numColumns-1) ? "," : "\r\n");
+	}
+}
+
+//write out a block of formatted flt.dat rows, adding the time it took to writeSeconds
+static void WriteFltDatBlock(FILE *file, const char *block, size_t length, double *writeSeconds)
+{
+	double writeStart = GetMonotonicTime();
+	fwrite(block, 1, length, file);
+	*writeSeconds += GetMonotonicTime() - writeStart;
+}
+
+void WriteColumnRows(FILE *file, const ColumnMap *map, double * const *columns, size_t count, double *writeSeconds)
+{
+	//each row is put together with the fast fixed-decimal formatter (which prints exactly what %*.*f would),
+	//into a block of rows that's written in one go once it's full
+	size_t lineCapacity = 2;
+	int c;
+	for (c = 0; c < map->numColumns; c++)
+		lineCapacity += ((map->columns[c].width > CSV_MAX_NUMBER_LENGTH) ? map->columns[c].width : CSV_MAX_NUMBER_LENGTH) + 1;
+	size_t blockCapacity = (lineCapacity > ROW_BLOCK_SIZE) ? lineCapacity : ROW_BLOCK_SIZE;
+	char *block = (char *)malloc(blockCapacity);
+	size_t blockLength = 0;
+	char cell[CSV_MAX_NUMBER_LENGTH];
+
+	size_t i;
+	for (i = 0; i < count; i++)
+	{
+		if (blockLength + lineCapacity > blockCapacity)
+		{
+			WriteFltDatBlock(file, block, blockLength, writeSeconds);
+			blockLength = 0;
+		}
+		char *line = block + blockLength;
+		size_t length = 0;
+		for (c = 0; c < map->numColumns; c++)
+		{
+			int cellLength = FormatDoubleFixed(cell, columns[c][i], map->columns[c].decimals);
+			//right-aligned in the column's width
+			int padding = map->columns[c].width - cellLength;
+			if (padding > 0)
+			{
+				memset(line + length, ' ', padding);
+				length += padding;
+			}
+			memcpy(line + length, cell, cellLength);
+			length += cellLength;
+			if (c < map->numColumns-1) line[length++] = ',';
+		}
+		line[length++] = '\r';
+		line[length++] = '\n';
+		blockLength += length;
+	}
+	if (blockLength > 0) WriteFltDatBlock(file, block, blockLength, writeSeconds);
+	free(block);
+}
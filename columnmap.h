@@ -0,0 +1,45 @@
+//columnmap.h: the table mapping NetCDF variables onto fixed-width flt.dat columns
+//Copyright 2012, Allen Jordan, allen.jordan@gmail.com
+
+#ifndef COLUMNMAP_H
+#define COLUMNMAP_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include "unitconvert.h"
+
+//one output column: where its values come from, how they're converted and how they're printed
+typedef struct
+{
+	char *label;
+	char *units;
+	//source variable, NULL for a column holding the same value on every row (ex: the flag column)
+	char *variable;
+	double constant;
+	UnitConversion conversion;
+	int width;
+	int decimals;
+} ColumnMapping;
+
+typedef struct
+{
+	//shown as the instrument type in the header
+	char *instrument;
+	int numColumns;
+	ColumnMapping *columns;
+} ColumnMap;
+
+//the RS-92 mapping rs92nc2fltdat has always used
+ColumnMap *CreateDefaultColumnMap(void);
+//read a mapping from a file (see DEFAULT_COLUMN_MAP in columnmap.c for the format)
+//returns NULL, after printing what's wrong with it, if the file can't be read or parsed
+ColumnMap *LoadColumnMap(const char *filename);
+void FreeColumnMap(ColumnMap *map);
+
+//write the label and [units] header lines, each right-aligned to its column's width
+void WriteColumnHeaders(FILE *file, const ColumnMap *map);
+//write count rows of converted values, columns[c] holding column c's values (constant columns are filled in already)
+//the time spent writing (rather than formatting) is added to writeSeconds
+void WriteColumnRows(FILE *file, const ColumnMap *map, double * const *columns, size_t count, double *writeSeconds);
+
+#endif
@@ -0,0 +1,174 @@
+//convertstats.c: phase timings and counters for each file converted, summed up over a batch
+//Copyright 2012, Allen Jordan, allen.jordan@gmail.com
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include "convertstats.h"
+
+static const char *phaseNames[NUM_PHASES] = { "open", "metadata", "read", "format", "write", "close" };
+
+void InitConvertStats(ConvertStats *stats)
+{
+	memset(stats, 0, sizeof(ConvertStats));
+}
+
+void AddConvertStats(ConvertStats *total, const ConvertStats *stats)
+{
+	int phase;
+	total->numFiles += stats->numFiles;
+	total->numFailed += stats->numFailed;
+	for (phase = 0; phase < NUM_PHASES; phase++) total->phaseSeconds[phase] += stats->phaseSeconds[phase];
+	total->totalSeconds += stats->totalSeconds;
+	total->bytesRead += stats->bytesRead;
+	total->bytesWritten += stats->bytesWritten;
+	total->rows += stats->rows;
+	total->cells += stats->cells;
+	total->allocations += stats->allocations;
+	total->allocatedBytes += stats->allocatedBytes;
+	if (stats->peakRSSKB > total->peakRSSKB) total->peakRSSKB = stats->peakRSSKB;
+}
+
+void CollectConvertStats(const void *stats, void *total)
+{
+	AddConvertStats((ConvertStats *)total, (const ConvertStats *)stats);
+}
+
+void FinishConvertStats(ConvertStats *stats, const char *outputFilename)
+{
+	struct rusage usage;
+	stats->peakRSSKB = (getrusage(RUSAGE_SELF, &usage) == 0) ? usage.ru_maxrss : 0;
+	struct stat outputInfo;
+	stats->bytesWritten = (outputFilename != NULL && stat(outputFilename, &outputInfo) == 0) ? (uint64_t)outputInfo.st_size : 0;
+}
+
+//write a string as a quoted JSON string
+static void WriteJSONString(FILE *out, const char *text)
+{
+	fputc('"', out);
+	for (; *text != '\0'; text++)
+	{
+		unsigned char c = (unsigned char)*text;
+		if (c == '"' || c == '\\') fprintf(out, "\\%c", c);
+		else if (c < 0x20) fprintf(out, "\\u%04x", c);
+		else fputc(c, out);
+	}
+	fputc('"', out);
+}
+
+//the fields shared by a file's stats and a batch's
+static void WriteStatsFields(FILE *out, const ConvertStats *stats)
+{
+	int phase;
+	fprintf(out, "\"total_s\":%.6f,\"phases\":{", stats->totalSeconds);
+	for (phase = 0; phase < NUM_PHASES; phase++)
+		fprintf(out, "%s\"%s_s\":%.6f", (phase > 0) ? "," : "", phaseNames[phase], stats->phaseSeconds[phase]);
+	fprintf(out, "},\"bytes_read\":%llu,\"bytes_written\":%llu,\"rows\":%llu,\"cells\":%llu,\"allocations\":%llu,"
+		"\"allocated_bytes\":%llu,\"peak_rss_kb\":%ld", (unsigned long long)stats->bytesRead,
+		(unsigned long long)stats->bytesWritten, (unsigned long long)stats->rows, (unsigned long long)stats->cells,
+		(unsigned long long)stats->allocations, (unsigned long long)stats->allocatedBytes, stats->peakRSSKB);
+}
+
+void WriteFileStatsJSON(FILE *out, const char *filename, int status, const ConvertStats *stats,
+	const VariableStats *vars, int numVars)
+{
+	int i;
+	fprintf(out, "{\"file\":");
+	WriteJSONString(out, filename);
+	fprintf(out, ",\"status\":%d,", status);
+	WriteStatsFields(out, stats);
+	fprintf(out, ",\"variables\":[");
+	for (i = 0; i < numVars; i++)
+	{
+		fprintf(out, "%s{\"name\":", (i > 0) ? "," : "");
+		WriteJSONString(out, vars[i].name);
+		fprintf(out, ",\"read_s\":%.6f,\"bytes_read\":%llu}", vars[i].readSeconds, (unsigned long long)vars[i].bytesRead);
+	}
+	fprintf(out, "]}\n");
+}
+
+void WriteBatchStatsJSON(FILE *out, const ConvertStats *totals, double wallSeconds)
+{
+	fprintf(out, "{\"batch\":{\"files\":%d,\"failed\":%d,\"wall_s\":%.6f},", totals->numFiles, totals->numFailed, wallSeconds);
+	WriteStatsFields(out, totals);
+	fprintf(out, "}\n");
+}
+
+//open statsDir/name for writing, printing why if it can't be
+static FILE *OpenStatsFile(const char *statsDir, const char *name)
+{
+	size_t pathLength = strlen(statsDir) + strlen(name) + 2;
+	char *path = (char *)malloc(pathLength);
+	snprintf(path, pathLength, "%s/%s", statsDir, name);
+	FILE *file = fopen(path, "w");
+	if (file == NULL) printf("warning: could not write stats file: %s\n", path);
+	free(path);
+	return file;
+}
+
+void ReportFileStats(const char *filename, int status, const ConvertStats *stats, const VariableStats *vars, int numVars,
+	int toStderr, const char *statsDir)
+{
+	if (toStderr) WriteFileStatsJSON(stderr, filename, status, stats, vars, numVars);
+	if (statsDir == NULL) return;
+
+	//named after the input file, without its directory or .nc extension
+	const char *baseName = strrchr(filename, '/');
+	baseName = (baseName != NULL) ? baseName + 1 : filename;
+	size_t baseLength = strlen(baseName);
+	if (baseLength > 3 && strcmp(baseName + baseLength - 3, ".nc") == 0) baseLength -= 3;
+	char *statsName = (char *)malloc(baseLength + 12);
+	snprintf(statsName, baseLength + 12, "%.*s.stats.json", (int)baseLength, baseName);
+	FILE *file = OpenStatsFile(statsDir, statsName);
+	free(statsName);
+	if (file == NULL) return;
+	WriteFileStatsJSON(file, filename, status, stats, vars, numVars);
+	fclose(file);
+}
+
+void ReportBatchStats(const ConvertStats *totals, double wallSeconds, int toStderr, const char *statsDir)
+{
+	if (toStderr) WriteBatchStatsJSON(stderr, totals, wallSeconds);
+	if (statsDir == NULL) return;
+	FILE *file = OpenStatsFile(statsDir, "batch.stats.json");
+	if (file == NULL) return;
+	WriteBatchStatsJSON(file, totals, wallSeconds);
+	fclose(file);
+}
+
+void InitWatchStats(WatchStats *stats)
+{
+	memset(stats, 0, sizeof(WatchStats));
+	stats->startTime = GetMonotonicTime();
+}
+
+void AddWatchedFile(WatchStats *stats, int status, double latencySeconds)
+{
+	stats->numFiles++;
+	if (status != 0) stats->numFailed++;
+	stats->totalLatency += latencySeconds;
+	if (latencySeconds > stats->maxLatency) stats->maxLatency = latencySeconds;
+}
+
+void WriteWatchStatsJSON(FILE *out, const char *filename, int status, double latencySeconds, const WatchStats *stats)
+{
+	double uptime = GetMonotonicTime() - stats->startTime;
+	fprintf(out, "{\"watch\":{\"file\":");
+	WriteJSONString(out, filename);
+	fprintf(out, ",\"status\":%d,\"latency_s\":%.6f,\"files\":%d,\"failed\":%d,\"uptime_s\":%.3f,\"files_per_s\":%.6f,"
+		"\"mean_latency_s\":%.6f,\"max_latency_s\":%.6f}}\n", status, latencySeconds, stats->numFiles, stats->numFailed, uptime,
+		(uptime > 0) ? stats->numFiles / uptime : 0.0, (stats->numFiles > 0) ? stats->totalLatency / stats->numFiles : 0.0,
+		stats->maxLatency);
+}
+
+void ReportWatchStats(const char *filename, int status, double latencySeconds, const WatchStats *stats, int toStderr,
+	const char *statsDir)
+{
+	if (toStderr) WriteWatchStatsJSON(stderr, filename, status, latencySeconds, stats);
+	if (statsDir == NULL) return;
+	FILE *file = OpenStatsFile(statsDir, "watch.stats.json");
+	if (file == NULL) return;
+	WriteWatchStatsJSON(file, filename, status, latencySeconds, stats);
+	fclose(file);
+}
@@ -0,0 +1,107 @@
+//convertstats.h: phase timings and counters for each file converted, summed up over a batch
+//Copyright 2012, Allen Jordan, allen.jordan@gmail.com
+
+#ifndef CONVERTSTATS_H
+#define CONVERTSTATS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "pipeline.h"
+
+//where the time converting a file goes
+typedef enum
+{
+	PHASE_OPEN,
+	PHASE_METADATA,
+	PHASE_READ,
+	PHASE_FORMAT,
+	PHASE_WRITE,
+	PHASE_CLOSE,
+	NUM_PHASES
+} ConvertPhase;
+
+//the timings and counters of one file, or the sum over a batch of them
+//(fixed size with no pointers, so a worker process can send it back through its result pipe)
+typedef struct
+{
+	int numFiles;
+	int numFailed;
+	double phaseSeconds[NUM_PHASES];
+	double totalSeconds;
+	uint64_t bytesRead;
+	//bytes in the output file (compressed, for gzip output)
+	uint64_t bytesWritten;
+	uint64_t rows;
+	uint64_t cells;
+	//buffers allocated for the data, and their total size
+	uint64_t allocations;
+	uint64_t allocatedBytes;
+	//the most of any file (the process's peak so far when the file finished)
+	long peakRSSKB;
+} ConvertStats;
+
+//time spent reading a single variable, and how much of it was read
+typedef struct
+{
+	const char *name;
+	double readSeconds;
+	uint64_t bytesRead;
+} VariableStats;
+
+//how quickly the files arriving in watched directories are converted
+typedef struct
+{
+	int numFiles;
+	int numFailed;
+	//when watching started
+	double startTime;
+	//from each file being completely written to its output being closed
+	double totalLatency;
+	double maxLatency;
+} WatchStats;
+
+//add the time since a lap started to a phase, returns the time now so the next phase's lap starts there
+static inline double LapPhase(ConvertStats *stats, ConvertPhase phase, double lapStart)
+{
+	double now = GetMonotonicTime();
+	stats->phaseSeconds[phase] += now - lapStart;
+	return now;
+}
+
+static inline void CountAllocation(ConvertStats *stats, size_t bytes)
+{
+	stats->allocations++;
+	stats->allocatedBytes += bytes;
+}
+
+//start a file's stats at zero
+void InitConvertStats(ConvertStats *stats);
+//add a file's stats (or another batch's) to a batch total
+void AddConvertStats(ConvertStats *total, const ConvertStats *stats);
+//AddConvertStats as a BatchRecord collect function, with the batch total as its context
+void CollectConvertStats(const void *stats, void *total);
+//set the peak RSS and the output size (0 if the output file can't be found) once a file is finished
+void FinishConvertStats(ConvertStats *stats, const char *outputFilename);
+
+//write a file's stats as one line of JSON, with the time and bytes read of each variable
+void WriteFileStatsJSON(FILE *out, const char *filename, int status, const ConvertStats *stats,
+	const VariableStats *vars, int numVars);
+//write a batch's totals as one line of JSON, wallSeconds is the time the whole batch took
+void WriteBatchStatsJSON(FILE *out, const ConvertStats *totals, double wallSeconds);
+//write a file's stats to stderr (when toStderr) and/or to statsDir/<input name>.stats.json (when statsDir isn't NULL)
+void ReportFileStats(const char *filename, int status, const ConvertStats *stats, const VariableStats *vars, int numVars,
+	int toStderr, const char *statsDir);
+//the same for a batch's totals, written to statsDir/batch.stats.json
+void ReportBatchStats(const ConvertStats *totals, double wallSeconds, int toStderr, const char *statsDir);
+
+//start watching's stats at zero, with startTime as now
+void InitWatchStats(WatchStats *stats);
+//add a file converted from a watched directory, latencySeconds after it was completely written
+void AddWatchedFile(WatchStats *stats, int status, double latencySeconds);
+//write one line of JSON for a file converted from a watched directory, with the throughput and latency so far
+void WriteWatchStatsJSON(FILE *out, const char *filename, int status, double latencySeconds, const WatchStats *stats);
+//write it to stderr (when toStderr) and/or replace statsDir/watch.stats.json with it (when statsDir isn't NULL)
+void ReportWatchStats(const char *filename, int status, double latencySeconds, const WatchStats *stats, int toStderr,
+	const char *statsDir);
+
+#endif
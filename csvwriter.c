@@ -0,0 +1,750 @@
+//csvwriter.c: buffered text output and hand-written number formatting for the converters
+//Copyright 2012, Allen Jordan, allen.jordan@gmail.com
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <math.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "csvwriter.h"
+#include "convertstats.h"
+
+//a writer for an open file, or -1 for one that only collects text in memory
+static CsvWriter *CreateWriter(int fd)
+{
+	CsvWriter *writer = (CsvWriter *)malloc(sizeof(CsvWriter));
+	writer->fd = fd;
+	writer->gzip = NULL;
+	writer->buffer = (char *)malloc(CSV_WRITER_BUFFER_SIZE);
+	writer->length = 0;
+	writer->capacity = CSV_WRITER_BUFFER_SIZE;
+	writer->bytesWritten = 0;
+	writer->writeSeconds = 0;
+	writer->error = 0;
+	return writer;
+}
+
+CsvWriter *CsvWriterOpen(const char *filename)
+{
+	int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) return NULL;
+	return CreateWriter(fd);
+}
+
+CsvWriter *CsvWriterOpenAt(const char *filename, uint64_t offset)
+{
+	int fd = open(filename, O_WRONLY);
+	if (fd < 0) return NULL;
+	if (ftruncate(fd, (off_t)offset) != 0 || lseek(fd, 0, SEEK_END) < 0)
+	{
+		close(fd);
+		return NULL;
+	}
+	return CreateWriter(fd);
+}
+
+CsvWriter *CsvWriterOpenMemory(void)
+{
+	return CreateWriter(-1);
+}
+
+//compress everything written from here on
+static CsvWriter *AttachGzipStream(CsvWriter *writer, int numThreads, int level)
+{
+	if (writer == NULL) return NULL;
+	writer->gzip = CreateGzipStream(writer->fd, numThreads, level);
+	if (writer->gzip == NULL)
+	{
+		CsvWriterClose(writer);
+		return NULL;
+	}
+	return writer;
+}
+
+CsvWriter *CsvWriterOpenGzip(const char *filename, int numThreads, int level)
+{
+	return AttachGzipStream(CsvWriterOpen(filename), numThreads, level);
+}
+
+CsvWriter *CsvWriterOpenGzipAt(const char *filename, uint64_t offset, int numThreads, int level)
+{
+	return AttachGzipStream(CsvWriterOpenAt(filename, offset), numThreads, level);
+}
+
+void CsvWriterMakeRoom(CsvWriter *writer, size_t length)
+{
+	if (writer->fd >= 0)
+	{
+		CsvWriterFlush(writer);
+		return;
+	}
+	while (writer->capacity - writer->length < length) writer->capacity *= 2;
+	writer->buffer = (char *)realloc(writer->buffer, writer->capacity);
+}
+
+//send bytes on to the file, or to the gzip stream (whose write errors come back when it's finished)
+static void WriteOut(CsvWriter *writer, const char *bytes, size_t length)
+{
+	double startTime = GetMonotonicTime();
+	if (writer->gzip != NULL)
+	{
+		GzipStreamWrite(writer->gzip, bytes, length);
+		writer->bytesWritten += length;
+	}
+	else
+	{
+		while (length > 0 && writer->error == 0)
+		{
+			ssize_t written = write(writer->fd, bytes, length);
+			if (written < 0)
+			{
+				if (errno == EINTR) continue;
+				writer->error = errno;
+				break;
+			}
+			bytes += written;
+			length -= (size_t)written;
+			writer->bytesWritten += (uint64_t)written;
+		}
+	}
+	writer->writeSeconds += GetMonotonicTime() - startTime;
+}
+
+int CsvWriterFlush(CsvWriter *writer)
+{
+	//memory writers keep everything until the owner takes it
+	if (writer->fd < 0) return 0;
+	
+	if (writer->length > 0) WriteOut(writer, writer->buffer, writer->length);
+	writer->length = 0;
+	return (writer->error == 0) ? 0 : -1;
+}
+
+int CsvWriterClose(CsvWriter *writer)
+{
+	CsvWriterFlush(writer);
+	if (writer->gzip != NULL)
+	{
+		int error = FinishGzipStream(writer->gzip);
+		if (error != 0 && writer->error == 0) writer->error = error;
+	}
+	if (writer->fd >= 0 && close(writer->fd) != 0 && writer->error == 0) writer->error = errno;
+	int result = (writer->error == 0) ? 0 : -1;
+	free(writer->buffer);
+	free(writer);
+	return result;
+}
+
+void CsvWriterPutBytes(CsvWriter *writer, const char *bytes, size_t length)
+{
+	//anything bigger than the whole buffer goes straight out after whatever is already buffered
+	if (length > writer->capacity && writer->fd >= 0)
+	{
+		CsvWriterFlush(writer);
+		WriteOut(writer, bytes, length);
+		return;
+	}
+	
+	CsvWriterReserve(writer, length);
+	memcpy(writer->buffer + writer->length, bytes, length);
+	writer->length += length;
+}
+
+void CsvWriterPutString(CsvWriter *writer, const char *str)
+{
+	CsvWriterPutBytes(writer, str, strlen(str));
+}
+
+void CsvWriterPutChar(CsvWriter *writer, char c)
+{
+	CsvWriterReserve(writer, 1);
+	writer->buffer[writer->length++] = c;
+}
+
+void CsvWriterPrintf(CsvWriter *writer, const char *format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	size_t available = writer->capacity - writer->length;
+	int length = vsnprintf(writer->buffer + writer->length, available, format, args);
+	va_end(args);
+	if (length < 0) return;
+	if ((size_t)length < available)
+	{
+		writer->length += (size_t)length;
+		return;
+	}
+	
+	//didn't fit, so format into a temporary string of the right size instead
+	char *text = (char *)malloc((size_t)length + 1);
+	va_start(args, format);
+	vsnprintf(text, (size_t)length + 1, format, args);
+	va_end(args);
+	CsvWriterPutBytes(writer, text, (size_t)length);
+	free(text);
+}
+
+void CsvWriterPutInt(CsvWriter *writer, int64_t value)
+{
+	CsvWriterReserve(writer, CSV_MAX_NUMBER_LENGTH);
+	writer->length += FormatInt64(writer->buffer + writer->length, value);
+}
+
+void CsvWriterPutUInt(CsvWriter *writer, uint64_t value)
+{
+	CsvWriterReserve(writer, CSV_MAX_NUMBER_LENGTH);
+	writer->length += FormatUInt64(writer->buffer + writer->length, value);
+}
+
+void CsvWriterPutFloat(CsvWriter *writer, float value, int decimals)
+{
+	CsvWriterReserve(writer, CSV_MAX_NUMBER_LENGTH);
+	char *out = writer->buffer + writer->length;
+	writer->length += (decimals < 0) ? FormatFloatShortest(out, value) : FormatDoubleFixed(out, value, decimals);
+}
+
+void CsvWriterPutDouble(CsvWriter *writer, double value, int decimals)
+{
+	CsvWriterReserve(writer, CSV_MAX_NUMBER_LENGTH);
+	char *out = writer->buffer + writer->length;
+	writer->length += (decimals < 0) ? FormatDoubleShortest(out, value) : FormatDoubleFixed(out, value, decimals);
+}
+
+//---------------------------------------------------------------------------------------------
+//integer formatting
+
+//pairs of decimal digits, so integers are converted two digits per division
+static const char digitPairs[201] =
+	"00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+	"40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+	"8081828384858687888990919293949596979899";
+
+int FormatUInt64(char *out, uint64_t value)
+{
+	char digits[20];
+	int position = 20;
+	while (value >= 100)
+	{
+		unsigned pair = (unsigned)(value % 100) * 2;
+		value /= 100;
+		digits[--position] = digitPairs[pair + 1];
+		digits[--position] = digitPairs[pair];
+	}
+	if (value >= 10)
+	{
+		unsigned pair = (unsigned)value * 2;
+		digits[--position] = digitPairs[pair + 1];
+		digits[--position] = digitPairs[pair];
+	}
+	else digits[--position] = (char)('0' + value);
+	
+	int length = 20 - position;
+	memcpy(out, digits + position, length);
+	return length;
+}
+
+int FormatInt64(char *out, int64_t value)
+{
+	if (value < 0)
+	{
+		out[0] = '-';
+		return 1 + FormatUInt64(out + 1, (uint64_t)0 - (uint64_t)value);
+	}
+	return FormatUInt64(out, (uint64_t)value);
+}
+
+//---------------------------------------------------------------------------------------------
+//shortest round-trip floating point formatting (Grisu3, after Florian Loitsch's "Printing
+//Floating-Point Numbers Quickly and Accurately with Integers")
+//Grisu3 knows when its digits might not be the shortest (around 1% of values), those are found
+//by an exact search instead, so the digits are always the shortest that read back as the value
+
+//a do-it-yourself floating point number: f * 2^e
+typedef struct
+{
+	uint64_t f;
+	int e;
+} DiyFp;
+
+//normalized 64-bit approximations of 10^k for k = -348, -340, ..., 340
+static const uint64_t cachedPowersF[] =
+{
+	UINT64_C(0xfa8fd5a0081c0288), UINT64_C(0xbaaee17fa23ebf76), UINT64_C(0x8b16fb203055ac76),
+	UINT64_C(0xcf42894a5dce35ea), UINT64_C(0x9a6bb0aa55653b2d), UINT64_C(0xe61acf033d1a45df),
+	UINT64_C(0xab70fe17c79ac6ca), UINT64_C(0xff77b1fcbebcdc4f), UINT64_C(0xbe5691ef416bd60c),
+	UINT64_C(0x8dd01fad907ffc3c), UINT64_C(0xd3515c2831559a83), UINT64_C(0x9d71ac8fada6c9b5),
+	UINT64_C(0xea9c227723ee8bcb), UINT64_C(0xaecc49914078536d), UINT64_C(0x823c12795db6ce57),
+	UINT64_C(0xc21094364dfb5637), UINT64_C(0x9096ea6f3848984f), UINT64_C(0xd77485cb25823ac7),
+	UINT64_C(0xa086cfcd97bf97f4), UINT64_C(0xef340a98172aace5), UINT64_C(0xb23867fb2a35b28e),
+	UINT64_C(0x84c8d4dfd2c63f3b), UINT64_C(0xc5dd44271ad3cdba), UINT64_C(0x936b9fcebb25c996),
+	UINT64_C(0xdbac6c247d62a584), UINT64_C(0xa3ab66580d5fdaf6), UINT64_C(0xf3e2f893dec3f126),
+	UINT64_C(0xb5b5ada8aaff80b8), UINT64_C(0x87625f056c7c4a8b), UINT64_C(0xc9bcff6034c13053),
+	UINT64_C(0x964e858c91ba2655), UINT64_C(0xdff9772470297ebd), UINT64_C(0xa6dfbd9fb8e5b88f),
+	UINT64_C(0xf8a95fcf88747d94), UINT64_C(0xb94470938fa89bcf), UINT64_C(0x8a08f0f8bf0f156b),
+	UINT64_C(0xcdb02555653131b6), UINT64_C(0x993fe2c6d07b7fac), UINT64_C(0xe45c10c42a2b3b06),
+	UINT64_C(0xaa242499697392d3), UINT64_C(0xfd87b5f28300ca0e), UINT64_C(0xbce5086492111aeb),
+	UINT64_C(0x8cbccc096f5088cc), UINT64_C(0xd1b71758e219652c), UINT64_C(0x9c40000000000000),
+	UINT64_C(0xe8d4a51000000000), UINT64_C(0xad78ebc5ac620000), UINT64_C(0x813f3978f8940984),
+	UINT64_C(0xc097ce7bc90715b3), UINT64_C(0x8f7e32ce7bea5c70), UINT64_C(0xd5d238a4abe98068),
+	UINT64_C(0x9f4f2726179a2245), UINT64_C(0xed63a231d4c4fb27), UINT64_C(0xb0de65388cc8ada8),
+	UINT64_C(0x83c7088e1aab65db), UINT64_C(0xc45d1df942711d9a), UINT64_C(0x924d692ca61be758),
+	UINT64_C(0xda01ee641a708dea), UINT64_C(0xa26da3999aef774a), UINT64_C(0xf209787bb47d6b85),
+	UINT64_C(0xb454e4a179dd1877), UINT64_C(0x865b86925b9bc5c2), UINT64_C(0xc83553c5c8965d3d),
+	UINT64_C(0x952ab45cfa97a0b3), UINT64_C(0xde469fbd99a05fe3), UINT64_C(0xa59bc234db398c25),
+	UINT64_C(0xf6c69a72a3989f5c), UINT64_C(0xb7dcbf5354e9bece), UINT64_C(0x88fcf317f22241e2),
+	UINT64_C(0xcc20ce9bd35c78a5), UINT64_C(0x98165af37b2153df), UINT64_C(0xe2a0b5dc971f303a),
+	UINT64_C(0xa8d9d1535ce3b396), UINT64_C(0xfb9b7cd9a4a7443c), UINT64_C(0xbb764c4ca7a44410),
+	UINT64_C(0x8bab8eefb6409c1a), UINT64_C(0xd01fef10a657842c), UINT64_C(0x9b10a4e5e9913129),
+	UINT64_C(0xe7109bfba19c0c9d), UINT64_C(0xac2820d9623bf429), UINT64_C(0x80444b5e7aa7cf85),
+	UINT64_C(0xbf21e44003acdd2d), UINT64_C(0x8e679c2f5e44ff8f), UINT64_C(0xd433179d9c8cb841),
+	UINT64_C(0x9e19db92b4e31ba9), UINT64_C(0xeb96bf6ebadf77d9), UINT64_C(0xaf87023b9bf0ee6b),
+};
+static const int16_t cachedPowersE[] =
+{
+	-1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980, -954, -927,
+	-901, -874, -847, -821, -794, -768, -741, -715, -688, -661, -635, -608,
+	-582, -555, -529, -502, -475, -449, -422, -396, -369, -343, -316, -289,
+	-263, -236, -210, -183, -157, -130, -103, -77, -50, -24, 3, 30,
+	56, 83, 109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+	375, 402, 428, 455, 481, 508, 534, 561, 588, 614, 641, 667,
+	694, 720, 747, 774, 800, 827, 853, 880, 907, 933, 960, 986,
+	1013, 1039, 1066,
+};
+
+static const uint64_t powersOf10[20] =
+{
+	UINT64_C(1), UINT64_C(10), UINT64_C(100), UINT64_C(1000), UINT64_C(10000), UINT64_C(100000),
+	UINT64_C(1000000), UINT64_C(10000000), UINT64_C(100000000), UINT64_C(1000000000),
+	UINT64_C(10000000000), UINT64_C(100000000000), UINT64_C(1000000000000), UINT64_C(10000000000000),
+	UINT64_C(100000000000000), UINT64_C(1000000000000000), UINT64_C(10000000000000000),
+	UINT64_C(100000000000000000), UINT64_C(1000000000000000000), UINT64_C(10000000000000000000)
+};
+
+static inline DiyFp DiyFpMultiply(DiyFp x, DiyFp y)
+{
+	const uint64_t M32 = 0xFFFFFFFFu;
+	uint64_t a = x.f >> 32, b = x.f & M32;
+	uint64_t c = y.f >> 32, d = y.f & M32;
+	uint64_t ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+	uint64_t tmp = (bd >> 32) + (ad & M32) + (bc & M32);
+	//round the lower half
+	tmp += 1U << 31;
+	DiyFp result = { ac + (ad >> 32) + (bc >> 32) + (tmp >> 32), x.e + y.e + 64 };
+	return result;
+}
+
+static inline DiyFp DiyFpNormalize(DiyFp v)
+{
+	int shift = __builtin_clzll(v.f);
+	v.f <<= shift;
+	v.e -= shift;
+	return v;
+}
+
+//get the normalized boundaries halfway to the neighbouring representable values
+//lowerCloser is set for exact powers of two, where the gap to the next smaller value is half as big
+static void NormalizedBoundaries(DiyFp v, int lowerCloser, DiyFp *minus, DiyFp *plus)
+{
+	DiyFp upper = { (v.f << 1) + 1, v.e - 1 };
+	upper = DiyFpNormalize(upper);
+	DiyFp lower;
+	if (lowerCloser)
+	{
+		lower.f = (v.f << 2) - 1;
+		lower.e = v.e - 2;
+	}
+	else
+	{
+		lower.f = (v.f << 1) - 1;
+		lower.e = v.e - 1;
+	}
+	lower.f <<= lower.e - upper.e;
+	lower.e = upper.e;
+	*minus = lower;
+	*plus = upper;
+}
+
+//get a cached power of ten c = 10^-K such that c * 2^e lands the product's exponent in [-60, -32]
+static DiyFp GetCachedPower(int e, int *K)
+{
+	double dk = (-61 - e) * 0.30102999566398114 + 347;
+	int k = (int)dk;
+	if (dk - k > 0.0) k++;
+	unsigned index = (unsigned)((k >> 3) + 1);
+	*K = -(-348 + (int)(index * 8));
+	DiyFp power = { cachedPowersF[index], cachedPowersE[index] };
+	return power;
+}
+
+static inline int CountDecimalDigits32(uint32_t n)
+{
+	if (n < 10) return 1;
+	if (n < 100) return 2;
+	if (n < 1000) return 3;
+	if (n < 10000) return 4;
+	if (n < 100000) return 5;
+	if (n < 1000000) return 6;
+	if (n < 10000000) return 7;
+	if (n < 100000000) return 8;
+	return 9;
+}
+
+//nudge the last digit towards the real value while staying inside the rounding interval
+//returns 0 if the digits can't be shown to be the shortest and closest ones, given the error of up to unit in the
+//scaled values (the caller then falls back to the exact search)
+static int RoundWeed(char *buffer, int length, uint64_t distanceTooHighW, uint64_t unsafeInterval, uint64_t rest,
+	uint64_t tenKappa, uint64_t unit)
+{
+	uint64_t smallDistance = distanceTooHighW - unit;
+	uint64_t bigDistance = distanceTooHighW + unit;
+	while (rest < smallDistance && unsafeInterval - rest >= tenKappa &&
+		(rest + tenKappa < smallDistance || smallDistance - rest >= rest + tenKappa - smallDistance))
+	{
+		buffer[length - 1]--;
+		rest += tenKappa;
+	}
+	//the digits one lower might be closer after all
+	if (rest < bigDistance && unsafeInterval - rest >= tenKappa &&
+		(rest + tenKappa < bigDistance || bigDistance - rest > rest + tenKappa - bigDistance))
+		return 0;
+	//and the digits have to be safely inside the interval
+	return (2 * unit <= rest) && (rest <= unsafeInterval - 4 * unit);
+}
+
+//generate the shortest digits inside the (conservatively widened) interval (low, high) around w
+//returns 0 if they couldn't be verified
+static int DigitGen(DiyFp low, DiyFp w, DiyFp high, char *buffer, int *length, int *K)
+{
+	uint64_t unit = 1;
+	DiyFp tooLow = { low.f - unit, low.e };
+	DiyFp tooHigh = { high.f + unit, high.e };
+	uint64_t unsafeInterval = tooHigh.f - tooLow.f;
+	DiyFp one = { (uint64_t)1 << -w.e, w.e };
+	uint32_t p1 = (uint32_t)(tooHigh.f >> -one.e);
+	uint64_t p2 = tooHigh.f & (one.f - 1);
+	int kappa = CountDecimalDigits32(p1);
+	*length = 0;
+	
+	//integer part digits
+	while (kappa > 0)
+	{
+		uint32_t divisor = (uint32_t)powersOf10[kappa - 1];
+		uint32_t d = p1 / divisor;
+		p1 %= divisor;
+		if (d || *length) buffer[(*length)++] = (char)('0' + d);
+		kappa--;
+		uint64_t rest = ((uint64_t)p1 << -one.e) + p2;
+		if (rest < unsafeInterval)
+		{
+			*K += kappa;
+			return RoundWeed(buffer, *length, tooHigh.f - w.f, unsafeInterval, rest, (uint64_t)divisor << -one.e, unit);
+		}
+	}
+	
+	//fractional part digits
+	for (;;)
+	{
+		p2 *= 10;
+		unit *= 10;
+		unsafeInterval *= 10;
+		char d = (char)(p2 >> -one.e);
+		if (d || *length) buffer[(*length)++] = (char)('0' + d);
+		p2 &= one.f - 1;
+		kappa--;
+		if (p2 < unsafeInterval)
+		{
+			*K += kappa;
+			return RoundWeed(buffer, *length, (tooHigh.f - w.f) * unit, unsafeInterval, p2, one.f, unit);
+		}
+	}
+}
+
+//generate the decimal digits of v, with v ~= digits * 10^K
+//returns 0 if they might not be the shortest
+static int Grisu3(DiyFp v, int lowerCloser, char *buffer, int *length, int *K)
+{
+	DiyFp minus, plus;
+	NormalizedBoundaries(v, lowerCloser, &minus, &plus);
+	DiyFp cachedPower = GetCachedPower(plus.e, K);
+	DiyFp W = DiyFpMultiply(DiyFpNormalize(v), cachedPower);
+	DiyFp Wp = DiyFpMultiply(plus, cachedPower);
+	DiyFp Wm = DiyFpMultiply(minus, cachedPower);
+	return DigitGen(Wm, W, Wp, buffer, length, K);
+}
+
+//check whether digits * 10^(exponent - length + 1) reads back as value (as a float when isFloat is set)
+static int DigitsReadBack(const char *digits, int length, int exponent, double value, int isFloat)
+{
+	char text[40];
+	int i, n = 0;
+	text[n++] = digits[0];
+	text[n++] = '.';
+	for (i = 1; i < length; i++) text[n++] = digits[i];
+	snprintf(&text[n], sizeof(text) - n, "e%d", exponent);
+	if (isFloat) return strtof(text, NULL) == (float)value;
+	return strtod(text, NULL) == value;
+}
+
+//step digits * 10^exponent by one unit in the last digit, up (direction 1) or down (-1)
+static void StepLastDigit(char *digits, int length, int *exponent, int direction)
+{
+	int i = length - 1;
+	if (direction > 0)
+	{
+		while (i >= 0 && digits[i] == '9') digits[i--] = '0';
+		if (i >= 0) digits[i]++;
+		else
+		{
+			//9.99 -> 1.00e+1
+			digits[0] = '1';
+			(*exponent)++;
+		}
+	}
+	else
+	{
+		while (digits[i] == '0') digits[i--] = '9';
+		digits[i]--;
+		if (digits[0] == '0')
+		{
+			//1.00 -> 9.99e-1
+			for (i = 0; i < length; i++) digits[i] = '9';
+			(*exponent)--;
+		}
+	}
+}
+
+//the exact search for the values Grisu3 gives up on: the fewest digits that read back as value, going by printf's
+//correctly rounded digits, or the digits one unit either side of them (next to a power of two the rounding interval
+//is lopsided, so those can be inside it when the nearest ones aren't)
+//the search starts at the length Grisu3 gave up with, as no shorter digits fit even in the wider interval it worked with
+static void ShortestDigitsExact(double value, int isFloat, int minLength, char *buffer, int *length, int *K)
+{
+	char text[40], nearest[20];
+	int precision, exponent = 0, direction, i;
+	for (precision = (minLength > 1) ? minLength : 1; precision <= 17; precision++)
+	{
+		//d.ddde-x
+		snprintf(text, sizeof(text), "%.*e", precision - 1, value);
+		for (i = 0; i < precision; i++) nearest[i] = text[(i == 0) ? 0 : i + 1];
+		int nearestExponent = atoi(strchr(text, 'e') + 1);
+		
+		memcpy(buffer, nearest, precision);
+		exponent = nearestExponent;
+		if (DigitsReadBack(buffer, precision, exponent, value, isFloat)) break;
+		for (direction = 1; direction >= -1; direction -= 2)
+		{
+			memcpy(buffer, nearest, precision);
+			exponent = nearestExponent;
+			StepLastDigit(buffer, precision, &exponent, direction);
+			if (DigitsReadBack(buffer, precision, exponent, value, isFloat)) break;
+		}
+		if (direction >= -1) break;
+	}
+	
+	*length = precision;
+	while (*length > 1 && buffer[*length - 1] == '0') (*length)--;
+	*K = exponent - (*length - 1);
+}
+
+static int WriteExponent(char *out, int exponent)
+{
+	int length = 0;
+	out[length++] = 'e';
+	if (exponent < 0)
+	{
+		out[length++] = '-';
+		exponent = -exponent;
+	}
+	return length + FormatUInt64(out + length, (uint64_t)exponent);
+}
+
+//lay out digits * 10^k in plain decimal notation, or scientific notation for very big/small values
+//buffer must have room for the extra zeros, decimal point and exponent
+static int Prettify(char *buffer, int length, int k)
+{
+	//10^(kk-1) <= value < 10^kk
+	int kk = length + k;
+	int i;
+	
+	if (k >= 0 && kk <= 21)
+	{
+		//integer, pad with zeros: 1234e3 -> 1234000
+		for (i = length; i < kk; i++) buffer[i] = '0';
+		return kk;
+	}
+	else if (kk > 0 && kk <= 21)
+	{
+		//decimal point inside the digits: 1234e-2 -> 12.34
+		memmove(&buffer[kk + 1], &buffer[kk], length - kk);
+		buffer[kk] = '.';
+		return length + 1;
+	}
+	else if (kk > -6 && kk <= 0)
+	{
+		//leading zeros: 1234e-6 -> 0.001234
+		int offset = 2 - kk;
+		memmove(&buffer[offset], &buffer[0], length);
+		buffer[0] = '0';
+		buffer[1] = '.';
+		for (i = 2; i < offset; i++) buffer[i] = '0';
+		return length + offset;
+	}
+	else if (length == 1)
+	{
+		//1e30
+		return 1 + WriteExponent(&buffer[1], kk - 1);
+	}
+	else
+	{
+		//1234e30 -> 1.234e33
+		memmove(&buffer[2], &buffer[1], length - 1);
+		buffer[1] = '.';
+		return length + 1 + WriteExponent(&buffer[length + 1], kk - 1);
+	}
+}
+
+//handle the values Grisu can't: returns the length written, or 0 if value is an ordinary nonzero number
+static int FormatSpecialValue(char *out, double value)
+{
+	if (isnan(value))
+	{
+		memcpy(out, "nan", 3);
+		return 3;
+	}
+	int length = 0;
+	if (signbit(value)) out[length++] = '-';
+	if (isinf(value))
+	{
+		memcpy(out + length, "inf", 3);
+		return length + 3;
+	}
+	if (value == 0.0)
+	{
+		out[length++] = '0';
+		return length;
+	}
+	return 0;
+}
+
+int FormatDoubleShortest(char *out, double value)
+{
+	int length = FormatSpecialValue(out, value);
+	if (length > 0) return length;
+	
+	if (value < 0)
+	{
+		*out++ = '-';
+		value = -value;
+		length = 1;
+	}
+	
+	uint64_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	uint64_t significand = bits & UINT64_C(0x000FFFFFFFFFFFFF);
+	int biasedExponent = (int)(bits >> 52);
+	DiyFp v;
+	if (biasedExponent != 0)
+	{
+		v.f = significand | UINT64_C(0x0010000000000000);
+		v.e = biasedExponent - 1075;
+	}
+	else
+	{
+		v.f = significand;
+		v.e = -1074;
+	}
+	
+	int digitCount, K;
+	if (!Grisu3(v, significand == 0 && biasedExponent > 1, out, &digitCount, &K))
+		ShortestDigitsExact(value, 0, digitCount, out, &digitCount, &K);
+	return length + Prettify(out, digitCount, K);
+}
+
+int FormatFloatShortest(char *out, float value)
+{
+	int length = FormatSpecialValue(out, value);
+	if (length > 0) return length;
+	
+	if (value < 0)
+	{
+		*out++ = '-';
+		value = -value;
+		length = 1;
+	}
+	
+	//same as the double version, but with the (wider) rounding interval of a float
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	uint32_t significand = bits & 0x007FFFFF;
+	int biasedExponent = (int)(bits >> 23);
+	DiyFp v;
+	if (biasedExponent != 0)
+	{
+		v.f = significand | 0x00800000;
+		v.e = biasedExponent - 150;
+	}
+	else
+	{
+		v.f = significand;
+		v.e = -149;
+	}
+	
+	int digitCount, K;
+	if (!Grisu3(v, significand == 0 && biasedExponent > 1, out, &digitCount, &K))
+		ShortestDigitsExact(value, 1, digitCount, out, &digitCount, &K);
+	return length + Prettify(out, digitCount, K);
+}
+
+//---------------------------------------------------------------------------------------------
+//fixed decimal places formatting, producing exactly the same text as printf's "%.*f"
+
+static const double exactPowersOf10[CSV_MAX_DECIMALS + 1] =
+{
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+	1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19
+};
+
+int FormatDoubleFixed(char *out, double value, int decimals)
+{
+	if (decimals > CSV_MAX_DECIMALS) decimals = CSV_MAX_DECIMALS;
+	
+	//scale so the digits to print are the integer part, then round to the nearest integer
+	//the multiply is off by at most half an ulp, so the result can only be wrong if the exact value is very close to a
+	//rounding tie, in which case (or if it's too big to handle with a double) printf does the exact conversion instead
+	if (isfinite(value))
+	{
+		double scaled = fabs(value) * exactPowersOf10[decimals];
+		if (scaled < 9007199254740992.0)
+		{
+			double whole = floor(scaled);
+			double fraction = scaled - whole;
+			double error = scaled * 2.3e-16 + 1e-300;
+			if (fabs(fraction - 0.5) > error)
+			{
+				uint64_t digits = (uint64_t)whole + (fraction > 0.5 ? 1 : 0);
+				int length = 0;
+				if (signbit(value)) out[length++] = '-';
+				
+				uint64_t divisor = powersOf10[decimals];
+				length += FormatUInt64(out + length, digits / divisor);
+				if (decimals > 0)
+				{
+					out[length++] = '.';
+					//the fraction digits, zero padded on the left
+					char fractionDigits[20];
+					int fractionLength = FormatUInt64(fractionDigits, digits % divisor);
+					int i;
+					for (i = fractionLength; i < decimals; i++) out[length++] = '0';
+					memcpy(out + length, fractionDigits, fractionLength);
+					length += fractionLength;
+				}
+				return length;
+			}
+		}
+	}
+	
+	return snprintf(out, CSV_MAX_NUMBER_LENGTH, "%.*f", decimals, value);
+}
@@ -0,0 +1,82 @@
+//csvwriter.h: buffered text output and hand-written number formatting for the converters
+//Copyright 2012, Allen Jordan, allen.jordan@gmail.com
+
+#ifndef CSVWRITER_H
+#define CSVWRITER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "gzipstream.h"
+
+//size of the reusable output buffer, flushed to the file with a single write() when full
+#define CSV_WRITER_BUFFER_SIZE	(1024*1024)
+
+//longest text any of the number formatters can produce (a %.19f of the largest double, plus sign)
+#define CSV_MAX_NUMBER_LENGTH	352
+
+//most decimal places supported by the fixed-point formatter
+#define CSV_MAX_DECIMALS	19
+
+//passed as the decimals argument to format the shortest text that reads back as the same value
+#define CSV_SHORTEST	-1
+
+typedef struct
+{
+	//output file, or -1 for a writer that only collects text in memory
+	int fd;
+	//set when the output is gzip compressed on its way to the file
+	GzipStream *gzip;
+	char *buffer;
+	size_t length;
+	size_t capacity;
+	uint64_t bytesWritten;
+	//time spent writing to the file (and compressing, for gzip output)
+	double writeSeconds;
+	//errno of the first failed write, 0 if all writes succeeded
+	int error;
+} CsvWriter;
+
+//open/create (truncating) a file for buffered output, returns NULL on failure
+CsvWriter *CsvWriterOpen(const char *filename);
+//open an existing file for buffered output, cutting it back to its first offset bytes and appending from there
+//(ex: dropping whatever an interrupted append left after the last complete one), returns NULL on failure
+CsvWriter *CsvWriterOpenAt(const char *filename, uint64_t offset);
+//write out anything still buffered, returns 0 on success or -1 on a write error
+int CsvWriterFlush(CsvWriter *writer);
+//open/create (truncating) a file for gzip compressed output, compressed on numThreads threads at the given level (1-9)
+//returns NULL on failure
+CsvWriter *CsvWriterOpenGzip(const char *filename, int numThreads, int level);
+//the same, appending to an existing file after its first offset bytes, the new text is added as more gzip members
+CsvWriter *CsvWriterOpenGzipAt(const char *filename, uint64_t offset, int numThreads, int level);
+//flush and close the file and free the writer, returns 0 on success or -1 if any write failed
+int CsvWriterClose(CsvWriter *writer);
+//create a writer that collects everything in its (growing) buffer instead of writing to a file
+CsvWriter *CsvWriterOpenMemory(void);
+//make room for at least length more bytes, by flushing to the file or growing a memory writer's buffer
+void CsvWriterMakeRoom(CsvWriter *writer, size_t length);
+
+//make sure there is room for at least length (<= CSV_WRITER_BUFFER_SIZE) more bytes in the buffer
+static inline void CsvWriterReserve(CsvWriter *writer, size_t length)
+{
+	if (writer->capacity - writer->length < length) CsvWriterMakeRoom(writer, length);
+}
+
+void CsvWriterPutBytes(CsvWriter *writer, const char *bytes, size_t length);
+void CsvWriterPutString(CsvWriter *writer, const char *str);
+void CsvWriterPutChar(CsvWriter *writer, char c);
+void CsvWriterPrintf(CsvWriter *writer, const char *format, ...) __attribute__((format(printf, 2, 3)));
+void CsvWriterPutInt(CsvWriter *writer, int64_t value);
+void CsvWriterPutUInt(CsvWriter *writer, uint64_t value);
+//decimals is either CSV_SHORTEST or a fixed number of decimal places (the same text as printf's %.Nf)
+void CsvWriterPutFloat(CsvWriter *writer, float value, int decimals);
+void CsvWriterPutDouble(CsvWriter *writer, double value, int decimals);
+
+//number formatters, each writes into out (which must have room for CSV_MAX_NUMBER_LENGTH bytes) and returns the length
+//the output is not null terminated
+int FormatInt64(char *out, int64_t value);
+int FormatUInt64(char *out, uint64_t value);
+int FormatDoubleShortest(char *out, double value);
+int FormatFloatShortest(char *out, float value);
+int FormatDoubleFixed(char *out, double value, int decimals);
+
+#endif
@@ -0,0 +1,274 @@
+//gzipstream.c: gzip compressed output, with blocks of the output compressed in parallel into a multi-member gzip file
+//Copyright 2012, Allen Jordan, allen.jordan@gmail.com
+
+//like pigz, the output is cut into fixed size blocks that are compressed on a pool of threads, but here every block is
+//a complete gzip member of its own (no dictionary is carried over), so the threads never wait on each other
+//gzip readers treat concatenated members as one stream, so gunzip/zcat and zlib's gzread see the original text
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <zlib.h>
+#include "gzipstream.h"
+
+//number of blocks per thread, so the threads can work ahead while compressed blocks wait to be written in order
+#define BLOCKS_PER_THREAD	2
+
+typedef struct
+{
+	char *input;
+	size_t inputLength;
+	unsigned char *output;
+	size_t outputLength;
+	int done;
+} GzipBlock;
+
+struct GzipStream
+{
+	int fd;
+	int level;
+	int numThreads;
+	pthread_t *threads;
+	int numBlocks;
+	GzipBlock *blocks;
+	size_t outputCapacity;
+
+	pthread_mutex_t lock;
+	//signalled when a block is full and when the stream is shutting down
+	pthread_cond_t workReady;
+	//signalled whenever a block is compressed
+	pthread_cond_t blockDone;
+	int shutdown;
+	//blocks are numbered in the order they fill, block n lives in blocks[n % numBlocks]
+	//blocks before numSubmitted are full, before numTaken are taken by a thread, before numWritten are written out
+	uint64_t numSubmitted, numTaken, numWritten;
+	//errno of the first failure, 0 if everything succeeded
+	int error;
+};
+
+static void *CompressThreadMain(void *argument)
+{
+	GzipStream *stream = (GzipStream *)argument;
+
+	//each thread keeps its own deflate state, reset for every block (windowBits 15+16 adds the gzip header/trailer)
+	z_stream deflater;
+	memset(&deflater, 0, sizeof(deflater));
+	int initResult = deflateInit2(&deflater, stream->level, Z_DEFLATED, 15+16, 8, Z_DEFAULT_STRATEGY);
+
+	pthread_mutex_lock(&stream->lock);
+	for (;;)
+	{
+		while (!stream->shutdown && stream->numTaken == stream->numSubmitted)
+			pthread_cond_wait(&stream->workReady, &stream->lock);
+		if (stream->numTaken == stream->numSubmitted) break;
+		GzipBlock *block = &stream->blocks[stream->numTaken++ % stream->numBlocks];
+		pthread_mutex_unlock(&stream->lock);
+
+		int result = Z_STREAM_ERROR;
+		if (initResult == Z_OK)
+		{
+			deflateReset(&deflater);
+			deflater.next_in = (Bytef *)block->input;
+			deflater.avail_in = (uInt)block->inputLength;
+			deflater.next_out = block->output;
+			deflater.avail_out = (uInt)stream->outputCapacity;
+			result = deflate(&deflater, Z_FINISH);
+		}
+		block->outputLength = (result == Z_STREAM_END) ? stream->outputCapacity - deflater.avail_out : 0;
+
+		pthread_mutex_lock(&stream->lock);
+		if (result != Z_STREAM_END && stream->error == 0) stream->error = ENOMEM;
+		block->done = 1;
+		pthread_cond_broadcast(&stream->blockDone);
+	}
+	pthread_mutex_unlock(&stream->lock);
+
+	if (initResult == Z_OK) deflateEnd(&deflater);
+	return NULL;
+}
+
+GzipStream *CreateGzipStream(int fd, int numThreads, int level)
+{
+	int i;
+	if (numThreads < 1) numThreads = 1;
+	if (level < 1 || level > 9) level = GZIP_DEFAULT_LEVEL;
+
+	GzipStream *stream = (GzipStream *)calloc(1, sizeof(GzipStream));
+	stream->fd = fd;
+	stream->level = level;
+	stream->numThreads = numThreads;
+	stream->numBlocks = numThreads * BLOCKS_PER_THREAD + 1;
+	//room for a block that doesn't compress at all, plus the gzip header and trailer
+	stream->outputCapacity = compressBound(GZIP_BLOCK_SIZE) + 32;
+	stream->blocks = (GzipBlock *)calloc(stream->numBlocks, sizeof(GzipBlock));
+	for (i = 0; i < stream->numBlocks; i++)
+	{
+		stream->blocks[i].input = (char *)malloc(GZIP_BLOCK_SIZE);
+		stream->blocks[i].output = (unsigned char *)malloc(stream->outputCapacity);
+	}
+	pthread_mutex_init(&stream->lock, NULL);
+	pthread_cond_init(&stream->workReady, NULL);
+	pthread_cond_init(&stream->blockDone, NULL);
+
+	stream->threads = (pthread_t *)malloc(numThreads * sizeof(pthread_t));
+	for (i = 0; i < numThreads; i++)
+	{
+		if (pthread_create(&stream->threads[i], NULL, CompressThreadMain, stream) != 0) break;
+	}
+	stream->numThreads = i;
+	if (i == 0)
+	{
+		stream->fd = -1;
+		FinishGzipStream(stream);
+		return NULL;
+	}
+	return stream;
+}
+
+//wait for the oldest outstanding block to be compressed, and write it out
+static void WriteOldestBlock(GzipStream *stream)
+{
+	GzipBlock *block = &stream->blocks[stream->numWritten % stream->numBlocks];
+	pthread_mutex_lock(&stream->lock);
+	while (!block->done) pthread_cond_wait(&stream->blockDone, &stream->lock);
+	//(the compression threads set error too, so it's only touched under the lock)
+	int error = stream->error;
+	pthread_mutex_unlock(&stream->lock);
+
+	size_t offset = 0;
+	while (offset < block->outputLength && error == 0 && stream->fd >= 0)
+	{
+		ssize_t written = write(stream->fd, block->output + offset, block->outputLength - offset);
+		if (written < 0)
+		{
+			if (errno == EINTR) continue;
+			error = errno;
+			pthread_mutex_lock(&stream->lock);
+			if (stream->error == 0) stream->error = error;
+			pthread_mutex_unlock(&stream->lock);
+			break;
+		}
+		offset += (size_t)written;
+	}
+	block->done = 0;
+	block->inputLength = 0;
+	stream->numWritten++;
+}
+
+//hand the block being filled to the threads, making room for the next one
+static void SubmitBlock(GzipStream *stream)
+{
+	pthread_mutex_lock(&stream->lock);
+	stream->numSubmitted++;
+	pthread_cond_signal(&stream->workReady);
+	pthread_mutex_unlock(&stream->lock);
+
+	//the next block to fill is still holding the oldest one when every block is in use
+	if (stream->numSubmitted - stream->numWritten == (uint64_t)stream->numBlocks) WriteOldestBlock(stream);
+}
+
+void GzipStreamWrite(GzipStream *stream, const char *bytes, size_t length)
+{
+	while (length > 0)
+	{
+		GzipBlock *block = &stream->blocks[stream->numSubmitted % stream->numBlocks];
+		size_t copyLength = GZIP_BLOCK_SIZE - block->inputLength;
+		if (copyLength > length) copyLength = length;
+		memcpy(block->input + block->inputLength, bytes, copyLength);
+		block->inputLength += copyLength;
+		bytes += copyLength;
+		length -= copyLength;
+		if (block->inputLength == GZIP_BLOCK_SIZE) SubmitBlock(stream);
+	}
+}
+
+int FinishGzipStream(GzipStream *stream)
+{
+	int i;
+	if (stream->numThreads > 0)
+	{
+		//the last partial block (or an empty member, so even empty output is a valid gzip file)
+		GzipBlock *block = &stream->blocks[stream->numSubmitted % stream->numBlocks];
+		if (block->inputLength > 0 || stream->numSubmitted == 0) SubmitBlock(stream);
+		while (stream->numWritten < stream->numSubmitted) WriteOldestBlock(stream);
+	}
+
+	pthread_mutex_lock(&stream->lock);
+	stream->shutdown = 1;
+	pthread_cond_broadcast(&stream->workReady);
+	pthread_mutex_unlock(&stream->lock);
+	for (i = 0; i < stream->numThreads; i++) pthread_join(stream->threads[i], NULL);
+
+	int error = stream->error;
+	for (i = 0; i < stream->numBlocks; i++)
+	{
+		free(stream->blocks[i].input);
+		free(stream->blocks[i].output);
+	}
+	free(stream->blocks);
+	free(stream->threads);
+	pthread_mutex_destroy(&stream->lock);
+	pthread_cond_destroy(&stream->workReady);
+	pthread_cond_destroy(&stream->blockDone);
+	free(stream);
+	return error;
+}
+
+//---- stdio streams ----
+
+typedef struct
+{
+	int fd;
+	GzipStream *stream;
+} GzipFileCookie;
+
+static ssize_t GzipFileWrite(void *cookie, const char *bytes, size_t length)
+{
+	GzipStreamWrite(((GzipFileCookie *)cookie)->stream, bytes, length);
+	return (ssize_t)length;
+}
+
+static int GzipFileClose(void *cookie)
+{
+	GzipFileCookie *file = (GzipFileCookie *)cookie;
+	int error = FinishGzipStream(file->stream);
+	if (close(file->fd) != 0 && error == 0) error = errno;
+	free(file);
+	if (error == 0) return 0;
+	errno = error;
+	return EOF;
+}
+
+FILE *OpenGzipFile(const char *filename, int numThreads, int level)
+{
+	int fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) return NULL;
+
+	GzipFileCookie *cookie = (GzipFileCookie *)malloc(sizeof(GzipFileCookie));
+	cookie->fd = fd;
+	cookie->stream = CreateGzipStream(fd, numThreads, level);
+	cookie_io_functions_t functions = { NULL, GzipFileWrite, NULL, GzipFileClose };
+	FILE *file = (cookie->stream != NULL) ? fopencookie(cookie, "w", functions) : NULL;
+	if (file == NULL)
+	{
+		if (cookie->stream != NULL) FinishGzipStream(cookie->stream);
+		close(fd);
+		free(cookie);
+		return NULL;
+	}
+	//stdio's own buffering in front of the blocks, so fprintf doesn't call into the stream for every field
+	setvbuf(file, NULL, _IOFBF, 64*1024);
+	return file;
+}
+
+int GetDefaultGzipThreads(int numJobs)
+{
+	long numCPUs = sysconf(_SC_NPROCESSORS_ONLN);
+	if (numJobs < 1) numJobs = 1;
+	int numThreads = (numCPUs > 0) ? (int)(numCPUs / numJobs) : 1;
+	return (numThreads > 0) ? numThreads : 1;
+}
@@ -0,0 +1,35 @@
+//gzipstream.h: gzip compressed output, with blocks of the output compressed in parallel into a multi-member gzip file
+//Copyright 2012, Allen Jordan, allen.jordan@gmail.com
+
+#ifndef GZIPSTREAM_H
+#define GZIPSTREAM_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+//uncompressed size of each independently compressed block (each becomes one gzip member)
+#define GZIP_BLOCK_SIZE	(1024*1024)
+
+//compression level used when none is given (zlib's 1-9, 1 is the fastest)
+#define GZIP_DEFAULT_LEVEL	1
+
+typedef struct GzipStream GzipStream;
+
+//start compressing everything written to the stream into fd on numThreads threads, returns NULL on failure
+//the compressed members are written to fd in order by whichever thread writes to the stream
+GzipStream *CreateGzipStream(int fd, int numThreads, int level);
+//add bytes to the stream, handing each block to the compression threads as soon as it fills
+void GzipStreamWrite(GzipStream *stream, const char *bytes, size_t length);
+//compress and write out everything left, stop the threads and free the stream (fd is left open)
+//returns 0 on success or the errno of the first failed write
+int FinishGzipStream(GzipStream *stream);
+
+//open/create (truncating) a gzip compressed file as a stdio stream, for output written with fprintf and friends
+//returns NULL on failure
+FILE *OpenGzipFile(const char *filename, int numThreads, int level);
+
+//number of compression threads to use when none is given: the online CPUs shared out between numJobs processes
+int GetDefaultGzipThreads(int numJobs);
+
+#endif
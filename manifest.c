@@ -0,0 +1,327 @@
+//manifest.c: a record of the inputs converted and what they were converted with, so re-runs can skip current outputs
+//Copyright 2012, Allen Jordan, allen.jordan@gmail.com
+
+//a manifest file is a line of tab separated fields for each input:
+//	size	mtime (ns)	hash (hex)	version	options	input path	output path
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "manifest.h"
+
+//bytes read at a time by HashFileContents
+#define HASH_BLOCK_SIZE	(1024*1024)
+#define MANIFEST_FIELDS	7
+
+void InitManifest(Manifest *manifest)
+{
+	manifest->entries = NULL;
+	manifest->count = 0;
+	manifest->capacity = 0;
+	manifest->slots = NULL;
+	manifest->numSlots = 0;
+}
+
+void FreeManifest(Manifest *manifest)
+{
+	int i;
+	for (i = 0; i < manifest->count; i++)
+	{
+		ManifestEntry *entry = &manifest->entries[i];
+		free(entry->inputPath);
+		free(entry->outputPath);
+		free(entry->version);
+		free(entry->signature);
+	}
+	free(manifest->entries);
+	free(manifest->slots);
+	InitManifest(manifest);
+}
+
+//FNV-1a of a path
+static uint64_t HashPath(const char *path)
+{
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	for (; *path != '\0'; path++)
+	{
+		hash ^= (unsigned char)*path;
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+//get the slot holding a path, or the empty slot it would go in
+static int FindSlot(const Manifest *manifest, const char *path)
+{
+	int mask = manifest->numSlots - 1;
+	int slot = (int)(HashPath(path) & (uint64_t)mask);
+	while (manifest->slots[slot] != 0 && strcmp(manifest->entries[manifest->slots[slot] - 1].inputPath, path) != 0)
+		slot = (slot + 1) & mask;
+	return slot;
+}
+
+//keep the table at most half full, rebuilding it when it grows
+static void GrowSlots(Manifest *manifest, int numEntries)
+{
+	if (numEntries * 2 <= manifest->numSlots) return;
+	int i;
+	int numSlots = (manifest->numSlots == 0) ? 1024 : manifest->numSlots;
+	while (numEntries * 2 > numSlots) numSlots *= 2;
+	free(manifest->slots);
+	manifest->slots = (int *)calloc(numSlots, sizeof(int));
+	manifest->numSlots = numSlots;
+	for (i = 0; i < manifest->count; i++) manifest->slots[FindSlot(manifest, manifest->entries[i].inputPath)] = i + 1;
+}
+
+ManifestEntry *FindManifestEntry(const Manifest *manifest, const char *inputPath)
+{
+	if (manifest->numSlots == 0) return NULL;
+	int slot = FindSlot(manifest, inputPath);
+	return (manifest->slots[slot] != 0) ? &manifest->entries[manifest->slots[slot] - 1] : NULL;
+}
+
+//add or replace an entry, taking over its strings
+static void PutEntry(Manifest *manifest, ManifestEntry *newEntry)
+{
+	ManifestEntry *entry = FindManifestEntry(manifest, newEntry->inputPath);
+	if (entry != NULL)
+	{
+		free(entry->inputPath);
+		free(entry->outputPath);
+		free(entry->version);
+		free(entry->signature);
+		*entry = *newEntry;
+		return;
+	}
+	if (manifest->count == manifest->capacity)
+	{
+		manifest->capacity = (manifest->capacity == 0) ? 1024 : manifest->capacity * 2;
+		manifest->entries = (ManifestEntry *)realloc(manifest->entries, manifest->capacity * sizeof(ManifestEntry));
+	}
+	GrowSlots(manifest, manifest->count + 1);
+	manifest->entries[manifest->count++] = *newEntry;
+	manifest->slots[FindSlot(manifest, newEntry->inputPath)] = manifest->count;
+}
+
+void SetManifestEntry(Manifest *manifest, const char *inputPath, const char *outputPath, const struct stat *inputInfo,
+	uint64_t hash, const char *version, const char *signature)
+{
+	ManifestEntry entry;
+	entry.inputPath = strdup(inputPath);
+	entry.outputPath = strdup(outputPath);
+	entry.size = (uint64_t)inputInfo->st_size;
+	entry.mtime = (int64_t)inputInfo->st_mtim.tv_sec * 1000000000 + inputInfo->st_mtim.tv_nsec;
+	entry.hash = hash;
+	entry.version = strdup(version);
+	entry.signature = strdup(signature);
+	PutEntry(manifest, &entry);
+}
+
+int LoadManifest(const char *filename, Manifest *manifest)
+{
+	InitManifest(manifest);
+	FILE *file = fopen(filename, "r");
+	if (file == NULL) return (errno == ENOENT) ? 0 : -1;
+
+	char *line = NULL;
+	size_t lineCapacity = 0;
+	ssize_t lineLength;
+	while ((lineLength = getline(&line, &lineCapacity, file)) >= 0)
+	{
+		while (lineLength > 0 && (line[lineLength-1] == '\n' || line[lineLength-1] == '\r')) line[--lineLength] = '\0';
+		if (lineLength == 0 || line[0] == '#') continue;
+
+		//split the line at its tabs
+		char *fields[MANIFEST_FIELDS];
+		int numFields = 0;
+		char *field = line;
+		while (numFields < MANIFEST_FIELDS)
+		{
+			fields[numFields++] = field;
+			char *tab = strchr(field, '\t');
+			if (tab == NULL) break;
+			*tab = '\0';
+			field = tab + 1;
+		}
+		if (numFields < MANIFEST_FIELDS) continue;
+
+		ManifestEntry entry;
+		char *end;
+		entry.size = strtoull(fields[0], &end, 10);
+		if (*end != '\0') continue;
+		entry.mtime = strtoll(fields[1], &end, 10);
+		if (*end != '\0') continue;
+		entry.hash = strtoull(fields[2], &end, 16);
+		if (*end != '\0') continue;
+		entry.version = strdup(fields[3]);
+		entry.signature = strdup(fields[4]);
+		entry.inputPath = strdup(fields[5]);
+		entry.outputPath = strdup(fields[6]);
+		PutEntry(manifest, &entry);
+	}
+	free(line);
+	fclose(file);
+	return 0;
+}
+
+int SaveManifest(const char *filename, const Manifest *manifest)
+{
+	int i;
+	size_t length = strlen(filename) + 5;
+	char *tempFilename = (char *)malloc(length);
+	snprintf(tempFilename, length, "%s.tmp", filename);
+
+	int status = -1;
+	FILE *file = fopen(tempFilename, "w");
+	if (file != NULL)
+	{
+		fputs("#size\tmtime_ns\thash\tversion\toptions\tinput\toutput\n", file);
+		for (i = 0; i < manifest->count; i++)
+		{
+			const ManifestEntry *entry = &manifest->entries[i];
+			fprintf(file, "%llu\t%lld\t%016llx\t%s\t%s\t%s\t%s\n", (unsigned long long)entry->size, (long long)entry->mtime,
+				(unsigned long long)entry->hash, entry->version, entry->signature, entry->inputPath, entry->outputPath);
+		}
+		if (fclose(file) == 0 && rename(tempFilename, filename) == 0) status = 0;
+		else remove(tempFilename);
+	}
+	free(tempFilename);
+	return status;
+}
+
+static inline uint64_t RotateLeft(uint64_t value, int bits)
+{
+	return (value << bits) | (value >> (64 - bits));
+}
+
+//mix a word into one of the hash's lanes
+static inline uint64_t MixWord(uint64_t lane, uint64_t word)
+{
+	return RotateLeft(lane + word * 0xC2B2AE3D27D4EB4FULL, 31) * 0x9E3779B185EBCA87ULL;
+}
+
+int HashFileContents(const char *filename, uint64_t *hash)
+{
+	int fd = open(filename, O_RDONLY);
+	if (fd < 0) return -1;
+	unsigned char *buffer = (unsigned char *)malloc(HASH_BLOCK_SIZE);
+
+	//four independent lanes over consecutive words, so the multiplies overlap
+	uint64_t lanes[4] = { 0x9E3779B97F4A7C15ULL, 0xBF58476D1CE4E5B9ULL, 0x94D049BB133111EBULL, 0x2545F4914F6CDD1DULL };
+	uint64_t totalLength = 0;
+	int status = 0;
+	for (;;)
+	{
+		//fill the block, so only the last one can come up short
+		size_t blockLength = 0;
+		while (blockLength < HASH_BLOCK_SIZE)
+		{
+			ssize_t result = read(fd, buffer + blockLength, HASH_BLOCK_SIZE - blockLength);
+			if (result < 0 && errno == EINTR) continue;
+			if (result < 0) status = -1;
+			if (result <= 0) break;
+			blockLength += (size_t)result;
+		}
+		if (status != 0) break;
+
+		size_t position = 0;
+		for (; position + 32 <= blockLength; position += 32)
+		{
+			uint64_t words[4];
+			memcpy(words, buffer + position, sizeof(words));
+			lanes[0] = MixWord(lanes[0], words[0]);
+			lanes[1] = MixWord(lanes[1], words[1]);
+			lanes[2] = MixWord(lanes[2], words[2]);
+			lanes[3] = MixWord(lanes[3], words[3]);
+		}
+		//the end of the file, a word at a time and then what's left over zero padded
+		for (; position < blockLength; position += 8)
+		{
+			uint64_t word = 0;
+			memcpy(&word, buffer + position, (blockLength - position < 8) ? blockLength - position : 8);
+			lanes[0] = MixWord(lanes[0], word);
+		}
+		totalLength += blockLength;
+		if (blockLength < HASH_BLOCK_SIZE) break;
+	}
+	free(buffer);
+	close(fd);
+	if (status != 0) return -1;
+
+	uint64_t combined = RotateLeft(lanes[0], 1) + RotateLeft(lanes[1], 7) + RotateLeft(lanes[2], 12) + RotateLeft(lanes[3], 18);
+	combined ^= totalLength;
+	combined ^= combined >> 33;
+	combined *= 0xFF51AFD7ED558CCDULL;
+	combined ^= combined >> 33;
+	*hash = combined;
+	return 0;
+}
+
+//check an input's output is current against its entry (see SelectOutdatedFiles)
+static int IsOutputCurrent(Manifest *manifest, const char *inputPath, const struct stat *inputInfo, const char *outputPath,
+	const char *version, const char *signature)
+{
+	ManifestEntry *entry = FindManifestEntry(manifest, inputPath);
+	if (entry == NULL || entry->size != (uint64_t)inputInfo->st_size || strcmp(entry->version, version) != 0 ||
+		strcmp(entry->signature, signature) != 0 || strcmp(entry->outputPath, outputPath) != 0)
+		return 0;
+	struct stat outputInfo;
+	if (stat(outputPath, &outputInfo) != 0) return 0;
+
+	int64_t mtime = (int64_t)inputInfo->st_mtim.tv_sec * 1000000000 + inputInfo->st_mtim.tv_nsec;
+	if (entry->mtime == mtime) return 1;
+	//touched or copied without being changed, the new time is noted so it isn't hashed again
+	uint64_t hash;
+	if (HashFileContents(inputPath, &hash) != 0 || hash != entry->hash) return 0;
+	entry->mtime = mtime;
+	return 1;
+}
+
+int SelectOutdatedFiles(Manifest *manifest, const FileList *inputs, OutputNameFunction outputName, const void *context,
+	const char *version, const char *signature, int force, FileList *outdated, struct stat **outdatedInfo)
+{
+	int i;
+	int numCurrent = 0;
+	InitFileList(outdated);
+	*outdatedInfo = (struct stat *)malloc((inputs->count + 1) * sizeof(struct stat));
+	for (i = 0; i < inputs->count; i++)
+	{
+		const char *inputPath = inputs->filenames[i];
+		struct stat inputInfo;
+		if (stat(inputPath, &inputInfo) != 0) memset(&inputInfo, 0, sizeof(inputInfo));
+		else if (!force)
+		{
+			char *outputPath = outputName(inputPath, context);
+			int current = IsOutputCurrent(manifest, inputPath, &inputInfo, outputPath, version, signature);
+			free(outputPath);
+			if (current)
+			{
+				numCurrent++;
+				continue;
+			}
+		}
+		(*outdatedInfo)[outdated->count] = inputInfo;
+		AddFileToList(outdated, inputPath);
+	}
+	return numCurrent;
+}
+
+void RecordConvertedFiles(Manifest *manifest, const FileList *converted, const struct stat *convertedInfo, const int *statuses,
+	OutputNameFunction outputName, const void *context, const char *version, const char *signature)
+{
+	int i;
+	for (i = 0; i < converted->count; i++)
+	{
+		if (statuses[i] != 0) continue;
+		const char *inputPath = converted->filenames[i];
+		//(it's normally still in the page cache from being converted)
+		uint64_t hash;
+		if (HashFileContents(inputPath, &hash) != 0) continue;
+		char *outputPath = outputName(inputPath, context);
+		SetManifestEntry(manifest, inputPath, outputPath, &convertedInfo[i], hash, version, signature);
+		free(outputPath);
+	}
+}
@@ -0,0 +1,69 @@
+//manifest.h: a record of the inputs converted and what they were converted with, so re-runs can skip current outputs
+//Copyright 2012, Allen Jordan, allen.jordan@gmail.com
+
+#ifndef MANIFEST_H
+#define MANIFEST_H
+
+#include <stdint.h>
+#include <sys/stat.h>
+#include "batch.h"
+
+//get the name of the output file a converter writes for an input, in a new string
+typedef char *(*OutputNameFunction)(const char *filename, const void *context);
+
+//an input as it was when it was last converted successfully
+typedef struct
+{
+	//the input's path as it was given, and its output's
+	char *inputPath;
+	char *outputPath;
+	uint64_t size;
+	//modification time in nanoseconds
+	int64_t mtime;
+	//HashFileContents of the input
+	uint64_t hash;
+	//the converter's name and version, and the options that shape the output
+	char *version;
+	char *signature;
+} ManifestEntry;
+
+//every input converted, looked up by path through an open addressing hash table
+typedef struct
+{
+	ManifestEntry *entries;
+	int count;
+	int capacity;
+	//entry index + 1 for each slot, 0 for an empty one (numSlots is a power of 2)
+	int *slots;
+	int numSlots;
+} Manifest;
+
+void InitManifest(Manifest *manifest);
+//read a manifest file, a missing one reads as an empty manifest
+//returns 0 on success or -1 if it couldn't be read
+int LoadManifest(const char *filename, Manifest *manifest);
+//write a manifest file, replacing the old one in a single rename, returns 0 on success or -1 if it couldn't be written
+int SaveManifest(const char *filename, const Manifest *manifest);
+void FreeManifest(Manifest *manifest);
+//get an input's entry, or NULL if it hasn't been converted
+ManifestEntry *FindManifestEntry(const Manifest *manifest, const char *inputPath);
+//add or replace an input's entry
+void SetManifestEntry(Manifest *manifest, const char *inputPath, const char *outputPath, const struct stat *inputInfo,
+	uint64_t hash, const char *version, const char *signature);
+
+//a fast 64-bit hash of a file's contents (not a cryptographic one, and it depends on the CPU's byte order)
+//returns 0 on success or -1 if the file couldn't be read
+int HashFileContents(const char *filename, uint64_t *hash);
+
+//pick out the inputs whose outputs aren't current, every one of them when force is set
+//an output is current if it's still there, and its input was last converted by the same version with the same options
+//and still has the same size and modification time (or the same contents, by its hash, if only the time changed)
+//outdatedInfo gets each outdated input's stat info from before it's converted (its size and time are 0 if it's missing)
+//returns the number of inputs that are current
+int SelectOutdatedFiles(Manifest *manifest, const FileList *inputs, OutputNameFunction outputName, const void *context,
+	const char *version, const char *signature, int force, FileList *outdated, struct stat **outdatedInfo);
+//record the inputs that converted successfully (a status of 0), with the stat info from SelectOutdatedFiles
+void RecordConvertedFiles(Manifest *manifest, const FileList *converted, const struct stat *convertedInfo, const int *statuses,
+	OutputNameFunction outputName, const void *context, const char *version, const char *signature);
+
+#endif
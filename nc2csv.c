@@ -4,417 +4,1085 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <stdint.h>
+#include <math.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
 //#include <sys/types.h>
 //#include <dirent.h>
 #include <netcdf.h>
+#include "ncdataset.h"
+#include "csvwriter.h"
+#include "colformat.h"
+#include "parallelformat.h"
+#include "pipeline.h"
+#include "arrowwriter.h"
+#include "batch.h"
+#include "watch.h"
+#include "convertstats.h"
+#include "manifest.h"
+#include "appendstate.h"
+#include "aggregate.h"
+
+//recorded in --manifest files, so outputs written by another version are converted again
+#define VERSION		1.001
 
 //string buffer for print formating
 //#define STR_LENGTH	100
 //char str[STR_LENGTH];
 
-//todo: make the program exit somehow
-void HandleNCError(char* funcName, int status)
+//get the Arrow column type the values of a NetCDF type are written as (the same bytes, no conversion)
+//returns 0, or -1 for a type that can't be written
+//(bytes are signed, as NetCDF has them, only CSV files print them unsigned like older versions did)
+int GetArrowColumnType(nc_type type, ArrowColumnType *columnType)
+{
+	switch (type)
+	{
+		case NC_BYTE: *columnType = ARROW_INT8; return 0;
+		case NC_CHAR: *columnType = ARROW_CHAR; return 0;
+		case NC_SHORT: *columnType = ARROW_INT16; return 0;
+		case NC_INT: *columnType = ARROW_INT32; return 0;
+		case NC_FLOAT: *columnType = ARROW_FLOAT32; return 0;
+		case NC_DOUBLE: *columnType = ARROW_FLOAT64; return 0;
+		default: return -1;
+	}
+}
+
+//parse a byte count with an optional K/M/G suffix (ex: 512M), returns 0 if the string is invalid
+size_t ParseByteSize(const char *str)
+{
+	char *end;
+	double value = strtod(str, &end);
+	if (end == str || value <= 0) return 0;
+	switch (*end)
+	{
+		case 'k': case 'K': value *= 1024.0; end++; break;
+		case 'm': case 'M': value *= 1024.0*1024.0; end++; break;
+		case 'g': case 'G': value *= 1024.0*1024.0*1024.0; end++; break;
+		default: break;
+	}
+	if (*end != '\0' && *end != 'B' && *end != 'b') return 0;
+	return (size_t)value;
+}
+
+//get the peak resident set size of this process so far, in kilobytes
+long GetPeakRSSKB()
 {
-	printf("NetCDF error in: %s with status: %d\n", funcName, status);
-	exit(status);
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0) return -1;
+	return usage.ru_maxrss;
 }
 
-//storage for individual NetCDF variable raw data
+//state shared by the read and format stages while converting one file
 typedef struct
 {
-	nc_type type;
-	void *data;
-} VariableData;
+	ReadPlan *plan;
+	ColumnFormatter *columnFormatters;
+	ParallelFormatter *parallelFormatter;
+	//set for --format arrow, where each window is written as a record batch instead of being formatted
+	ArrowFileWriter *arrowWriter;
+	//set for --bin-rows and --bin, where each window's rows are added to the bins instead of being formatted
+	Aggregator *aggregator;
+} ConversionStages;
 
-int main (int argc, char** argv)
+//read stage: read a window of every column into a slot's buffers, keeping only the rows that pass the --where predicates
+int ReadWindowStage(void *context, int slot, size_t windowIndex, size_t *rowCount)
+{
+	ConversionStages *conversion = (ConversionStages *)context;
+	return ReadPlanWindow(conversion->plan, slot, windowIndex, rowCount);
+}
+
+//format stage: format a slot's window a block of rows at a time, with one kernel call per column per block
+//(or copy the window's buffers straight out as an Arrow record batch, or add its rows to the bins)
+void FormatWindowStage(void *context, int slot, size_t count, CsvWriter *output)
+{
+	ConversionStages *conversion = (ConversionStages *)context;
+	ReadPlan *plan = conversion->plan;
+	void **columnData = plan->columnData + slot*plan->numColumns;
+	if (conversion->arrowWriter != NULL)
+	{
+		//windows without any rows left after --where don't need an empty batch
+		if (count > 0) WriteArrowRecordBatch(conversion->arrowWriter, columnData, count, output);
+		return;
+	}
+	const void **columnViews = plan->columnViews + slot*plan->numColumns;
+	size_t *columnStrides = plan->columnStrides + slot*plan->numColumns;
+	if (conversion->aggregator != NULL) AggregateRows(conversion->aggregator, columnViews, columnStrides, count, output);
+	else if (conversion->parallelFormatter != NULL) FormatWindowParallel(conversion->parallelFormatter, columnViews, columnStrides, count, output);
+	else FormatRowRange(conversion->columnFormatters, plan->numColumns, columnViews, columnStrides, 0, count, output);
+}
+
+//what kind of file is written next to each NetCDF file
+typedef enum
+{
+	OUTPUT_CSV,
+	OUTPUT_ARROW
+} OutputFormat;
+
+//options shared by every file converted
+typedef struct
+{
+	OutputFormat outputFormat;
+	//read classic and 64-bit offset files through a memory map rather than libnetcdf (unless --no-mmap)
+	int mapClassic;
+	//--gzip compresses the output as it's written, on gzipThreads threads
+	int gzip;
+	int gzipLevel;
+	int gzipThreads;
+	size_t windowRows;
+	size_t maxMemory;
+	int decimals;
+	int numThreads;
+	int pipelined;
+	//--cf-decode unpacks and masks the variables with CF packing and missing value attributes
+	int cfDecode;
+	//--iso-time writes time coordinates as ISO 8601 timestamps (CSV output only)
+	int isoTime;
+	//--bin-rows or --bin output statistics over bins of rows instead of the rows (binVariable is NULL for bins of rows),
+	//aggregateStatistics holds the AGGREGATE_* bits from --aggregate
+	size_t binRows;
+	char *binVariable;
+	double binWidth;
+	int aggregateStatistics;
+	//--readers, processes reading the variables of each file that go through libnetcdf, each with its own handle on it
+	int numReaders;
+	//--vars projection, names or shell-style globs of the variables to output (all of them when there are none)
+	char **varPatterns;
+	int numVarPatterns;
+	//--start/--count/--stride along the first row dimension (count 0 for all of them)
+	size_t rowStart, rowCount, rowStride;
+	//--where predicates, rows are only output if they pass all of them
+	RowPredicate *predicates;
+	int numPredicates;
+	//--stats prints each file's timings and counters to stderr, --stats-dir writes them to a JSON file per input
+	int statsToStderr;
+	const char *statsDir;
+	//where each file's stats are left for the batch to collect
+	ConvertStats *fileStats;
+	//--append only converts the records added to a file's record dimension since the last time, after the rows already
+	//output, as long as the options that shape the output (summed up by outputSignature) haven't changed
+	int append;
+	char *outputSignature;
+} ConvertOptions;
+
+void PrintUsage()
+{
+	puts("usage: nc2csv [options] file.nc [file2.nc ...]");
+	puts("  -j N                convert N files at a time in parallel worker processes, largest first");
+	puts("  --files-from FILE   also convert the files listed in FILE, one per line (- reads the list from stdin)");
+	puts("  --manifest FILE     skip the inputs whose outputs are current according to FILE, and record the ones converted");
+	puts("  --force             with --manifest, convert every input anyway");
+	puts("  --watch DIR         keep running, converting each .nc file written to DIR (can be repeated) on -j workers");
+	puts("                      that stay up between files, until interrupted (any files given are converted first)");
+	puts("  --settle MS         with --watch, wait until a file has gone MS milliseconds without being written after");
+	printf("                      it's closed before converting it (default %d)\n", DEFAULT_SETTLE_MS);
+	puts("  --format FORMAT     csv (the default) or arrow, an Arrow IPC file holding the values as they're stored");
+	puts("  --gzip              write gzip compressed output (file.csv.gz), compressed in parallel blocks");
+	puts("  --gzip-level N      gzip compression level from 1 (fastest, the default) to 9 (smallest)");
+	puts("  --gzip-threads N    compress on N threads (defaults to the CPUs shared out between the -j jobs)");
+	puts("  --vars LIST         only output (and read) the comma separated variables, names or globs like temp*");
+	puts("  --start N           skip the first N indices of the first dimension (the rows of a 1-dimensional file)");
+	puts("  --count N           only output N indices of the first dimension");
+	puts("  --stride N          only output every Nth index of the first dimension");
+	puts("  --where PREDICATE   only output rows where a variable compares true, ex: time>=600 (can be repeated)");
+	puts("  --no-mmap           read classic and 64-bit offset files through libnetcdf instead of a memory map");
+	puts("  --window-rows N     number of rows read from every variable at a time");
+	puts("  --max-memory SIZE   cap on the variable window buffers, used to pick the window size");
+	puts("  --pipeline          overlap reading, formatting and writing of consecutive windows on separate threads");
+	puts("  --threads N         format the rows of each file on N threads (the output is the same as with 1)");
+	puts("  --cf-decode         unpack variables with CF scale_factor/add_offset attributes, and leave the cells of");
+	puts("                      _FillValue, missing_value and out of valid_range values empty (NaN in Arrow files)");
+	puts("  --iso-time          write time variables (with units like \"seconds since 2012-06-14 18:05:32\") as ISO 8601");
+	puts("                      UTC timestamps, ex: 2012-06-14T18:05:32Z (CSV output only)");
+	puts("  --bin-rows N        write the count, mean, min, max and standard deviation of every variable over each N rows,");
+	puts("                      one line per bin, instead of the rows (CSV output only)");
+	puts("  --bin VAR:WIDTH     the same over bins of consecutive rows whose VAR values fall in the same WIDTH wide");
+	puts("                      interval, ex: press:50 (rows without a VAR value are left out)");
+	puts("  --aggregate LIST    the comma separated statistics written for each bin, out of count, mean, min, max and stddev");
+	puts("  --readers N         read the variables of each file on N processes, each opening the file itself, so");
+	puts("                      compressed NetCDF-4 variables are decompressed on several cores at once");
+	puts("  --append            only convert the records added since the last --append run, appending them to the");
+	puts("                      output (tracked in file.csv.state), the whole file is converted the first time");
+	puts("  --decimals N        print floating point values with N decimal places (6 matches older versions),");
+	puts("                      instead of the shortest text that reads back as the same value");
+	puts("  --stats             print each file's phase timings and counters (and the batch's) to stderr as JSON lines");
+	puts("  --stats-dir DIR     write them to DIR/<file>.stats.json for each input, and DIR/batch.stats.json");
+	puts("                      (with --watch, each file's latency and the throughput so far go to DIR/watch.stats.json)");
+}
+
+//the operators of --where predicates, as they're written
+static const char *predicateOperatorText[] = { "<", "<=", ">", ">=", "==", "!=" };
+
+//sum up the options that change what goes into the output, an output is only appended to (or counted as current by
+//--manifest) with the same ones
+static char *BuildOutputSignature(const ConvertOptions *options)
+{
+	int i;
+	CsvWriter *signature = CsvWriterOpenMemory();
+	if (options->outputFormat == OUTPUT_ARROW) CsvWriterPutString(signature, "arrow");
+	else CsvWriterPrintf(signature, "%s decimals=%d", options->gzip ? "csv.gz" : "csv", options->decimals);
+	if (options->rowStart > 0 || options->rowCount > 0 || options->rowStride > 1)
+		CsvWriterPrintf(signature, " start=%zu count=%zu stride=%zu", options->rowStart, options->rowCount, options->rowStride);
+	for (i = 0; i < options->numVarPatterns; i++) CsvWriterPrintf(signature, "%s%s", (i == 0) ? " vars=" : ",", options->varPatterns[i]);
+	for (i = 0; i < options->numPredicates; i++)
+	{
+		const RowPredicate *predicate = &options->predicates[i];
+		CsvWriterPrintf(signature, " where=%s%s%.17g", predicate->varName, predicateOperatorText[predicate->op], predicate->value);
+	}
+	if (options->cfDecode) CsvWriterPutString(signature, " cf");
+	if (options->isoTime && options->outputFormat != OUTPUT_ARROW) CsvWriterPutString(signature, " iso_time");
+	if (options->binRows > 0) CsvWriterPrintf(signature, " bin_rows=%zu", options->binRows);
+	if (options->binVariable != NULL) CsvWriterPrintf(signature, " bin=%s:%.17g", options->binVariable, options->binWidth);
+	if (options->binRows > 0 || options->binVariable != NULL) CsvWriterPrintf(signature, " aggregate=%d", options->aggregateStatistics);
+	CsvWriterPutChar(signature, '\0');
+	char *text = strdup(signature->buffer);
+	CsvWriterClose(signature);
+	return text;
+}
+
+//get the name of the CSV (or Arrow) file written next to a NetCDF file, in a new string (an OutputNameFunction)
+static char *GetOutputFilename(const char *filename, const void *context)
+{
+	const ConvertOptions *options = (const ConvertOptions *)context;
+	
+	//allocate space for the CSV filename, plus some room for the longer extension, etc
+	char *csvFilename = malloc((strlen(filename) + 10)*sizeof(char));
+	strcpy(csvFilename, filename);
+	char *periodLocation = strrchr(csvFilename, '.');
+	if (periodLocation != NULL && strchr(periodLocation, '/') == NULL) *periodLocation = '\0';
+	strcat(csvFilename, (options->outputFormat == OUTPUT_ARROW) ? ".arrow" : ".csv");
+	if (options->gzip) strcat(csvFilename, ".gz");
+	return csvFilename;
+}
+
+//check how much of a file an --append run has already converted, going by the output's state file
+//the output has to have been written with the same options and still hold everything the state says it does, and the
+//file has to be the same one (not replaced by a new sounding, or rewritten with other values in the records already
+//converted) and can't have lost records since, otherwise the whole file is converted again
+//returns the number of records already converted (0 to convert the whole file), and sets the size of the output they took
+static size_t GetAppendStart(const char *outputFilename, const char *stateFilename, const char *signature,
+	const NcDataset *dataset, const struct stat *inputInfo, size_t numRecords, uint64_t *outputBytes)
+{
+	AppendState state;
+	if (LoadAppendState(stateFilename, &state) != 0) return 0;
+	
+	size_t appendStart = 0;
+	struct stat outputInfo;
+	uint64_t recordHash = 0;
+	if (strcmp(state.signature, signature) != 0) puts("output was written with other options, converting the whole file");
+	else if (stat(outputFilename, &outputInfo) != 0 || (uint64_t)outputInfo.st_size < state.outputBytes)
+		puts("output is missing or shorter than its state file says, converting the whole file");
+	else if (state.inputDevice != (uint64_t)inputInfo->st_dev || state.inputInode != (uint64_t)inputInfo->st_ino)
+		puts("file was replaced since it was converted, converting the whole file");
+	else if (state.numRecords > numRecords) puts("file has fewer records than were converted, converting the whole file");
+	else if (state.numRecords == 0 || HashRecords(dataset->datasetID, dataset->unlimitedDimID, 0, (size_t)state.numRecords - 1,
+		&recordHash) != NC_NOERR || recordHash != state.recordHash)
+		puts("records already converted have changed, converting the whole file");
+	else
+	{
+		appendStart = (size_t)state.numRecords;
+		*outputBytes = state.outputBytes;
+	}
+	FreeAppendState(&state);
+	return appendStart;
+}
+
+//convert a single NetCDF file into a CSV (or Arrow) file next to it, returns 0 on success or a nonzero error status
+//variables with several dimensions are flattened into one row per combination of dimension indices, with a column
+//for each dimension's coordinate values (or indices) at the front, and variables missing some of the dimensions
+//repeated along them
+int ConvertFile(const char *filename, void *context)
 {
+	const ConvertOptions *options = (const ConvertOptions *)context;
+	
 	//define some generic loop indices
-	int i, j;
+	int i;
+	
+	int status = 0;
+	int ncResult;
+	
+	//everything that needs cleaning up, so a failure part way through only abandons this file
+	NcDataset *dataset = NULL;
+	ReadPlan *plan = NULL;
+	char *csvFilename = NULL;
+	CsvWriter *csvFile = NULL;
+	int numColumns = 0;
+	ColumnFormatter *columnFormatters = NULL;
+	ColumnFormatKernel *columnKernels = NULL;
+	ParallelFormatter *parallelFormatter = NULL;
+	ArrowFileWriter *arrowWriter = NULL;
+	Aggregator *aggregator = NULL;
+	int arrowOutput = (options->outputFormat == OUTPUT_ARROW);
+	size_t numRowsOutput = 0;
+	//with --append, the records converted by the time this run is done, the record the run starts from (0 when the whole
+	//file is converted), and whether the file's rows run along its record dimension so it can be appended to next time
+	char *stateFilename = NULL;
+	size_t numRecords = 0;
+	size_t appendStart = 0;
+	uint64_t appendOffset = 0;
+	int appendable = 0;
+	struct stat inputInfo;
+	
+	//timings and counters, every phase's lap runs from the end of the one before
+	ConvertStats stats;
+	InitConvertStats(&stats);
+	stats.numFiles = 1;
+	ConvertPhase phase = PHASE_OPEN;
+	double fileStart = GetMonotonicTime();
+	double lapStart = fileStart;
+	
+	csvFilename = GetOutputFilename(filename, options);
 	
-	//make sure a filename was provided
-	if (argc < 2)
+	//open the NetCDF file/dataset, classic and 64-bit offset files are memory-mapped too
+	//(Arrow output wants native byte order, so it stays with libnetcdf)
+	status = OpenNcDataset(filename, options->mapClassic && !arrowOutput, &dataset);
+	if (status != 0) goto cleanup;
+	int datasetID = dataset->datasetID;
+	lapStart = LapPhase(&stats, phase, lapStart);
+	phase = PHASE_METADATA;
+	
+	printf("opened NetCDF file: %s", filename);
+	printf("output %s filename: %s\n", arrowOutput ? "Arrow" : "CSV", csvFilename);
+	
+	//show some of the NetCDF file information on the console
+	status = PrintDatasetInfo(dataset);
+	if (status != 0) goto cleanup;
+	
+	//with --append, a file that has grown along its record dimension since it was last converted only has its new
+	//records read, and their rows are added to the end of the output
+	if (options->append && dataset->unlimitedDimID != -1)
 	{
-		puts("NetCDF filename argument required");
-		return -1;
+		ncResult = nc_inq_dimlen(datasetID, dataset->unlimitedDimID, &numRecords);
+		if (ncResult != NC_NOERR)
+		{
+			status = HandleNCError("nc_inq_dimlen", ncResult);
+			goto cleanup;
+		}
+		if (stat(filename, &inputInfo) != 0)
+		{
+			printf("error: could not stat input file: %s\n", filename);
+			status = -1;
+			goto cleanup;
+		}
+		stateFilename = GetAppendStateFilename(csvFilename);
+		appendStart = GetAppendStart(csvFilename, stateFilename, options->outputSignature, dataset, &inputInfo, numRecords,
+			&appendOffset);
+		if (appendStart > 0 && appendStart == numRecords)
+		{
+			printf("no new records since the last conversion (%zu records)\n", numRecords);
+			goto cleanup;
+		}
+		if (appendStart > 0) printf("appending records %zu to %zu\n", appendStart, numRecords - 1);
 	}
+	int appending = (appendStart > 0);
+	//(the CSV header lines only go at the start of the file)
+	int headerLines = !arrowOutput && !appending;
 	
-	//loop through every input file
-	int argIndex;
-	for (argIndex = 1; argIndex < argc; argIndex++)
+	//open/create the CSV file for outputting data, or reopen it after the rows already converted
+	//todo: better file name
+	if (options->gzip && appending) csvFile = CsvWriterOpenGzipAt(csvFilename, appendOffset, options->gzipThreads, options->gzipLevel);
+	else if (options->gzip) csvFile = CsvWriterOpenGzip(csvFilename, options->gzipThreads, options->gzipLevel);
+	else if (appending) csvFile = CsvWriterOpenAt(csvFilename, appendOffset);
+	else csvFile = CsvWriterOpen(csvFilename);
+	if (csvFile == NULL)
 	{
-		char* filename = argv[argIndex];
-		size_t filenameLength = strlen(filename);
-		
-		//allocate space for the CSV filename, plus some room for the longer extension, etc
-		char *csvFilename = malloc((filenameLength + 5)*sizeof(char));
-		strcpy(csvFilename, filename);
-		char *periodLocation = strrchr(csvFilename, '.');
-		*periodLocation = '\0';
-		strcat(csvFilename, ".csv");
-		
-		//open the NetCDF file/dataset
-		int datasetID;
-		int ncResult;
-		ncResult = nc_open(filename, NC_NOWRITE, &datasetID);
-		if (ncResult != NC_NOERR) HandleNCError("nc_open", ncResult);
-		
-		printf("opened NetCDF file: %s", filename);
-		printf("output CSV filename: %s\n", csvFilename);
+		printf("error: could not create output file: %s\n", csvFilename);
+		status = -1;
+		goto cleanup;
+	}
+	//a whole conversion without --append leaves nothing to append to
+	if (!options->append)
+	{
+		char *staleStateFilename = GetAppendStateFilename(csvFilename);
+		remove(staleStateFilename);
+		free(staleStateFilename);
+	}
+	//an Arrow file's schema carries the attributes and header text as metadata
+	if (arrowOutput) arrowWriter = CreateArrowFileWriter();
+	
+	//output the global attributes
+	//todo: output more than just the text-based ones
+	for (i=0; i<dataset->numGlobalAtts && !appending; i++)
+	{
+		char attName[NC_MAX_NAME+1];
+		ncResult = nc_inq_attname(datasetID, NC_GLOBAL, i, attName);
+		if (ncResult != NC_NOERR)
+		{
+			status = HandleNCError("nc_inq_attname", ncResult);
+			goto cleanup;
+		}
+		size_t attLength;
+		ncResult = nc_inq_attlen(datasetID, NC_GLOBAL, attName, &attLength);
+		if (ncResult != NC_NOERR)
+		{
+			status = HandleNCError("nc_inq_attlen", ncResult);
+			goto cleanup;
+		}
 		
-		//get basic information about the NetCDF file
-		int numDims, numVars, numGlobalAtts, unlimitedDimID;
-		ncResult = nc_inq(datasetID, &numDims, &numVars, &numGlobalAtts, &unlimitedDimID);
-		if (ncResult != NC_NOERR) HandleNCError("nc_inq", ncResult);
-		int formatVersion;
-		ncResult = nc_inq_format(datasetID, &formatVersion);
-		if (ncResult != NC_NOERR) HandleNCError("nc_inq_format", ncResult);
+		char *attValue = malloc((attLength+1)*sizeof(char));
 		
-		if (numDims != 1)
+		//only output the attribute if it can be converted into text
+		ncResult = nc_get_att_text(datasetID, NC_GLOBAL, attName, attValue);
+		if (ncResult == NC_NOERR)
 		{
-			puts("error: only 1-dimensional NetCDF files are supported for now");
-			return -1;
+			attValue[attLength] = '\0';
+			if (arrowOutput) AddArrowMetadata(arrowWriter, -1, attName, attValue);
+			else CsvWriterPrintf(csvFile, "%s, %s\r\n", attName, attValue);
 		}
 		
-		//show some of the NetCDF file information on the console
-		printf("# dims: %d\n# vars: %d\n# global atts: %d\n", numDims, numVars, numGlobalAtts);
-		if (unlimitedDimID != -1) puts("contains unlimited dimension");
-		switch (formatVersion)
-		{
-			case NC_FORMAT_CLASSIC:
-				puts("classic file format");
-				break;
-			case NC_FORMAT_64BIT:
-				puts("64-bit file format");
-				break;
-			case NC_FORMAT_NETCDF4:
-				puts("netcdf4 file format");
-				break;
-			case NC_FORMAT_NETCDF4_CLASSIC:
-				puts("netcdf4 classic format");
-				break;
-			default:
-				puts("unrecognized file format");
-				return -1;
-				break;
+		free(attValue);
+	}
+	if (headerLines) CsvWriterPutBytes(csvFile, "\r\n", 2);
+	
+	//plan the columns and windows of rows to read, the pipeline keeps several windows in flight, each with its own buffers
+	PlanOptions planOptions;
+	InitPlanOptions(&planOptions);
+	planOptions.varPatterns = options->varPatterns;
+	planOptions.numVarPatterns = options->numVarPatterns;
+	planOptions.rowStart = appending ? appendStart : options->rowStart;
+	planOptions.rowCount = options->rowCount;
+	planOptions.rowStride = options->rowStride;
+	planOptions.predicates = options->predicates;
+	planOptions.numPredicates = options->numPredicates;
+	planOptions.windowRows = options->windowRows;
+	planOptions.maxMemory = options->maxMemory;
+	planOptions.numSlots = options->pipelined ? PIPELINE_SLOTS : 1;
+	planOptions.cfDecode = options->cfDecode;
+	planOptions.decodeTimes = options->isoTime && !arrowOutput;
+	planOptions.numReaders = options->numReaders;
+	planOptions.verbose = 1;
+	status = CreateReadPlan(dataset, &planOptions, &plan);
+	if (status != 0) goto cleanup;
+	numColumns = plan->numColumns;
+	VariableData **columnList = plan->columns;
+	stats.allocations += plan->numAllocations;
+	stats.allocatedBytes += plan->allocatedBytes;
+	
+	//only a file whose rows run along its record dimension first can be appended to as it grows
+	if (options->append)
+	{
+		appendable = (numRecords > 0 && plan->rowSpace.numDims > 0 && plan->rowSpace.dimIDs[0] == dataset->unlimitedDimID);
+		if (!appendable && stateFilename != NULL) remove(stateFilename);
+		if (!appendable && appending)
+		{
+			puts("error: the file's dimensions have changed since it was last converted, it will be converted whole next time");
+			status = -1;
+			goto cleanup;
 		}
+		if (!appendable) puts("note: the rows don't run along a record dimension, --append converts the whole file each time");
+	}
+	
+	//with --bin-rows or --bin, the rows are summed up into bins instead of being output
+	if (options->binRows > 0 || options->binVariable != NULL)
+	{
+		AggregateOptions aggregateOptions;
+		aggregateOptions.binRows = options->binRows;
+		aggregateOptions.keyColumn = -1;
+		aggregateOptions.binWidth = options->binWidth;
+		aggregateOptions.statistics = options->aggregateStatistics;
+		aggregateOptions.decimals = options->decimals;
+		for (i=0; i<numColumns && options->binVariable != NULL; i++)
+		{
+			if (strcmp(columnList[i]->name, options->binVariable) == 0) aggregateOptions.keyColumn = i;
+		}
+		if (options->binVariable != NULL && aggregateOptions.keyColumn < 0)
+		{
+			printf("error: --bin variable isn't one of the columns output: %s\n", options->binVariable);
+			status = -1;
+			goto cleanup;
+		}
+		aggregator = CreateAggregator(&aggregateOptions, columnList, numColumns);
+		if (aggregator == NULL)
+		{
+			status = -1;
+			goto cleanup;
+		}
+	}
+	
+	//choose each column's formatting kernel once
+	columnFormatters = (ColumnFormatter *)malloc(numColumns * sizeof(ColumnFormatter));
+	columnKernels = (ColumnFormatKernel *)malloc(numColumns * sizeof(ColumnFormatKernel));
+	for (i=0; i<numColumns; i++)
+	{
+		if (columnList[i]->timestamp) columnKernels[i] = GetTimestampColumnKernel();
+		else if (columnList[i]->cf.active) columnKernels[i] = SelectMaskedColumnKernel(columnList[i]->type, options->decimals);
+		else columnKernels[i] = SelectColumnKernel(columnList[i]->type, columnList[i]->mapped, options->decimals);
+		InitColumnFormatter(&columnFormatters[i], columnKernels[i], options->decimals);
+	}
+	
+	//with more than one thread, each window's rows are formatted in parallel chunks
+	if (options->numThreads > 1 && !arrowOutput && aggregator == NULL) parallelFormatter = CreateParallelFormatter(options->numThreads, columnKernels, numColumns, options->decimals);
+	
+	//an Arrow file gets a schema with the header text as metadata on each field, instead of the header lines
+	if (arrowOutput)
+	{
+		for (i=0; i<numColumns; i++)
+		{
+			ArrowColumnType columnType;
+			if (GetArrowColumnType(columnList[i]->type, &columnType) != 0)
+			{
+				printf("error: variable %s has a type that can't be written to Arrow files\n", columnList[i]->name);
+				status = -1;
+				goto cleanup;
+			}
+			int field = AddArrowField(arrowWriter, columnList[i]->name, columnType);
+			if (columnList[i]->standardName[0] != '\0') AddArrowMetadata(arrowWriter, field, "standard_name", columnList[i]->standardName);
+			if (columnList[i]->longName[0] != '\0') AddArrowMetadata(arrowWriter, field, "long_name", columnList[i]->longName);
+			if (columnList[i]->units[0] != '\0') AddArrowMetadata(arrowWriter, field, "units", columnList[i]->units);
+		}
+		WriteArrowHeader(arrowWriter, csvFile);
+	}
+	//the bins have a column for each statistic of each variable instead
+	if (aggregator != NULL)
+	{
+		WriteAggregateHeader(aggregator, csvFile);
+		headerLines = 0;
+	}
+
+	//output the column names
+	for (i=0; i<numColumns && headerLines; i++)
+	{
+		CsvWriterPutString(csvFile, columnList[i]->name);
+		if (i != (numColumns-1)) CsvWriterPutBytes(csvFile, ", ", 2);
+	}
+	if (headerLines) CsvWriterPutBytes(csvFile, "\r\n", 2);
+	
+	//output the variable standard names
+	for (i=0; i<numColumns && headerLines; i++)
+	{
+		CsvWriterPutString(csvFile, columnList[i]->standardName);
+		if (i != (numColumns-1)) CsvWriterPutBytes(csvFile, ", ", 2);
+	}
+	if (headerLines) CsvWriterPutBytes(csvFile, "\r\n", 2);
+	
+	//output the variable long names
+	for (i=0; i<numColumns && headerLines; i++)
+	{
+		CsvWriterPutString(csvFile, columnList[i]->longName);
+		if (i != (numColumns-1)) CsvWriterPutBytes(csvFile, ", ", 2);
+	}
+	if (headerLines) CsvWriterPutBytes(csvFile, "\r\n", 2);
+	
+	//output the variable units
+	for (i=0; i<numColumns && headerLines; i++)
+	{
+		//(the time coordinates written as timestamps are in UTC, whatever they counted from)
+		char *unitsName = columnList[i]->timestamp ? "UTC" : columnList[i]->units;
+		if (unitsName[0] != '[')
+			CsvWriterPutChar(csvFile, '[');
 		
-		//int dimID;
-		//for (dimID = 0; dimID < numDims; dimID++)
-		//{
-		//get dimension names and lengths
-		char dimName[NC_MAX_NAME+1];
-		size_t dimLength;
-		ncResult = nc_inq_dim(datasetID, 0, dimName, &dimLength);
-		if (ncResult != NC_NOERR) HandleNCError("nc_inq_dim", ncResult);
-		
-		printf("dimension: %s length: %d\n", dimName, dimLength);
-		//}
+		CsvWriterPutString(csvFile, unitsName);
 		
-		//open/create the CSV file for outputting data
-		//todo: better file name
-		FILE *csvFile = fopen(csvFilename, "w");
+		if (unitsName[0] == '\0' || unitsName[strlen(unitsName)-1] != ']')
+			CsvWriterPutChar(csvFile, ']');
 		
-		//output the global attributes
-		//todo: output more than just the text-based ones
-		for (i=0; i<numGlobalAtts; i++)
-		{
-			char attName[NC_MAX_NAME+1];
-			ncResult = nc_inq_attname(datasetID, NC_GLOBAL, i, attName);
-			if (ncResult != NC_NOERR) HandleNCError("nc_inq_attname", ncResult);
-			size_t attLength;
-			ncResult = nc_inq_attlen(datasetID, NC_GLOBAL, attName, &attLength);
-			if (ncResult != NC_NOERR) HandleNCError("nc_inq_attlen", ncResult);
-			
-			char *attValue = malloc(attLength*sizeof(char));
-			
-			//only output the attribute if it can be converted into text
-			ncResult = nc_get_att_text(datasetID, NC_GLOBAL, attName, attValue);
-			if (ncResult == NC_NOERR)
+		if (i != (numColumns-1)) CsvWriterPutBytes(csvFile, ", ", 2);
+	}
+	if (headerLines) CsvWriterPutBytes(csvFile, "\r\n", 2);
+	
+	
+	//output variable data to the CSV file, one window of rows at a time
+	ConversionStages conversion;
+	conversion.plan = plan;
+	conversion.columnFormatters = columnFormatters;
+	conversion.parallelFormatter = parallelFormatter;
+	conversion.arrowWriter = arrowWriter;
+	conversion.aggregator = aggregator;
+	WindowStages stages = { ReadWindowStage, FormatWindowStage, &conversion };
+	StageTimings timings;
+	lapStart = LapPhase(&stats, phase, lapStart);
+	phase = PHASE_CLOSE;
+	status = RunWindowStages(&stages, plan->rowSpace.numWindows, options->pipelined, csvFile, &timings);
+	//the stages time themselves, the writes they did (as part of formatting, when serial) are timed by the writer
+	double writeSeconds = csvFile->writeSeconds;
+	stats.phaseSeconds[PHASE_READ] = timings.readBusy;
+	stats.phaseSeconds[PHASE_FORMAT] = timings.pipelined ? timings.formatBusy : timings.formatBusy - writeSeconds;
+	if (stats.phaseSeconds[PHASE_FORMAT] < 0) stats.phaseSeconds[PHASE_FORMAT] = 0;
+	lapStart = GetMonotonicTime();
+	numRowsOutput = plan->numRowsSelected;
+	if (status != 0) goto cleanup;
+	if (arrowOutput) WriteArrowFooter(arrowWriter, csvFile);
+	if (aggregator != NULL)
+	{
+		FinishAggregation(aggregator, csvFile);
+		numRowsOutput = GetAggregateBinCount(aggregator);
+		printf("bins: %zu of %zu rows\n", numRowsOutput, plan->numRowsSelected);
+	}
+	PrintStageTimings(&timings);
+	if (plan->numPredicates > 0) printf("rows: %zu of %zu passed --where\n", plan->numRowsSelected, plan->numRowsRead);
+	
+cleanup:
+	//whatever phase a failure happened in gets the time up to here
+	lapStart = LapPhase(&stats, phase, lapStart);
+	
+	//the stats of every variable read, output or tested by a --where predicate
+	int numVarStats = 0;
+	int numPlanned = (plan != NULL) ? plan->numColumns + plan->numPredicates : 0;
+	VariableStats *varStats = (VariableStats *)malloc((numPlanned + 1) * sizeof(VariableStats));
+	for (i=0; i<numPlanned; i++)
+	{
+		VariableData *variableData = (i < plan->numColumns) ? plan->columns[i] : plan->predicateColumns[i - plan->numColumns];
+		if (variableData->varID < 0) continue;
+		varStats[numVarStats].name = variableData->name;
+		varStats[numVarStats].readSeconds = variableData->readSeconds;
+		varStats[numVarStats].bytesRead = variableData->bytesRead;
+		stats.bytesRead += variableData->bytesRead;
+		numVarStats++;
+	}
+	stats.rows = numRowsOutput;
+	stats.cells = (uint64_t)numRowsOutput * ((aggregator != NULL) ? GetAggregateColumnCount(aggregator) : numColumns);
+	
+	//the output file's still open, the plan is freed once its stats are reported
+	if (csvFile != NULL)
+	{
+		//(anything written before the window stages or after them, like the header lines, counts as writing too)
+		CsvWriterFlush(csvFile);
+		stats.phaseSeconds[PHASE_WRITE] = csvFile->writeSeconds;
+		lapStart = GetMonotonicTime();
+	}
+	if (csvFile != NULL && CsvWriterClose(csvFile) != 0)
+	{
+		printf("error: failed writing output file: %s\n", csvFilename);
+		if (status == 0) status = -1;
+	}
+	
+	//with --append, note how far the output has got for the next run
+	if (status == 0 && appendable)
+	{
+		struct stat outputInfo;
+		AppendState state;
+		int saved = 0;
+		if (stat(csvFilename, &outputInfo) == 0)
+		{
+			state.numRecords = numRecords;
+			state.outputBytes = (uint64_t)outputInfo.st_size;
+			state.inputDevice = (uint64_t)inputInfo.st_dev;
+			state.inputInode = (uint64_t)inputInfo.st_ino;
+			state.signature = options->outputSignature;
+			ncResult = HashRecords(dataset->datasetID, dataset->unlimitedDimID, 0, numRecords - 1, &state.recordHash);
+			saved = (ncResult == NC_NOERR && SaveAppendState(stateFilename, &state) == 0);
+		}
+		if (!saved) printf("warning: could not write append state file: %s\n", stateFilename);
+	}
+	
+	//close the NetCDF file
+	if (dataset != NULL)
+	{
+		ncResult = CloseNcDataset(dataset);
+		if (ncResult != NC_NOERR && status == 0) status = HandleNCError("nc_close", ncResult);
+	}
+	lapStart = LapPhase(&stats, PHASE_CLOSE, lapStart);
+	
+	stats.numFailed = (status != 0);
+	stats.totalSeconds = lapStart - fileStart;
+	FinishConvertStats(&stats, csvFilename);
+	ReportFileStats(filename, status, &stats, varStats, numVarStats, options->statsToStderr, options->statsDir);
+	if (options->fileStats != NULL) *options->fileStats = stats;
+	free(varStats);
+	
+	//free up heap memory
+	if (parallelFormatter != NULL) FreeParallelFormatter(parallelFormatter);
+	if (arrowWriter != NULL) FreeArrowFileWriter(arrowWriter);
+	FreeAggregator(aggregator);
+	for (i=0; i<numColumns; i++)
+	{
+		if (columnFormatters != NULL) FreeColumnFormatter(&columnFormatters[i]);
+	}
+	free(columnFormatters);
+	free(columnKernels);
+	FreeReadPlan(plan);
+	free(stateFilename);
+	free(csvFilename);
+	
+	if (status == 0) printf("peak resident memory: %ld KB\n", GetPeakRSSKB());
+	printf("\r\n");
+	
+	return status;
+}
+
+int main (int argc, char** argv)
+{
+	ConvertOptions options;
+	options.outputFormat = OUTPUT_CSV;
+	options.mapClassic = 1;
+	options.gzip = 0;
+	options.gzipLevel = GZIP_DEFAULT_LEVEL;
+	//(0 until the number of jobs is known)
+	options.gzipThreads = 0;
+	//window sizing options (0 means not specified)
+	options.windowRows = 0;
+	options.maxMemory = 0;
+	//number of decimal places for floating point values, or the shortest text that reads back as the same value
+	options.decimals = CSV_SHORTEST;
+	options.numThreads = 1;
+	options.pipelined = 0;
+	options.cfDecode = 0;
+	options.isoTime = 0;
+	options.numReaders = 1;
+	options.binRows = 0;
+	options.binVariable = NULL;
+	options.binWidth = 0;
+	options.aggregateStatistics = AGGREGATE_ALL;
+	options.varPatterns = NULL;
+	options.numVarPatterns = 0;
+	options.rowStart = 0;
+	options.rowCount = 0;
+	options.rowStride = 1;
+	options.predicates = NULL;
+	options.numPredicates = 0;
+	options.statsToStderr = 0;
+	options.statsDir = NULL;
+	options.fileStats = NULL;
+	options.append = 0;
+	options.outputSignature = NULL;
+	int numJobs = 1;
+	const char *manifestFilename = NULL;
+	int force = 0;
+	WatchOptions watchOptions;
+	watchOptions.directories = NULL;
+	watchOptions.numDirectories = 0;
+	watchOptions.settleMs = DEFAULT_SETTLE_MS;
+	
+	//pull the options out of the argument list, leaving only the input filenames
+	FileList inputFiles;
+	InitFileList(&inputFiles);
+	int argIndex;
+	for (argIndex = 1; argIndex < argc; argIndex++)
+	{
+		char *arg = argv[argIndex];
+		if (strcmp(arg, "--format") == 0 && argIndex+1 < argc)
+		{
+			char *format = argv[++argIndex];
+			if (strcmp(format, "csv") == 0) options.outputFormat = OUTPUT_CSV;
+			else if (strcmp(format, "arrow") == 0) options.outputFormat = OUTPUT_ARROW;
+			else
 			{
-				fprintf(csvFile, "%s, %s\r\n", attName, attValue);
+				printf("error: unknown --format: %s (expected csv or arrow)\n", format);
+				return -1;
 			}
-			
-			free(attValue);
 		}
-		fprintf(csvFile, "\r\n");
-		
-		//storage for all variables in the NetCDF file
-		//todo: watch out for segfaults, maybe use nc_get_vara_ to get pieces instead of whole variables
-		VariableData **variableDataList = (VariableData **)malloc(numVars * sizeof(VariableData*));
-		char **standardNameList = (char **)malloc(numVars * sizeof(char*));
-		char **longNameList = (char **)malloc(numVars * sizeof(char*));
-		char **unitStringList = (char **)malloc(numVars * sizeof(char*));
-		
-		//loop through all the variables
-		int varID;
-		for (varID=0; varID<numVars; varID++)
-		{
-			//get information about the variable
-			char varName[NC_MAX_NAME+1];
-			nc_type varType;
-			int numVarDims;
-			int varDimIDs[NC_MAX_VAR_DIMS];
-			int numVarAtts;
-			ncResult = nc_inq_var(datasetID, varID, varName, &varType, &numVarDims, varDimIDs, &numVarAtts);
-			if (ncResult != NC_NOERR) HandleNCError("nc_inq_var", ncResult);
-			
-			//output variable info to console
-			printf("variable: %s # dims: %d # atts: %d type: %d\n", varName, numVarDims, numVarAtts, (int)varType);
-			
-			//output variable name to the CSV file
-			fprintf(csvFile, "%s", varName);
-			if (varID != (numVars-1)) fprintf(csvFile, ", ");
-			
-			//see if there is an attribute for the variable standard name, and store it if there is
-			int standardNameAttLen = 0;
-			ncResult = nc_inq_attlen(datasetID, varID, "standard_name", &standardNameAttLen);
-			if (ncResult == NC_NOERR)
+		else if (strcmp(arg, "--no-mmap") == 0)
+		{
+			options.mapClassic = 0;
+		}
+		else if (strcmp(arg, "--gzip") == 0)
+		{
+			options.gzip = 1;
+		}
+		else if (strcmp(arg, "--gzip-level") == 0 && argIndex+1 < argc)
+		{
+			options.gzipLevel = atoi(argv[++argIndex]);
+			if (options.gzipLevel < 1 || options.gzipLevel > 9)
 			{
-				//allocate enough space for the units string
-				char *standardNameValueStr = (char *) malloc(standardNameAttLen + 1);
-				ncResult = nc_get_att_text(datasetID, varID, "standard_name", standardNameValueStr);
-				if (ncResult != NC_NOERR) HandleNCError("nc_get_att_text", ncResult);
-				//make sure the string is null terminated (sometimes it won't be, apparently)
-				standardNameValueStr[standardNameAttLen] = '\0';
-				standardNameList[varID] = standardNameValueStr;
+				puts("error: --gzip-level must be between 1 and 9");
+				return -1;
 			}
-			else
+		}
+		else if (strcmp(arg, "--gzip-threads") == 0 && argIndex+1 < argc)
+		{
+			options.gzipThreads = atoi(argv[++argIndex]);
+			if (options.gzipThreads < 1)
 			{
-				char *emptyHeapStr = malloc(1*sizeof(char));
-				emptyHeapStr[0] = '\0';
-				standardNameList[varID] = emptyHeapStr;
+				puts("error: --gzip-threads must be at least 1");
+				return -1;
 			}
-			
-			//see if there is an attribute for the variable long name, and store it if there is
-			int longNameAttLen = 0;
-			ncResult = nc_inq_attlen(datasetID, varID, "long_name", &longNameAttLen);
-			if (ncResult == NC_NOERR)
+		}
+		else if (strcmp(arg, "--window-rows") == 0 && argIndex+1 < argc)
+		{
+			options.windowRows = (size_t)strtoull(argv[++argIndex], NULL, 10);
+			if (options.windowRows == 0)
 			{
-				//allocate enough space for the units string
-				char *longNameValueStr = (char *) malloc(longNameAttLen + 1);
-				ncResult = nc_get_att_text(datasetID, varID, "long_name", longNameValueStr);
-				if (ncResult != NC_NOERR) HandleNCError("nc_get_att_text", ncResult);
-				//make sure the string is null terminated (sometimes it won't be, apparently)
-				longNameValueStr[longNameAttLen] = '\0';
-				longNameList[varID] = longNameValueStr;
+				puts("error: --window-rows must be a positive integer");
+				return -1;
 			}
-			else
+		}
+		else if (strcmp(arg, "--max-memory") == 0 && argIndex+1 < argc)
+		{
+			options.maxMemory = ParseByteSize(argv[++argIndex]);
+			if (options.maxMemory == 0)
 			{
-				char *emptyHeapStr = malloc(1*sizeof(char));
-				emptyHeapStr[0] = '\0';
-				longNameList[varID] = emptyHeapStr;
+				puts("error: invalid --max-memory size");
+				return -1;
 			}
-			
-			//see if there is an attribute for the variable units description, and store it if there is
-			int unitsAttLen = 0;
-			ncResult = nc_inq_attlen(datasetID, varID, "units", &unitsAttLen);
-			if (ncResult == NC_NOERR)
+		}
+		else if (strcmp(arg, "--decimals") == 0 && argIndex+1 < argc)
+		{
+			char *end;
+			options.decimals = (int)strtol(argv[++argIndex], &end, 10);
+			if (*end != '\0' || options.decimals < 0 || options.decimals > CSV_MAX_DECIMALS)
 			{
-				//allocate enough space for the units string
-				char *unitsValueStr = (char *) malloc(unitsAttLen + 1);
-				ncResult = nc_get_att_text(datasetID, varID, "units", unitsValueStr);
-				if (ncResult != NC_NOERR) HandleNCError("nc_get_att_text", ncResult);
-				//make sure the string is null terminated (sometimes it won't be, apparently)
-				unitsValueStr[unitsAttLen] = '\0';
-				unitStringList[varID] = unitsValueStr;
+				printf("error: --decimals must be between 0 and %d\n", CSV_MAX_DECIMALS);
+				return -1;
 			}
-			else
+		}
+		else if (strcmp(arg, "--vars") == 0 && argIndex+1 < argc)
+		{
+			//a comma separated list, which can be given more than once
+			char *list = argv[++argIndex];
+			char *pattern;
+			for (pattern = strtok(list, ","); pattern != NULL; pattern = strtok(NULL, ","))
 			{
-				char *emptyHeapStr = malloc(1*sizeof(char));
-				emptyHeapStr[0] = '\0';
-				unitStringList[varID] = emptyHeapStr;
+				options.varPatterns = (char **)realloc(options.varPatterns, (options.numVarPatterns+1) * sizeof(char*));
+				options.varPatterns[options.numVarPatterns++] = pattern;
 			}
-			
-			
-			//make sure the variable only has 1 dimension
-			if (numVarDims != 1) puts("warning: only 1-dimensional variables are supported for now... skipping");
-			else
+		}
+		else if ((strcmp(arg, "--start") == 0 || strcmp(arg, "--count") == 0 || strcmp(arg, "--stride") == 0) && argIndex+1 < argc)
+		{
+			char *end;
+			char *valueText = argv[++argIndex];
+			size_t value = (size_t)strtoull(valueText, &end, 10);
+			if (end == valueText || *end != '\0' || valueText[0] == '-' || (value == 0 && strcmp(arg, "--start") != 0))
 			{
-				//storage for this variable's data structure
-				VariableData *variableData = (VariableData *)malloc(sizeof(VariableData));
-				variableData->type = varType;
-				
-				//depending on the type, allocate storage for this variable's raw data contained in the structure
-				switch (varType)
-				{
-					case NC_BYTE:
-					{
-						variableData->data = malloc(dimLength * sizeof(unsigned char));
-						ncResult = nc_get_var_uchar(datasetID, varID, (unsigned char*)variableData->data);
-						if (ncResult != NC_NOERR) HandleNCError("nc_get_var", ncResult);
-						break;
-					}
-					case NC_CHAR:
-					{
-						variableData->data = malloc(dimLength * sizeof(char));
-						ncResult = nc_get_var_text(datasetID, varID, (char*)variableData->data);
-						if (ncResult != NC_NOERR) HandleNCError("nc_get_var", ncResult);
-						break;
-					}
-					case NC_SHORT:
-					{
-						variableData->data = malloc(dimLength * sizeof(short));
-						ncResult = nc_get_var_short(datasetID, varID, (short*)variableData->data);
-						if (ncResult != NC_NOERR) HandleNCError("nc_get_var", ncResult);
-						break;
-					}
-					case NC_INT:
-					{
-						variableData->data = malloc(dimLength * sizeof(int));
-						ncResult = nc_get_var_int(datasetID, varID, (int*)variableData->data);
-						if (ncResult != NC_NOERR) HandleNCError("nc_get_var", ncResult);
-						break;
-					}
-					case NC_FLOAT:
-					{
-						variableData->data = malloc(dimLength * sizeof(float));
-						ncResult = nc_get_var_float(datasetID, varID, (float*)variableData->data);
-						if (ncResult != NC_NOERR) HandleNCError("nc_get_var", ncResult);
-						break;
-					}
-					case NC_DOUBLE:
-					{
-						variableData->data = malloc(dimLength * sizeof(double));
-						ncResult = nc_get_var_double(datasetID, varID, (double*)variableData->data);
-						if (ncResult != NC_NOERR) HandleNCError("nc_get_var", ncResult);
-						break;
-					}
-					default:
-					{
-						puts("warning: invalid variable type");
-						break;
-					}
-				}//end of type switch
-				
-				//store the variable data structure in the list of all variable data structures, to be used later when outputting
-				variableDataList[varID] = variableData;
-				
-			}//end of num var dimensions check
-		}//end of variable loop
-		
-		//output a newline after the variable names CSV header line
-		fprintf(csvFile, "\r\n");
-		
-		//output the variable standard names
-		for (i=0; i<numVars; i++)
+				printf("error: invalid %s value: %s\n", arg, valueText);
+				return -1;
+			}
+			if (strcmp(arg, "--start") == 0) options.rowStart = value;
+			else if (strcmp(arg, "--count") == 0) options.rowCount = value;
+			else options.rowStride = value;
+		}
+		else if (strcmp(arg, "--where") == 0 && argIndex+1 < argc)
 		{
-			fprintf(csvFile, "%s", standardNameList[i]);
-			if (i != (numVars-1)) fprintf(csvFile, ", ");
+			options.predicates = (RowPredicate *)realloc(options.predicates, (options.numPredicates+1) * sizeof(RowPredicate));
+			if (ParseRowPredicate(argv[++argIndex], &options.predicates[options.numPredicates]) != 0)
+			{
+				printf("error: invalid --where predicate: %s (expected something like time>=600)\n", argv[argIndex]);
+				return -1;
+			}
+			options.numPredicates++;
 		}
-		fprintf(csvFile, "\r\n");
-		
-		//output the variable long names
-		for (i=0; i<numVars; i++)
+		else if (strcmp(arg, "--append") == 0)
 		{
-			fprintf(csvFile, "%s", longNameList[i]);
-			if (i != (numVars-1)) fprintf(csvFile, ", ");
+			options.append = 1;
 		}
-		fprintf(csvFile, "\r\n");
-		
-		//output the variable units
-		for (i=0; i<numVars; i++)
-		{
-			char *unitsName = unitStringList[i];
-			if (unitsName[0] != '[')
-				fprintf(csvFile, "[");
-			
-			fprintf(csvFile, "%s", unitsName);
-			
-			if (unitsName[strlen(unitsName)-1] != ']')
-				fprintf(csvFile, "]");
-			
-			if (i != (numVars-1)) fprintf(csvFile, ", ");
-		}
-		fprintf(csvFile, "\r\n");
-		
-		
-		//output variable data to the CSV file
-		for (i=0; i<dimLength; i++)
+		else if (strcmp(arg, "--pipeline") == 0)
+		{
+			options.pipelined = 1;
+		}
+		else if (strcmp(arg, "--threads") == 0 && argIndex+1 < argc)
 		{
-			for (j=0; j<numVars; j++)
+			options.numThreads = atoi(argv[++argIndex]);
+			if (options.numThreads < 1)
 			{
-				VariableData *variableData = variableDataList[j];
-				//write data in the correct format for the variable's type
-				switch (variableData->type)
-				{
-					case NC_BYTE:
-					{
-						unsigned char *byteList = (unsigned char *)variableData->data;
-						fprintf(csvFile, "%u", byteList[i]);
-						break;
-					}
-					case NC_CHAR:
-					{
-						char *byteList = (char *)variableData->data;
-						fprintf(csvFile, "%c", byteList[i]);
-						break;
-					}
-					case NC_SHORT:
-					{
-						short *byteList = (short *)variableData->data;
-						fprintf(csvFile, "%d", byteList[i]);
-						break;
-					}
-					case NC_INT:
-					{
-						int *byteList = (int *)variableData->data;
-						fprintf(csvFile, "%d", byteList[i]);
-						break;
-					}
-					case NC_FLOAT:
-					{
-						float *byteList = (float *)variableData->data;
-						fprintf(csvFile, "%f", byteList[i]);
-						break;
-					}
-					case NC_DOUBLE:
-					{
-						double *byteList = (double *)variableData->data;
-						fprintf(csvFile, "%f", byteList[i]);
-						break;
-					}
-					default:
-						break;
-				}
-				
-				if (j != (numVars-1)) fprintf(csvFile, ", ");
+				puts("error: --threads must be at least 1");
+				return -1;
 			}
-			fprintf(csvFile, "\r\n");
 		}
-		
-		//free up heap memory
-		for (i=0; i<numVars; i++)
+		else if (strcmp(arg, "--cf-decode") == 0)
 		{
-			free(standardNameList[i]);
+			options.cfDecode = 1;
 		}
-		free(standardNameList);
-		for (i=0; i<numVars; i++)
+		else if (strcmp(arg, "--iso-time") == 0)
 		{
-			free(longNameList[i]);
+			options.isoTime = 1;
 		}
-		free(longNameList);
-		for (i=0; i<numVars; i++)
+		else if (strcmp(arg, "--bin-rows") == 0 && argIndex+1 < argc)
 		{
-			free(unitStringList[i]);
+			char *end;
+			char *valueText = argv[++argIndex];
+			options.binRows = (size_t)strtoull(valueText, &end, 10);
+			if (end == valueText || *end != '\0' || valueText[0] == '-' || options.binRows == 0)
+			{
+				printf("error: invalid --bin-rows value: %s\n", valueText);
+				return -1;
+			}
+		}
+		else if (strcmp(arg, "--bin") == 0 && argIndex+1 < argc)
+		{
+			//VAR:WIDTH, split at the last colon
+			char *spec = argv[++argIndex];
+			char *colon = strrchr(spec, ':');
+			char *end = NULL;
+			if (colon != NULL) options.binWidth = strtod(colon + 1, &end);
+			if (colon == NULL || colon == spec || end == colon + 1 || *end != '\0' || !(options.binWidth > 0) || isinf(options.binWidth))
+			{
+				printf("error: invalid --bin: %s (expected something like press:50)\n", spec);
+				return -1;
+			}
+			*colon = '\0';
+			options.binVariable = spec;
 		}
-		free(unitStringList);
-		for (i=0; i<numVars; i++)
+		else if (strcmp(arg, "--aggregate") == 0 && argIndex+1 < argc)
 		{
-			free(variableDataList[i]->data);
+			options.aggregateStatistics = ParseAggregateStatistics(argv[++argIndex]);
+			if (options.aggregateStatistics == 0)
+			{
+				printf("error: invalid --aggregate list: %s (expected some of count,mean,min,max,stddev)\n", argv[argIndex]);
+				return -1;
+			}
 		}
-		free(variableDataList);
-		free(csvFilename);
-		
-		//close the CSV file
-		fclose(csvFile);
-		
-		//close the NetCDF file
-		ncResult = nc_close(datasetID);
-		if (ncResult != NC_NOERR) HandleNCError("nc_close", ncResult);
-		
-		printf("\r\n");
-		
-	}//end of input file for loop
+		else if (strcmp(arg, "--readers") == 0 && argIndex+1 < argc)
+		{
+			options.numReaders = atoi(argv[++argIndex]);
+			if (options.numReaders < 1)
+			{
+				puts("error: --readers must be at least 1");
+				return -1;
+			}
+		}
+		else if (strcmp(arg, "-j") == 0 && argIndex+1 < argc)
+		{
+			numJobs = atoi(argv[++argIndex]);
+			if (numJobs < 1)
+			{
+				puts("error: -j must be at least 1");
+				return -1;
+			}
+		}
+		else if (strcmp(arg, "--files-from") == 0 && argIndex+1 < argc)
+		{
+			if (ReadFileManifest(&inputFiles, argv[++argIndex]) != 0) return -1;
+		}
+		else if (strcmp(arg, "--manifest") == 0 && argIndex+1 < argc)
+		{
+			manifestFilename = argv[++argIndex];
+		}
+		else if (strcmp(arg, "--force") == 0)
+		{
+			force = 1;
+		}
+		else if (strcmp(arg, "--watch") == 0 && argIndex+1 < argc)
+		{
+			watchOptions.directories = (char **)realloc(watchOptions.directories, (watchOptions.numDirectories+1) * sizeof(char*));
+			watchOptions.directories[watchOptions.numDirectories++] = argv[++argIndex];
+		}
+		else if (strcmp(arg, "--settle") == 0 && argIndex+1 < argc)
+		{
+			char *end;
+			watchOptions.settleMs = (int)strtol(argv[++argIndex], &end, 10);
+			if (*end != '\0' || watchOptions.settleMs < 0)
+			{
+				puts("error: --settle must be a number of milliseconds");
+				return -1;
+			}
+		}
+		else if (strcmp(arg, "--stats") == 0)
+		{
+			options.statsToStderr = 1;
+		}
+		else if (strcmp(arg, "--stats-dir") == 0 && argIndex+1 < argc)
+		{
+			options.statsDir = argv[++argIndex];
+		}
+		else if (strcmp(arg, "--help") == 0 || strcmp(arg, "-h") == 0)
+		{
+			PrintUsage();
+			return 0;
+		}
+		else if (strncmp(arg, "--", 2) == 0 || (arg[0] == '-' && arg[1] != '\0'))
+		{
+			printf("error: unknown option: %s\n", arg);
+			PrintUsage();
+			return -1;
+		}
+		else AddFileToList(&inputFiles, arg);
+	}
+	
+	//make sure a filename (or a directory to watch) was provided
+	if (inputFiles.count < 1 && watchOptions.numDirectories == 0)
+	{
+		puts("NetCDF filename argument required");
+		PrintUsage();
+		return -1;
+	}
+	
+	//an Arrow file is memory-mapped by its readers, which a compressed one can't be
+	if (options.gzip && options.outputFormat == OUTPUT_ARROW)
+	{
+		puts("error: --gzip only applies to --format csv");
+		return -1;
+	}
+	//appending needs a text file whose rows follow the records, from the first to the last
+	if (options.append && (options.outputFormat == OUTPUT_ARROW || options.rowStart > 0 || options.rowCount > 0 || options.rowStride > 1))
+	{
+		puts("error: --append can't be combined with --format arrow, --start, --count or --stride");
+		return -1;
+	}
+	//a bin can take rows from either side of where an --append run picks up, so bins are only written whole
+	int aggregating = (options.binRows > 0 || options.binVariable != NULL);
+	if (options.binRows > 0 && options.binVariable != NULL)
+	{
+		puts("error: only one of --bin-rows and --bin can be given");
+		return -1;
+	}
+	if (!aggregating && options.aggregateStatistics != AGGREGATE_ALL)
+	{
+		puts("error: --aggregate needs --bin-rows or --bin");
+		return -1;
+	}
+	if (aggregating && (options.outputFormat == OUTPUT_ARROW || options.append))
+	{
+		puts("error: --bin-rows and --bin can't be combined with --format arrow or --append");
+		return -1;
+	}
+	options.outputSignature = BuildOutputSignature(&options);
+	if (options.gzipThreads == 0) options.gzipThreads = GetDefaultGzipThreads(numJobs);
+	
+	//convert every input file, a failure only fails that one file
+	//(each file's stats come back to this process to be added up, from the worker processes too)
+	ConvertStats fileStats, batchStats;
+	InitConvertStats(&batchStats);
+	options.fileStats = &fileStats;
+	BatchRecord statsRecord = { &fileStats, sizeof(ConvertStats), CollectConvertStats, &batchStats };
+	double batchStart = GetMonotonicTime();
+	
+	//with --manifest, only the inputs whose outputs aren't current are converted (every one of them with --force)
+	char version[32];
+	snprintf(version, sizeof(version), "nc2csv %.3f", VERSION);
+	FileList *batchFiles = &inputFiles;
+	FileList outdatedFiles;
+	struct stat *outdatedInfo = NULL;
+	Manifest manifest;
+	InitManifest(&manifest);
+	InitFileList(&outdatedFiles);
+	if (manifestFilename != NULL)
+	{
+		if (LoadManifest(manifestFilename, &manifest) != 0)
+		{
+			printf("error: could not read manifest: %s\n", manifestFilename);
+			return -1;
+		}
+		int numCurrent = SelectOutdatedFiles(&manifest, &inputFiles, GetOutputFilename, &options, version, options.outputSignature,
+			force, &outdatedFiles, &outdatedInfo);
+		if (inputFiles.count > 0) printf("%d of %d files are up to date\n", numCurrent, inputFiles.count);
+		batchFiles = &outdatedFiles;
+	}
+	
+	int numFiles = batchFiles->count;
+	int *statuses = (int *)malloc((batchFiles->count + 1) * sizeof(int));
+	int numFailed = (batchFiles->count > 0) ? RunBatch(batchFiles, numJobs, ConvertFile, &options, &statsRecord, statuses) : 0;
+	if (manifestFilename != NULL)
+	{
+		RecordConvertedFiles(&manifest, batchFiles, outdatedInfo, statuses, GetOutputFilename, &options, version, options.outputSignature);
+		if (SaveManifest(manifestFilename, &manifest) != 0) printf("warning: could not write manifest: %s\n", manifestFilename);
+	}
+	free(statuses);
+	free(outdatedInfo);
+	FreeFileList(&outdatedFiles);
+	FreeManifest(&manifest);
+	
+	int watchFailed = 0;
+	if (watchOptions.numDirectories > 0)
+	{
+		//then the files that arrive, on workers that stay up until the watch is interrupted
+		watchOptions.numJobs = numJobs;
+		watchOptions.statsToStderr = options.statsToStderr;
+		watchOptions.statsDir = options.statsDir;
+		int numWatched;
+		watchFailed = WatchDirectories(&watchOptions, ConvertFile, &options, &statsRecord, &numWatched);
+		//(-1 if the directories couldn't be watched at all)
+		if (watchFailed >= 0)
+		{
+			numFiles += numWatched;
+			numFailed += watchFailed;
+		}
+	}
+	if (options.statsToStderr || options.statsDir != NULL)
+	{
+		//(files whose worker died never sent their stats)
+		batchStats.numFiles = numFiles;
+		batchStats.numFailed = numFailed;
+		ReportBatchStats(&batchStats, GetMonotonicTime() - batchStart, options.statsToStderr, options.statsDir);
+	}
 	
 	/*DIR *dp;
 	struct dirent *ep;
@@ -430,5 +1098,11 @@ int main (int argc, char** argv)
 	else
 	perror ("Couldn't open the directory");*/
 
-	return 0;
+	free(options.outputSignature);
+	free(options.varPatterns);
+	for (argIndex = 0; argIndex < options.numPredicates; argIndex++) FreeRowPredicate(&options.predicates[argIndex]);
+	free(options.predicates);
+	free(watchOptions.directories);
+	FreeFileList(&inputFiles);
+	return (numFailed == 0 && watchFailed >= 0) ? 0 : 1;
 }
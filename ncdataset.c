@@ -0,0 +1,1245 @@
+//ncdataset.c: the core shared by the converters (libnc2csv), an open NetCDF dataset, a plan of the rows and columns to
+//read from it, and an iterator handing the planned rows back a block at a time
+//Copyright 2012, Allen Jordan, allen.jordan@gmail.com
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <fnmatch.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include "ncdataset.h"
+#include "convertstats.h"
+
+int HandleNCError(const char *funcName, int status)
+{
+	printf("NetCDF error in: %s with status: %d (%s)\n", funcName, status, nc_strerror(status));
+	return status;
+}
+
+static void FreeVariableData(VariableData *variableData)
+{
+	if (variableData == NULL) return;
+	free(variableData->name);
+	free(variableData->standardName);
+	free(variableData->longName);
+	free(variableData->units);
+	free(variableData);
+}
+
+//read a text attribute of a variable into a new null terminated string, or an empty string if it doesn't have one
+//returns the NetCDF status of reading an attribute that exists
+int GetTextAttribute(int datasetID, int varID, const char *attName, char **value)
+{
+	size_t attLength = 0;
+	int ncResult = nc_inq_attlen(datasetID, varID, attName, &attLength);
+	if (ncResult != NC_NOERR) attLength = 0;
+	*value = (char *)malloc(attLength + 1);
+	(*value)[0] = '\0';
+	if (ncResult != NC_NOERR) return NC_NOERR;
+	
+	ncResult = nc_get_att_text(datasetID, varID, attName, *value);
+	//make sure the string is null terminated (sometimes it won't be, apparently)
+	(*value)[attLength] = '\0';
+	return ncResult;
+}
+
+//get the size in bytes of a single value of a supported NetCDF type, or 0 if the type isn't supported
+size_t GetTypeSize(nc_type type)
+{
+	switch (type)
+	{
+		case NC_BYTE: return sizeof(unsigned char);
+		case NC_CHAR: return sizeof(char);
+		case NC_SHORT: return sizeof(short);
+		case NC_INT: return sizeof(int);
+		case NC_FLOAT: return sizeof(float);
+		case NC_DOUBLE: return sizeof(double);
+		default: return 0;
+	}
+}
+
+//read the hyperslab of a mapped classic variable covering a window, as a view into the file when it is one and the
+//caller can use it (returns 1), or else copied into buffer (returns 0), either way with the values left big-endian
+//the range of file offsets [*first, *last) is widened to cover the hyperslab
+static int ReadMappedColumnSlab(const ClassicFile *file, const RowSpace *space, VariableData *variableData, const RowWindow *window,
+	int viewable, void *buffer, const void **view, size_t *viewStride, uint64_t *first, uint64_t *last)
+{
+	size_t start[MAX_ROW_DIMS], count[MAX_ROW_DIMS];
+	ptrdiff_t stride[MAX_ROW_DIMS];
+	size_t numValues = GetColumnSlab(space, &variableData->shape, window, start, count, stride);
+	variableData->bytesRead += numValues * variableData->elementSize;
+	uint64_t slabFirst, slabLast;
+	GetClassicSlabRange(file, variableData->varID, start, count, stride, &slabFirst, &slabLast);
+	if (slabFirst < slabLast && *first == *last)
+	{
+		*first = slabFirst;
+		*last = slabLast;
+	}
+	else if (slabFirst < slabLast)
+	{
+		if (slabFirst < *first) *first = slabFirst;
+		if (slabLast > *last) *last = slabLast;
+	}
+	if (viewable && GetClassicView(file, variableData->varID, start, count, stride, view, viewStride))
+	{
+		PrefetchClassicView(file, *view, numValues, *viewStride, variableData->elementSize);
+		return 1;
+	}
+	CopyClassicSlab(file, variableData->varID, start, count, stride, buffer);
+	return 0;
+}
+
+//read the hyperslab of a column covering a window of rows into a buffer
+//returns the NetCDF status of the read
+static int ReadColumnSlab(int datasetID, const RowSpace *space, VariableData *variableData, const RowWindow *window, void *buffer)
+{
+	size_t start[MAX_ROW_DIMS], count[MAX_ROW_DIMS];
+	ptrdiff_t stride[MAX_ROW_DIMS];
+	size_t numValues = GetColumnSlab(space, &variableData->shape, window, start, count, stride);
+	
+	//dimension index columns are made up rather than read
+	if (variableData->varID < 0)
+	{
+		size_t i;
+		int *indices = (int *)buffer;
+		for (i=0; i<numValues; i++) indices[i] = (int)(start[0] + i*stride[0]);
+		return NC_NOERR;
+	}
+	variableData->bytesRead += numValues * variableData->elementSize;
+	
+	//only take the slower strided path when it's needed
+	int i, strided = 0;
+	for (i=0; i<variableData->shape.numDims; i++)
+	{
+		if (stride[i] != 1) strided = 1;
+	}
+	
+	int ncResult;
+	switch (variableData->type)
+	{
+		case NC_BYTE:
+			//the raw bytes, printed as unsigned (reading them as uchar would fail on negative bytes in NetCDF-4 files)
+			if (strided) ncResult = nc_get_vars(datasetID, variableData->varID, start, count, stride, buffer);
+			else ncResult = nc_get_vara(datasetID, variableData->varID, start, count, buffer);
+			break;
+		case NC_CHAR:
+			if (strided) ncResult = nc_get_vars_text(datasetID, variableData->varID, start, count, stride, (char*)buffer);
+			else ncResult = nc_get_vara_text(datasetID, variableData->varID, start, count, (char*)buffer);
+			break;
+		case NC_SHORT:
+			if (strided) ncResult = nc_get_vars_short(datasetID, variableData->varID, start, count, stride, (short*)buffer);
+			else ncResult = nc_get_vara_short(datasetID, variableData->varID, start, count, (short*)buffer);
+			break;
+		case NC_INT:
+			if (strided) ncResult = nc_get_vars_int(datasetID, variableData->varID, start, count, stride, (int*)buffer);
+			else ncResult = nc_get_vara_int(datasetID, variableData->varID, start, count, (int*)buffer);
+			break;
+		case NC_FLOAT:
+			if (strided) ncResult = nc_get_vars_float(datasetID, variableData->varID, start, count, stride, (float*)buffer);
+			else ncResult = nc_get_vara_float(datasetID, variableData->varID, start, count, (float*)buffer);
+			break;
+		case NC_DOUBLE:
+			if (strided) ncResult = nc_get_vars_double(datasetID, variableData->varID, start, count, stride, (double*)buffer);
+			else ncResult = nc_get_vara_double(datasetID, variableData->varID, start, count, (double*)buffer);
+			break;
+		default:
+			ncResult = NC_EBADTYPE;
+			break;
+	}
+	return ncResult;
+}
+
+//look up how a NetCDF-4 variable is split into chunks, returns 1 if it's chunked
+static int GetVariableChunking(int datasetID, VariableData *variableData)
+{
+	int storage;
+	variableData->chunked = 0;
+	if (variableData->varID < 0 || variableData->shape.numDims == 0) return 0;
+	if (nc_inq_var_chunking(datasetID, variableData->varID, &storage, variableData->chunkSizes) != NC_NOERR) return 0;
+	variableData->chunked = (storage == NC_CHUNKED);
+	return variableData->chunked;
+}
+
+static size_t RoundUpToMultiple(size_t value, size_t multiple)
+{
+	return ((value + multiple - 1) / multiple) * multiple;
+}
+
+//count the chunks of a variable touched by every window of a plan
+//this is the number of chunk decompressions when nothing stays cached from one window to the next
+static size_t CountWindowChunks(const RowSpace *space, const VariableData *variableData)
+{
+	size_t total = 0, windowIndex;
+	int i;
+	for (windowIndex=0; windowIndex<space->numWindows; windowIndex++)
+	{
+		RowWindow window;
+		size_t start[MAX_ROW_DIMS], count[MAX_ROW_DIMS];
+		ptrdiff_t stride[MAX_ROW_DIMS];
+		GetRowWindow(space, windowIndex, &window);
+		GetColumnSlab(space, &variableData->shape, &window, start, count, stride);
+		size_t numChunks = 1;
+		for (i=0; i<variableData->shape.numDims; i++)
+		{
+			//(an upper bound with a stride longer than the chunks)
+			size_t chunk = variableData->chunkSizes[i];
+			numChunks *= (start[i] + (count[i] - 1) * stride[i]) / chunk - start[i] / chunk + 1;
+		}
+		total += numChunks;
+	}
+	return total;
+}
+
+//count every chunk of a variable, the number of chunk decompressions when each is only decompressed once
+static size_t CountVariableChunks(const RowSpace *space, const VariableData *variableData)
+{
+	size_t numChunks = 1;
+	int i;
+	for (i=0; i<variableData->shape.numDims; i++)
+	{
+		int rowDim = variableData->shape.rowDims[i];
+		if (space->dimLengths[rowDim] == 0) return 0;
+		size_t first = space->dimStarts[rowDim];
+		size_t last = first + (space->dimLengths[rowDim] - 1) * space->dimStrides[rowDim];
+		numChunks *= last / variableData->chunkSizes[i] - first / variableData->chunkSizes[i] + 1;
+	}
+	return numChunks;
+}
+
+//bytes of chunks a variable needs to keep cached so that each of its chunks is only decompressed once
+//windows take one index at a time along the dimensions before the split one, so a chunk that is longer along one of
+//those is revisited until the windows have stepped through it, and all the chunks across the rest of the row space
+//have to stay cached in the meantime
+static size_t GetChunkWorkingSet(const RowSpace *space, const VariableData *variableData)
+{
+	int i;
+	int revisited = 0;
+	for (i=0; i<variableData->shape.numDims; i++)
+	{
+		if (variableData->shape.rowDims[i] < space->splitDim && variableData->chunkSizes[i] > 1) revisited = 1;
+	}
+	
+	size_t bytes = variableData->elementSize;
+	for (i=0; i<variableData->shape.numDims; i++)
+	{
+		int rowDim = variableData->shape.rowDims[i];
+		size_t chunk = variableData->chunkSizes[i];
+		size_t stride = (size_t)space->dimStrides[rowDim];
+		//(extents are in file indices, so they take in any stride)
+		size_t first = space->dimStarts[rowDim];
+		size_t last = first + ((space->dimLengths[rowDim] > 0) ? space->dimLengths[rowDim] - 1 : 0) * stride;
+		size_t fullExtent = (last / chunk - first / chunk + 1) * chunk;
+		size_t extent = fullExtent;
+		if (rowDim < space->splitDim) extent = chunk;
+		else if (rowDim == space->splitDim && !revisited)
+		{
+			//a window that doesn't line up with the chunks can straddle one more
+			extent = RoundUpToMultiple(space->splitCount * stride, chunk);
+			if ((space->splitCount * stride) % chunk != 0 || space->dimStarts[rowDim] % chunk != 0) extent += chunk;
+		}
+		if (extent > fullExtent) extent = fullExtent;
+		bytes *= extent;
+	}
+	return bytes;
+}
+
+//size the chunk cache of every chunked column to hold its working set (as long as they all fit in cacheLimit bytes)
+//and print (when verbose) how many chunk decompressions that and the chunk-aligned windows should save
+static void TuneChunkCaches(int datasetID, const RowSpace *space, VariableData **columnList, int numColumns,
+	size_t targetRows, size_t cacheLimit, int verbose)
+{
+	int i, j;
+	//the windows that would have been read without lining them up with chunks, for comparison
+	RowSpace unaligned = *space;
+	PlanRowWindows(&unaligned, targetRows, NULL);
+	
+	size_t cacheBytes = 0, decompressions = 0, unalignedDecompressions = 0;
+	int numChunked = 0, numTuned = 0;
+	for (i=0; i<numColumns; i++)
+	{
+		VariableData *variableData = columnList[i];
+		if (!variableData->chunked) continue;
+		numChunked++;
+		unalignedDecompressions += CountWindowChunks(&unaligned, variableData);
+		
+		size_t chunkBytes = variableData->elementSize;
+		for (j=0; j<variableData->shape.numDims; j++) chunkBytes *= variableData->chunkSizes[j];
+		size_t workingSet = GetChunkWorkingSet(space, variableData);
+		//the chunk hash table wants a good few more slots than chunks
+		size_t numSlots = (workingSet / chunkBytes) * 4 + 1;
+		if (numSlots < 1009) numSlots = 1009;
+		if (cacheBytes + workingSet <= cacheLimit
+			&& nc_set_var_chunk_cache(datasetID, variableData->varID, workingSet, numSlots, 0.75f) == NC_NOERR)
+		{
+			cacheBytes += workingSet;
+			numTuned++;
+			decompressions += CountVariableChunks(space, variableData);
+		}
+		else decompressions += CountWindowChunks(space, variableData);
+	}
+	
+	if (!verbose) return;
+	printf("chunked variables: %d, chunk caches sized for %d of them (%zu bytes)\n", numChunked, numTuned, cacheBytes);
+	printf("chunk decompressions: about %zu, instead of %zu with unaligned windows and nothing cached between them (%zu avoided)\n",
+		decompressions, unalignedDecompressions, (unalignedDecompressions > decompressions) ? unalignedDecompressions - decompressions : 0);
+}
+
+//pick the variables to output from their names alone, before any data is read, setting selected[varID] for each
+//in a file with several dimensions, the coordinate variables of the selected variables' dimensions come along too
+//returns the NetCDF status of looking the variables up
+static int SelectVariables(int datasetID, int numVars, int numDims, const PlanOptions *options, int *selected)
+{
+	int varID, i;
+	int ncResult = NC_NOERR;
+	if (options->numVarPatterns == 0)
+	{
+		for (varID=0; varID<numVars; varID++) selected[varID] = 1;
+		return NC_NOERR;
+	}
+	
+	int *dimUsed = (int *)calloc(numDims > 0 ? numDims : 1, sizeof(int));
+	int *patternUsed = (int *)calloc(options->numVarPatterns, sizeof(int));
+	for (varID=0; varID<numVars && ncResult == NC_NOERR; varID++)
+	{
+		char varName[NC_MAX_NAME+1];
+		int numVarDims;
+		int varDimIDs[NC_MAX_VAR_DIMS];
+		ncResult = nc_inq_var(datasetID, varID, varName, NULL, &numVarDims, varDimIDs, NULL);
+		if (ncResult != NC_NOERR) break;
+		
+		selected[varID] = 0;
+		for (i=0; i<options->numVarPatterns; i++)
+		{
+			if (fnmatch(options->varPatterns[i], varName, 0) != 0) continue;
+			selected[varID] = 1;
+			patternUsed[i] = 1;
+		}
+		if (!selected[varID]) continue;
+		for (i=0; i<numVarDims; i++)
+		{
+			if (varDimIDs[i] >= 0 && varDimIDs[i] < numDims) dimUsed[varDimIDs[i]] = 1;
+		}
+	}
+	
+	int numUsedDims = 0;
+	for (i=0; i<numDims; i++) numUsedDims += dimUsed[i];
+	for (i=0; i<numDims && numUsedDims > 1 && ncResult == NC_NOERR; i++)
+	{
+		if (!dimUsed[i]) continue;
+		char dimName[NC_MAX_NAME+1];
+		ncResult = nc_inq_dimname(datasetID, i, dimName);
+		if (ncResult == NC_NOERR && nc_inq_varid(datasetID, dimName, &varID) == NC_NOERR) selected[varID] = 1;
+	}
+	
+	for (i=0; i<options->numVarPatterns; i++)
+	{
+		if (!patternUsed[i]) printf("warning: %s doesn't match any variable\n", options->varPatterns[i]);
+	}
+	free(patternUsed);
+	free(dimUsed);
+	return ncResult;
+}
+
+int OpenNcDataset(const char *filename, int mapClassic, NcDataset **dataset)
+{
+	int datasetID;
+	int ncResult = nc_open(filename, NC_NOWRITE, &datasetID);
+	if (ncResult != NC_NOERR) return HandleNCError("nc_open", ncResult);
+	
+	NcDataset *opened = (NcDataset *)calloc(1, sizeof(NcDataset));
+	opened->datasetID = datasetID;
+	opened->filename = strdup(filename);
+	ncResult = nc_inq(datasetID, &opened->numDims, &opened->numVars, &opened->numGlobalAtts, &opened->unlimitedDimID);
+	if (ncResult != NC_NOERR)
+	{
+		HandleNCError("nc_inq", ncResult);
+		CloseNcDataset(opened);
+		return ncResult;
+	}
+	ncResult = nc_inq_format(datasetID, &opened->formatVersion);
+	if (ncResult != NC_NOERR)
+	{
+		HandleNCError("nc_inq_format", ncResult);
+		CloseNcDataset(opened);
+		return ncResult;
+	}
+	switch (opened->formatVersion)
+	{
+		case NC_FORMAT_CLASSIC:
+		case NC_FORMAT_64BIT:
+		case NC_FORMAT_NETCDF4:
+		case NC_FORMAT_NETCDF4_CLASSIC:
+			break;
+		default:
+			puts("unrecognized file format");
+			CloseNcDataset(opened);
+			return -1;
+	}
+	
+	//classic and 64-bit offset files have a simple fixed layout, so their variables can be read straight out of a
+	//memory map instead
+	if (mapClassic && (opened->formatVersion == NC_FORMAT_CLASSIC || opened->formatVersion == NC_FORMAT_64BIT))
+	{
+		opened->classicFile = OpenClassicFile(filename);
+		//make sure the header was read the same way libnetcdf read it
+		if (opened->classicFile != NULL && opened->classicFile->numVars != opened->numVars)
+		{
+			CloseClassicFile(opened->classicFile);
+			opened->classicFile = NULL;
+		}
+		if (opened->classicFile == NULL) puts("warning: couldn't map the classic file, reading it through libnetcdf");
+	}
+	
+	*dataset = opened;
+	return 0;
+}
+
+int CloseNcDataset(NcDataset *dataset)
+{
+	if (dataset == NULL) return NC_NOERR;
+	CloseClassicFile(dataset->classicFile);
+	int ncResult = nc_close(dataset->datasetID);
+	free(dataset->filename);
+	free(dataset);
+	return ncResult;
+}
+
+int PrintDatasetInfo(const NcDataset *dataset)
+{
+	printf("# dims: %d\n# vars: %d\n# global atts: %d\n", dataset->numDims, dataset->numVars, dataset->numGlobalAtts);
+	if (dataset->unlimitedDimID != -1) puts("contains unlimited dimension");
+	switch (dataset->formatVersion)
+	{
+		case NC_FORMAT_CLASSIC:
+			puts("classic file format");
+			break;
+		case NC_FORMAT_64BIT:
+			puts("64-bit file format");
+			break;
+		case NC_FORMAT_NETCDF4:
+			puts("netcdf4 file format");
+			break;
+		default:
+			puts("netcdf4 classic format");
+			break;
+	}
+	
+	//get dimension names and lengths
+	int dimID;
+	for (dimID = 0; dimID < dataset->numDims; dimID++)
+	{
+		char dimName[NC_MAX_NAME+1];
+		size_t dimLength;
+		int ncResult = nc_inq_dim(dataset->datasetID, dimID, dimName, &dimLength);
+		if (ncResult != NC_NOERR) return HandleNCError("nc_inq_dim", ncResult);
+		printf("dimension: %s length: %zu\n", dimName, dimLength);
+	}
+	return NC_NOERR;
+}
+
+void InitPlanOptions(PlanOptions *options)
+{
+	options->varPatterns = NULL;
+	options->numVarPatterns = 0;
+	options->rowStart = 0;
+	options->rowCount = 0;
+	options->rowStride = 1;
+	options->predicates = NULL;
+	options->numPredicates = 0;
+	options->windowRows = 0;
+	options->maxMemory = 0;
+	options->numSlots = 1;
+	options->readAsDouble = 0;
+	options->cfDecode = 0;
+	options->decodeTimes = 0;
+	options->numReaders = 0;
+	options->verbose = 0;
+}
+
+//allocate a data buffer, counting it in the plan's allocations
+static void *AllocatePlanBuffer(ReadPlan *plan, size_t bytes)
+{
+	plan->numAllocations++;
+	plan->allocatedBytes += bytes;
+	return malloc(bytes);
+}
+
+//apply the CF decoding and time conversion of a column to count rows of it
+static void DecodeColumnRows(const VariableData *variableData, void *rows, size_t count)
+{
+	if (variableData->cf.active) DecodeCfColumn(rows, variableData->type, count, &variableData->cf);
+	if (variableData->timestamp) ConvertTimesToEpoch((double *)rows, count, &variableData->timeUnits);
+}
+
+//a window handed to a reader process
+typedef struct
+{
+	uint64_t windowIndex;
+	int32_t slot;
+} ReaderRequest;
+
+//read exactly size bytes from a socket, returns 0 on success or -1 at the end of the stream or on an error
+static int ReceiveFully(int socket, void *buffer, size_t size)
+{
+	char *bytes = (char *)buffer;
+	while (size > 0)
+	{
+		ssize_t numRead = recv(socket, bytes, size, 0);
+		if (numRead <= 0) return -1;
+		bytes += numRead;
+		size -= numRead;
+	}
+	return 0;
+}
+
+//pick the process that reads each column, the columns read through libnetcdf go to whichever of the processes has
+//the fewest bytes per row so far (this one being process 0), returns the number of other processes given any
+static int AssignPlanReaders(ReadPlan *plan, int numProcesses)
+{
+	int i, j;
+	plan->columnReaders = (int *)calloc(plan->numColumns, sizeof(int));
+	int numReadColumns = 0;
+	for (i=0; i<plan->numColumns; i++) numReadColumns += (plan->columns[i]->varID >= 0 && !plan->columns[i]->mapped);
+	if (numProcesses > numReadColumns) numProcesses = numReadColumns;
+	if (numProcesses < 2) return 0;
+	
+	size_t *rowBytes = (size_t *)calloc(numProcesses, sizeof(size_t));
+	for (i=0; i<plan->numColumns; i++)
+	{
+		if (plan->columns[i]->varID < 0 || plan->columns[i]->mapped) continue;
+		int least = 0;
+		for (j=1; j<numProcesses; j++)
+		{
+			if (rowBytes[j] < rowBytes[least]) least = j;
+		}
+		plan->columnReaders[i] = least;
+		rowBytes[least] += plan->columns[i]->elementSize;
+	}
+	free(rowBytes);
+	return numProcesses - 1;
+}
+
+//the loop of a reader process, reading its columns of each window it's sent into the shared buffers through its own
+//handle on the file and answering with the NetCDF status, until the plan's process closes its socket
+static void RunPlanReader(ReadPlan *plan, int reader, int socket, size_t cacheLimit)
+{
+	int j;
+	int datasetID;
+	int32_t status = nc_open(plan->dataset->filename, NC_NOWRITE, &datasetID);
+	if (status == NC_NOERR && cacheLimit > 0)
+		TuneChunkCaches(datasetID, &plan->rowSpace, plan->columns, plan->numColumns, plan->windowRows, cacheLimit, 0);
+	
+	ReaderRequest request;
+	while (ReceiveFully(socket, &request, sizeof(request)) == 0)
+	{
+		RowWindow window;
+		GetRowWindow(&plan->rowSpace, request.windowIndex, &window);
+		for (j=0; j<plan->numColumns && status == NC_NOERR; j++)
+		{
+			if (plan->columnReaders[j] != reader) continue;
+			VariableData *variableData = plan->columns[j];
+			void *rows = plan->columnData[request.slot*plan->numColumns + j];
+			//(the slab buffer is this process's own copy)
+			void *slab = variableData->inRowOrder ? rows : plan->slabBuffer;
+			uint64_t bytesBefore = variableData->bytesRead;
+			double readStart = GetMonotonicTime();
+			status = ReadColumnSlab(datasetID, &plan->rowSpace, variableData, &window, slab);
+			plan->readerStats[j].readSeconds = GetMonotonicTime() - readStart;
+			plan->readerStats[j].bytesRead = variableData->bytesRead - bytesBefore;
+			if (status == NC_NOERR && !variableData->inRowOrder) ExpandColumnToRows(&plan->rowSpace, &variableData->shape, &window, slab, variableData->elementSize, rows);
+			if (status == NC_NOERR) DecodeColumnRows(variableData, rows, window.numRows);
+		}
+		if (send(socket, &status, sizeof(status), MSG_NOSIGNAL) != sizeof(status)) break;
+	}
+	nc_close(datasetID);
+}
+
+//fork the reader processes, each of them opening the file again (libnetcdf isn't thread-safe, and serializes
+//everything done with a single handle), returns 0 on success or -1 if they couldn't all be started
+static int StartPlanReaders(ReadPlan *plan, int numReaders, size_t cacheLimit)
+{
+	int i, j;
+	plan->readerPids = (pid_t *)malloc(numReaders * sizeof(pid_t));
+	plan->readerSockets = (int *)malloc(numReaders * sizeof(int));
+	//(anything still buffered would be written again by every reader)
+	fflush(stdout);
+	for (i=0; i<numReaders; i++)
+	{
+		int sockets[2];
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) != 0)
+		{
+			perror("socketpair");
+			return -1;
+		}
+		pid_t pid = fork();
+		if (pid < 0)
+		{
+			perror("fork");
+			close(sockets[0]);
+			close(sockets[1]);
+			return -1;
+		}
+		if (pid == 0)
+		{
+			close(sockets[0]);
+			for (j=0; j<i; j++) close(plan->readerSockets[j]);
+			RunPlanReader(plan, i + 1, sockets[1], cacheLimit);
+			_exit(0);
+		}
+		close(sockets[1]);
+		plan->readerPids[i] = pid;
+		plan->readerSockets[i] = sockets[0];
+		plan->numReaders++;
+	}
+	return 0;
+}
+
+//send a window to every reader process, returns 0 on success or -1 if one of them has gone
+static int SendReaderRequests(ReadPlan *plan, int slot, size_t windowIndex)
+{
+	int i;
+	ReaderRequest request;
+	memset(&request, 0, sizeof(request));
+	request.windowIndex = windowIndex;
+	request.slot = slot;
+	for (i=0; i<plan->numReaders; i++)
+	{
+		if (send(plan->readerSockets[i], &request, sizeof(request), MSG_NOSIGNAL) != sizeof(request))
+		{
+			puts("error: a reader process exited");
+			return -1;
+		}
+	}
+	return 0;
+}
+
+//wait for every reader process to finish its columns of a window, then drop the rows that failed the predicates from
+//them and count their reads, returns 0 or a nonzero error status
+static int CollectReaderWindow(ReadPlan *plan, int slot, size_t numRows, size_t numSelected)
+{
+	int i, j;
+	int status = 0;
+	for (i=0; i<plan->numReaders; i++)
+	{
+		int32_t readerStatus;
+		if (ReceiveFully(plan->readerSockets[i], &readerStatus, sizeof(readerStatus)) != 0)
+		{
+			if (status == 0)
+			{
+				puts("error: a reader process exited");
+				status = -1;
+			}
+		}
+		else if (readerStatus != NC_NOERR && status == 0) status = HandleNCError("nc_get_vara", readerStatus);
+	}
+	if (status != 0) return status;
+	
+	for (j=0; j<plan->numColumns; j++)
+	{
+		if (plan->columnReaders[j] == 0) continue;
+		VariableData *variableData = plan->columns[j];
+		int column = slot*plan->numColumns + j;
+		plan->columnViews[column] = plan->columnData[column];
+		plan->columnStrides[column] = variableData->elementSize;
+		variableData->readSeconds += plan->readerStats[j].readSeconds;
+		variableData->bytesRead += plan->readerStats[j].bytesRead;
+		if (numSelected < numRows) CompactRows(plan->columnData[column], variableData->elementSize, plan->selectedRows, numSelected);
+	}
+	return 0;
+}
+
+int CreateReadPlan(NcDataset *dataset, const PlanOptions *options, ReadPlan **planOut)
+{
+	int i, j;
+	int status = 0;
+	int ncResult;
+	int datasetID = dataset->datasetID;
+	int numVars = dataset->numVars;
+	int numDims = dataset->numDims;
+	int *selectedVars = NULL;
+	int (*varDimIDLists)[MAX_ROW_DIMS] = NULL;
+	int *isDimensionColumn = NULL;
+	char *launchTime = NULL;
+	
+	//the plan starts out zeroed so a partially planned one can still be freed
+	ReadPlan *plan = (ReadPlan *)calloc(1, sizeof(ReadPlan));
+	plan->dataset = dataset;
+	plan->numVars = numVars;
+	InitRowSpace(&plan->rowSpace);
+	RowSpace *rowSpace = &plan->rowSpace;
+	
+	//apply the projection up front, unselected variables are never read (not even their attributes)
+	selectedVars = (int *)calloc(numVars > 0 ? numVars : 1, sizeof(int));
+	ncResult = SelectVariables(datasetID, numVars, numDims, options, selectedVars);
+	if (ncResult != NC_NOERR)
+	{
+		status = HandleNCError("nc_inq_var", ncResult);
+		goto cleanup;
+	}
+	if (options->numVarPatterns > 0 && options->verbose)
+	{
+		int numSelected = 0;
+		for (i=0; i<numVars; i++) numSelected += selectedVars[i];
+		printf("selected %d of %d variables\n", numSelected, numVars);
+	}
+	
+	//GRUAN files count their time coordinate in plain seconds from the launch
+	if (options->decodeTimes)
+	{
+		ncResult = GetTextAttribute(datasetID, NC_GLOBAL, "g.Ascent.StartTime", &launchTime);
+		if (ncResult != NC_NOERR)
+		{
+			status = HandleNCError("nc_get_att_text", ncResult);
+			goto cleanup;
+		}
+	}
+	else launchTime = strdup("");
+	
+	//storage for the selected variables, they're read in windows of rows with nc_get_vara_, so only one window of
+	//each is held in memory
+	plan->variableDataList = (VariableData **)calloc(numVars > 0 ? numVars : 1, sizeof(VariableData*));
+	//dimension IDs of every variable, until they're turned into row dimensions
+	varDimIDLists = calloc(numVars > 0 ? numVars : 1, sizeof(int[MAX_ROW_DIMS]));
+	int maxVarDims = 0;
+	
+	//loop through all the variables
+	int varID;
+	for (varID=0; varID<numVars; varID++)
+	{
+		if (!selectedVars[varID]) continue;
+		
+		//get information about the variable
+		char varName[NC_MAX_NAME+1];
+		nc_type varType;
+		int numVarDims;
+		int varDimIDs[NC_MAX_VAR_DIMS];
+		int numVarAtts;
+		ncResult = nc_inq_var(datasetID, varID, varName, &varType, &numVarDims, varDimIDs, &numVarAtts);
+		if (ncResult != NC_NOERR)
+		{
+			status = HandleNCError("nc_inq_var", ncResult);
+			goto cleanup;
+		}
+		
+		//output variable info to console
+		if (options->verbose) printf("variable: %s # dims: %d # atts: %d type: %d\n", varName, numVarDims, numVarAtts, (int)varType);
+		
+		//make sure the variable can be flattened into rows
+		int repeatedDim = 0;
+		for (i=0; i<numVarDims; i++)
+		{
+			for (j=0; j<i; j++)
+			{
+				if (varDimIDs[j] == varDimIDs[i]) repeatedDim = 1;
+			}
+		}
+		if (GetTypeSize(varType) == 0) puts("warning: invalid variable type... skipping");
+		else if (varType == NC_CHAR && numVarDims > 1) puts("warning: character array variables aren't supported yet... skipping");
+		else if (numVarDims > MAX_ROW_DIMS) puts("warning: too many dimensions... skipping");
+		else if (repeatedDim) puts("warning: variables using a dimension more than once aren't supported... skipping");
+		else
+		{
+			//storage for this variable's data structure, the window buffers are allocated once the window size is known
+			VariableData *variableData = (VariableData *)calloc(1, sizeof(VariableData));
+			variableData->varID = varID;
+			variableData->type = varType;
+			if (options->readAsDouble && varType != NC_FLOAT && varType != NC_CHAR && varType != NC_DOUBLE)
+			{
+				variableData->type = NC_DOUBLE;
+				variableData->converted = 1;
+			}
+			//(doubles are left as they are, but still read through libnetcdf so they come out in native byte order)
+			if (options->readAsDouble && varType == NC_DOUBLE) variableData->converted = 1;
+			variableData->elementSize = GetTypeSize(variableData->type);
+			variableData->shape.numDims = numVarDims;
+			variableData->name = strdup(varName);
+			memcpy(varDimIDLists[varID], varDimIDs, numVarDims * sizeof(int));
+			if (numVarDims > maxVarDims) maxVarDims = numVarDims;
+			
+			//store the variable data structure in the list of all variable data structures
+			plan->variableDataList[varID] = variableData;
+			
+			//see if there are attributes for the variable standard name, long name and units description
+			ncResult = GetTextAttribute(datasetID, varID, "standard_name", &variableData->standardName);
+			if (ncResult == NC_NOERR) ncResult = GetTextAttribute(datasetID, varID, "long_name", &variableData->longName);
+			if (ncResult == NC_NOERR) ncResult = GetTextAttribute(datasetID, varID, "units", &variableData->units);
+			if (ncResult != NC_NOERR)
+			{
+				status = HandleNCError("nc_get_att_text", ncResult);
+				goto cleanup;
+			}
+			
+			//packed and masked variables are read as the type they're decoded to (libnetcdf converts them)
+			if (options->cfDecode)
+			{
+				ncResult = GetCfDecoding(datasetID, varID, varType, &variableData->cf);
+				if (ncResult != NC_NOERR)
+				{
+					status = HandleNCError("nc_get_att_double", ncResult);
+					goto cleanup;
+				}
+				if (variableData->cf.active)
+				{
+					variableData->type = variableData->cf.decodedType;
+					variableData->elementSize = GetTypeSize(variableData->type);
+					variableData->converted = 1;
+				}
+			}
+			
+			//time coordinates are read as doubles, and decoded after any unpacking (only in the Gregorian calendar)
+			const char *defaultEpoch = (strcmp(variableData->standardName, "time") == 0 && launchTime[0] != '\0') ? launchTime : NULL;
+			if (options->decodeTimes && varType != NC_CHAR && ParseTimeUnits(variableData->units, defaultEpoch, &variableData->timeUnits) == 0)
+			{
+				char *calendar;
+				ncResult = GetTextAttribute(datasetID, varID, "calendar", &calendar);
+				if (ncResult != NC_NOERR)
+				{
+					status = HandleNCError("nc_get_att_text", ncResult);
+					goto cleanup;
+				}
+				if (IsGregorianCalendar(calendar))
+				{
+					variableData->timestamp = 1;
+					variableData->type = NC_DOUBLE;
+					variableData->elementSize = sizeof(double);
+					variableData->converted = 1;
+				}
+				else printf("warning: %s uses the %s calendar, its times are left as they are\n", varName, calendar);
+				free(calendar);
+			}
+		}//end of variable support check
+	}//end of variable loop
+	
+	//lay out the row dimensions, taking them from the variables with the most dimensions first so the biggest
+	//variables are read in their own storage order
+	int rank;
+	for (rank=maxVarDims; rank>0; rank--)
+	{
+		for (varID=0; varID<numVars; varID++)
+		{
+			VariableData *variableData = plan->variableDataList[varID];
+			if (variableData == NULL || variableData->shape.numDims != rank) continue;
+			for (i=0; i<rank; i++)
+			{
+				size_t dimLength;
+				ncResult = nc_inq_dimlen(datasetID, varDimIDLists[varID][i], &dimLength);
+				if (ncResult != NC_NOERR)
+				{
+					status = HandleNCError("nc_inq_dimlen", ncResult);
+					goto cleanup;
+				}
+				variableData->shape.rowDims[i] = AddRowDimension(rowSpace, varDimIDLists[varID][i], dimLength);
+				if (variableData->shape.rowDims[i] < 0)
+				{
+					printf("error: too many row dimensions, the variables use more than %d dimensions between them\n", MAX_ROW_DIMS);
+					status = -1;
+					goto cleanup;
+				}
+			}
+		}
+	}
+	
+	//columns: with a single row dimension every variable (including its coordinate variable) is a column as is,
+	//with several there's a column for each dimension first, holding its coordinate variable or just its indices
+	plan->columns = (VariableData **)malloc((numVars + rowSpace->numDims + 1) * sizeof(VariableData*));
+	isDimensionColumn = (int *)calloc(numVars > 0 ? numVars : 1, sizeof(int));
+	if (rowSpace->numDims > 1)
+	{
+		for (i=0; i<rowSpace->numDims; i++)
+		{
+			char dimName[NC_MAX_NAME+1];
+			ncResult = nc_inq_dimname(datasetID, rowSpace->dimIDs[i], dimName);
+			if (ncResult != NC_NOERR)
+			{
+				status = HandleNCError("nc_inq_dimname", ncResult);
+				goto cleanup;
+			}
+			
+			//a coordinate variable is a 1-dimensional variable with the same name as its dimension
+			VariableData *coordinate = NULL;
+			int coordinateID;
+			if (nc_inq_varid(datasetID, dimName, &coordinateID) == NC_NOERR && plan->variableDataList[coordinateID] != NULL
+				&& plan->variableDataList[coordinateID]->shape.numDims == 1 && plan->variableDataList[coordinateID]->shape.rowDims[0] == i)
+			{
+				coordinate = plan->variableDataList[coordinateID];
+				isDimensionColumn[coordinateID] = 1;
+			}
+			else
+			{
+				coordinate = (VariableData *)calloc(1, sizeof(VariableData));
+				coordinate->varID = -1;
+				coordinate->type = NC_INT;
+				coordinate->elementSize = sizeof(int);
+				coordinate->shape.numDims = 1;
+				coordinate->shape.rowDims[0] = i;
+				coordinate->name = strdup(dimName);
+				coordinate->standardName = strdup("");
+				coordinate->longName = strdup("");
+				coordinate->units = strdup("");
+				plan->dimensionColumns[i] = coordinate;
+			}
+			plan->columns[plan->numColumns++] = coordinate;
+		}
+	}
+	for (varID=0; varID<numVars; varID++)
+	{
+		if (plan->variableDataList[varID] != NULL && !isDimensionColumn[varID]) plan->columns[plan->numColumns++] = plan->variableDataList[varID];
+	}
+	int numColumns = plan->numColumns;
+	VariableData **columnList = plan->columns;
+	if (numColumns == 0)
+	{
+		puts("error: no variables to output");
+		status = -1;
+		goto cleanup;
+	}
+	
+	//start/count/stride pick out part of the first row dimension (the only one in a 1-dimensional file),
+	//and are pushed down into the reads as the start and stride of every hyperslab
+	if (rowSpace->numDims > 0 && (options->rowStart > 0 || options->rowCount > 0 || options->rowStride > 1))
+		RestrictRowDimension(rowSpace, 0, options->rowStart, options->rowCount, options->rowStride);
+	
+	//look up the variables tested by the predicates, they're read along with the columns but not output
+	plan->predicates = options->predicates;
+	plan->predicateColumns = (VariableData **)calloc(options->numPredicates > 0 ? options->numPredicates : 1, sizeof(VariableData*));
+	for (i=0; i<options->numPredicates; i++)
+	{
+		int predicateVarID, numPredicateDims;
+		nc_type predicateType;
+		int predicateDimIDs[NC_MAX_VAR_DIMS];
+		ncResult = nc_inq_varid(datasetID, options->predicates[i].varName, &predicateVarID);
+		if (ncResult == NC_NOERR) ncResult = nc_inq_var(datasetID, predicateVarID, NULL, &predicateType, &numPredicateDims, predicateDimIDs, NULL);
+		if (ncResult != NC_NOERR)
+		{
+			printf("error: --where variable not found: %s\n", options->predicates[i].varName);
+			status = HandleNCError("nc_inq_varid", ncResult);
+			goto cleanup;
+		}
+		
+		VariableData *predicateColumn = (VariableData *)calloc(1, sizeof(VariableData));
+		plan->predicateColumns[plan->numPredicates++] = predicateColumn;
+		predicateColumn->varID = predicateVarID;
+		//tested as doubles whatever the variable's type
+		predicateColumn->type = NC_DOUBLE;
+		predicateColumn->elementSize = sizeof(double);
+		predicateColumn->converted = 1;
+		predicateColumn->shape.numDims = numPredicateDims;
+		predicateColumn->name = strdup(options->predicates[i].varName);
+		//(tested against the decoded values)
+		if (options->cfDecode)
+		{
+			ncResult = GetCfDecoding(datasetID, predicateVarID, predicateType, &predicateColumn->cf);
+			if (ncResult != NC_NOERR)
+			{
+				status = HandleNCError("nc_get_att_double", ncResult);
+				goto cleanup;
+			}
+		}
+		for (j=0; j<numPredicateDims && j<MAX_ROW_DIMS; j++)
+		{
+			predicateColumn->shape.rowDims[j] = FindRowDimension(rowSpace, predicateDimIDs[j]);
+			if (predicateColumn->shape.rowDims[j] < 0) break;
+		}
+		if (j < numPredicateDims)
+		{
+			printf("error: --where variable %s has dimensions that aren't being output\n", options->predicates[i].varName);
+			status = -1;
+			goto cleanup;
+		}
+	}
+	
+	//work out how many rows to read per window from the per-row size of all the columns
+	size_t rowBytes = 0;
+	for (i=0; i<numColumns; i++) rowBytes += columnList[i]->elementSize;
+	int numSlots = (options->numSlots > 0) ? options->numSlots : 1;
+	size_t windowRows = DEFAULT_WINDOW_ROWS;
+	if (options->windowRows > 0) windowRows = options->windowRows;
+	else if (options->maxMemory > 0 && rowBytes > 0) windowRows = options->maxMemory / (rowBytes * numSlots);
+	if (windowRows < 1) windowRows = 1;
+	//(rows within a window are picked out with 32-bit indices, and Arrow string offsets are signed 32-bit)
+	if (windowRows > INT32_MAX) windowRows = INT32_MAX;
+	
+	//NetCDF-4 variables are stored in (usually compressed) chunks, and a window that ends part way through a chunk
+	//means decompressing that chunk again for the next window, so the windows are lined up with the chunks
+	size_t chunkAlignment[MAX_ROW_DIMS] = { 0 };
+	int numChunked = 0;
+	if (dataset->formatVersion == NC_FORMAT_NETCDF4 || dataset->formatVersion == NC_FORMAT_NETCDF4_CLASSIC)
+	{
+		for (i=0; i<numColumns; i++)
+		{
+			if (!GetVariableChunking(datasetID, columnList[i])) continue;
+			numChunked++;
+			for (j=0; j<columnList[i]->shape.numDims; j++)
+			{
+				//(in rows, which skip over the stride)
+				int rowDim = columnList[i]->shape.rowDims[j];
+				size_t chunkRows = columnList[i]->chunkSizes[j] / (size_t)rowSpace->dimStrides[rowDim];
+				if (chunkRows > chunkAlignment[rowDim]) chunkAlignment[rowDim] = chunkRows;
+			}
+		}
+	}
+	PlanRowWindows(rowSpace, windowRows, (numChunked > 0) ? chunkAlignment : NULL);
+	
+	//variables of a mapped classic file are read straight out of the map, as long as the header was read the same way
+	//libnetcdf read it (and they aren't converted as they're read)
+	ClassicFile *classicFile = dataset->classicFile;
+	int useMap = (classicFile != NULL);
+	for (i=0; i<numColumns && useMap; i++)
+	{
+		VariableData *variableData = columnList[i];
+		if (variableData->varID < 0 || variableData->converted) continue;
+		if (classicFile->vars[variableData->varID].type != variableData->type
+			|| classicFile->vars[variableData->varID].numDims != variableData->shape.numDims)
+		{
+			puts("warning: couldn't map the classic file, reading it through libnetcdf");
+			useMap = 0;
+		}
+	}
+	int numMapped = 0;
+	for (i=0; i<numColumns && useMap; i++)
+	{
+		columnList[i]->mapped = (columnList[i]->varID >= 0 && !columnList[i]->converted);
+		numMapped += columnList[i]->mapped;
+	}
+	if (useMap && options->verbose) printf("reading %d variable(s) straight from the memory-mapped file\n", numMapped);
+	if (options->verbose) printf("rows: %zu over %d dimension(s)\n", rowSpace->numRows, rowSpace->numDims);
+	
+	//and the chunk caches are sized so any chunk the windows come back to is still there
+	size_t cacheLimit = 0;
+	if (numChunked > 0)
+	{
+		cacheLimit = (options->maxMemory > 0) ? options->maxMemory : DEFAULT_CHUNK_CACHE_LIMIT;
+		TuneChunkCaches(datasetID, rowSpace, columnList, numColumns, windowRows, cacheLimit, options->verbose);
+	}
+	windowRows = rowSpace->windowRows;
+	plan->windowRows = windowRows;
+	plan->numSlots = numSlots;
+	
+	//allocate the reusable window buffers, plus room to read hyperslabs that have to be rearranged into rows
+	int needsSlabBuffer = 0;
+	for (i=0; i<numColumns; i++)
+	{
+		columnList[i]->inRowOrder = IsColumnInRowOrder(rowSpace, &columnList[i]->shape);
+		if (!columnList[i]->inRowOrder) needsSlabBuffer = 1;
+	}
+	for (i=0; i<plan->numPredicates; i++)
+	{
+		plan->predicateColumns[i]->inRowOrder = IsColumnInRowOrder(rowSpace, &plan->predicateColumns[i]->shape);
+		if (!plan->predicateColumns[i]->inRowOrder) needsSlabBuffer = 1;
+	}
+	if (plan->numPredicates > 0)
+	{
+		plan->predicateValues = (double *)AllocatePlanBuffer(plan, windowRows * sizeof(double));
+		plan->selectedRows = (uint32_t *)AllocatePlanBuffer(plan, windowRows * sizeof(uint32_t));
+	}
+	int numColumnData = numSlots * numColumns;
+	int numReaders = AssignPlanReaders(plan, options->numReaders);
+	if (numReaders > 0)
+	{
+		//the buffers of the columns other processes read are shared with them, along with the stats of their reads
+		size_t statsBytes = RoundUpToMultiple(numColumns * sizeof(ColumnReadStats), 64);
+		size_t sharedBytes = statsBytes;
+		for (i=0; i<numColumnData; i++)
+		{
+			if (plan->columnReaders[i % numColumns] > 0) sharedBytes += RoundUpToMultiple(windowRows * columnList[i % numColumns]->elementSize, 64);
+		}
+		void *shared = mmap(NULL, sharedBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+		if (shared == MAP_FAILED)
+		{
+			perror("mmap");
+			status = -1;
+			goto cleanup;
+		}
+		plan->sharedMemory = shared;
+		plan->sharedMemorySize = sharedBytes;
+		plan->numAllocations++;
+		plan->allocatedBytes += sharedBytes;
+		plan->readerStats = (ColumnReadStats *)shared;
+	}
+	plan->columnData = (void **)calloc(numColumnData, sizeof(void*));
+	char *nextShared = (char *)plan->sharedMemory + RoundUpToMultiple(numColumns * sizeof(ColumnReadStats), 64);
+	for (i=0; i<numColumnData; i++)
+	{
+		size_t bytes = windowRows * columnList[i % numColumns]->elementSize;
+		if (plan->columnReaders[i % numColumns] == 0) plan->columnData[i] = AllocatePlanBuffer(plan, bytes);
+		else
+		{
+			plan->columnData[i] = nextShared;
+			nextShared += RoundUpToMultiple(bytes, 64);
+		}
+	}
+	plan->columnViews = (const void **)calloc(numColumnData, sizeof(void*));
+	plan->columnStrides = (size_t *)calloc(numColumnData, sizeof(size_t));
+	plan->mappedFirst = (uint64_t *)calloc(numSlots, sizeof(uint64_t));
+	plan->mappedLast = (uint64_t *)calloc(numSlots, sizeof(uint64_t));
+	if (needsSlabBuffer) plan->slabBuffer = AllocatePlanBuffer(plan, windowRows * sizeof(double));
+	if (options->verbose) printf("window: %zu rows x %d slot(s), %zu bytes of variable buffers\n", windowRows, numSlots, windowRows * rowBytes * numSlots);
+	
+	//the readers start out with a copy of the finished plan
+	if (numReaders > 0)
+	{
+		if (options->verbose) printf("reading the variables on %d processes\n", numReaders + 1);
+		if (StartPlanReaders(plan, numReaders, cacheLimit) != 0)
+		{
+			status = -1;
+			goto cleanup;
+		}
+	}
+	
+cleanup:
+	free(launchTime);
+	free(selectedVars);
+	free(varDimIDLists);
+	free(isDimensionColumn);
+	if (status != 0)
+	{
+		FreeReadPlan(plan);
+		return status;
+	}
+	*planOut = plan;
+	return 0;
+}
+
+void FreeReadPlan(ReadPlan *plan)
+{
+	int i;
+	if (plan == NULL) return;
+	//the readers finish once their sockets are closed
+	for (i=0; i<plan->numReaders; i++) close(plan->readerSockets[i]);
+	for (i=0; i<plan->numReaders; i++) waitpid(plan->readerPids[i], NULL, 0);
+	for (i=0; i<plan->numVars; i++)
+	{
+		if (plan->variableDataList != NULL) FreeVariableData(plan->variableDataList[i]);
+	}
+	for (i=0; i<MAX_ROW_DIMS; i++) FreeVariableData(plan->dimensionColumns[i]);
+	for (i=0; i<plan->numPredicates; i++) FreeVariableData(plan->predicateColumns[i]);
+	if (plan->columnData != NULL)
+	{
+		for (i=0; i<plan->numSlots * plan->numColumns; i++)
+		{
+			if (plan->columnReaders[i % plan->numColumns] == 0) free(plan->columnData[i]);
+		}
+	}
+	if (plan->sharedMemory != NULL) munmap(plan->sharedMemory, plan->sharedMemorySize);
+	free(plan->readerPids);
+	free(plan->readerSockets);
+	free(plan->columnReaders);
+	free(plan->variableDataList);
+	free(plan->columns);
+	free(plan->predicateColumns);
+	free(plan->columnData);
+	free(plan->columnViews);
+	free(plan->mappedFirst);
+	free(plan->mappedLast);
+	free(plan->columnStrides);
+	free(plan->predicateValues);
+	free(plan->selectedRows);
+	free(plan->slabBuffer);
+	free(plan);
+}
+
+int FindPlanColumn(const ReadPlan *plan, const char *name)
+{
+	int i;
+	for (i=0; i<plan->numColumns; i++)
+	{
+		if (strcmp(plan->columns[i]->name, name) == 0) return i;
+	}
+	return -1;
+}
+
+int ReadPlanWindow(ReadPlan *plan, int slot, size_t windowIndex, size_t *rowCount)
+{
+	int datasetID = plan->dataset->datasetID;
+	RowWindow window;
+	GetRowWindow(&plan->rowSpace, windowIndex, &window);
+	int j, ncResult;
+	
+	//test the predicates first, a window without any rows that pass doesn't need anything else read
+	size_t numSelected = window.numRows;
+	for (j=0; j<plan->numPredicates && numSelected > 0; j++)
+	{
+		VariableData *variableData = plan->predicateColumns[j];
+		void *slab = variableData->inRowOrder ? (void *)plan->predicateValues : plan->slabBuffer;
+		double readStart = GetMonotonicTime();
+		ncResult = ReadColumnSlab(datasetID, &plan->rowSpace, variableData, &window, slab);
+		variableData->readSeconds += GetMonotonicTime() - readStart;
+		if (ncResult != NC_NOERR) return HandleNCError("nc_get_vara", ncResult);
+		if (!variableData->inRowOrder) ExpandColumnToRows(&plan->rowSpace, &variableData->shape, &window, slab, sizeof(double), plan->predicateValues);
+		if (variableData->cf.active) DecodeCfColumn(plan->predicateValues, NC_DOUBLE, window.numRows, &variableData->cf);
+		numSelected = FilterRows(&plan->predicates[j], plan->predicateValues, window.numRows, plan->selectedRows, numSelected, j == 0);
+	}
+	plan->numRowsRead += window.numRows;
+	plan->numRowsSelected += numSelected;
+	*rowCount = numSelected;
+	
+	//the slot's last window has been used by now, so the pages it read out of a mapped file can go, and the file is
+	//checked before any more are touched (one truncated since it was mapped would raise SIGBUS and take down the batch)
+	ClassicFile *classicFile = plan->dataset->classicFile;
+	if (classicFile != NULL)
+	{
+		ReleaseClassicRange(classicFile, plan->mappedFirst[slot], plan->mappedLast[slot]);
+		plan->mappedFirst[slot] = plan->mappedLast[slot] = 0;
+		if (numSelected > 0 && CheckClassicFileSize(classicFile) != 0)
+		{
+			puts("error: the file was truncated while it was being converted");
+			return -1;
+		}
+	}
+	if (numSelected == 0) return 0;
+	
+	//hand the window to the reader processes first, so their columns are read while this process reads its own
+	if (plan->numReaders > 0 && SendReaderRequests(plan, slot, windowIndex) != 0) return -1;
+	for (j=0; j<plan->numColumns; j++)
+	{
+		if (plan->numReaders > 0 && plan->columnReaders[j] > 0) continue;
+		VariableData *variableData = plan->columns[j];
+		int column = slot*plan->numColumns + j;
+		void *rows = plan->columnData[column];
+		void *slab = variableData->inRowOrder ? rows : plan->slabBuffer;
+		plan->columnViews[column] = rows;
+		plan->columnStrides[column] = variableData->elementSize;
+		double readStart = GetMonotonicTime();
+		if (variableData->mapped)
+		{
+			//rows that come out of the file in order, with none of them dropped, are formatted straight from the map
+			int viewable = variableData->inRowOrder && numSelected == window.numRows;
+			int isView = ReadMappedColumnSlab(classicFile, &plan->rowSpace, variableData, &window, viewable, slab,
+				&plan->columnViews[column], &plan->columnStrides[column], &plan->mappedFirst[slot], &plan->mappedLast[slot]);
+			variableData->readSeconds += GetMonotonicTime() - readStart;
+			if (isView) continue;
+		}
+		else
+		{
+			ncResult = ReadColumnSlab(datasetID, &plan->rowSpace, variableData, &window, slab);
+			variableData->readSeconds += GetMonotonicTime() - readStart;
+			if (ncResult != NC_NOERR) return HandleNCError("nc_get_vara", ncResult);
+		}
+		if (!variableData->inRowOrder) ExpandColumnToRows(&plan->rowSpace, &variableData->shape, &window, slab, variableData->elementSize, rows);
+		//drop the rows that failed, so only the rest are formatted
+		if (numSelected < window.numRows) CompactRows(rows, variableData->elementSize, plan->selectedRows, numSelected);
+		DecodeColumnRows(variableData, rows, numSelected);
+	}
+	if (plan->numReaders > 0) return CollectReaderWindow(plan, slot, window.numRows, numSelected);
+	return 0;
+}
+
+int NextRowBlock(ReadPlan *plan, RowBlock *block)
+{
+	block->numRows = 0;
+	block->numColumns = plan->numColumns;
+	block->columnInfo = plan->columns;
+	block->columns = plan->columnViews;
+	block->strides = plan->columnStrides;
+	
+	//windows without any rows left after the predicates are skipped over
+	while (block->numRows == 0 && plan->nextWindow < plan->rowSpace.numWindows)
+	{
+		int status = ReadPlanWindow(plan, 0, plan->nextWindow++, &block->numRows);
+		if (status != 0) return status;
+	}
+	return 0;
+}
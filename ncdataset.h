@@ -0,0 +1,202 @@
+//ncdataset.h: the core shared by the converters (libnc2csv), an open NetCDF dataset, a plan of the rows and columns to
+//read from it, and an iterator handing the planned rows back a block at a time
+//Copyright 2012, Allen Jordan, allen.jordan@gmail.com
+
+#ifndef NCDATASET_H
+#define NCDATASET_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <netcdf.h>
+#include "rowspace.h"
+#include "rowfilter.h"
+#include "classicfile.h"
+#include "cfdecode.h"
+#include "cftime.h"
+
+//default number of rows read from every variable per window when no limits are given
+#define DEFAULT_WINDOW_ROWS	65536
+//cap on the chunk caches sized for NetCDF-4 variables when no memory limit is given
+#define DEFAULT_CHUNK_CACHE_LIMIT	((size_t)512*1024*1024)
+
+//report a NetCDF error, returns the status so the caller can abandon the current file with it
+int HandleNCError(const char *funcName, int status);
+//get the size in bytes of a single value of a supported NetCDF type, or 0 if the type isn't supported
+size_t GetTypeSize(nc_type type);
+//read a text attribute of a variable (or NC_GLOBAL) into a new null terminated string, or an empty string if it
+//doesn't have one, returns the NetCDF status of reading an attribute that exists
+int GetTextAttribute(int datasetID, int varID, const char *attName, char **value);
+
+//an open NetCDF file
+typedef struct
+{
+	int datasetID;
+	//the path it was opened with, so reader processes can open handles of their own
+	char *filename;
+	int formatVersion;
+	int numDims, numVars, numGlobalAtts, unlimitedDimID;
+	//the file's memory map, for a classic or 64-bit offset file opened with mapClassic (NULL otherwise)
+	ClassicFile *classicFile;
+} NcDataset;
+
+//open a NetCDF file, memory-mapping it as well when mapClassic is set and it's a classic or 64-bit offset file
+//returns 0 or a nonzero error status (a NetCDF error code, or -1 for a format that isn't supported),
+//*dataset is only set on success
+int OpenNcDataset(const char *filename, int mapClassic, NcDataset **dataset);
+//close the file and free the handle, returns the NetCDF status of closing it
+int CloseNcDataset(NcDataset *dataset);
+//print the file's format and dimensions, returns the NetCDF status of looking them up
+int PrintDatasetInfo(const NcDataset *dataset);
+
+//a column of a plan, a NetCDF variable or the indices along one of the row dimensions
+//its raw data is read one window of rows at a time into reusable buffers, one per slot
+typedef struct
+{
+	//NetCDF variable ID, or -1 for a column of dimension indices
+	int varID;
+	nc_type type;
+	size_t elementSize;
+	//where the variable's dimensions sit among the row dimensions, and whether its hyperslabs already come out in row order
+	ColumnShape shape;
+	int inRowOrder;
+	//NetCDF-4 chunk shape, in the variable's own dimension order
+	int chunked;
+	size_t chunkSizes[MAX_ROW_DIMS];
+	//set when the values are converted to doubles as they're read (so they can't come straight out of the map)
+	int converted;
+	//set when the variable is read straight out of a memory-mapped classic file (its values stay big-endian)
+	int mapped;
+	//with PlanOptions.cfDecode, how its values are unpacked and masked as they're read (type is the decoded type)
+	CfDecoding cf;
+	//with PlanOptions.decodeTimes, set for a time coordinate, whose values are read as seconds since 1970
+	int timestamp;
+	TimeUnits timeUnits;
+	//time spent reading its hyperslabs, and their size
+	double readSeconds;
+	uint64_t bytesRead;
+	//name and descriptive attributes (empty strings if it doesn't have them)
+	char *name;
+	char *standardName;
+	char *longName;
+	char *units;
+} VariableData;
+
+//time spent reading a column's window in a reader process, and its size
+typedef struct
+{
+	double readSeconds;
+	uint64_t bytesRead;
+} ColumnReadStats;
+
+//what to read from a dataset
+typedef struct
+{
+	//names or shell-style globs of the variables to read (all of them when there are none)
+	char **varPatterns;
+	int numVarPatterns;
+	//start/count/stride along the first row dimension (count 0 for all of them)
+	size_t rowStart, rowCount, rowStride;
+	//rows are only read if they pass all of the predicates
+	const RowPredicate *predicates;
+	int numPredicates;
+	//rows read per window, or 0 to fit the windows into maxMemory (or 0 for DEFAULT_WINDOW_ROWS)
+	size_t windowRows;
+	size_t maxMemory;
+	//number of windows held at once, each with its own buffers (ex: PIPELINE_SLOTS)
+	int numSlots;
+	//read numeric variables other than floats as doubles (floats stay floats)
+	int readAsDouble;
+	//decode the variables with CF packing or masking attributes as they're read, masked values become NaN
+	int cfDecode;
+	//turn time coordinates (variables with units like "seconds since 2012-06-14 18:05:32") into doubles holding
+	//seconds since 1970-01-01 UTC as they're read
+	int decodeTimes;
+	//number of processes reading the columns that go through libnetcdf, each with its own handle on the file, so
+	//variables are decompressed on several cores at once (0 or 1 to read them all in this process)
+	int numReaders;
+	//print the variables, rows and windows planned
+	int verbose;
+} PlanOptions;
+
+//the rows and columns to read from a dataset, and the buffers they're read into a window at a time
+typedef struct
+{
+	NcDataset *dataset;
+	RowSpace rowSpace;
+	//with a single row dimension every variable (including its coordinate variable) is a column as is, with several
+	//there's a column for each dimension first, holding its coordinate variable or just its indices
+	int numColumns;
+	VariableData **columns;
+	size_t windowRows;
+	int numSlots;
+	//window buffers, columnData[slot*numColumns + column] holds a window of a column for one slot
+	void **columnData;
+	//what each slot's window of a column was read as, either its buffer or a view of its rows in the mapped file,
+	//and the bytes from one row to the next
+	const void **columnViews;
+	size_t *columnStrides;
+	//the range of file offsets [first, last) each slot's window read out of a mapped classic file, released from
+	//memory when the slot is read into again (once that window has been used)
+	uint64_t *mappedFirst, *mappedLast;
+	//rows read so far, and how many of them passed the predicates
+	size_t numRowsRead, numRowsSelected;
+	//data buffers allocated for the plan, and their total size
+	uint64_t numAllocations, allocatedBytes;
+	//the window NextRowBlock reads next
+	size_t nextWindow;
+
+	//every variable of the dataset that's read, by variable ID, and the made up dimension index columns
+	int numVars;
+	VariableData **variableDataList;
+	VariableData *dimensionColumns[MAX_ROW_DIMS];
+	//the variables tested by the predicates, read as doubles into predicateValues, narrowing down selectedRows to the
+	//rows of a window that are kept
+	int numPredicates;
+	const RowPredicate *predicates;
+	VariableData **predicateColumns;
+	double *predicateValues;
+	uint32_t *selectedRows;
+	//hyperslabs that have to be spread out over the rows are read into here first
+	void *slabBuffer;
+	
+	//with PlanOptions.numReaders, the other reader processes and a socket to each, the process reading each column
+	//(0 for this one, or reader number + 1), and the shared memory holding their columns' window buffers and read stats
+	int numReaders;
+	pid_t *readerPids;
+	int *readerSockets;
+	int *columnReaders;
+	void *sharedMemory;
+	size_t sharedMemorySize;
+	ColumnReadStats *readerStats;
+} ReadPlan;
+
+//a block of rows handed back by NextRowBlock, columns[c] points to the first value of column c (described by
+//columnInfo[c]) and strides[c] is the bytes from one row to the next
+typedef struct
+{
+	size_t numRows;
+	int numColumns;
+	VariableData * const *columnInfo;
+	const void * const *columns;
+	const size_t *strides;
+} RowBlock;
+
+//the options of a plan that reads every row of every variable, in windows of the default size
+void InitPlanOptions(PlanOptions *options);
+//pick the columns and rows to read and plan the windows they're read in, only looking at the names and attributes
+//of the variables that are read (unselected ones are never touched)
+//returns 0 or a nonzero error status, *plan is only set on success
+int CreateReadPlan(NcDataset *dataset, const PlanOptions *options, ReadPlan **plan);
+void FreeReadPlan(ReadPlan *plan);
+//get the index of the column reading a variable, or -1 if it isn't one of the plan's columns
+int FindPlanColumn(const ReadPlan *plan, const char *name);
+
+//read window number windowIndex into the buffers of slot, in row order, keeping only the rows that pass the predicates
+//sets the number of rows kept, returns 0 or a nonzero error status (a read stage for RunWindowStages)
+int ReadPlanWindow(ReadPlan *plan, int slot, size_t windowIndex, size_t *rowCount);
+//read the next block of rows that passed the predicates into slot 0, a block with no rows means there aren't any more
+//the block stays valid until the next call, returns 0 or a nonzero error status
+int NextRowBlock(ReadPlan *plan, RowBlock *block);
+
+#endif
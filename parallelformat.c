@@ -0,0 +1,176 @@
+//parallelformat.c: formatting a window of rows on several threads, written out in the original row order
+//Copyright 2012, Allen Jordan, allen.jordan@gmail.com
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "parallelformat.h"
+
+//number of chunks per thread each window is split into, so threads that finish early can pick up more work
+#define CHUNKS_PER_THREAD	4
+
+//a contiguous range of rows formatted by one thread into its own buffer
+typedef struct
+{
+	size_t start;
+	size_t count;
+	CsvWriter *text;
+	int done;
+} FormatChunk;
+
+typedef struct
+{
+	ParallelFormatter *owner;
+	pthread_t thread;
+	//this thread's own text blocks for every column
+	ColumnFormatter *columns;
+} FormatThread;
+
+struct ParallelFormatter
+{
+	int numThreads;
+	int numColumns;
+	FormatThread *threads;
+
+	pthread_mutex_t lock;
+	//signalled when a new window is ready and when the formatter is shutting down
+	pthread_cond_t workReady;
+	//signalled whenever a chunk is done
+	pthread_cond_t chunkDone;
+	int shutdown;
+	//bumped for every window so threads can tell new work from old
+	unsigned long generation;
+
+	//the current window
+	const void * const *columnData;
+	const size_t *strides;
+	FormatChunk *chunks;
+	int numChunks;
+	int chunkCapacity;
+	int nextChunk;
+};
+
+static void *FormatThreadMain(void *argument)
+{
+	FormatThread *self = (FormatThread *)argument;
+	ParallelFormatter *formatter = self->owner;
+	unsigned long seenGeneration = 0;
+
+	pthread_mutex_lock(&formatter->lock);
+	for (;;)
+	{
+		while (!formatter->shutdown && formatter->generation == seenGeneration)
+			pthread_cond_wait(&formatter->workReady, &formatter->lock);
+		if (formatter->shutdown) break;
+		seenGeneration = formatter->generation;
+
+		//keep taking chunks of this window until there are none left
+		while (formatter->nextChunk < formatter->numChunks)
+		{
+			FormatChunk *chunk = &formatter->chunks[formatter->nextChunk++];
+			pthread_mutex_unlock(&formatter->lock);
+
+			chunk->text->length = 0;
+			FormatRowRange(self->columns, formatter->numColumns, formatter->columnData, formatter->strides,
+				chunk->start, chunk->count, chunk->text);
+
+			pthread_mutex_lock(&formatter->lock);
+			chunk->done = 1;
+			pthread_cond_broadcast(&formatter->chunkDone);
+		}
+	}
+	pthread_mutex_unlock(&formatter->lock);
+	return NULL;
+}
+
+ParallelFormatter *CreateParallelFormatter(int numThreads, const ColumnFormatKernel *kernels, int numColumns, int decimals)
+{
+	int i, column;
+	ParallelFormatter *formatter = (ParallelFormatter *)calloc(1, sizeof(ParallelFormatter));
+	formatter->numThreads = numThreads;
+	formatter->numColumns = numColumns;
+	pthread_mutex_init(&formatter->lock, NULL);
+	pthread_cond_init(&formatter->workReady, NULL);
+	pthread_cond_init(&formatter->chunkDone, NULL);
+
+	formatter->threads = (FormatThread *)calloc(numThreads, sizeof(FormatThread));
+	for (i = 0; i < numThreads; i++)
+	{
+		FormatThread *thread = &formatter->threads[i];
+		thread->owner = formatter;
+		thread->columns = (ColumnFormatter *)malloc(numColumns * sizeof(ColumnFormatter));
+		for (column = 0; column < numColumns; column++) InitColumnFormatter(&thread->columns[column], kernels[column], decimals);
+		pthread_create(&thread->thread, NULL, FormatThreadMain, thread);
+	}
+	return formatter;
+}
+
+void FreeParallelFormatter(ParallelFormatter *formatter)
+{
+	int i, column;
+	pthread_mutex_lock(&formatter->lock);
+	formatter->shutdown = 1;
+	pthread_cond_broadcast(&formatter->workReady);
+	pthread_mutex_unlock(&formatter->lock);
+
+	for (i = 0; i < formatter->numThreads; i++)
+	{
+		FormatThread *thread = &formatter->threads[i];
+		pthread_join(thread->thread, NULL);
+		for (column = 0; column < formatter->numColumns; column++) FreeColumnFormatter(&thread->columns[column]);
+		free(thread->columns);
+	}
+	for (i = 0; i < formatter->chunkCapacity; i++) CsvWriterClose(formatter->chunks[i].text);
+	free(formatter->chunks);
+	free(formatter->threads);
+	pthread_cond_destroy(&formatter->chunkDone);
+	pthread_cond_destroy(&formatter->workReady);
+	pthread_mutex_destroy(&formatter->lock);
+	free(formatter);
+}
+
+void FormatWindowParallel(ParallelFormatter *formatter, const void * const *columnData, const size_t *strides,
+	size_t count, CsvWriter *writer)
+{
+	int i;
+	if (count == 0) return;
+
+	//split the rows into whole format blocks, a few chunks per thread
+	size_t chunkRows = count / (formatter->numThreads * CHUNKS_PER_THREAD);
+	chunkRows = (chunkRows + FORMAT_BLOCK_ROWS - 1) / FORMAT_BLOCK_ROWS * FORMAT_BLOCK_ROWS;
+	if (chunkRows == 0) chunkRows = FORMAT_BLOCK_ROWS;
+	int numChunks = (int)((count + chunkRows - 1) / chunkRows);
+
+	//chunk text buffers are kept between windows, so they only grow for the first window or two
+	if (numChunks > formatter->chunkCapacity)
+	{
+		formatter->chunks = (FormatChunk *)realloc(formatter->chunks, numChunks * sizeof(FormatChunk));
+		for (i = formatter->chunkCapacity; i < numChunks; i++) formatter->chunks[i].text = CsvWriterOpenMemory();
+		formatter->chunkCapacity = numChunks;
+	}
+
+	pthread_mutex_lock(&formatter->lock);
+	for (i = 0; i < numChunks; i++)
+	{
+		formatter->chunks[i].start = (size_t)i * chunkRows;
+		formatter->chunks[i].count = (i == numChunks-1) ? count - formatter->chunks[i].start : chunkRows;
+		formatter->chunks[i].done = 0;
+	}
+	formatter->columnData = columnData;
+	formatter->strides = strides;
+	formatter->numChunks = numChunks;
+	formatter->nextChunk = 0;
+	formatter->generation++;
+	pthread_cond_broadcast(&formatter->workReady);
+
+	//write the chunks out in order, each one as soon as it's done
+	for (i = 0; i < numChunks; i++)
+	{
+		while (!formatter->chunks[i].done) pthread_cond_wait(&formatter->chunkDone, &formatter->lock);
+		pthread_mutex_unlock(&formatter->lock);
+		CsvWriter *text = formatter->chunks[i].text;
+		CsvWriterPutBytes(writer, text->buffer, text->length);
+		pthread_mutex_lock(&formatter->lock);
+	}
+	pthread_mutex_unlock(&formatter->lock);
+}
@@ -0,0 +1,22 @@
+//parallelformat.h: formatting a window of rows on several threads, written out in the original row order
+//Copyright 2012, Allen Jordan, allen.jordan@gmail.com
+
+#ifndef PARALLELFORMAT_H
+#define PARALLELFORMAT_H
+
+#include "colformat.h"
+
+typedef struct ParallelFormatter ParallelFormatter;
+
+//start numThreads formatting threads, each with its own copy of the column kernels
+ParallelFormatter *CreateParallelFormatter(int numThreads, const ColumnFormatKernel *kernels, int numColumns, int decimals);
+//stop the threads and free everything
+void FreeParallelFormatter(ParallelFormatter *formatter);
+
+//format rows [0, count) of a window of column data (laid out as for FormatRowRange) and write them to writer
+//the rows are split into chunks formatted in parallel, and each chunk is written as soon as it and every chunk
+//before it are done, so the output is byte-identical to formatting on a single thread
+void FormatWindowParallel(ParallelFormatter *formatter, const void * const *columnData, const size_t *strides,
+	size_t count, CsvWriter *writer);
+
+#endif
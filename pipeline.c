@@ -0,0 +1,244 @@
+//pipeline.c: reading, formatting and writing windows of rows, either one after another or as overlapping stages
+//Copyright 2012, Allen Jordan, allen.jordan@gmail.com
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <pthread.h>
+#include "pipeline.h"
+
+double GetMonotonicTime(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (double)now.tv_sec + (double)now.tv_nsec * 1e-9;
+}
+
+//a bounded FIFO of buffer indices, -1 is used to mark the end of the stream
+typedef struct
+{
+	int items[PIPELINE_SLOTS + 1];
+	int head;
+	int count;
+	pthread_mutex_t lock;
+	pthread_cond_t notEmpty;
+	pthread_cond_t notFull;
+} IndexQueue;
+
+static void InitIndexQueue(IndexQueue *queue)
+{
+	queue->head = 0;
+	queue->count = 0;
+	pthread_mutex_init(&queue->lock, NULL);
+	pthread_cond_init(&queue->notEmpty, NULL);
+	pthread_cond_init(&queue->notFull, NULL);
+}
+
+static void DestroyIndexQueue(IndexQueue *queue)
+{
+	pthread_cond_destroy(&queue->notFull);
+	pthread_cond_destroy(&queue->notEmpty);
+	pthread_mutex_destroy(&queue->lock);
+}
+
+//add an item, blocking while the queue is full, and add the time spent blocked to waitTime
+static void PushIndex(IndexQueue *queue, int item, double *waitTime)
+{
+	const int capacity = PIPELINE_SLOTS + 1;
+	pthread_mutex_lock(&queue->lock);
+	if (queue->count == capacity)
+	{
+		double waitStart = GetMonotonicTime();
+		while (queue->count == capacity) pthread_cond_wait(&queue->notFull, &queue->lock);
+		*waitTime += GetMonotonicTime() - waitStart;
+	}
+	queue->items[(queue->head + queue->count) % capacity] = item;
+	queue->count++;
+	pthread_cond_signal(&queue->notEmpty);
+	pthread_mutex_unlock(&queue->lock);
+}
+
+//take the oldest item, blocking while the queue is empty, and add the time spent blocked to waitTime
+static int PopIndex(IndexQueue *queue, double *waitTime)
+{
+	const int capacity = PIPELINE_SLOTS + 1;
+	pthread_mutex_lock(&queue->lock);
+	if (queue->count == 0)
+	{
+		double waitStart = GetMonotonicTime();
+		while (queue->count == 0) pthread_cond_wait(&queue->notEmpty, &queue->lock);
+		*waitTime += GetMonotonicTime() - waitStart;
+	}
+	int item = queue->items[queue->head];
+	queue->head = (queue->head + 1) % capacity;
+	queue->count--;
+	pthread_cond_signal(&queue->notFull);
+	pthread_mutex_unlock(&queue->lock);
+	return item;
+}
+
+typedef struct
+{
+	const WindowStages *stages;
+	size_t numWindows;
+	CsvWriter *output;
+	StageTimings *timings;
+
+	//read slots go free -> read -> formatted -> free, text buffers go free -> formatted -> written -> free
+	IndexQueue freeSlots, readSlots;
+	IndexQueue freeTexts, formattedTexts;
+	size_t slotRowCounts[PIPELINE_SLOTS];
+	CsvWriter *texts[PIPELINE_SLOTS];
+	int status;
+} Pipeline;
+
+static void *ReaderStage(void *argument)
+{
+	Pipeline *pipeline = (Pipeline *)argument;
+	StageTimings *timings = pipeline->timings;
+	size_t windowIndex;
+	for (windowIndex = 0; windowIndex < pipeline->numWindows; windowIndex++)
+	{
+		int slot = PopIndex(&pipeline->freeSlots, &timings->readWait);
+		double readStart = GetMonotonicTime();
+		size_t count = 0;
+		int status = pipeline->stages->read(pipeline->stages->context, slot, windowIndex, &count);
+		timings->readBusy += GetMonotonicTime() - readStart;
+		if (status != 0)
+		{
+			//the formatter reads this after taking the end marker, which the queue lock orders after this write
+			pipeline->status = status;
+			break;
+		}
+		pipeline->slotRowCounts[slot] = count;
+		PushIndex(&pipeline->readSlots, slot, &timings->readWait);
+	}
+	PushIndex(&pipeline->readSlots, -1, &timings->readWait);
+	return NULL;
+}
+
+static void *WriterStage(void *argument)
+{
+	Pipeline *pipeline = (Pipeline *)argument;
+	StageTimings *timings = pipeline->timings;
+	for (;;)
+	{
+		int text = PopIndex(&pipeline->formattedTexts, &timings->writeWait);
+		if (text < 0) break;
+		double writeStart = GetMonotonicTime();
+		CsvWriterPutBytes(pipeline->output, pipeline->texts[text]->buffer, pipeline->texts[text]->length);
+		timings->writeBusy += GetMonotonicTime() - writeStart;
+		PushIndex(&pipeline->freeTexts, text, &timings->writeWait);
+	}
+	return NULL;
+}
+
+static int RunPipelined(const WindowStages *stages, size_t numWindows, CsvWriter *output, StageTimings *timings)
+{
+	int i;
+	Pipeline pipeline;
+	pipeline.stages = stages;
+	pipeline.numWindows = numWindows;
+	pipeline.output = output;
+	pipeline.timings = timings;
+	pipeline.status = 0;
+	InitIndexQueue(&pipeline.freeSlots);
+	InitIndexQueue(&pipeline.readSlots);
+	InitIndexQueue(&pipeline.freeTexts);
+	InitIndexQueue(&pipeline.formattedTexts);
+
+	//every buffer starts out free
+	double unused = 0;
+	for (i = 0; i < PIPELINE_SLOTS; i++)
+	{
+		pipeline.texts[i] = CsvWriterOpenMemory();
+		PushIndex(&pipeline.freeSlots, i, &unused);
+		PushIndex(&pipeline.freeTexts, i, &unused);
+	}
+
+	pthread_t readerThread, writerThread;
+	pthread_create(&readerThread, NULL, ReaderStage, &pipeline);
+	pthread_create(&writerThread, NULL, WriterStage, &pipeline);
+
+	//the format stage runs on this thread
+	for (;;)
+	{
+		int slot = PopIndex(&pipeline.readSlots, &timings->formatWait);
+		if (slot < 0) break;
+		int text = PopIndex(&pipeline.freeTexts, &timings->formatWait);
+
+		double formatStart = GetMonotonicTime();
+		pipeline.texts[text]->length = 0;
+		stages->format(stages->context, slot, pipeline.slotRowCounts[slot], pipeline.texts[text]);
+		timings->formatBusy += GetMonotonicTime() - formatStart;
+
+		PushIndex(&pipeline.freeSlots, slot, &timings->formatWait);
+		PushIndex(&pipeline.formattedTexts, text, &timings->formatWait);
+	}
+	PushIndex(&pipeline.formattedTexts, -1, &timings->formatWait);
+
+	pthread_join(readerThread, NULL);
+	pthread_join(writerThread, NULL);
+
+	for (i = 0; i < PIPELINE_SLOTS; i++) CsvWriterClose(pipeline.texts[i]);
+	DestroyIndexQueue(&pipeline.formattedTexts);
+	DestroyIndexQueue(&pipeline.freeTexts);
+	DestroyIndexQueue(&pipeline.readSlots);
+	DestroyIndexQueue(&pipeline.freeSlots);
+	return pipeline.status;
+}
+
+int RunWindowStages(const WindowStages *stages, size_t numWindows, int pipelined,
+	CsvWriter *output, StageTimings *timings)
+{
+	StageTimings emptyTimings = { 0 };
+	*timings = emptyTimings;
+	timings->pipelined = pipelined;
+	double runStart = GetMonotonicTime();
+	int status = 0;
+
+	if (pipelined) status = RunPipelined(stages, numWindows, output, timings);
+	else
+	{
+		//one window at a time, formatting straight into the output (so writes are counted as formatting time)
+		size_t windowIndex;
+		for (windowIndex = 0; windowIndex < numWindows; windowIndex++)
+		{
+			double readStart = GetMonotonicTime();
+			size_t count = 0;
+			status = stages->read(stages->context, 0, windowIndex, &count);
+			double formatStart = GetMonotonicTime();
+			timings->readBusy += formatStart - readStart;
+			if (status != 0) break;
+
+			stages->format(stages->context, 0, count, output);
+			timings->formatBusy += GetMonotonicTime() - formatStart;
+		}
+	}
+
+	timings->total = GetMonotonicTime() - runStart;
+	return status;
+}
+
+void PrintStageTimings(const StageTimings *timings)
+{
+	printf("stage timings (%s): total %.3f s\n", timings->pipelined ? "pipelined" : "serial", timings->total);
+	printf("  read:   %.3f s busy, %.3f s waiting\n", timings->readBusy, timings->readWait);
+	if (timings->pipelined)
+	{
+		printf("  format: %.3f s busy, %.3f s waiting\n", timings->formatBusy, timings->formatWait);
+		printf("  write:  %.3f s busy, %.3f s waiting\n", timings->writeBusy, timings->writeWait);
+	}
+	else printf("  format and write: %.3f s busy\n", timings->formatBusy);
+
+	//the stage that was busy the longest is the one holding everything else up
+	const char *bottleneck = "read";
+	double longest = timings->readBusy;
+	if (timings->formatBusy > longest)
+	{
+		bottleneck = timings->pipelined ? "format" : "format and write";
+		longest = timings->formatBusy;
+	}
+	if (timings->pipelined && timings->writeBusy > longest) bottleneck = "write";
+	printf("  bottleneck: %s\n", bottleneck);
+}
@@ -0,0 +1,49 @@
+//pipeline.h: reading, formatting and writing windows of rows, either one after another or as overlapping stages
+//Copyright 2012, Allen Jordan, allen.jordan@gmail.com
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stddef.h>
+#include "csvwriter.h"
+
+//number of window buffers the caller has to provide for a pipelined run:
+//one being read, one being formatted, and one spare so the reader never waits on the formatter to hand one back
+#define PIPELINE_SLOTS	3
+
+//the work done for each window, on whichever buffer slot the window was given
+typedef struct
+{
+	//read window number windowIndex into the buffers of slot and set the number of rows it holds,
+	//returns 0 or a nonzero error status
+	int (*read)(void *context, int slot, size_t windowIndex, size_t *rowCount);
+	//format the count rows held in slot as text onto the end of output
+	void (*format)(void *context, int slot, size_t count, CsvWriter *output);
+	void *context;
+} WindowStages;
+
+//time spent by each stage, busy doing its own work and waiting on the other stages, in seconds
+typedef struct
+{
+	double readBusy, readWait;
+	double formatBusy, formatWait;
+	double writeBusy, writeWait;
+	double total;
+	int pipelined;
+} StageTimings;
+
+//run windows [0, numWindows) in order through the read and format stages, writing the text to output
+//when pipelined, a reader thread reads window k+1 while window k is formatted and a writer thread writes out
+//window k-1, connected by bounded queues of recycled buffers (the caller provides PIPELINE_SLOTS read slots)
+//otherwise slot 0 is used for every window, formatted straight into output
+//returns 0, or the first error status from the read stage
+int RunWindowStages(const WindowStages *stages, size_t numWindows, int pipelined,
+	CsvWriter *output, StageTimings *timings);
+
+//print a one-line-per-stage breakdown of where the time went
+void PrintStageTimings(const StageTimings *timings);
+
+//seconds on the monotonic clock
+double GetMonotonicTime(void);
+
+#endif
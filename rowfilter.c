@@ -0,0 +1,98 @@
+//rowfilter.c: --where predicates, and dropping the rows of a window that fail them
+//Copyright 2012, Allen Jordan, allen.jordan@gmail.com
+
+#include <stdlib.h>
+#include <string.h>
+#include "rowfilter.h"
+
+int ParseRowPredicate(const char *text, RowPredicate *predicate)
+{
+	size_t nameLength = strcspn(text, "<>=!");
+	const char *opText = text + nameLength;
+	const char *valueText;
+	predicate->varName = NULL;
+
+	if (strncmp(opText, "<=", 2) == 0) { predicate->op = PREDICATE_LESS_EQUAL; valueText = opText + 2; }
+	else if (strncmp(opText, ">=", 2) == 0) { predicate->op = PREDICATE_GREATER_EQUAL; valueText = opText + 2; }
+	else if (strncmp(opText, "==", 2) == 0) { predicate->op = PREDICATE_EQUAL; valueText = opText + 2; }
+	else if (strncmp(opText, "!=", 2) == 0) { predicate->op = PREDICATE_NOT_EQUAL; valueText = opText + 2; }
+	else if (*opText == '<') { predicate->op = PREDICATE_LESS; valueText = opText + 1; }
+	else if (*opText == '>') { predicate->op = PREDICATE_GREATER; valueText = opText + 1; }
+	else if (*opText == '=') { predicate->op = PREDICATE_EQUAL; valueText = opText + 1; }
+	else return -1;
+	if (nameLength == 0) return -1;
+
+	char *end;
+	predicate->value = strtod(valueText, &end);
+	if (end == valueText || *end != '\0') return -1;
+
+	predicate->varName = (char *)malloc(nameLength + 1);
+	memcpy(predicate->varName, text, nameLength);
+	predicate->varName[nameLength] = '\0';
+	return 0;
+}
+
+void FreeRowPredicate(RowPredicate *predicate)
+{
+	free(predicate->varName);
+	predicate->varName = NULL;
+}
+
+//one loop per operator, so the comparison isn't chosen again for every row
+#define FILTER_LOOP(test) \
+	if (allRows) \
+	{ \
+		for (i = 0; i < numRows; i++) \
+		{ \
+			double x = values[i]; \
+			rows[numKept] = (uint32_t)i; \
+			numKept += (test); \
+		} \
+	} \
+	else \
+	{ \
+		for (i = 0; i < numSelected; i++) \
+		{ \
+			double x = values[rows[i]]; \
+			rows[numKept] = rows[i]; \
+			numKept += (test); \
+		} \
+	}
+
+size_t FilterRows(const RowPredicate *predicate, const double *values, size_t numRows,
+	uint32_t *rows, size_t numSelected, int allRows)
+{
+	size_t i, numKept = 0;
+	double value = predicate->value;
+	switch (predicate->op)
+	{
+		case PREDICATE_LESS: FILTER_LOOP(x < value) break;
+		case PREDICATE_LESS_EQUAL: FILTER_LOOP(x <= value) break;
+		case PREDICATE_GREATER: FILTER_LOOP(x > value) break;
+		case PREDICATE_GREATER_EQUAL: FILTER_LOOP(x >= value) break;
+		case PREDICATE_EQUAL: FILTER_LOOP(x == value) break;
+		case PREDICATE_NOT_EQUAL: FILTER_LOOP(x != value) break;
+	}
+	return numKept;
+}
+
+#define COMPACT_ROWS(type) \
+	{ \
+		type *column = (type *)data; \
+		for (i = 0; i < numSelected; i++) column[i] = column[rows[i]]; \
+	}
+
+void CompactRows(void *data, size_t elementSize, const uint32_t *rows, size_t numSelected)
+{
+	size_t i;
+	switch (elementSize)
+	{
+		case 1: COMPACT_ROWS(uint8_t) break;
+		case 2: COMPACT_ROWS(uint16_t) break;
+		case 4: COMPACT_ROWS(uint32_t) break;
+		case 8: COMPACT_ROWS(uint64_t) break;
+		default:
+			for (i = 0; i < numSelected; i++) memmove((char *)data + i*elementSize, (char *)data + rows[i]*elementSize, elementSize);
+			break;
+	}
+}
@@ -0,0 +1,42 @@
+//rowfilter.h: --where predicates, and dropping the rows of a window that fail them
+//Copyright 2012, Allen Jordan, allen.jordan@gmail.com
+
+#ifndef ROWFILTER_H
+#define ROWFILTER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum
+{
+	PREDICATE_LESS,
+	PREDICATE_LESS_EQUAL,
+	PREDICATE_GREATER,
+	PREDICATE_GREATER_EQUAL,
+	PREDICATE_EQUAL,
+	PREDICATE_NOT_EQUAL
+} PredicateOperator;
+
+//a comparison of a variable's value against a constant, ex: time>=600
+typedef struct
+{
+	char *varName;
+	PredicateOperator op;
+	double value;
+} RowPredicate;
+
+//parse a predicate of the form name<op>value, with op one of < <= > >= == = !=
+//returns 0 on success or -1 if the text isn't a valid predicate
+int ParseRowPredicate(const char *text, RowPredicate *predicate);
+void FreeRowPredicate(RowPredicate *predicate);
+
+//narrow a selection of rows down to the ones whose value passes a predicate, returns the number left
+//rows holds numSelected ascending row indices into values, unless allRows is set, in which case every one of
+//[0, numRows) starts out selected and rows is just filled in
+size_t FilterRows(const RowPredicate *predicate, const double *values, size_t numRows,
+	uint32_t *rows, size_t numSelected, int allRows);
+
+//move the selected rows of a column buffer down to the front of it, keeping them in order
+void CompactRows(void *data, size_t elementSize, const uint32_t *rows, size_t numSelected);
+
+#endif
@@ -0,0 +1,252 @@
+//rowspace.c: flattening N-dimensional variables into rows, one row per combination of dimension indices
+//Copyright 2012, Allen Jordan, allen.jordan@gmail.com
+
+#include <stdlib.h>
+#include <string.h>
+#include "rowspace.h"
+
+void InitRowSpace(RowSpace *space)
+{
+	memset(space, 0, sizeof(RowSpace));
+	space->numRows = 1;
+}
+
+int FindRowDimension(const RowSpace *space, int dimID)
+{
+	int i;
+	for (i = 0; i < space->numDims; i++)
+	{
+		if (space->dimIDs[i] == dimID) return i;
+	}
+	return -1;
+}
+
+int AddRowDimension(RowSpace *space, int dimID, size_t length)
+{
+	int position = FindRowDimension(space, dimID);
+	if (position >= 0) return position;
+	if (space->numDims == MAX_ROW_DIMS) return -1;
+
+	position = space->numDims++;
+	space->dimIDs[position] = dimID;
+	space->dimLengths[position] = length;
+	space->dimStarts[position] = 0;
+	space->dimStrides[position] = 1;
+	space->numRows *= length;
+	return position;
+}
+
+void RestrictRowDimension(RowSpace *space, int position, size_t start, size_t count, size_t stride)
+{
+	int i;
+	size_t fileLength = space->dimLengths[position];
+	if (stride < 1) stride = 1;
+	size_t available = (start < fileLength) ? (fileLength - start + stride - 1) / stride : 0;
+	if (count == 0 || count > available) count = available;
+
+	space->dimLengths[position] = count;
+	space->dimStarts[position] = start;
+	space->dimStrides[position] = (ptrdiff_t)stride;
+	space->numRows = 1;
+	for (i = 0; i < space->numDims; i++) space->numRows *= space->dimLengths[i];
+}
+
+void PlanRowWindows(RowSpace *space, size_t targetRows, const size_t *alignment)
+{
+	int i;
+	if (targetRows < 1) targetRows = 1;
+
+	//with no dimensions at all (only scalars) there is a single row
+	if (space->numDims == 0)
+	{
+		space->splitDim = 0;
+		space->splitCount = 1;
+		space->windowRows = 1;
+		space->numWindows = 1;
+		return;
+	}
+
+	//take whole dimensions from the fastest changing end while they fit, then split the next one
+	size_t innerRows = 1;
+	int splitDim = 0;
+	for (i = space->numDims-1; i >= 0; i--)
+	{
+		if (i == 0 || innerRows * space->dimLengths[i] > targetRows)
+		{
+			splitDim = i;
+			break;
+		}
+		innerRows *= space->dimLengths[i];
+	}
+
+	size_t splitLength = space->dimLengths[splitDim];
+	size_t splitCount = targetRows / innerRows;
+	if (splitCount < 1) splitCount = 1;
+	//line the windows up with the preferred boundaries: a multiple of them where the windows are bigger,
+	//or an even fraction of them where they're smaller (if one isn't much smaller), so no window straddles a boundary
+	if (alignment != NULL && alignment[splitDim] > 1 && splitCount < splitLength)
+	{
+		if (splitCount > alignment[splitDim]) splitCount -= splitCount % alignment[splitDim];
+		else
+		{
+			size_t fraction = splitCount;
+			while (fraction > splitCount/2 && alignment[splitDim] % fraction != 0) fraction--;
+			if (fraction > splitCount/2) splitCount = fraction;
+		}
+	}
+	if (splitCount > splitLength) splitCount = splitLength;
+
+	space->splitDim = splitDim;
+	space->splitCount = splitCount;
+	space->windowRows = splitCount * innerRows;
+
+	if (space->numRows == 0 || splitCount == 0)
+	{
+		space->numWindows = 0;
+		return;
+	}
+	size_t numWindows = (splitLength + splitCount - 1) / splitCount;
+	for (i = 0; i < splitDim; i++) numWindows *= space->dimLengths[i];
+	space->numWindows = numWindows;
+}
+
+void GetRowWindow(const RowSpace *space, size_t windowIndex, RowWindow *window)
+{
+	int i;
+	window->numRows = 1;
+	if (space->numDims == 0) return;
+
+	int splitDim = space->splitDim;
+	size_t splitLength = space->dimLengths[splitDim];
+	size_t numPieces = (splitLength + space->splitCount - 1) / space->splitCount;
+	size_t piece = windowIndex % numPieces;
+	size_t outerIndex = windowIndex / numPieces;
+
+	//the dimensions before the split one count through their indices like an odometer, one per window
+	for (i = splitDim-1; i >= 0; i--)
+	{
+		window->start[i] = outerIndex % space->dimLengths[i];
+		window->count[i] = 1;
+		outerIndex /= space->dimLengths[i];
+	}
+	window->start[splitDim] = piece * space->splitCount;
+	window->count[splitDim] = splitLength - window->start[splitDim];
+	if (window->count[splitDim] > space->splitCount) window->count[splitDim] = space->splitCount;
+	window->numRows = window->count[splitDim];
+	for (i = splitDim+1; i < space->numDims; i++)
+	{
+		window->start[i] = 0;
+		window->count[i] = space->dimLengths[i];
+		window->numRows *= space->dimLengths[i];
+	}
+}
+
+size_t GetColumnSlab(const RowSpace *space, const ColumnShape *shape, const RowWindow *window,
+	size_t *start, size_t *count, ptrdiff_t *stride)
+{
+	int i;
+	size_t numValues = 1;
+	for (i = 0; i < shape->numDims; i++)
+	{
+		int rowDim = shape->rowDims[i];
+		stride[i] = space->dimStrides[rowDim];
+		start[i] = space->dimStarts[rowDim] + window->start[rowDim] * (size_t)stride[i];
+		count[i] = window->count[rowDim];
+		numValues *= count[i];
+	}
+	return numValues;
+}
+
+int IsColumnInRowOrder(const RowSpace *space, const ColumnShape *shape)
+{
+	//dimensions before the split one only ever cover one index per window, so they can sit anywhere,
+	//but the rest have to all be there, in row order
+	int i, nextDim = space->splitDim;
+	for (i = 0; i < shape->numDims; i++)
+	{
+		if (shape->rowDims[i] < space->splitDim) continue;
+		if (shape->rowDims[i] != nextDim) return 0;
+		nextDim++;
+	}
+	return nextDim == space->numDims;
+}
+
+//walk every row of a window like an odometer, with strides[d] the step through the hyperslab for each index along row
+//dimension d (0 where the column is broadcast along it), copying a whole run of the last dimension at a time
+#define DEFINE_EXPAND_ROWS(name, type) \
+static void name(int numDims, const size_t *counts, const size_t *strides, const void *slab, void *rows) \
+{ \
+	const type *source = (const type *)slab; \
+	type *destination = (type *)rows; \
+	size_t index[MAX_ROW_DIMS] = { 0 }; \
+	size_t innerCount = counts[numDims-1]; \
+	size_t innerStride = strides[numDims-1]; \
+	size_t offset = 0, i; \
+	int d; \
+	for (;;) \
+	{ \
+		if (innerStride == 1) memcpy(destination, source + offset, innerCount * sizeof(type)); \
+		else if (innerStride == 0) \
+		{ \
+			type value = source[offset]; \
+			for (i = 0; i < innerCount; i++) destination[i] = value; \
+		} \
+		else \
+		{ \
+			for (i = 0; i < innerCount; i++) destination[i] = source[offset + i*innerStride]; \
+		} \
+		destination += innerCount; \
+		for (d = numDims-2; d >= 0; d--) \
+		{ \
+			offset += strides[d]; \
+			if (++index[d] < counts[d]) break; \
+			offset -= strides[d] * counts[d]; \
+			index[d] = 0; \
+		} \
+		if (d < 0) break; \
+	} \
+}
+
+DEFINE_EXPAND_ROWS(ExpandRows8, unsigned char)
+DEFINE_EXPAND_ROWS(ExpandRows16, unsigned short)
+DEFINE_EXPAND_ROWS(ExpandRows32, unsigned int)
+DEFINE_EXPAND_ROWS(ExpandRows64, unsigned long long)
+
+void ExpandColumnToRows(const RowSpace *space, const ColumnShape *shape, const RowWindow *window,
+	const void *slab, size_t elementSize, void *rows)
+{
+	int i;
+	size_t counts[MAX_ROW_DIMS], strides[MAX_ROW_DIMS];
+	int numDims = space->numDims;
+	if (numDims == 0)
+	{
+		//a single row holding the single value
+		numDims = 1;
+		counts[0] = 1;
+		strides[0] = 0;
+	}
+	else
+	{
+		for (i = 0; i < numDims; i++)
+		{
+			counts[i] = window->count[i];
+			strides[i] = 0;
+		}
+		//the hyperslab is row-major in the variable's own dimension order
+		size_t slabStride = 1;
+		for (i = shape->numDims-1; i >= 0; i--)
+		{
+			strides[shape->rowDims[i]] += slabStride;
+			slabStride *= window->count[shape->rowDims[i]];
+		}
+	}
+
+	switch (elementSize)
+	{
+		case 1: ExpandRows8(numDims, counts, strides, slab, rows); break;
+		case 2: ExpandRows16(numDims, counts, strides, slab, rows); break;
+		case 4: ExpandRows32(numDims, counts, strides, slab, rows); break;
+		case 8: ExpandRows64(numDims, counts, strides, slab, rows); break;
+		default: break;
+	}
+}
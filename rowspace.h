@@ -0,0 +1,74 @@
+//rowspace.h: flattening N-dimensional variables into rows, one row per combination of dimension indices
+//Copyright 2012, Allen Jordan, allen.jordan@gmail.com
+
+#ifndef ROWSPACE_H
+#define ROWSPACE_H
+
+#include <stddef.h>
+
+//most dimensions the rows can be spread over
+#define MAX_ROW_DIMS	32
+
+//the dimensions the output rows run over, in row-major order (the last dimension changes fastest from row to row)
+//rows are read in windows that are contiguous in row order: dimensions before splitDim advance one index per
+//window, splitDim advances splitCount indices, and the dimensions after it are always read whole
+typedef struct
+{
+	int numDims;
+	int dimIDs[MAX_ROW_DIMS];
+	//number of indices output along each dimension, row index i along dimension d is file index
+	//dimStarts[d] + i*dimStrides[d] (all of them, 0 + i*1, unless the dimension has been restricted)
+	size_t dimLengths[MAX_ROW_DIMS];
+	size_t dimStarts[MAX_ROW_DIMS];
+	ptrdiff_t dimStrides[MAX_ROW_DIMS];
+	size_t numRows;
+
+	int splitDim;
+	size_t splitCount;
+	size_t windowRows;
+	size_t numWindows;
+} RowSpace;
+
+//the part of the row space covered by one window
+typedef struct
+{
+	size_t start[MAX_ROW_DIMS];
+	size_t count[MAX_ROW_DIMS];
+	size_t numRows;
+} RowWindow;
+
+//how a variable's own dimensions map onto the row space, rowDims[i] is the row dimension of its i'th dimension
+//row dimensions the variable doesn't have are broadcast (its values repeat along them)
+typedef struct
+{
+	int numDims;
+	int rowDims[MAX_ROW_DIMS];
+} ColumnShape;
+
+void InitRowSpace(RowSpace *space);
+//add a dimension to the end of the row order if it isn't already in it
+//returns its position in the row order, or -1 if there are already MAX_ROW_DIMS dimensions
+int AddRowDimension(RowSpace *space, int dimID, size_t length);
+//get the position of a dimension in the row order, or -1 if it isn't part of the row space
+int FindRowDimension(const RowSpace *space, int dimID);
+//only output every stride'th index of a dimension, count of them from file index start (count 0 for as many as there are)
+void RestrictRowDimension(RowSpace *space, int position, size_t start, size_t count, size_t stride);
+
+//split the row space into windows of at most targetRows rows (or whole runs of the fastest dimension if that's longer)
+//alignment, if not NULL, gives boundaries along each dimension that windows shouldn't straddle (ex: storage chunk sizes)
+void PlanRowWindows(RowSpace *space, size_t targetRows, const size_t *alignment);
+void GetRowWindow(const RowSpace *space, size_t windowIndex, RowWindow *window);
+
+//get the file start/count/stride of a variable's hyperslab for a window (in the variable's own dimension order)
+//returns the number of values in the hyperslab
+size_t GetColumnSlab(const RowSpace *space, const ColumnShape *shape, const RowWindow *window,
+	size_t *start, size_t *count, ptrdiff_t *stride);
+//check if a variable's hyperslabs come out in window row order for every window, so they can be read straight
+//into the row buffer without rearranging
+int IsColumnInRowOrder(const RowSpace *space, const ColumnShape *shape);
+//spread a variable's hyperslab out over the rows of a window, repeating values along broadcast dimensions and
+//reordering transposed ones
+void ExpandColumnToRows(const RowSpace *space, const ColumnShape *shape, const RowWindow *window,
+	const void *slab, size_t elementSize, void *rows);
+
+#endif
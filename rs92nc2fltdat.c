@@ -6,497 +6,568 @@
 #include <stdio.h>
 #include <time.h>
 #include <netcdf.h>
+#include "ncdataset.h"
+#include "batch.h"
+#include "watch.h"
+#include "gzipstream.h"
+#include "unitconvert.h"
+#include "columnmap.h"
+#include "convertstats.h"
+#include "manifest.h"
+#include "cftime.h"
 
 #define VERSION		1.001
 
-//a macro for copying a substring
-//#define substr(dest, src, start, length) (strlcpy(dest, src+start, length+1))
-#define substr(dest, src, start, length) (snprintf(dest, length+1, "%s", src+start))
+//options shared by every file converted
+typedef struct
+{
+	//--gzip compresses the output as it's written, on gzipThreads threads
+	int gzip;
+	int gzipLevel;
+	int gzipThreads;
+	//read classic and 64-bit offset files straight out of a memory map (--no-mmap turns this off)
+	int mapClassic;
+	//the output columns, the built-in RS-92 mapping or a --columns file
+	const ColumnMap *columnMap;
+	//--stats prints each file's timings and counters to stderr, --stats-dir writes them to a JSON file per input
+	int statsToStderr;
+	const char *statsDir;
+	//where each file's stats are left for the batch to collect
+	ConvertStats *fileStats;
+} ConvertOptions;
 
-//todo: make the program exit somehow
-void HandleNCError(char* funcName, int status)
+//get the name of the flt.dat file written next to a NetCDF file, in a new string (an OutputNameFunction)
+static char *GetOutputFilename(const char *filename, const void *context)
 {
-	printf("NetCDF error in: %s with status: %d\n", funcName, status);
-	exit(status);
+	const ConvertOptions *options = (const ConvertOptions *)context;
+	
+	//allocate space for the flt.dat filename, plus some room for the longer extension, etc
+	char *fltDatFilename = malloc((strlen(filename) + 11)*sizeof(char));
+	strcpy(fltDatFilename, filename);
+	char *periodLocation = strrchr(fltDatFilename, '.');
+	if (periodLocation != NULL && strchr(periodLocation, '/') == NULL) *periodLocation = '\0';
+	strcat(fltDatFilename, "flt.dat");
+	if (options->gzip) strcat(fltDatFilename, ".gz");
+	return fltDatFilename;
 }
 
-//storage for individual NetCDF variable raw data
-typedef struct
-{
-	nc_type type;
-	void *data;
-} VariableData;
-
-int main (int argc, char** argv)
+//convert a single GRUAN RS-92 NetCDF file into a flt.dat file next to it, returns 0 on success or a nonzero error status
+int ConvertFile(const char *filename, void *context)
 {
+	const ConvertOptions *options = (const ConvertOptions *)context;
+	const ColumnMap *columnMap = options->columnMap;
+	
 	//define some generic loop indices
 	int i, j;
 	
-	//make sure a filename was provided
-	if (argc < 2)
+	int status = 0;
+	int ncResult;
+	
+	//everything that needs cleaning up, so a failure part way through only abandons this file
+	NcDataset *dataset = NULL;
+	ReadPlan *plan = NULL;
+	char *fltDatFilename = NULL;
+	FILE *fltFile = NULL;
+	char **variableNames = NULL;
+	char *launchTimeStr = NULL;
+	int *planColumns = NULL;
+	float *floatValues = NULL;
+	double *outputColumns = NULL;
+	double **columns = NULL;
+	
+	//timings and counters, every phase's lap runs from the end of the one before
+	ConvertStats stats;
+	InitConvertStats(&stats);
+	stats.numFiles = 1;
+	ConvertPhase phase = PHASE_OPEN;
+	double fileStart = GetMonotonicTime();
+	double lapStart = fileStart;
+	
+	fltDatFilename = GetOutputFilename(filename, options);
+	
+	//open the NetCDF file/dataset, classic and 64-bit offset files are memory-mapped too
+	status = OpenNcDataset(filename, options->mapClassic, &dataset);
+	if (status != 0) goto cleanup;
+	lapStart = LapPhase(&stats, phase, lapStart);
+	phase = PHASE_METADATA;
+	
+	printf("opened NetCDF file: %s", filename);
+	printf("output flt.dat filename: %s\n", fltDatFilename);
+	
+	if (dataset->numDims != 1)
 	{
-		puts("NetCDF filename argument required");
-		return -1;
+		puts("error: only 1-dimensional NetCDF files are supported for now");
+		status = -1;
+		goto cleanup;
 	}
 	
-	//loop through every input file
-	int argIndex;
-	for (argIndex = 1; argIndex < argc; argIndex++)
+	//show some of the NetCDF file information on the console
+	status = PrintDatasetInfo(dataset);
+	if (status != 0) goto cleanup;
+	
+	//open/create the flt.dat file for outputting data
+	//todo: better file name
+	if (options->gzip) fltFile = OpenGzipFile(fltDatFilename, options->gzipThreads, options->gzipLevel);
+	else fltFile = fopen(fltDatFilename, "w");
+	if (fltFile == NULL)
 	{
-		char* filename = argv[argIndex];
-		size_t filenameLength = strlen(filename);
-		
-		//allocate space for the flt.dat filename, plus some room for the longer extension, etc
-		char *fltDatFilename = malloc((filenameLength + 7)*sizeof(char));
-		strcpy(fltDatFilename, filename);
-		char *periodLocation = strrchr(fltDatFilename, '.');
-		*periodLocation = '\0';
-		strcat(fltDatFilename, "flt.dat");
-		
-		//open the NetCDF file/dataset
-		int datasetID;
-		int ncResult;
-		ncResult = nc_open(filename, NC_NOWRITE, &datasetID);
-		if (ncResult != NC_NOERR) HandleNCError("nc_open", ncResult);
-		
-		printf("opened NetCDF file: %s", filename);
-		printf("output flt.dat filename: %s\n", fltDatFilename);
-		
-		//get basic information about the NetCDF file
-		int numDims, numVars, numGlobalAtts, unlimitedDimID;
-		ncResult = nc_inq(datasetID, &numDims, &numVars, &numGlobalAtts, &unlimitedDimID);
-		if (ncResult != NC_NOERR) HandleNCError("nc_inq", ncResult);
-		int formatVersion;
-		ncResult = nc_inq_format(datasetID, &formatVersion);
-		if (ncResult != NC_NOERR) HandleNCError("nc_inq_format", ncResult);
-		
-		if (numDims != 1)
+		printf("error: could not create output file: %s\n", fltDatFilename);
+		status = -1;
+		goto cleanup;
+	}
+	
+	//get the current GMT date/time
+	time_t currentTime;
+	time(&currentTime);
+	struct tm *currentTimeStruct = gmtime(&currentTime);
+	
+	printf("current gmt time: %d/%d/%d %d:%d:%d\n", currentTimeStruct->tm_year+1900, currentTimeStruct->tm_mon+1, currentTimeStruct->tm_mday, 
+		currentTimeStruct->tm_hour, currentTimeStruct->tm_min, currentTimeStruct->tm_sec);
+	
+	//get the launch date/time attribute (allocated at its full length, however long it is)
+	ncResult = GetTextAttribute(dataset->datasetID, NC_GLOBAL, "g.Ascent.StartTime", &launchTimeStr);
+	if (ncResult != NC_NOERR)
+	{
+		status = HandleNCError("nc_get_att_text", ncResult);
+		goto cleanup;
+	}
+	//parse the launch date/time (ex: 2012-06-14T18:05:32.000Z)
+	DateTime launchTime;
+	if (ParseDateTime(launchTimeStr, &launchTime) != 0)
+	{
+		printf("error: couldn't read the launch time g.Ascent.StartTime: %s\n", launchTimeStr);
+		status = -1;
+		goto cleanup;
+	}
+	int launchYear = launchTime.year;
+	int launchMonth = launchTime.month;
+	int launchDay = launchTime.day;
+	int launchHour = launchTime.hour;
+	int launchMinute = launchTime.minute;
+	int launchSecond = (int)launchTime.second;
+	
+	printf("launch gmt time: %d/%d/%d %d:%d:%d\n", launchYear, launchMonth, launchDay, launchHour, launchMinute, launchSecond);
+	
+	//output the flt.dat header
+	fprintf(fltFile, "Extended NOAA/GMD preliminary data %02d-%02d-%04d %02d:%02d:%02d [GMT], nc2fltdat version %.3f\r\n", 
+		currentTimeStruct->tm_mday, currentTimeStruct->tm_mon+1, currentTimeStruct->tm_year+1900, currentTimeStruct->tm_hour, currentTimeStruct->tm_min, currentTimeStruct->tm_sec, VERSION);
+	
+	fprintf(fltFile, "Software written by Allen Jordan, NOAA\r\n");
+	fprintf(fltFile, "               Header lines = 16\r\n");
+	fprintf(fltFile, "               Data columns = %d\r\n", columnMap->numColumns);
+	fprintf(fltFile, "                 Date [GMT] = %02d-%02d-%04d\r\n", launchDay, launchMonth, launchYear);
+	fprintf(fltFile, "                 Time [GMT] = %02d:%02d:%02d\r\n", launchHour, launchMinute, launchSecond);
+	fprintf(fltFile, "            Instrument type = %s\r\n", columnMap->instrument);
+	fprintf(fltFile, "\r\n\r\n");
+	fprintf(fltFile, "    THE DATA CONTAINED IN THIS FILE ARE PRELIMINARY\r\n");
+	fprintf(fltFile, "     AND SUBJECT TO REPROCESSING AND VERIFICATION\r\n");
+	fprintf(fltFile, "\r\n\r\n\r\n");
+	WriteColumnHeaders(fltFile, columnMap);
+	
+	//look up the variables that get output before reading anything, so only those are read
+	variableNames = (char **)malloc(columnMap->numColumns * sizeof(char*));
+	int numVariableNames = 0;
+	for (i = 0; i < columnMap->numColumns; i++)
+	{
+		char *variableName = columnMap->columns[i].variable;
+		int varID;
+		if (variableName == NULL) continue;
+		ncResult = nc_inq_varid(dataset->datasetID, variableName, &varID);
+		if (ncResult != NC_NOERR)
 		{
-			puts("error: only 1-dimensional NetCDF files are supported for now");
-			return -1;
+			char funcName[NC_MAX_NAME+32];
+			snprintf(funcName, sizeof(funcName), "nc_inq_varid (%s)", variableName);
+			status = HandleNCError(funcName, ncResult);
+			goto cleanup;
 		}
-		
-		//show some of the NetCDF file information on the console
-		printf("# dims: %d\n# vars: %d\n# global atts: %d\n", numDims, numVars, numGlobalAtts);
-		if (unlimitedDimID != -1) puts("contains unlimited dimension");
-		switch (formatVersion)
+		for (j = 0; j < numVariableNames && strcmp(variableNames[j], variableName) != 0; j++);
+		if (j == numVariableNames) variableNames[numVariableNames++] = variableName;
+	}
+	
+	//plan reading them a window of rows at a time, converting everything but floats to doubles as they're read
+	PlanOptions planOptions;
+	InitPlanOptions(&planOptions);
+	planOptions.varPatterns = variableNames;
+	planOptions.numVarPatterns = numVariableNames;
+	planOptions.readAsDouble = 1;
+	planOptions.verbose = 1;
+	status = CreateReadPlan(dataset, &planOptions, &plan);
+	if (status != 0) goto cleanup;
+	
+	//every column that gets output must have been planned (constant columns have no variable, -1)
+	planColumns = (int *)malloc(columnMap->numColumns * sizeof(int));
+	for (i = 0; i < columnMap->numColumns; i++)
+	{
+		planColumns[i] = -1;
+		if (columnMap->columns[i].variable == NULL) continue;
+		planColumns[i] = FindPlanColumn(plan, columnMap->columns[i].variable);
+		if (planColumns[i] < 0 || plan->columns[planColumns[i]]->shape.numDims != 1 || plan->columns[planColumns[i]]->type == NC_CHAR)
 		{
-			case NC_FORMAT_CLASSIC:
-				puts("classic file format");
-				break;
-			case NC_FORMAT_64BIT:
-				puts("64-bit file format");
-				break;
-			case NC_FORMAT_NETCDF4:
-				puts("netcdf4 file format");
-				break;
-			case NC_FORMAT_NETCDF4_CLASSIC:
-				puts("netcdf4 classic format");
-				break;
-			default:
-				puts("unrecognized file format");
-				return -1;
-				break;
+			printf("error: the %s variable could not be loaded\n", columnMap->columns[i].variable);
+			status = -1;
+			goto cleanup;
 		}
-		
-		//int dimID;
-		//for (dimID = 0; dimID < numDims; dimID++)
-		//{
-		//get dimension names and lengths
-		char dimName[NC_MAX_NAME+1];
-		size_t dimLength;
-		ncResult = nc_inq_dim(datasetID, 0, dimName, &dimLength);
-		if (ncResult != NC_NOERR) HandleNCError("nc_inq_dim", ncResult);
-		
-		printf("dimension: %s length: %d\n", dimName, dimLength);
-		//}
-		
-		//open/create the flt.dat file for outputting data
-		//todo: better file name
-		FILE *fltFile = fopen(fltDatFilename, "w");
-		
-		//get the current GMT date/time
-		time_t currentTime;
-		time(&currentTime);
-		struct tm *currentTimeStruct = gmtime(&currentTime);
-		
-		printf("current gmt time: %d/%d/%d %d:%d:%d\n", currentTimeStruct->tm_year+1900, currentTimeStruct->tm_mon+1, currentTimeStruct->tm_mday, 
-			currentTimeStruct->tm_hour, currentTimeStruct->tm_min, currentTimeStruct->tm_sec);
-		
-		//get the launch date/time attribute
-		char launchTimeStr[100];
-		ncResult = nc_get_att_text(datasetID, NC_GLOBAL, "g.Ascent.StartTime", launchTimeStr);
-		if (ncResult != NC_NOERR) HandleNCError("nc_get_att_text", ncResult);
-		//split the launch date/time string into token strings
-		char yearStr[10];
-		substr(yearStr, launchTimeStr, 0, 4);
-		char monStr[10];
-		substr(monStr, launchTimeStr, 5, 2);
-		char dayStr[10];
-		substr(dayStr, launchTimeStr, 8, 2);
-		char hourStr[10];
-		substr(hourStr, launchTimeStr, 11, 2);
-		char minStr[10];
-		substr(minStr, launchTimeStr, 14, 2);
-		char secStr[10];
-		substr(secStr, launchTimeStr, 17, 2);
-		//convert the launch date/time into a tm structure
-		struct tm launchTimeStruct;
-		int launchYear = atoi(yearStr);
-		int launchMonth = atoi(monStr);
-		int launchDay = atoi(dayStr);
-		int launchHour = atoi(hourStr);
-		int launchMinute = atoi(minStr);
-		int launchSecond = atoi(secStr);
-		
-		printf("launch gmt time: %d/%d/%d %d:%d:%d\n", launchYear, launchMonth, launchDay, launchHour, launchMinute, launchSecond);
-		
-		//output the flt.dat header
-		fprintf(fltFile, "Extended NOAA/GMD preliminary data %02d-%02d-%04d %02d:%02d:%02d [GMT], nc2fltdat version %.3f\r\n", 
-			currentTimeStruct->tm_mday, currentTimeStruct->tm_mon+1, currentTimeStruct->tm_year+1900, currentTimeStruct->tm_hour, currentTimeStruct->tm_min, currentTimeStruct->tm_sec, VERSION);
-		
-		fprintf(fltFile, "Software written by Allen Jordan, NOAA\r\n");
-		fprintf(fltFile, "               Header lines = 16\r\n");
-		fprintf(fltFile, "               Data columns = 12\r\n");
-		fprintf(fltFile, "                 Date [GMT] = %02d-%02d-%04d\r\n", launchDay, launchMonth, launchYear);
-		fprintf(fltFile, "                 Time [GMT] = %02d:%02d:%02d\r\n", launchHour, launchMinute, launchSecond);
-		fprintf(fltFile, "            Instrument type = Vaisala RS92\r\n");
-		fprintf(fltFile, "\r\n\r\n");
-		fprintf(fltFile, "    THE DATA CONTAINED IN THIS FILE ARE PRELIMINARY\r\n");
-		fprintf(fltFile, "     AND SUBJECT TO REPROCESSING AND VERIFICATION\r\n");
-		fprintf(fltFile, "\r\n\r\n\r\n");
-		fprintf(fltFile, "      Time,     Press,       Alt,      Temp,        RH,     TFp V,   GPS lat,   GPS lon,   GPS alt,      Wind,  Wind Dir,        Fl\r\n");
-		fprintf(fltFile, "     [min],     [hpa],      [km],   [deg C],       [%%],   [deg C],     [deg],     [deg],      [km],     [m/s],     [deg],        []\r\n");
-		
-		//storage for all variables in the NetCDF file
-		//todo: watch out for segfaults, maybe use nc_get_vara_ to get pieces instead of whole variables
-		VariableData **variableDataList = (VariableData **)malloc(numVars * sizeof(VariableData*));
-		char **standardNameList = (char **)malloc(numVars * sizeof(char*));
-		//char **longNameList = (char **)malloc(numVars * sizeof(char*));
-		//char **unitStringList = (char **)malloc(numVars * sizeof(char*));
-		
-		//loop through all the variables
-		int varID;
-		for (varID=0; varID<numVars; varID++)
+	}
+	
+	//each block of rows is converted to the output units a whole column at a time, then written out row by row
+	//(constant columns are filled in once)
+	size_t windowRows = plan->windowRows;
+	floatValues = (float *)malloc(windowRows * sizeof(float));
+	outputColumns = (double *)malloc(columnMap->numColumns * windowRows * sizeof(double));
+	columns = (double **)malloc(columnMap->numColumns * sizeof(double*));
+	stats.allocations += plan->numAllocations;
+	stats.allocatedBytes += plan->allocatedBytes;
+	CountAllocation(&stats, windowRows * sizeof(float));
+	CountAllocation(&stats, columnMap->numColumns * windowRows * sizeof(double));
+	for (i = 0; i < columnMap->numColumns; i++)
+	{
+		columns[i] = outputColumns + i*windowRows;
+		size_t row;
+		if (planColumns[i] < 0)
+		{
+			for (row = 0; row < windowRows; row++) columns[i][row] = columnMap->columns[i].constant;
+		}
+	}
+	
+	//reading each block is timed apart from converting and writing it, and the time spent writing the rows out is
+	//taken back out of formatting
+	double writeSeconds = 0;
+	RowBlock block;
+	for (;;)
+	{
+		lapStart = LapPhase(&stats, phase, lapStart);
+		phase = PHASE_READ;
+		status = NextRowBlock(plan, &block);
+		lapStart = LapPhase(&stats, phase, lapStart);
+		phase = PHASE_FORMAT;
+		if (status != 0) goto cleanup;
+		if (block.numRows == 0) break;
+		
+		for (i = 0; i < columnMap->numColumns; i++)
 		{
-			//get information about the variable
-			char varName[NC_MAX_NAME+1];
-			nc_type varType;
-			int numVarDims;
-			int varDimIDs[NC_MAX_VAR_DIMS];
-			int numVarAtts;
-			ncResult = nc_inq_var(datasetID, varID, varName, &varType, &numVarDims, varDimIDs, &numVarAtts);
-			if (ncResult != NC_NOERR) HandleNCError("nc_inq_var", ncResult);
-			
-			//output variable info to console
-			printf("variable: %s # dims: %d # atts: %d type: %d\n", varName, numVarDims, numVarAtts, (int)varType);
-			
-			//output variable name to the flt.dat file
-			//fprintf(fltFile, "%s", varName);
-			//if (varID != (numVars-1)) fprintf(fltFile, ", ");
-			
-			/*//see if there is an attribute for the variable standard name, and store it if there is
-			int standardNameAttLen = 0;
-			ncResult = nc_inq_attlen(datasetID, varID, "standard_name", &standardNameAttLen);
-			if (ncResult == NC_NOERR)
+			const ColumnMapping *mapping = &columnMap->columns[i];
+			int column = planColumns[i];
+			if (column < 0) continue;
+			if (block.columnInfo[column]->type == NC_FLOAT)
 			{
-				//allocate enough space for the units string
-				char *standardNameValueStr = (char *) malloc(standardNameAttLen + 1);
-				ncResult = nc_get_att_text(datasetID, varID, "standard_name", standardNameValueStr);
-				if (ncResult != NC_NOERR) HandleNCError("nc_get_att_text", ncResult);
-				//make sure the string is null terminated (sometimes it won't be, apparently)
-				standardNameValueStr[standardNameAttLen] = '\0';
-				standardNameList[varID] = standardNameValueStr;
+				//floats straight out of a mapped file only need byte swapping first
+				const float *values = (const float *)block.columns[column];
+				if (block.columnInfo[column]->mapped)
+				{
+					SwapFloatColumn(block.columns[column], block.strides[column], block.numRows, floatValues);
+					values = floatValues;
+				}
+				ConvertFloatColumn(values, block.numRows, &mapping->conversion, columns[i]);
 			}
-			else
+			else ConvertDoubleColumn((const double *)block.columns[column], block.numRows, &mapping->conversion, columns[i]);
+		}
+		WriteColumnRows(fltFile, columnMap, columns, block.numRows, &writeSeconds);
+		stats.rows += block.numRows;
+	}
+	lapStart = LapPhase(&stats, phase, lapStart);
+	stats.phaseSeconds[PHASE_FORMAT] -= writeSeconds;
+	stats.phaseSeconds[PHASE_WRITE] += writeSeconds;
+	stats.cells = stats.rows * columnMap->numColumns;
+	phase = PHASE_CLOSE;
+	
+cleanup:
+	//whatever phase a failure happened in gets the time up to here
+	lapStart = LapPhase(&stats, phase, lapStart);
+	
+	free(variableNames);
+	free(launchTimeStr);
+	free(planColumns);
+	free(floatValues);
+	free(outputColumns);
+	free(columns);
+	
+	//close the flt.dat file
+	if (fltFile != NULL && fclose(fltFile) != 0)
+	{
+		puts("error: failed writing output file");
+		if (status == 0) status = -1;
+	}
+	
+	//close the NetCDF file
+	if (dataset != NULL)
+	{
+		ncResult = CloseNcDataset(dataset);
+		if (ncResult != NC_NOERR && status == 0) status = HandleNCError("nc_close", ncResult);
+	}
+	lapStart = LapPhase(&stats, PHASE_CLOSE, lapStart);
+	
+	//the time and size of each variable read
+	int numVarStats = 0;
+	VariableStats *varStats = (VariableStats *)malloc((((plan != NULL) ? plan->numColumns : 0) + 1) * sizeof(VariableStats));
+	for (i = 0; plan != NULL && i < plan->numColumns; i++)
+	{
+		varStats[numVarStats].name = plan->columns[i]->name;
+		varStats[numVarStats].readSeconds = plan->columns[i]->readSeconds;
+		varStats[numVarStats].bytesRead = plan->columns[i]->bytesRead;
+		stats.bytesRead += plan->columns[i]->bytesRead;
+		numVarStats++;
+	}
+	
+	stats.numFailed = (status != 0);
+	stats.totalSeconds = lapStart - fileStart;
+	FinishConvertStats(&stats, fltDatFilename);
+	ReportFileStats(filename, status, &stats, varStats, numVarStats, options->statsToStderr, options->statsDir);
+	if (options->fileStats != NULL) *options->fileStats = stats;
+	free(varStats);
+	FreeReadPlan(plan);
+	free(fltDatFilename);
+	
+	printf("\r\n");
+	
+	return status;
+}
+
+void PrintUsage()
+{
+	puts("usage: rs92nc2fltdat [options] file.nc [file2.nc ...]");
+	puts("  -j N                convert N files at a time in parallel worker processes, largest first");
+	puts("  --files-from FILE   also convert the files listed in FILE, one per line (- reads the list from stdin)");
+	puts("  --manifest FILE     skip the inputs whose outputs are current according to FILE, and record the ones converted");
+	puts("  --force             with --manifest, convert every input anyway");
+	puts("  --watch DIR         keep running, converting each .nc file written to DIR (can be repeated) on -j workers");
+	puts("                      that stay up between files, until interrupted (any files given are converted first)");
+	puts("  --settle MS         with --watch, wait until a file has gone MS milliseconds without being written after");
+	printf("                      it's closed before converting it (default %d)\n", DEFAULT_SETTLE_MS);
+	puts("  --gzip              write gzip compressed output (flt.dat.gz), compressed in parallel blocks");
+	puts("  --gzip-level N      gzip compression level from 1 (fastest, the default) to 9 (smallest)");
+	puts("  --gzip-threads N    compress on N threads (defaults to the CPUs shared out between the -j jobs)");
+	puts("  --columns FILE      map the variables onto output columns as listed in FILE instead of the RS-92 defaults");
+	puts("  --no-mmap           read classic and 64-bit offset files through the NetCDF library instead of a memory map");
+	puts("  --simd PATH         convert units with the scalar, sse2 or avx2 kernels (defaults to the best the CPU supports)");
+	puts("  --stats             print each file's phase timings and counters (and the batch's) to stderr as JSON lines");
+	puts("  --stats-dir DIR     write them to DIR/<file>.stats.json for each input, and DIR/batch.stats.json");
+	puts("                      (with --watch, each file's latency and the throughput so far go to DIR/watch.stats.json)");
+}
+
+int main (int argc, char** argv)
+{
+	ConvertOptions options;
+	options.gzip = 0;
+	options.gzipLevel = GZIP_DEFAULT_LEVEL;
+	//(0 until the number of jobs is known)
+	options.gzipThreads = 0;
+	options.mapClassic = 1;
+	options.columnMap = NULL;
+	options.statsToStderr = 0;
+	options.statsDir = NULL;
+	options.fileStats = NULL;
+	const char *columnMapFilename = NULL;
+	int numJobs = 1;
+	const char *manifestFilename = NULL;
+	int force = 0;
+	WatchOptions watchOptions;
+	watchOptions.directories = NULL;
+	watchOptions.numDirectories = 0;
+	watchOptions.settleMs = DEFAULT_SETTLE_MS;
+	
+	//pull the options out of the argument list, leaving only the input filenames
+	FileList inputFiles;
+	InitFileList(&inputFiles);
+	int argIndex;
+	for (argIndex = 1; argIndex < argc; argIndex++)
+	{
+		char *arg = argv[argIndex];
+		if (strcmp(arg, "-j") == 0 && argIndex+1 < argc)
+		{
+			numJobs = atoi(argv[++argIndex]);
+			if (numJobs < 1)
 			{
-				char *emptyHeapStr = malloc(1*sizeof(char));
-				emptyHeapStr[0] = '\0';
-				standardNameList[varID] = emptyHeapStr;
+				puts("error: -j must be at least 1");
+				return -1;
 			}
-			
-			//see if there is an attribute for the variable long name, and store it if there is
-			int longNameAttLen = 0;
-			ncResult = nc_inq_attlen(datasetID, varID, "long_name", &longNameAttLen);
-			if (ncResult == NC_NOERR)
+		}
+		else if (strcmp(arg, "--files-from") == 0 && argIndex+1 < argc)
+		{
+			if (ReadFileManifest(&inputFiles, argv[++argIndex]) != 0) return -1;
+		}
+		else if (strcmp(arg, "--manifest") == 0 && argIndex+1 < argc)
+		{
+			manifestFilename = argv[++argIndex];
+		}
+		else if (strcmp(arg, "--force") == 0)
+		{
+			force = 1;
+		}
+		else if (strcmp(arg, "--watch") == 0 && argIndex+1 < argc)
+		{
+			watchOptions.directories = (char **)realloc(watchOptions.directories, (watchOptions.numDirectories+1) * sizeof(char*));
+			watchOptions.directories[watchOptions.numDirectories++] = argv[++argIndex];
+		}
+		else if (strcmp(arg, "--settle") == 0 && argIndex+1 < argc)
+		{
+			char *end;
+			watchOptions.settleMs = (int)strtol(argv[++argIndex], &end, 10);
+			if (*end != '\0' || watchOptions.settleMs < 0)
 			{
-				//allocate enough space for the units string
-				char *longNameValueStr = (char *) malloc(longNameAttLen + 1);
-				ncResult = nc_get_att_text(datasetID, varID, "long_name", longNameValueStr);
-				if (ncResult != NC_NOERR) HandleNCError("nc_get_att_text", ncResult);
-				//make sure the string is null terminated (sometimes it won't be, apparently)
-				longNameValueStr[longNameAttLen] = '\0';
-				longNameList[varID] = longNameValueStr;
+				puts("error: --settle must be a number of milliseconds");
+				return -1;
 			}
-			else
+		}
+		else if (strcmp(arg, "--gzip") == 0)
+		{
+			options.gzip = 1;
+		}
+		else if (strcmp(arg, "--gzip-level") == 0 && argIndex+1 < argc)
+		{
+			options.gzipLevel = atoi(argv[++argIndex]);
+			if (options.gzipLevel < 1 || options.gzipLevel > 9)
 			{
-				char *emptyHeapStr = malloc(1*sizeof(char));
-				emptyHeapStr[0] = '\0';
-				longNameList[varID] = emptyHeapStr;
+				puts("error: --gzip-level must be between 1 and 9");
+				return -1;
 			}
-			
-			//see if there is an attribute for the variable units description, and store it if there is
-			int unitsAttLen = 0;
-			ncResult = nc_inq_attlen(datasetID, varID, "units", &unitsAttLen);
-			if (ncResult == NC_NOERR)
+		}
+		else if (strcmp(arg, "--gzip-threads") == 0 && argIndex+1 < argc)
+		{
+			options.gzipThreads = atoi(argv[++argIndex]);
+			if (options.gzipThreads < 1)
 			{
-				//allocate enough space for the units string
-				char *unitsValueStr = (char *) malloc(unitsAttLen + 1);
-				ncResult = nc_get_att_text(datasetID, varID, "units", unitsValueStr);
-				if (ncResult != NC_NOERR) HandleNCError("nc_get_att_text", ncResult);
-				//make sure the string is null terminated (sometimes it won't be, apparently)
-				unitsValueStr[unitsAttLen] = '\0';
-				unitStringList[varID] = unitsValueStr;
+				puts("error: --gzip-threads must be at least 1");
+				return -1;
 			}
-			else
-			{
-				char *emptyHeapStr = malloc(1*sizeof(char));
-				emptyHeapStr[0] = '\0';
-				unitStringList[varID] = emptyHeapStr;
-			}*/
-			
-			
-			//make sure the variable only has 1 dimension
-			if (numVarDims != 1) puts("warning: only 1-dimensional variables are supported for now... skipping");
-			else
-			{
-				//storage for this variable's data structure
-				VariableData *variableData = (VariableData *)malloc(sizeof(VariableData));
-				variableData->type = varType;
-				
-				//depending on the type, allocate storage for this variable's raw data contained in the structure
-				switch (varType)
-				{
-					case NC_BYTE:
-					{
-						variableData->data = malloc(dimLength * sizeof(unsigned char));
-						ncResult = nc_get_var_uchar(datasetID, varID, (unsigned char*)variableData->data);
-						if (ncResult != NC_NOERR) HandleNCError("nc_get_var", ncResult);
-						break;
-					}
-					case NC_CHAR:
-					{
-						variableData->data = malloc(dimLength * sizeof(char));
-						ncResult = nc_get_var_text(datasetID, varID, (char*)variableData->data);
-						if (ncResult != NC_NOERR) HandleNCError("nc_get_var", ncResult);
-						break;
-					}
-					case NC_SHORT:
-					{
-						variableData->data = malloc(dimLength * sizeof(short));
-						ncResult = nc_get_var_short(datasetID, varID, (short*)variableData->data);
-						if (ncResult != NC_NOERR) HandleNCError("nc_get_var", ncResult);
-						break;
-					}
-					case NC_INT:
-					{
-						variableData->data = malloc(dimLength * sizeof(int));
-						ncResult = nc_get_var_int(datasetID, varID, (int*)variableData->data);
-						if (ncResult != NC_NOERR) HandleNCError("nc_get_var", ncResult);
-						break;
-					}
-					case NC_FLOAT:
-					{
-						variableData->data = malloc(dimLength * sizeof(float));
-						ncResult = nc_get_var_float(datasetID, varID, (float*)variableData->data);
-						if (ncResult != NC_NOERR) HandleNCError("nc_get_var", ncResult);
-						break;
-					}
-					case NC_DOUBLE:
-					{
-						variableData->data = malloc(dimLength * sizeof(double));
-						ncResult = nc_get_var_double(datasetID, varID, (double*)variableData->data);
-						if (ncResult != NC_NOERR) HandleNCError("nc_get_var", ncResult);
-						break;
-					}
-					default:
-					{
-						puts("warning: invalid variable type");
-						break;
-					}
-				}//end of type switch
-				
-				//store the variable data structure in the list of all variable data structures, to be used later when outputting
-				variableDataList[varID] = variableData;
-				
-			}//end of num var dimensions check
-		}//end of variable loop
-		
-		//output a newline after the variable names flt.dat header line
-		//fprintf(fltFile, "\r\n");
-		
-		/*//output the variable standard names
-		for (i=0; i<numVars; i++)
+		}
+		else if (strcmp(arg, "--columns") == 0 && argIndex+1 < argc)
 		{
-			fprintf(fltFile, "%s", standardNameList[i]);
-			if (i != (numVars-1)) fprintf(fltFile, ", ");
+			columnMapFilename = argv[++argIndex];
 		}
-		fprintf(fltFile, "\r\n");
-		
-		//output the variable long names
-		for (i=0; i<numVars; i++)
+		else if (strcmp(arg, "--no-mmap") == 0)
 		{
-			fprintf(fltFile, "%s", longNameList[i]);
-			if (i != (numVars-1)) fprintf(fltFile, ", ");
+			options.mapClassic = 0;
 		}
-		fprintf(fltFile, "\r\n");
-		
-		//output the variable units
-		for (i=0; i<numVars; i++)
+		else if (strcmp(arg, "--stats") == 0)
 		{
-			char *unitsName = unitStringList[i];
-			if (unitsName[0] != '[')
-				fprintf(fltFile, "[");
-			
-			fprintf(fltFile, "%s", unitsName);
-			
-			if (unitsName[strlen(unitsName)-1] != ']')
-				fprintf(fltFile, "]");
-			
-			if (i != (numVars-1)) fprintf(fltFile, ", ");
+			options.statsToStderr = 1;
 		}
-		fprintf(fltFile, "\r\n");*/
-		
-		
-		
-		
-		
-		
-		
-		int timeIndex;
-		ncResult = nc_inq_varid(datasetID, "time", &timeIndex);
-		if (ncResult != NC_NOERR) HandleNCError("nc_inq_varid (time)", ncResult);
-		int pressureIndex;
-		ncResult = nc_inq_varid(datasetID, "press", &pressureIndex);
-		if (ncResult != NC_NOERR) HandleNCError("nc_inq_varid (press)", ncResult);
-		int temperatureIndex;
-		ncResult = nc_inq_varid(datasetID, "temp", &temperatureIndex);
-		if (ncResult != NC_NOERR) HandleNCError("nc_inq_varid (temp)", ncResult);
-		int vaisRHIndex;
-		ncResult = nc_inq_varid(datasetID, "rh", &vaisRHIndex);
-		if (ncResult != NC_NOERR) HandleNCError("nc_inq_varid (rh)", ncResult);
-		int windDirIndex;
-		ncResult = nc_inq_varid(datasetID, "wdir", &windDirIndex);
-		if (ncResult != NC_NOERR) HandleNCError("nc_inq_varid (wdir)", ncResult);
-		int windSpeedIndex;
-		ncResult = nc_inq_varid(datasetID, "wspeed", &windSpeedIndex);
-		if (ncResult != NC_NOERR) HandleNCError("nc_inq_varid (wspeed)", ncResult);
-		int geopotAltIndex;
-		ncResult = nc_inq_varid(datasetID, "geopot", &geopotAltIndex);
-		if (ncResult != NC_NOERR) HandleNCError("nc_inq_varid (geopot)", ncResult);
-		int lonIndex;
-		ncResult = nc_inq_varid(datasetID, "lon", &lonIndex);
-		if (ncResult != NC_NOERR) HandleNCError("nc_inq_varid (lon)", ncResult);
-		int latIndex;
-		ncResult = nc_inq_varid(datasetID, "lat", &latIndex);
-		if (ncResult != NC_NOERR) HandleNCError("nc_inq_varid (lat)", ncResult);
-		int gpsAltIndex;
-		ncResult = nc_inq_varid(datasetID, "alt", &gpsAltIndex);
-		if (ncResult != NC_NOERR) HandleNCError("nc_inq_varid (alt)", ncResult);
-		int vaisFPIndex;
-		ncResult = nc_inq_varid(datasetID, "FP", &vaisFPIndex);
-		if (ncResult != NC_NOERR) HandleNCError("nc_inq_varid (FP)", ncResult);
-		
-		for (i = 0; i < dimLength; i++)
+		else if (strcmp(arg, "--stats-dir") == 0 && argIndex+1 < argc)
 		{
-			if (variableDataList[timeIndex]->type != NC_FLOAT) 
-			{
-				printf("Invalid NetCDF type for outputting to flt.dat: %d\r\n", variableDataList[timeIndex]->type);
-			}
-			fprintf(fltFile, "%10.5f,%10.2f,%10.4f,%10.2f,%10.2f,%10.2f,%10.5f,%10.5f,%10.4f,%10.2f,%10.2f,%10d\r\n", 
-				((float*)variableDataList[timeIndex]->data)[i] / 60.0, ((float*)variableDataList[pressureIndex]->data)[i], ((float*)variableDataList[geopotAltIndex]->data)[i] / 1000,
-				((float*)variableDataList[temperatureIndex]->data)[i] - 273.15, ((float*)variableDataList[vaisRHIndex]->data)[i]*100, ((float*)variableDataList[vaisFPIndex]->data)[i] - 273.15,
-				((float*)variableDataList[latIndex]->data)[i], ((float*)variableDataList[lonIndex]->data)[i], ((float*)variableDataList[gpsAltIndex]->data)[i]/1000, ((float*)variableDataList[windSpeedIndex]->data)[i], ((float*)variableDataList[windDirIndex]->data)[i], 1);
+			options.statsDir = argv[++argIndex];
 		}
-		
-		/*
-		//output variable data to the flt.dat file
-		for (i=0; i<dimLength; i++)
+		else if (strcmp(arg, "--simd") == 0 && argIndex+1 < argc)
 		{
-			for (j=0; j<numVars; j++)
+			char *pathName = argv[++argIndex];
+			int path;
+			for (path = 0; path < NUM_CONVERT_PATHS && strcmp(pathName, GetConvertPathName((ConvertPath)path)) != 0; path++);
+			if (path == NUM_CONVERT_PATHS)
 			{
-				VariableData *variableData = variableDataList[j];
-				//write data in the correct format for the variable's type
-				switch (variableData->type)
-				{
-					case NC_BYTE:
-					{
-						unsigned char *byteList = (unsigned char *)variableData->data;
-						fprintf(fltFile, "%u", byteList[i]);
-						break;
-					}
-					case NC_CHAR:
-					{
-						char *byteList = (char *)variableData->data;
-						fprintf(fltFile, "%c", byteList[i]);
-						break;
-					}
-					case NC_SHORT:
-					{
-						short *byteList = (short *)variableData->data;
-						fprintf(fltFile, "%d", byteList[i]);
-						break;
-					}
-					case NC_INT:
-					{
-						int *byteList = (int *)variableData->data;
-						fprintf(fltFile, "%d", byteList[i]);
-						break;
-					}
-					case NC_FLOAT:
-					{
-						float *byteList = (float *)variableData->data;
-						fprintf(fltFile, "%f", byteList[i]);
-						break;
-					}
-					case NC_DOUBLE:
-					{
-						double *byteList = (double *)variableData->data;
-						fprintf(fltFile, "%f", byteList[i]);
-						break;
-					}
-					default:
-						break;
-				}
-				
-				if (j != (numVars-1)) fprintf(fltFile, ", ");
+				printf("error: unknown --simd path: %s\n", pathName);
+				return -1;
 			}
-			fprintf(fltFile, "\r\n");
-		}*/
-		
-		//free up heap memory
-		/*for (i=0; i<numVars; i++)
+			if (SetConvertPath((ConvertPath)path) != 0)
+			{
+				printf("error: this CPU doesn't support --simd %s\n", pathName);
+				return -1;
+			}
+		}
+		else if (strcmp(arg, "--help") == 0 || strcmp(arg, "-h") == 0)
 		{
-			free(standardNameList[i]);
+			PrintUsage();
+			return 0;
 		}
-		free(standardNameList);
-		for (i=0; i<numVars; i++)
+		else if (strncmp(arg, "--", 2) == 0 || (arg[0] == '-' && arg[1] != '\0'))
 		{
-			free(longNameList[i]);
+			printf("error: unknown option: %s\n", arg);
+			PrintUsage();
+			return -1;
 		}
-		free(longNameList);
-		for (i=0; i<numVars; i++)
+		else AddFileToList(&inputFiles, arg);
+	}
+	
+	//make sure a filename (or a directory to watch) was provided
+	if (inputFiles.count < 1 && watchOptions.numDirectories == 0)
+	{
+		puts("NetCDF filename argument required");
+		PrintUsage();
+		return -1;
+	}
+	
+	if (options.gzipThreads == 0) options.gzipThreads = GetDefaultGzipThreads(numJobs);
+	
+	//the column mapping is parsed once, up front, for every file
+	ColumnMap *columnMap = (columnMapFilename != NULL) ? LoadColumnMap(columnMapFilename) : CreateDefaultColumnMap();
+	if (columnMap == NULL)
+	{
+		FreeFileList(&inputFiles);
+		return -1;
+	}
+	options.columnMap = columnMap;
+	printf("unit conversion kernels: %s\n", GetConvertPathName(GetConvertPath()));
+	
+	//convert every input file, a failure only fails that one file
+	//(each file's stats come back to this process to be added up, from the worker processes too)
+	ConvertStats fileStats, batchStats;
+	InitConvertStats(&batchStats);
+	options.fileStats = &fileStats;
+	BatchRecord statsRecord = { &fileStats, sizeof(ConvertStats), CollectConvertStats, &batchStats };
+	double batchStart = GetMonotonicTime();
+	
+	//with --manifest, only the inputs whose outputs aren't current are converted (every one of them with --force)
+	//(the output depends on the column map's contents)
+	char outputSignature[64];
+	uint64_t columnsHash;
+	if (columnMapFilename != NULL && HashFileContents(columnMapFilename, &columnsHash) == 0)
+		snprintf(outputSignature, sizeof(outputSignature), "%s columns=%016llx", options.gzip ? "flt.dat.gz" : "flt.dat", (unsigned long long)columnsHash);
+	else snprintf(outputSignature, sizeof(outputSignature), "%s columns=default", options.gzip ? "flt.dat.gz" : "flt.dat");
+	char version[32];
+	snprintf(version, sizeof(version), "rs92nc2fltdat %.3f", VERSION);
+	FileList *batchFiles = &inputFiles;
+	FileList outdatedFiles;
+	struct stat *outdatedInfo = NULL;
+	Manifest manifest;
+	InitManifest(&manifest);
+	InitFileList(&outdatedFiles);
+	if (manifestFilename != NULL)
+	{
+		if (LoadManifest(manifestFilename, &manifest) != 0)
 		{
-			free(unitStringList[i]);
+			printf("error: could not read manifest: %s\n", manifestFilename);
+			return -1;
 		}
-		free(unitStringList);*/
-		for (i=0; i<numVars; i++)
+		int numCurrent = SelectOutdatedFiles(&manifest, &inputFiles, GetOutputFilename, &options, version, outputSignature,
+			force, &outdatedFiles, &outdatedInfo);
+		if (inputFiles.count > 0) printf("%d of %d files are up to date\n", numCurrent, inputFiles.count);
+		batchFiles = &outdatedFiles;
+	}
+	
+	int numFiles = batchFiles->count;
+	int *statuses = (int *)malloc((batchFiles->count + 1) * sizeof(int));
+	int numFailed = (batchFiles->count > 0) ? RunBatch(batchFiles, numJobs, ConvertFile, &options, &statsRecord, statuses) : 0;
+	if (manifestFilename != NULL)
+	{
+		RecordConvertedFiles(&manifest, batchFiles, outdatedInfo, statuses, GetOutputFilename, &options, version, outputSignature);
+		if (SaveManifest(manifestFilename, &manifest) != 0) printf("warning: could not write manifest: %s\n", manifestFilename);
+	}
+	free(statuses);
+	free(outdatedInfo);
+	FreeFileList(&outdatedFiles);
+	FreeManifest(&manifest);
+	
+	int watchFailed = 0;
+	if (watchOptions.numDirectories > 0)
+	{
+		//then the files that arrive, on workers that stay up until the watch is interrupted
+		watchOptions.numJobs = numJobs;
+		watchOptions.statsToStderr = options.statsToStderr;
+		watchOptions.statsDir = options.statsDir;
+		int numWatched;
+		watchFailed = WatchDirectories(&watchOptions, ConvertFile, &options, &statsRecord, &numWatched);
+		//(-1 if the directories couldn't be watched at all)
+		if (watchFailed >= 0)
 		{
-			free(variableDataList[i]->data);
+			numFiles += numWatched;
+			numFailed += watchFailed;
 		}
-		free(variableDataList);
-		free(fltDatFilename);
-		
-		//close the flt.dat file
-		fclose(fltFile);
-		
-		//close the NetCDF file
-		ncResult = nc_close(datasetID);
-		if (ncResult != NC_NOERR) HandleNCError("nc_close", ncResult);
-		
-		printf("\r\n");
-		
-	}//end of input file for loop
+	}
+	if (options.statsToStderr || options.statsDir != NULL)
+	{
+		//(files whose worker died never sent their stats)
+		batchStats.numFiles = numFiles;
+		batchStats.numFailed = numFailed;
+		ReportBatchStats(&batchStats, GetMonotonicTime() - batchStart, options.statsToStderr, options.statsDir);
+	}
 	
 	/*DIR *dp;
 	struct dirent *ep;
@@ -512,5 +583,8 @@ int main (int argc, char** argv)
 	else
 	perror ("Couldn't open the directory");*/
 
-	return 0;
+	FreeColumnMap(columnMap);
+	free(watchOptions.directories);
+	FreeFileList(&inputFiles);
+	return (numFailed == 0 && watchFailed >= 0) ? 0 : 1;
 }
@@ -0,0 +1,196 @@
+//synthetic.c: generating synthetic NetCDF files to benchmark the converters on
+//Copyright 2012, Allen Jordan, allen.jordan@gmail.com
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include "synthetic.h"
+
+//rows written per nc_put_vara call, so memory use stays flat however many rows are generated
+#define SYNTHETIC_CHUNK_ROWS	65536
+
+//the RS-92 variables rs92nc2fltdat's built-in column map reads, in file order
+static const char *rs92Names[] = { "time", "press", "temp", "rh", "FP", "geopot", "alt", "lat", "lon", "wspeed", "wdir" };
+static const char *rs92Units[] = { "s", "hPa", "K", "1", "K", "m", "m", "degree_north", "degree_east", "m/s", "degree" };
+#define NUM_RS92_VARS	((int)(sizeof(rs92Names)/sizeof(char*)))
+
+//the generic types cycled through by a mixed file
+static const nc_type mixedTypes[] = { NC_BYTE, NC_SHORT, NC_INT, NC_FLOAT, NC_DOUBLE };
+#define NUM_MIXED_TYPES	((int)(sizeof(mixedTypes)/sizeof(nc_type)))
+
+void InitSyntheticSpec(SyntheticSpec *spec)
+{
+	spec->numRows = 1000000;
+	spec->numVars = 8;
+	spec->type = NC_FLOAT;
+	spec->format = NC_FORMAT_CLASSIC;
+	spec->deflateLevel = 0;
+	spec->record = 0;
+	spec->rs92 = 0;
+}
+
+static const char *GetTypeName(nc_type type)
+{
+	switch (type)
+	{
+		case NC_BYTE: return "byte";
+		case NC_SHORT: return "short";
+		case NC_INT: return "int";
+		case NC_FLOAT: return "float";
+		case NC_DOUBLE: return "double";
+		default: return "mixed";
+	}
+}
+
+void GetSyntheticName(const SyntheticSpec *spec, char *name, size_t nameSize)
+{
+	const char *formatName = (spec->format == NC_FORMAT_NETCDF4) ? "nc4" : (spec->format == NC_FORMAT_64BIT) ? "64bit" : "classic";
+	char deflate[16] = "";
+	if (spec->format == NC_FORMAT_NETCDF4 && spec->deflateLevel > 0) snprintf(deflate, sizeof(deflate), "_z%d", spec->deflateLevel);
+	snprintf(name, nameSize, "%s%s%s_%s_v%d_r%zu%s", spec->rs92 ? "rs92_" : "", formatName, deflate,
+		GetTypeName(spec->type), spec->numVars, spec->numRows, spec->record ? "_rec" : "");
+}
+
+//a repeatable pseudo-random number in [0, 1) for each row and variable
+static double GetNoise(size_t row, int var)
+{
+	uint64_t hash = (uint64_t)row * 0x9E3779B97F4A7C15ULL + (uint64_t)(var + 1) * 0xBF58476D1CE4E5B9ULL;
+	hash ^= hash >> 31;
+	hash *= 0x94D049BB133111EBULL;
+	hash ^= hash >> 29;
+	return (double)(hash >> 11) / 9007199254740992.0;
+}
+
+//a slowly varying value with some noise, in range for the type
+static double GetGenericValue(size_t row, int var, nc_type type)
+{
+	double wave = sin(row * (0.0007 + 0.0001*var));
+	double noise = GetNoise(row, var);
+	switch (type)
+	{
+		case NC_BYTE: return floor(wave*100 + noise*20);
+		case NC_SHORT: return floor(wave*30000 + noise*100);
+		case NC_INT: return floor(wave*1000000 + noise*1000 + var*10);
+		default: return wave*100 + var*10 + noise*0.01;
+	}
+}
+
+//an RS-92 sounding ascending at 5 m/s, one row per second
+static double GetRS92Value(size_t row, int var)
+{
+	double seconds = (double)row;
+	double altitude = 1600 + 5*seconds + GetNoise(row, 100)*0.5;
+	double temperature = 288.15 - 0.0065*((altitude < 11000) ? altitude : 11000) + GetNoise(row, 101)*0.1;
+	switch (var)
+	{
+		case 0: return seconds;
+		case 1: return 1013.25 * exp(-altitude/7500);
+		case 2: return temperature;
+		case 3: return 0.5 + 0.4*sin(seconds*0.002) + GetNoise(row, 103)*0.01;
+		case 4: return temperature - 5 - GetNoise(row, 104);
+		case 5: return altitude - 2;
+		case 6: return altitude;
+		case 7: return 40.0 + seconds*1e-5;
+		case 8: return -105.2 + seconds*2e-5;
+		case 9: return 5 + seconds*0.001 + GetNoise(row, 109);
+		default: return fmod(seconds*0.1, 360.0);
+	}
+}
+
+int GenerateSyntheticFile(const SyntheticSpec *spec, const char *filename)
+{
+	int status = NC_NOERR;
+	int datasetID = -1;
+	int *varIDs = NULL;
+	nc_type *varTypes = NULL;
+	double *values = NULL;
+	int v;
+
+	int numRS92 = spec->rs92 ? NUM_RS92_VARS : 0;
+	int numVars = numRS92 + spec->numVars;
+	int mode = NC_CLOBBER;
+	if (spec->format == NC_FORMAT_64BIT) mode |= NC_64BIT_OFFSET;
+	else if (spec->format == NC_FORMAT_NETCDF4) mode |= NC_NETCDF4;
+
+	status = nc_create(filename, mode, &datasetID);
+	if (status != NC_NOERR)
+	{
+		datasetID = -1;
+		goto cleanup;
+	}
+
+	int dimID;
+	status = nc_def_dim(datasetID, "time", spec->record ? NC_UNLIMITED : spec->numRows, &dimID);
+	if (status != NC_NOERR) goto cleanup;
+	if (spec->rs92)
+	{
+		const char *startTime = "2012-05-01T11:30:00";
+		status = nc_put_att_text(datasetID, NC_GLOBAL, "g.Ascent.StartTime", strlen(startTime), startTime);
+		if (status != NC_NOERR) goto cleanup;
+	}
+
+	varIDs = (int *)malloc(numVars * sizeof(int));
+	varTypes = (nc_type *)malloc(numVars * sizeof(nc_type));
+	for (v = 0; v < numVars; v++)
+	{
+		char name[NC_MAX_NAME+1];
+		if (v < numRS92)
+		{
+			snprintf(name, sizeof(name), "%s", rs92Names[v]);
+			varTypes[v] = NC_FLOAT;
+		}
+		else
+		{
+			snprintf(name, sizeof(name), "var%d", v - numRS92);
+			varTypes[v] = (spec->type == NC_NAT) ? mixedTypes[(v - numRS92) % NUM_MIXED_TYPES] : spec->type;
+		}
+		status = nc_def_var(datasetID, name, varTypes[v], 1, &dimID, &varIDs[v]);
+		if (status != NC_NOERR) goto cleanup;
+		if (v < numRS92)
+		{
+			status = nc_put_att_text(datasetID, varIDs[v], "units", strlen(rs92Units[v]), rs92Units[v]);
+			if (status != NC_NOERR) goto cleanup;
+		}
+		if (spec->format == NC_FORMAT_NETCDF4)
+		{
+			//(the default chunks along an unlimited dimension are tiny)
+			size_t chunkRows = (spec->numRows < SYNTHETIC_CHUNK_ROWS) ? ((spec->numRows > 0) ? spec->numRows : 1) : SYNTHETIC_CHUNK_ROWS;
+			status = nc_def_var_chunking(datasetID, varIDs[v], NC_CHUNKED, &chunkRows);
+			if (status == NC_NOERR && spec->deflateLevel > 0)
+				status = nc_def_var_deflate(datasetID, varIDs[v], 1, 1, spec->deflateLevel);
+			if (status != NC_NOERR) goto cleanup;
+		}
+	}
+	status = nc_enddef(datasetID);
+	if (status != NC_NOERR) goto cleanup;
+
+	//write every variable a chunk of rows at a time
+	values = (double *)malloc(SYNTHETIC_CHUNK_ROWS * sizeof(double));
+	for (v = 0; v < numVars; v++)
+	{
+		size_t start;
+		for (start = 0; start < spec->numRows; start += SYNTHETIC_CHUNK_ROWS)
+		{
+			size_t count = spec->numRows - start;
+			if (count > SYNTHETIC_CHUNK_ROWS) count = SYNTHETIC_CHUNK_ROWS;
+			size_t i;
+			for (i = 0; i < count; i++)
+				values[i] = (v < numRS92) ? GetRS92Value(start + i, v) : GetGenericValue(start + i, v - numRS92, varTypes[v]);
+			status = nc_put_vara_double(datasetID, varIDs[v], &start, &count, values);
+			if (status != NC_NOERR) goto cleanup;
+		}
+	}
+
+cleanup:
+	if (datasetID >= 0)
+	{
+		int closeStatus = nc_close(datasetID);
+		if (status == NC_NOERR) status = closeStatus;
+	}
+	free(varIDs);
+	free(varTypes);
+	free(values);
+	return status;
+}
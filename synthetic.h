@@ -0,0 +1,36 @@
+//synthetic.h: generating synthetic NetCDF files to benchmark the converters on
+//Copyright 2012, Allen Jordan, allen.jordan@gmail.com
+
+#ifndef SYNTHETIC_H
+#define SYNTHETIC_H
+
+#include <stddef.h>
+#include <netcdf.h>
+
+//the shape of a synthetic file, every variable runs along a single dimension of numRows rows
+typedef struct
+{
+	size_t numRows;
+	//number of generic variables (in an RS-92 shaped file, the variables beyond the RS-92 ones)
+	int numVars;
+	//type of the generic variables, or NC_NAT to cycle through byte, short, int, float and double
+	nc_type type;
+	//NC_FORMAT_CLASSIC, NC_FORMAT_64BIT or NC_FORMAT_NETCDF4
+	int format;
+	//zlib level for NetCDF-4 variables, 0 for none
+	int deflateLevel;
+	//make the dimension unlimited, so the variables are record variables
+	int record;
+	//the variables and launch time attribute of a GRUAN RS-92 file, with plausible profiles, so rs92nc2fltdat can
+	//convert it
+	int rs92;
+} SyntheticSpec;
+
+//the values of a spec that isn't set up otherwise: 1 million rows of 8 float variables in a classic file
+void InitSyntheticSpec(SyntheticSpec *spec);
+//a short name for the spec, usable as a filename (ex: classic_float_v8_r1000000)
+void GetSyntheticName(const SyntheticSpec *spec, char *name, size_t nameSize);
+//write the file, returns 0 or a NetCDF error status
+int GenerateSyntheticFile(const SyntheticSpec *spec, const char *filename);
+
+#endif
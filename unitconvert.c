@@ -0,0 +1,613 @@
+//unitconvert.c: vectorized byte swapping, unit conversion, masking and summing up of whole float columns
+//Copyright 2012, Allen Jordan, allen.jordan@gmail.com
+
+//every path does the same IEEE operations in the same order (multiply, divide, add, with the same widening), so the
+//vector paths give bit-for-bit the same results as the scalar one, just several values at a time
+//sums are kept in SUM_LANES lanes on every path, value i going into lane i % SUM_LANES, and the lanes are added
+//together in the same order at the end, so they don't depend on the path either
+
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include "unitconvert.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CONVERT_X86
+#include <immintrin.h>
+#endif
+
+//values converted per pass, so a block stays in cache through every step of a conversion
+#define CONVERT_BLOCK_VALUES	1024
+//running sums kept apart while summing up a column (one AVX2 vector of doubles, or two SSE2 ones)
+#define SUM_LANES	4
+
+//the running sums of each lane
+typedef struct
+{
+	double count[SUM_LANES];
+	double sum[SUM_LANES];
+	double min[SUM_LANES];
+	double max[SUM_LANES];
+} SummaryLanes;
+
+typedef struct
+{
+	void (*swap)(const void *source, size_t stride, size_t count, float *values);
+	void (*widen)(const float *values, size_t count, double *out);
+	void (*multiplyFloats)(float *values, size_t count, float multiplier);
+	void (*divideFloats)(float *values, size_t count, float divisor);
+	void (*multiplyDoubles)(double *values, size_t count, double multiplier);
+	void (*divideDoubles)(double *values, size_t count, double divisor);
+	void (*addDoubles)(double *values, size_t count, double offset);
+	void (*narrow)(const double *values, size_t count, float *out);
+	void (*maskFloats)(float *values, size_t count, float low, float high, float fill, float missing);
+	void (*maskDoubles)(double *values, size_t count, double low, double high, double fill, double missing);
+	//(these start at value 0 of a lane, count doesn't have to be a multiple of SUM_LANES)
+	void (*summarize)(const double *values, size_t count, SummaryLanes *lanes);
+	void (*sumSquaredDeviations)(const double *values, size_t count, double mean, double *lanes);
+} ConvertKernels;
+
+//---- scalar ----
+
+//(the loops are kept from being auto-vectorized, so the fallback really is the plain version the others are checked
+//and timed against)
+#define SCALAR_ONLY	__attribute__((optimize("no-tree-vectorize")))
+
+static inline uint32_t SwapBytes32(uint32_t value)
+{
+	return __builtin_bswap32(value);
+}
+
+SCALAR_ONLY static void SwapFloatsScalar(const void *source, size_t stride, size_t count, float *values)
+{
+	const unsigned char *bytes = (const unsigned char *)source;
+	size_t i;
+	for (i = 0; i < count; i++)
+	{
+		uint32_t word;
+		memcpy(&word, bytes + i*stride, sizeof(word));
+		word = SwapBytes32(word);
+		memcpy(&values[i], &word, sizeof(word));
+	}
+}
+
+SCALAR_ONLY static void WidenScalar(const float *values, size_t count, double *out)
+{
+	size_t i;
+	for (i = 0; i < count; i++) out[i] = values[i];
+}
+
+#define DEFINE_SCALAR_OP(name, type, operator) \
+	SCALAR_ONLY static void name(type *values, size_t count, type operand) \
+	{ \
+		size_t i; \
+		for (i = 0; i < count; i++) values[i] = values[i] operator operand; \
+	}
+
+DEFINE_SCALAR_OP(MultiplyFloatsScalar, float, *)
+DEFINE_SCALAR_OP(DivideFloatsScalar, float, /)
+DEFINE_SCALAR_OP(MultiplyDoublesScalar, double, *)
+DEFINE_SCALAR_OP(DivideDoublesScalar, double, /)
+DEFINE_SCALAR_OP(AddDoublesScalar, double, +)
+
+SCALAR_ONLY static void NarrowScalar(const double *values, size_t count, float *out)
+{
+	size_t i;
+	for (i = 0; i < count; i++) out[i] = (float)values[i];
+}
+
+//(a NaN is never in range, so it stays NaN)
+#define DEFINE_SCALAR_MASK(name, type) \
+	SCALAR_ONLY static void name(type *values, size_t count, type low, type high, type fill, type missing) \
+	{ \
+		size_t i; \
+		for (i = 0; i < count; i++) \
+		{ \
+			type value = values[i]; \
+			if (!(value >= low && value <= high) || value == fill || value == missing) values[i] = NAN; \
+		} \
+	}
+
+DEFINE_SCALAR_MASK(MaskFloatsScalar, float)
+DEFINE_SCALAR_MASK(MaskDoublesScalar, double)
+
+SCALAR_ONLY static void SummarizeScalar(const double *values, size_t count, SummaryLanes *lanes)
+{
+	size_t i;
+	for (i = 0; i < count; i++)
+	{
+		int lane = i % SUM_LANES;
+		double value = values[i];
+		if (value != value) continue;
+		lanes->count[lane] += 1.0;
+		lanes->sum[lane] += value;
+		if (value < lanes->min[lane]) lanes->min[lane] = value;
+		if (value > lanes->max[lane]) lanes->max[lane] = value;
+	}
+}
+
+SCALAR_ONLY static void SumSquaredDeviationsScalar(const double *values, size_t count, double mean, double *lanes)
+{
+	size_t i;
+	for (i = 0; i < count; i++)
+	{
+		double deviation = values[i] - mean;
+		if (values[i] == values[i]) lanes[i % SUM_LANES] += deviation * deviation;
+	}
+}
+
+static const ConvertKernels scalarKernels =
+{
+	SwapFloatsScalar, WidenScalar, MultiplyFloatsScalar, DivideFloatsScalar,
+	MultiplyDoublesScalar, DivideDoublesScalar, AddDoublesScalar,
+	NarrowScalar, MaskFloatsScalar, MaskDoublesScalar,
+	SummarizeScalar, SumSquaredDeviationsScalar
+};
+
+#ifdef CONVERT_X86
+
+//---- SSE2 ----
+
+//swap the bytes of each 32-bit lane: swap the 16-bit halves, then the bytes within each half (SSE2 has no byte shuffle)
+__attribute__((target("sse2"))) static inline __m128i SwapLanes128(__m128i words)
+{
+	words = _mm_shufflehi_epi16(_mm_shufflelo_epi16(words, 0xB1), 0xB1);
+	return _mm_or_si128(_mm_slli_epi16(words, 8), _mm_srli_epi16(words, 8));
+}
+
+__attribute__((target("sse2"))) static void SwapFloatsSSE2(const void *source, size_t stride, size_t count, float *values)
+{
+	const unsigned char *bytes = (const unsigned char *)source;
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128i words;
+		if (stride == 4) words = _mm_loadu_si128((const __m128i *)(bytes + i*4));
+		else
+		{
+			uint32_t gathered[4];
+			memcpy(&gathered[0], bytes + i*stride, 4);
+			memcpy(&gathered[1], bytes + (i+1)*stride, 4);
+			memcpy(&gathered[2], bytes + (i+2)*stride, 4);
+			memcpy(&gathered[3], bytes + (i+3)*stride, 4);
+			words = _mm_loadu_si128((const __m128i *)gathered);
+		}
+		_mm_storeu_si128((__m128i *)(values + i), SwapLanes128(words));
+	}
+	SwapFloatsScalar(bytes + i*stride, stride, count - i, values + i);
+}
+
+__attribute__((target("sse2"))) static void WidenSSE2(const float *values, size_t count, double *out)
+{
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 floats = _mm_loadu_ps(values + i);
+		_mm_storeu_pd(out + i, _mm_cvtps_pd(floats));
+		_mm_storeu_pd(out + i + 2, _mm_cvtps_pd(_mm_movehl_ps(floats, floats)));
+	}
+	WidenScalar(values + i, count - i, out + i);
+}
+
+#define DEFINE_VECTOR_OP(name, targetName, type, vectorType, width, load, store, set, operation, scalarName) \
+	__attribute__((target(targetName))) static void name(type *values, size_t count, type operand) \
+	{ \
+		vectorType operands = set(operand); \
+		size_t i = 0; \
+		for (; i + width <= count; i += width) store(values + i, operation(load(values + i), operands)); \
+		scalarName(values + i, count - i, operand); \
+	}
+
+DEFINE_VECTOR_OP(MultiplyFloatsSSE2, "sse2", float, __m128, 4, _mm_loadu_ps, _mm_storeu_ps, _mm_set1_ps, _mm_mul_ps, MultiplyFloatsScalar)
+DEFINE_VECTOR_OP(DivideFloatsSSE2, "sse2", float, __m128, 4, _mm_loadu_ps, _mm_storeu_ps, _mm_set1_ps, _mm_div_ps, DivideFloatsScalar)
+DEFINE_VECTOR_OP(MultiplyDoublesSSE2, "sse2", double, __m128d, 2, _mm_loadu_pd, _mm_storeu_pd, _mm_set1_pd, _mm_mul_pd, MultiplyDoublesScalar)
+DEFINE_VECTOR_OP(DivideDoublesSSE2, "sse2", double, __m128d, 2, _mm_loadu_pd, _mm_storeu_pd, _mm_set1_pd, _mm_div_pd, DivideDoublesScalar)
+DEFINE_VECTOR_OP(AddDoublesSSE2, "sse2", double, __m128d, 2, _mm_loadu_pd, _mm_storeu_pd, _mm_set1_pd, _mm_add_pd, AddDoublesScalar)
+
+__attribute__((target("sse2"))) static void NarrowSSE2(const double *values, size_t count, float *out)
+{
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 low = _mm_cvtpd_ps(_mm_loadu_pd(values + i));
+		__m128 high = _mm_cvtpd_ps(_mm_loadu_pd(values + i + 2));
+		_mm_storeu_ps(out + i, _mm_movelh_ps(low, high));
+	}
+	NarrowScalar(values + i, count - i, out + i);
+}
+
+//define a kernel that replaces the lanes that aren't valid with NaN, valid(v, lows, highs, fills, missings) gives
+//all ones for the lanes to keep and select(masked, v, valid) picks between the two
+#define DEFINE_VECTOR_MASK(name, targetName, type, vectorType, width, load, store, set, valid, select, scalarName) \
+	__attribute__((target(targetName))) static void name(type *values, size_t count, type low, type high, type fill, type missing) \
+	{ \
+		vectorType lows = set(low), highs = set(high), fills = set(fill), missings = set(missing), nans = set(NAN); \
+		size_t i = 0; \
+		for (; i + width <= count; i += width) \
+		{ \
+			vectorType v = load(values + i); \
+			store(values + i, select(nans, v, valid(v, lows, highs, fills, missings))); \
+		} \
+		scalarName(values + i, count - i, low, high, fill, missing); \
+	}
+
+//(the ordered comparisons are false for NaN, and the unordered not-equals are true for a NaN fill or missing value)
+__attribute__((target("sse2"))) static inline __m128 ValidFloatsSSE2(__m128 v, __m128 lows, __m128 highs, __m128 fills, __m128 missings)
+{
+	__m128 inRange = _mm_and_ps(_mm_cmpge_ps(v, lows), _mm_cmple_ps(v, highs));
+	return _mm_and_ps(inRange, _mm_and_ps(_mm_cmpneq_ps(v, fills), _mm_cmpneq_ps(v, missings)));
+}
+
+__attribute__((target("sse2"))) static inline __m128 SelectFloatsSSE2(__m128 masked, __m128 v, __m128 valid)
+{
+	return _mm_or_ps(_mm_and_ps(valid, v), _mm_andnot_ps(valid, masked));
+}
+
+__attribute__((target("sse2"))) static inline __m128d ValidDoublesSSE2(__m128d v, __m128d lows, __m128d highs, __m128d fills, __m128d missings)
+{
+	__m128d inRange = _mm_and_pd(_mm_cmpge_pd(v, lows), _mm_cmple_pd(v, highs));
+	return _mm_and_pd(inRange, _mm_and_pd(_mm_cmpneq_pd(v, fills), _mm_cmpneq_pd(v, missings)));
+}
+
+__attribute__((target("sse2"))) static inline __m128d SelectDoublesSSE2(__m128d masked, __m128d v, __m128d valid)
+{
+	return _mm_or_pd(_mm_and_pd(valid, v), _mm_andnot_pd(valid, masked));
+}
+
+DEFINE_VECTOR_MASK(MaskFloatsSSE2, "sse2", float, __m128, 4, _mm_loadu_ps, _mm_storeu_ps, _mm_set1_ps, ValidFloatsSSE2, SelectFloatsSSE2, MaskFloatsScalar)
+DEFINE_VECTOR_MASK(MaskDoublesSSE2, "sse2", double, __m128d, 2, _mm_loadu_pd, _mm_storeu_pd, _mm_set1_pd, ValidDoublesSSE2, SelectDoublesSSE2, MaskDoublesScalar)
+
+//lanes 0-1 and 2-3 are a vector each (NaNs add 0 and a count of 0, and are never smaller or larger)
+__attribute__((target("sse2"))) static void SummarizeSSE2(const double *values, size_t count, SummaryLanes *lanes)
+{
+	const __m128d ones = _mm_set1_pd(1.0);
+	__m128d counts[2], sums[2], mins[2], maxes[2];
+	int half;
+	for (half = 0; half < 2; half++)
+	{
+		counts[half] = _mm_loadu_pd(lanes->count + 2*half);
+		sums[half] = _mm_loadu_pd(lanes->sum + 2*half);
+		mins[half] = _mm_loadu_pd(lanes->min + 2*half);
+		maxes[half] = _mm_loadu_pd(lanes->max + 2*half);
+	}
+	size_t i = 0;
+	for (; i + SUM_LANES <= count; i += SUM_LANES)
+	{
+		for (half = 0; half < 2; half++)
+		{
+			__m128d v = _mm_loadu_pd(values + i + 2*half);
+			__m128d valid = _mm_cmpord_pd(v, v);
+			counts[half] = _mm_add_pd(counts[half], _mm_and_pd(valid, ones));
+			sums[half] = _mm_add_pd(sums[half], _mm_and_pd(valid, v));
+			__m128d smaller = _mm_cmplt_pd(v, mins[half]);
+			mins[half] = _mm_or_pd(_mm_and_pd(smaller, v), _mm_andnot_pd(smaller, mins[half]));
+			__m128d larger = _mm_cmpgt_pd(v, maxes[half]);
+			maxes[half] = _mm_or_pd(_mm_and_pd(larger, v), _mm_andnot_pd(larger, maxes[half]));
+		}
+	}
+	for (half = 0; half < 2; half++)
+	{
+		_mm_storeu_pd(lanes->count + 2*half, counts[half]);
+		_mm_storeu_pd(lanes->sum + 2*half, sums[half]);
+		_mm_storeu_pd(lanes->min + 2*half, mins[half]);
+		_mm_storeu_pd(lanes->max + 2*half, maxes[half]);
+	}
+	SummarizeScalar(values + i, count - i, lanes);
+}
+
+__attribute__((target("sse2"))) static void SumSquaredDeviationsSSE2(const double *values, size_t count, double mean, double *lanes)
+{
+	const __m128d means = _mm_set1_pd(mean);
+	__m128d sums[2] = { _mm_loadu_pd(lanes), _mm_loadu_pd(lanes + 2) };
+	size_t i = 0;
+	for (; i + SUM_LANES <= count; i += SUM_LANES)
+	{
+		int half;
+		for (half = 0; half < 2; half++)
+		{
+			__m128d v = _mm_loadu_pd(values + i + 2*half);
+			__m128d deviations = _mm_sub_pd(v, means);
+			sums[half] = _mm_add_pd(sums[half], _mm_and_pd(_mm_cmpord_pd(v, v), _mm_mul_pd(deviations, deviations)));
+		}
+	}
+	_mm_storeu_pd(lanes, sums[0]);
+	_mm_storeu_pd(lanes + 2, sums[1]);
+	SumSquaredDeviationsScalar(values + i, count - i, mean, lanes);
+}
+
+static const ConvertKernels sse2Kernels =
+{
+	SwapFloatsSSE2, WidenSSE2, MultiplyFloatsSSE2, DivideFloatsSSE2,
+	MultiplyDoublesSSE2, DivideDoublesSSE2, AddDoublesSSE2,
+	NarrowSSE2, MaskFloatsSSE2, MaskDoublesSSE2,
+	SummarizeSSE2, SumSquaredDeviationsSSE2
+};
+
+//---- AVX2 ----
+
+__attribute__((target("avx2"))) static void SwapFloatsAVX2(const void *source, size_t stride, size_t count, float *values)
+{
+	const unsigned char *bytes = (const unsigned char *)source;
+	const __m256i reverse = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+		3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+	size_t i = 0;
+	if (stride == 4)
+	{
+		for (; i + 8 <= count; i += 8)
+		{
+			__m256i words = _mm256_loadu_si256((const __m256i *)(bytes + i*4));
+			_mm256_storeu_si256((__m256i *)(values + i), _mm256_shuffle_epi8(words, reverse));
+		}
+	}
+	else if (stride <= INT32_MAX / 8)
+	{
+		//interleaved values (one per record) are gathered 8 at a time
+		int s = (int)stride;
+		const __m256i offsets = _mm256_setr_epi32(0, s, 2*s, 3*s, 4*s, 5*s, 6*s, 7*s);
+		for (; i + 8 <= count; i += 8)
+		{
+			__m256i words = _mm256_i32gather_epi32((const int *)(bytes + i*stride), offsets, 1);
+			_mm256_storeu_si256((__m256i *)(values + i), _mm256_shuffle_epi8(words, reverse));
+		}
+	}
+	SwapFloatsScalar(bytes + i*stride, stride, count - i, values + i);
+}
+
+__attribute__((target("avx2"))) static void WidenAVX2(const float *values, size_t count, double *out)
+{
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) _mm256_storeu_pd(out + i, _mm256_cvtps_pd(_mm_loadu_ps(values + i)));
+	WidenScalar(values + i, count - i, out + i);
+}
+
+DEFINE_VECTOR_OP(MultiplyFloatsAVX2, "avx2", float, __m256, 8, _mm256_loadu_ps, _mm256_storeu_ps, _mm256_set1_ps, _mm256_mul_ps, MultiplyFloatsScalar)
+DEFINE_VECTOR_OP(DivideFloatsAVX2, "avx2", float, __m256, 8, _mm256_loadu_ps, _mm256_storeu_ps, _mm256_set1_ps, _mm256_div_ps, DivideFloatsScalar)
+DEFINE_VECTOR_OP(MultiplyDoublesAVX2, "avx2", double, __m256d, 4, _mm256_loadu_pd, _mm256_storeu_pd, _mm256_set1_pd, _mm256_mul_pd, MultiplyDoublesScalar)
+DEFINE_VECTOR_OP(DivideDoublesAVX2, "avx2", double, __m256d, 4, _mm256_loadu_pd, _mm256_storeu_pd, _mm256_set1_pd, _mm256_div_pd, DivideDoublesScalar)
+DEFINE_VECTOR_OP(AddDoublesAVX2, "avx2", double, __m256d, 4, _mm256_loadu_pd, _mm256_storeu_pd, _mm256_set1_pd, _mm256_add_pd, AddDoublesScalar)
+
+__attribute__((target("avx2"))) static void NarrowAVX2(const double *values, size_t count, float *out)
+{
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) _mm_storeu_ps(out + i, _mm256_cvtpd_ps(_mm256_loadu_pd(values + i)));
+	NarrowScalar(values + i, count - i, out + i);
+}
+
+__attribute__((target("avx2"))) static inline __m256 ValidFloatsAVX2(__m256 v, __m256 lows, __m256 highs, __m256 fills, __m256 missings)
+{
+	__m256 inRange = _mm256_and_ps(_mm256_cmp_ps(v, lows, _CMP_GE_OQ), _mm256_cmp_ps(v, highs, _CMP_LE_OQ));
+	return _mm256_and_ps(inRange, _mm256_and_ps(_mm256_cmp_ps(v, fills, _CMP_NEQ_UQ), _mm256_cmp_ps(v, missings, _CMP_NEQ_UQ)));
+}
+
+__attribute__((target("avx2"))) static inline __m256d ValidDoublesAVX2(__m256d v, __m256d lows, __m256d highs, __m256d fills, __m256d missings)
+{
+	__m256d inRange = _mm256_and_pd(_mm256_cmp_pd(v, lows, _CMP_GE_OQ), _mm256_cmp_pd(v, highs, _CMP_LE_OQ));
+	return _mm256_and_pd(inRange, _mm256_and_pd(_mm256_cmp_pd(v, fills, _CMP_NEQ_UQ), _mm256_cmp_pd(v, missings, _CMP_NEQ_UQ)));
+}
+
+DEFINE_VECTOR_MASK(MaskFloatsAVX2, "avx2", float, __m256, 8, _mm256_loadu_ps, _mm256_storeu_ps, _mm256_set1_ps, ValidFloatsAVX2, _mm256_blendv_ps, MaskFloatsScalar)
+DEFINE_VECTOR_MASK(MaskDoublesAVX2, "avx2", double, __m256d, 4, _mm256_loadu_pd, _mm256_storeu_pd, _mm256_set1_pd, ValidDoublesAVX2, _mm256_blendv_pd, MaskDoublesScalar)
+
+__attribute__((target("avx2"))) static void SummarizeAVX2(const double *values, size_t count, SummaryLanes *lanes)
+{
+	const __m256d ones = _mm256_set1_pd(1.0);
+	__m256d counts = _mm256_loadu_pd(lanes->count);
+	__m256d sums = _mm256_loadu_pd(lanes->sum);
+	__m256d mins = _mm256_loadu_pd(lanes->min);
+	__m256d maxes = _mm256_loadu_pd(lanes->max);
+	size_t i = 0;
+	for (; i + SUM_LANES <= count; i += SUM_LANES)
+	{
+		__m256d v = _mm256_loadu_pd(values + i);
+		__m256d valid = _mm256_cmp_pd(v, v, _CMP_ORD_Q);
+		counts = _mm256_add_pd(counts, _mm256_and_pd(valid, ones));
+		sums = _mm256_add_pd(sums, _mm256_and_pd(valid, v));
+		mins = _mm256_blendv_pd(mins, v, _mm256_cmp_pd(v, mins, _CMP_LT_OQ));
+		maxes = _mm256_blendv_pd(maxes, v, _mm256_cmp_pd(v, maxes, _CMP_GT_OQ));
+	}
+	_mm256_storeu_pd(lanes->count, counts);
+	_mm256_storeu_pd(lanes->sum, sums);
+	_mm256_storeu_pd(lanes->min, mins);
+	_mm256_storeu_pd(lanes->max, maxes);
+	SummarizeScalar(values + i, count - i, lanes);
+}
+
+__attribute__((target("avx2"))) static void SumSquaredDeviationsAVX2(const double *values, size_t count, double mean, double *lanes)
+{
+	const __m256d means = _mm256_set1_pd(mean);
+	__m256d sums = _mm256_loadu_pd(lanes);
+	size_t i = 0;
+	for (; i + SUM_LANES <= count; i += SUM_LANES)
+	{
+		__m256d v = _mm256_loadu_pd(values + i);
+		__m256d deviations = _mm256_sub_pd(v, means);
+		sums = _mm256_add_pd(sums, _mm256_and_pd(_mm256_cmp_pd(v, v, _CMP_ORD_Q), _mm256_mul_pd(deviations, deviations)));
+	}
+	_mm256_storeu_pd(lanes, sums);
+	SumSquaredDeviationsScalar(values + i, count - i, mean, lanes);
+}
+
+static const ConvertKernels avx2Kernels =
+{
+	SwapFloatsAVX2, WidenAVX2, MultiplyFloatsAVX2, DivideFloatsAVX2,
+	MultiplyDoublesAVX2, DivideDoublesAVX2, AddDoublesAVX2,
+	NarrowAVX2, MaskFloatsAVX2, MaskDoublesAVX2,
+	SummarizeAVX2, SumSquaredDeviationsAVX2
+};
+
+#endif
+
+//---- dispatch ----
+
+static const ConvertKernels *kernels = NULL;
+static ConvertPath currentPath = CONVERT_SCALAR;
+
+int IsConvertPathSupported(ConvertPath path)
+{
+	switch (path)
+	{
+		case CONVERT_SCALAR: return 1;
+#ifdef CONVERT_X86
+		case CONVERT_SSE2: return __builtin_cpu_supports("sse2");
+		case CONVERT_AVX2: return __builtin_cpu_supports("avx2");
+#endif
+		default: return 0;
+	}
+}
+
+const char *GetConvertPathName(ConvertPath path)
+{
+	switch (path)
+	{
+		case CONVERT_SCALAR: return "scalar";
+		case CONVERT_SSE2: return "sse2";
+		case CONVERT_AVX2: return "avx2";
+		default: return "unknown";
+	}
+}
+
+int SetConvertPath(ConvertPath path)
+{
+	if (!IsConvertPathSupported(path)) return -1;
+	switch (path)
+	{
+#ifdef CONVERT_X86
+		case CONVERT_SSE2: kernels = &sse2Kernels; break;
+		case CONVERT_AVX2: kernels = &avx2Kernels; break;
+#endif
+		default: kernels = &scalarKernels; break;
+	}
+	currentPath = path;
+	return 0;
+}
+
+//pick the best path the first time any kernel is needed
+static const ConvertKernels *GetKernels(void)
+{
+	if (kernels == NULL)
+	{
+		int path;
+		for (path = NUM_CONVERT_PATHS-1; path > CONVERT_SCALAR && !IsConvertPathSupported((ConvertPath)path); path--);
+		SetConvertPath((ConvertPath)path);
+	}
+	return kernels;
+}
+
+ConvertPath GetConvertPath(void)
+{
+	GetKernels();
+	return currentPath;
+}
+
+void SwapFloatColumn(const void *source, size_t stride, size_t count, float *values)
+{
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	size_t i;
+	for (i = 0; i < count; i++) memcpy(&values[i], (const char *)source + i*stride, sizeof(float));
+#else
+	GetKernels()->swap(source, stride, count, values);
+#endif
+}
+
+void ConvertFloatColumn(const float *values, size_t count, const UnitConversion *conversion, double *out)
+{
+	const ConvertKernels *k = GetKernels();
+	float block[CONVERT_BLOCK_VALUES];
+	size_t start;
+	for (start = 0; start < count; start += CONVERT_BLOCK_VALUES)
+	{
+		size_t blockCount = count - start;
+		if (blockCount > CONVERT_BLOCK_VALUES) blockCount = CONVERT_BLOCK_VALUES;
+		double *outBlock = out + start;
+		if (conversion->singlePrecision && (conversion->multiplier != 1.0 || conversion->divisor != 1.0))
+		{
+			memcpy(block, values + start, blockCount * sizeof(float));
+			if (conversion->multiplier != 1.0) k->multiplyFloats(block, blockCount, (float)conversion->multiplier);
+			if (conversion->divisor != 1.0) k->divideFloats(block, blockCount, (float)conversion->divisor);
+			k->widen(block, blockCount, outBlock);
+		}
+		else
+		{
+			k->widen(values + start, blockCount, outBlock);
+			if (conversion->multiplier != 1.0) k->multiplyDoubles(outBlock, blockCount, conversion->multiplier);
+			if (conversion->divisor != 1.0) k->divideDoubles(outBlock, blockCount, conversion->divisor);
+		}
+		if (conversion->offset != 0.0) k->addDoubles(outBlock, blockCount, conversion->offset);
+	}
+}
+
+void ConvertDoubleColumn(const double *values, size_t count, const UnitConversion *conversion, double *out)
+{
+	const ConvertKernels *k = GetKernels();
+	size_t start;
+	for (start = 0; start < count; start += CONVERT_BLOCK_VALUES)
+	{
+		size_t blockCount = count - start;
+		if (blockCount > CONVERT_BLOCK_VALUES) blockCount = CONVERT_BLOCK_VALUES;
+		double *outBlock = out + start;
+		if (outBlock != values + start) memcpy(outBlock, values + start, blockCount * sizeof(double));
+		if (conversion->multiplier != 1.0) k->multiplyDoubles(outBlock, blockCount, conversion->multiplier);
+		if (conversion->divisor != 1.0) k->divideDoubles(outBlock, blockCount, conversion->divisor);
+		if (conversion->offset != 0.0) k->addDoubles(outBlock, blockCount, conversion->offset);
+	}
+}
+
+void ScaleFloatColumn(float *values, size_t count, double scale, double offset)
+{
+	const ConvertKernels *k = GetKernels();
+	double block[CONVERT_BLOCK_VALUES];
+	size_t start;
+	for (start = 0; start < count; start += CONVERT_BLOCK_VALUES)
+	{
+		size_t blockCount = count - start;
+		if (blockCount > CONVERT_BLOCK_VALUES) blockCount = CONVERT_BLOCK_VALUES;
+		k->widen(values + start, blockCount, block);
+		if (scale != 1.0) k->multiplyDoubles(block, blockCount, scale);
+		if (offset != 0.0) k->addDoubles(block, blockCount, offset);
+		k->narrow(block, blockCount, values + start);
+	}
+}
+
+void MaskFloatColumn(float *values, size_t count, const ValueMask *mask)
+{
+	GetKernels()->maskFloats(values, count, (float)mask->validMin, (float)mask->validMax, (float)mask->fillValue, (float)mask->missingValue);
+}
+
+void MaskDoubleColumn(double *values, size_t count, const ValueMask *mask)
+{
+	GetKernels()->maskDoubles(values, count, mask->validMin, mask->validMax, mask->fillValue, mask->missingValue);
+}
+
+void SummarizeDoubleColumn(const double *values, size_t count, ColumnSummary *summary)
+{
+	SummaryLanes lanes;
+	int lane;
+	for (lane = 0; lane < SUM_LANES; lane++)
+	{
+		lanes.count[lane] = 0.0;
+		lanes.sum[lane] = 0.0;
+		lanes.min[lane] = INFINITY;
+		lanes.max[lane] = -INFINITY;
+	}
+	GetKernels()->summarize(values, count, &lanes);
+	
+	summary->count = (size_t)(lanes.count[0] + lanes.count[1] + lanes.count[2] + lanes.count[3]);
+	summary->sum = (lanes.sum[0] + lanes.sum[1]) + (lanes.sum[2] + lanes.sum[3]);
+	summary->min = NAN;
+	summary->max = NAN;
+	if (summary->count == 0) return;
+	summary->min = lanes.min[0];
+	summary->max = lanes.max[0];
+	for (lane = 1; lane < SUM_LANES; lane++)
+	{
+		if (lanes.min[lane] < summary->min) summary->min = lanes.min[lane];
+		if (lanes.max[lane] > summary->max) summary->max = lanes.max[lane];
+	}
+}
+
+double SumSquaredDeviations(const double *values, size_t count, double mean)
+{
+	double lanes[SUM_LANES] = { 0.0, 0.0, 0.0, 0.0 };
+	GetKernels()->sumSquaredDeviations(values, count, mean, lanes);
+	return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+}
@@ -0,0 +1,74 @@
+//unitconvert.h: vectorized byte swapping, unit conversion, masking and summing up of whole float columns
+//Copyright 2012, Allen Jordan, allen.jordan@gmail.com
+
+#ifndef UNITCONVERT_H
+#define UNITCONVERT_H
+
+#include <stddef.h>
+
+//the instruction sets the kernels come in, the best one the CPU supports is picked at runtime
+typedef enum
+{
+	CONVERT_SCALAR,
+	CONVERT_SSE2,
+	CONVERT_AVX2,
+	NUM_CONVERT_PATHS
+} ConvertPath;
+
+//an affine unit conversion: y = x * multiplier / divisor + offset, skipping the steps that do nothing (1, 1 and 0)
+//with singlePrecision set the multiply and divide are done on floats before widening to double, which reproduces float
+//expressions like x/1000 exactly (the offset is always added in double precision)
+typedef struct
+{
+	double multiplier;
+	double divisor;
+	double offset;
+	int singlePrecision;
+} UnitConversion;
+
+//the values of a column that are marked missing: anything outside [validMin, validMax], and the fill and missing values
+//(bounds that aren't set are -inf and inf, and fill and missing values that aren't set are NaN, which matches nothing)
+typedef struct
+{
+	double validMin;
+	double validMax;
+	double fillValue;
+	double missingValue;
+} ValueMask;
+
+//the count, sum, smallest and largest of the values of a column that aren't NaN (the smallest and largest are NaN
+//when there aren't any)
+typedef struct
+{
+	size_t count;
+	double sum;
+	double min;
+	double max;
+} ColumnSummary;
+
+//check if the CPU (and the build) supports a path
+int IsConvertPathSupported(ConvertPath path);
+const char *GetConvertPathName(ConvertPath path);
+//use a path's kernels from now on (the best supported one is picked on first use otherwise)
+//returns 0, or -1 if the path isn't supported
+int SetConvertPath(ConvertPath path);
+ConvertPath GetConvertPath(void);
+
+//convert count big-endian floats, stride bytes apart (ex: a record variable in a memory-mapped classic file), into
+//native floats
+void SwapFloatColumn(const void *source, size_t stride, size_t count, float *values);
+//apply a unit conversion to count floats, giving doubles
+void ConvertFloatColumn(const float *values, size_t count, const UnitConversion *conversion, double *out);
+//apply a unit conversion to count doubles (singlePrecision doesn't apply, the scaling is always done in double precision)
+void ConvertDoubleColumn(const double *values, size_t count, const UnitConversion *conversion, double *out);
+//y = x * scale + offset on count floats in place, worked out in double precision and rounded to float once at the end
+void ScaleFloatColumn(float *values, size_t count, double scale, double offset);
+//set the masked values of count floats or doubles to NaN, in place (NaNs stay NaN)
+void MaskFloatColumn(float *values, size_t count, const ValueMask *mask);
+void MaskDoubleColumn(double *values, size_t count, const ValueMask *mask);
+//sum up count doubles, skipping NaNs
+void SummarizeDoubleColumn(const double *values, size_t count, ColumnSummary *summary);
+//the sum of the squared differences from mean of the values that aren't NaN
+double SumSquaredDeviations(const double *values, size_t count, double mean);
+
+#endif
@@ -0,0 +1,338 @@
+//watch.c: converting NetCDF files as they arrive in watched directories, on a pool of worker processes that stay up
+//Copyright 2012, Allen Jordan, allen.jordan@gmail.com
+
+//(for ppoll)
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include "watch.h"
+#include "convertstats.h"
+
+//closing a file after writing it, or moving one in, means it's complete, unless it's written again before it settles
+#define WATCH_EVENTS	(IN_CLOSE_WRITE | IN_MOVED_TO | IN_MODIFY | IN_DELETE | IN_MOVED_FROM)
+//room for a batch of events, each with its filename
+#define WATCH_EVENT_BUFFER_SIZE	65536
+
+//a file that's been written to a watched directory and hasn't been handed to a worker yet
+typedef struct
+{
+	char *path;
+	//set once it's been closed since it was last written to, and when
+	int closed;
+	double closeTime;
+} PendingFile;
+
+typedef struct
+{
+	PendingFile *files;
+	int count;
+	int capacity;
+} PendingList;
+
+//the directories, and the files each worker is converting with when they were closed (for their latency)
+typedef struct
+{
+	const WatchOptions *options;
+	int *watchDescriptors;
+	PendingList pending;
+	char **busyPaths;
+	double *busyCloseTimes;
+	WatchStats stats;
+	int numFailed;
+} WatchState;
+
+static volatile sig_atomic_t stopRequested = 0;
+
+static void RequestStop(int signalNumber)
+{
+	stopRequested = 1;
+}
+
+//only .nc files are converted, skipping hidden ones (ex: the temporary files of rsync and editors)
+static int IsNetCDFName(const char *name)
+{
+	size_t length = strlen(name);
+	return (length > 3 && name[0] != '.' && strcmp(name + length - 3, ".nc") == 0);
+}
+
+static int FindPendingFile(const PendingList *pending, const char *path)
+{
+	int i;
+	for (i = 0; i < pending->count; i++)
+	{
+		if (strcmp(pending->files[i].path, path) == 0) return i;
+	}
+	return -1;
+}
+
+static void RemovePendingFile(PendingList *pending, int index)
+{
+	free(pending->files[index].path);
+	memmove(&pending->files[index], &pending->files[index+1], (pending->count - index - 1) * sizeof(PendingFile));
+	pending->count--;
+}
+
+//update a file's place in the pending list for an event on it
+static void NoteFileEvent(PendingList *pending, const char *path, uint32_t mask, double now)
+{
+	int index = FindPendingFile(pending, path);
+	if (mask & (IN_DELETE | IN_MOVED_FROM))
+	{
+		if (index >= 0) RemovePendingFile(pending, index);
+		return;
+	}
+	if (index < 0)
+	{
+		//writes to a file are only noticed once it's been closed
+		if (mask & IN_MODIFY) return;
+		if (pending->count == pending->capacity)
+		{
+			pending->capacity = (pending->capacity == 0) ? 16 : pending->capacity * 2;
+			pending->files = (PendingFile *)realloc(pending->files, pending->capacity * sizeof(PendingFile));
+		}
+		index = pending->count++;
+		pending->files[index].path = strdup(path);
+	}
+	//written to again, so it waits for the next close
+	if (mask & IN_MODIFY) pending->files[index].closed = 0;
+	else
+	{
+		pending->files[index].closed = 1;
+		pending->files[index].closeTime = now;
+	}
+}
+
+//read every event waiting on the inotify descriptor
+static void ReadWatchEvents(int inotifyFd, WatchState *state)
+{
+	char buffer[WATCH_EVENT_BUFFER_SIZE] __attribute__((aligned(__alignof__(struct inotify_event))));
+	for (;;)
+	{
+		ssize_t length = read(inotifyFd, buffer, sizeof(buffer));
+		if (length < 0 && errno == EINTR) continue;
+		if (length <= 0) break;
+		double now = GetMonotonicTime();
+
+		char *position;
+		for (position = buffer; position < buffer + length; position += sizeof(struct inotify_event) + ((struct inotify_event *)position)->len)
+		{
+			const struct inotify_event *event = (const struct inotify_event *)position;
+			if (event->mask & IN_Q_OVERFLOW)
+			{
+				puts("warning: too many files arrived at once, some of them may have been missed");
+				continue;
+			}
+			int dir;
+			for (dir = 0; dir < state->options->numDirectories && state->watchDescriptors[dir] != event->wd; dir++);
+			if (dir == state->options->numDirectories) continue;
+			if (event->mask & IN_IGNORED)
+			{
+				printf("warning: stopped watching %s (it was removed)\n", state->options->directories[dir]);
+				state->watchDescriptors[dir] = -1;
+				continue;
+			}
+			if ((event->mask & IN_ISDIR) || event->len == 0 || !IsNetCDFName(event->name)) continue;
+
+			const char *dirName = state->options->directories[dir];
+			size_t pathLength = strlen(dirName) + strlen(event->name) + 2;
+			char *path = (char *)malloc(pathLength);
+			snprintf(path, pathLength, "%s/%s", dirName, event->name);
+			NoteFileEvent(&state->pending, path, event->mask, now);
+			free(path);
+		}
+	}
+}
+
+//hand the files that have settled to idle workers, oldest first
+//returns when the next file still settling will be ready (or -1 if there aren't any), and sets stalled if a file is ready
+//but no worker could take it
+static double SubmitSettledFiles(WorkerPool *pool, WatchState *state, double now, int *stalled)
+{
+	int i;
+	double settleSeconds = state->options->settleMs / 1000.0;
+	double nextReady = -1;
+	PendingList *pending = &state->pending;
+	*stalled = 0;
+	for (;;)
+	{
+		int oldest = -1;
+		for (i = 0; i < pending->count; i++)
+		{
+			if (!pending->files[i].closed) continue;
+			double readyTime = pending->files[i].closeTime + settleSeconds;
+			if (readyTime > now)
+			{
+				if (nextReady < 0 || readyTime < nextReady) nextReady = readyTime;
+			}
+			else if (oldest < 0 || pending->files[i].closeTime < pending->files[oldest].closeTime) oldest = i;
+		}
+		if (oldest < 0) break;
+
+		int workerIndex = SubmitPoolFile(pool, pending->files[oldest].path, 0);
+		if (workerIndex < 0)
+		{
+			*stalled = 1;
+			break;
+		}
+		state->busyPaths[workerIndex] = strdup(pending->files[oldest].path);
+		state->busyCloseTimes[workerIndex] = pending->files[oldest].closeTime;
+		RemovePendingFile(pending, oldest);
+	}
+	return nextReady;
+}
+
+//collect the files the polled workers finished
+static void CollectWatchedFiles(WorkerPool *pool, WatchState *state, const struct pollfd *pollList, const int *pollWorkers,
+	int numPolled)
+{
+	int i;
+	const WatchOptions *options = state->options;
+	for (i = 0; i < numPolled; i++)
+	{
+		if (pollList[i].revents == 0) continue;
+		int workerIndex = pollWorkers[i];
+		int tag, status, deathSignal;
+		ReadPoolResult(pool, workerIndex, &tag, &status, &deathSignal);
+		double latency = GetMonotonicTime() - state->busyCloseTimes[workerIndex];
+		const char *filename = state->busyPaths[workerIndex];
+
+		AddWatchedFile(&state->stats, status, latency);
+		if (status != 0) state->numFailed++;
+		if (status == BATCH_WORKER_DIED) printf("failed: %s (worker died, signal %d)\n", filename, deathSignal);
+		else if (status != 0) printf("failed: %s (status %d)\n", filename, status);
+		fflush(stdout);
+		if (options->statsToStderr || options->statsDir != NULL)
+			ReportWatchStats(filename, status, latency, &state->stats, options->statsToStderr, options->statsDir);
+
+		free(state->busyPaths[workerIndex]);
+		state->busyPaths[workerIndex] = NULL;
+	}
+}
+
+int WatchDirectories(const WatchOptions *options, ConvertFileFunction convert, void *context, const BatchRecord *record,
+	int *numConverted)
+{
+	int i;
+	*numConverted = 0;
+	int numJobs = (options->numJobs > 0) ? options->numJobs : 1;
+
+	int inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (inotifyFd < 0)
+	{
+		perror("error: could not start watching for files");
+		return -1;
+	}
+
+	WatchState state;
+	state.options = options;
+	state.watchDescriptors = (int *)malloc(options->numDirectories * sizeof(int));
+	for (i = 0; i < options->numDirectories; i++)
+	{
+		state.watchDescriptors[i] = inotify_add_watch(inotifyFd, options->directories[i], WATCH_EVENTS);
+		if (state.watchDescriptors[i] < 0)
+		{
+			printf("error: could not watch directory: %s (%s)\n", options->directories[i], strerror(errno));
+			free(state.watchDescriptors);
+			close(inotifyFd);
+			return -1;
+		}
+		printf("watching %s\n", options->directories[i]);
+	}
+	fflush(stdout);
+	state.pending.files = NULL;
+	state.pending.count = 0;
+	state.pending.capacity = 0;
+	state.busyPaths = (char **)calloc(numJobs, sizeof(char*));
+	state.busyCloseTimes = (double *)calloc(numJobs, sizeof(double));
+	state.numFailed = 0;
+	InitWatchStats(&state.stats);
+
+	//the workers stay up for as long as the watch does
+	WorkerPool pool;
+	InitWorkerPool(&pool, numJobs, convert, context, record);
+	struct pollfd *pollList = (struct pollfd *)malloc((numJobs + 1) * sizeof(struct pollfd));
+	int *pollWorkers = (int *)malloc(numJobs * sizeof(int));
+
+	//SIGINT and SIGTERM stop the watch, they're blocked except while waiting so one can't slip in just before a wait
+	//(the workers are started with them blocked too, so they finish the file they're on)
+	struct sigaction stopAction, previousInt, previousTerm;
+	memset(&stopAction, 0, sizeof(stopAction));
+	stopAction.sa_handler = RequestStop;
+	sigemptyset(&stopAction.sa_mask);
+	sigset_t stopSignals, previousMask, waitMask;
+	sigemptyset(&stopSignals);
+	sigaddset(&stopSignals, SIGINT);
+	sigaddset(&stopSignals, SIGTERM);
+	sigprocmask(SIG_BLOCK, &stopSignals, &previousMask);
+	waitMask = previousMask;
+	sigdelset(&waitMask, SIGINT);
+	sigdelset(&waitMask, SIGTERM);
+	stopRequested = 0;
+	sigaction(SIGINT, &stopAction, &previousInt);
+	sigaction(SIGTERM, &stopAction, &previousTerm);
+
+	while (!stopRequested)
+	{
+		int stalled;
+		double now = GetMonotonicTime();
+		double nextReady = SubmitSettledFiles(&pool, &state, now, &stalled);
+
+		//wait for new events, a worker finishing, or the next file to settle
+		int numPolled = GetPoolPollList(&pool, pollList, pollWorkers);
+		//(if no worker could be started at all, try again in a second)
+		if (stalled && numPolled == 0 && (nextReady < 0 || nextReady > now + 1)) nextReady = now + 1;
+		pollList[numPolled].fd = inotifyFd;
+		pollList[numPolled].events = POLLIN;
+		pollList[numPolled].revents = 0;
+		struct timespec timeout;
+		if (nextReady >= 0)
+		{
+			double wait = (nextReady > now) ? nextReady - now : 0;
+			timeout.tv_sec = (time_t)wait;
+			timeout.tv_nsec = (long)((wait - timeout.tv_sec) * 1e9);
+		}
+		if (ppoll(pollList, numPolled + 1, (nextReady >= 0) ? &timeout : NULL, &waitMask) < 0)
+		{
+			if (errno == EINTR) continue;
+			perror("poll");
+			break;
+		}
+
+		CollectWatchedFiles(&pool, &state, pollList, pollWorkers, numPolled);
+		if (pollList[numPolled].revents != 0) ReadWatchEvents(inotifyFd, &state);
+	}
+
+	//put the signals back, so a second one stops the process outright, and let the busy workers finish
+	sigaction(SIGINT, &previousInt, NULL);
+	sigaction(SIGTERM, &previousTerm, NULL);
+	sigprocmask(SIG_SETMASK, &previousMask, NULL);
+	int numPolled;
+	while ((numPolled = GetPoolPollList(&pool, pollList, pollWorkers)) > 0)
+	{
+		printf("stopping, waiting for %d file%s being converted\n", numPolled, (numPolled == 1) ? "" : "s");
+		fflush(stdout);
+		if (poll(pollList, numPolled, -1) < 0 && errno != EINTR) break;
+		CollectWatchedFiles(&pool, &state, pollList, pollWorkers, numPolled);
+	}
+	if (state.pending.count > 0) printf("%d file%s still being written weren't converted\n", state.pending.count, (state.pending.count == 1) ? "" : "s");
+	printf("converted %d files while watching, %d failed\n", state.stats.numFiles - state.numFailed, state.numFailed);
+
+	StopWorkerPool(&pool);
+	close(inotifyFd);
+	for (i = 0; i < state.pending.count; i++) free(state.pending.files[i].path);
+	free(state.pending.files);
+	for (i = 0; i < numJobs; i++) free(state.busyPaths[i]);
+	free(state.busyPaths);
+	free(state.busyCloseTimes);
+	free(state.watchDescriptors);
+	free(pollWorkers);
+	free(pollList);
+	*numConverted = state.stats.numFiles;
+	return state.numFailed;
+}
@@ -0,0 +1,32 @@
+//watch.h: converting NetCDF files as they arrive in watched directories, on a pool of worker processes that stay up
+//Copyright 2012, Allen Jordan, allen.jordan@gmail.com
+
+#ifndef WATCH_H
+#define WATCH_H
+
+#include "batch.h"
+
+//how long a file has to go untouched after it's closed before it's converted, by default
+#define DEFAULT_SETTLE_MS	100
+
+typedef struct
+{
+	//directories watched for new files (not their subdirectories)
+	char **directories;
+	int numDirectories;
+	//number of worker processes converting files
+	int numJobs;
+	//a file is converted once it's been closed after writing (or moved in) and hasn't been written again for settleMs
+	int settleMs;
+	//--stats prints each file's latency and the throughput so far to stderr, --stats-dir keeps the latest in watch.stats.json
+	int statsToStderr;
+	const char *statsDir;
+} WatchOptions;
+
+//convert each .nc file written to (or moved into) the directories, until SIGINT or SIGTERM
+//the workers stay up from one file to the next, each file's record is collected as RunBatch does
+//sets the number of files converted, returns the number that failed, or -1 if the directories couldn't be watched
+int WatchDirectories(const WatchOptions *options, ConvertFileFunction convert, void *context, const BatchRecord *record,
+	int *numConverted);
+
+#endif